@@ -284,6 +284,7 @@ typedef struct ustore_read_t {
      * Possible values:
      * - `::ustore_option_transaction_dont_watch_k`: Disables collision-detection for transactional reads.
      * - `::ustore_option_read_shared_memory_k`: Exports to shared memory to accelerate inter-process communication.
+     * - `::ustore_option_read_pinned_k`: Exports `addresses` of stored values instead of copying them.
      * - `::ustore_option_scan_bulk_k`: Suggests that the list of keys was received from a bulk scan.
      * - `::ustore_option_dont_discard_memory_k`: Won't reset the `arena` before the operation begins.
      */
@@ -383,6 +384,16 @@ typedef struct ustore_read_t {
      * Is @b optional, as you may only want to get `lengths` or check `presences`.
      */
     ustore_byte_t** values;
+    /**
+     * @brief Output addresses of values, exported without copies.
+     *
+     * Only used with `::ustore_option_read_pinned_k`. Will contain a pointer to an array
+     * of `tasks_count` pointers into the memory of the engine, to be combined with `lengths`.
+     * In that mode the `values` tape and its `offsets` aren't exported.
+     * Engines, that can't pin values, leave it untouched, so initialize it with `NULL`.
+     * Is @b optional.
+     */
+    ustore_bytes_cptr_t** addresses;
     /// @}
 } ustore_read_t;
 
@@ -539,6 +550,48 @@ typedef struct ustore_scan_t {
      * runtime- or library-specific implementations.
      */
     ustore_key_t** keys;
+    /**
+     * @brief Output offsets of values of the exported keys within `values`.
+     *
+     * Will contain a pointer to an array of `counts` sum plus one integer offsets,
+     * following the order of `keys`, just like `ustore_read_t::offsets`.
+     * Is @b optional. Requesting any of the values outputs fetches values in the
+     * same pass as keys, which is cheaper than a following `ustore_read()`.
+     */
+    ustore_length_t** value_offsets;
+    /**
+     * @brief Output lengths of values of the exported keys.
+     * Is @b optional.
+     */
+    ustore_length_t** value_lengths;
+    /**
+     * @brief Output values tape of the exported keys.
+     * Is @b optional.
+     */
+    ustore_byte_t** values;
+
+    /// @}
+    /// @name Late Inputs
+    /// @{
+
+    /**
+     * @brief Exclusive upper bounds for each scan.
+     *
+     * Contains the pointer to the first of `tasks_count` ending points.
+     * Scans stop at those keys, even if the `count_limits` aren't reached,
+     * which lets engines skip the remaining data, including the removed entries.
+     * Is @b optional, without it the scans are only bounded by collections.
+     * Placed after the outputs to keep the layout of the older fields unchanged.
+     */
+    ustore_key_t const* end_keys;
+    /**
+     * @brief Step between `end_keys`.
+     *
+     * Contains the number of bytes separating entries in the `end_keys` array.
+     * Zero stride would reuse the same address for all tasks.
+     * Is @b optional.
+     */
+    ustore_size_t end_keys_stride;
     /// @}
 
 } ustore_scan_t;
@@ -588,6 +641,7 @@ typedef struct ustore_sample_t {
      * - `::ustore_option_transaction_dont_watch_k`: Disables collision-detection for transactional reads.
      * - `::ustore_option_read_shared_memory_k`: Exports to shared memory to accelerate inter-process communication.
      * - `::ustore_option_dont_discard_memory_k`: Won't reset the `arena` before the operation begins.
+     * - `::ustore_option_sample_weighted_k`: Weights the sampled key ranges by density, where sampling is approximate.
      */
     ustore_options_t options;
 
@@ -314,13 +314,14 @@ class database_t : public std::enable_shared_from_this<database_t> {
             return context_t {db_, raw};
     }
 
-    expected_gt<context_t> snapshot() noexcept {
+    expected_gt<context_t> snapshot(ustore_str_view_t directory = nullptr) noexcept {
         status_t status;
         ustore_snapshot_t raw = {};
         ustore_snapshot_create_t snap_create {
             .db = db_,
             .error = status.member_ptr(),
             .id = &raw,
+            .directory = directory,
         };
         ustore_snapshot_create(&snap_create);
         if (!status)
@@ -104,6 +104,8 @@ struct scan_t {
     ustore_collection_t collection;
     ustore_key_t min_key;
     ustore_length_t limit;
+    /** @brief The largest key to be exported, inclusive, unlike the `end_keys` in the C API. */
+    ustore_key_t max_key = std::numeric_limits<ustore_key_t>::max();
 };
 
 /**
@@ -115,13 +117,26 @@ struct scans_arg_t {
     strided_iterator_gt<ustore_key_t const> start_keys;
     strided_iterator_gt<ustore_length_t const> limits;
     ustore_size_t count = 0;
+    strided_iterator_gt<ustore_key_t const> end_keys = {};
 
     inline std::size_t size() const noexcept { return count; }
     inline scan_t operator[](std::size_t i) const noexcept {
         ustore_collection_t collection = collections ? collections[i] : ustore_collection_main_k;
         ustore_key_t min_key = start_keys ? start_keys[i] : std::numeric_limits<ustore_key_t>::min();
         ustore_length_t limit = limits[i];
-        return {collection, min_key, limit};
+        ustore_key_t max_key = std::numeric_limits<ustore_key_t>::max();
+        if (end_keys) {
+            ustore_key_t end_key = end_keys[i];
+            // Empty ranges also end before they start, unless nothing precedes `min_key`
+            if (end_key <= min_key) {
+                limit = 0;
+                if (min_key != std::numeric_limits<ustore_key_t>::min())
+                    max_key = min_key - 1;
+            }
+            else
+                max_key = end_key - 1;
+        }
+        return {collection, min_key, limit, max_key};
     }
 
     bool same_collection() const noexcept {
@@ -261,12 +276,23 @@ inline void validate_write(ustore_transaction_t const c_txn,
                            ustore_options_t const c_options,
                            ustore_error_t* c_error) noexcept {
 
-    auto allowed_options =                       //
-        ustore_option_transaction_dont_watch_k | //
-        ustore_option_dont_discard_memory_k |    //
-        ustore_option_write_flush_k;
+    auto allowed_options =                          //
+        ustore_option_transaction_dont_watch_k |    //
+        ustore_option_dont_discard_memory_k |       //
+        ustore_option_write_flush_k |               //
+        ustore_option_write_merge_neighborhoods_k | //
+        ustore_option_write_bulk_k;
     return_error_if_m(enum_is_subset(c_options, allowed_options), c_error, args_wrong_k, "Invalid options!");
 
+    if (c_options & ustore_option_write_merge_neighborhoods_k)
+        return_error_if_m(&ustore_supports_neighborhood_merges_k && ustore_supports_neighborhood_merges_k,
+                          c_error,
+                          args_wrong_k,
+                          "Current engine does not support neighborhood merges!");
+
+    if (c_options & ustore_option_write_bulk_k)
+        return_error_if_m(!c_txn, c_error, args_wrong_k, "Bulk writes can't be transactional!");
+
     return_error_if_m(places.keys_begin, c_error, args_wrong_k, "No keys were provided!");
 
     bool const remove_all = !contents.contents_begin;
@@ -297,7 +323,8 @@ inline void validate_read(ustore_transaction_t const c_txn,
     auto allowed_options =                       //
         ustore_option_transaction_dont_watch_k | //
         ustore_option_dont_discard_memory_k |    //
-        ustore_option_read_shared_memory_k;
+        ustore_option_read_shared_memory_k |     //
+        ustore_option_read_pinned_k;
     return_error_if_m(enum_is_subset(c_options, allowed_options), c_error, args_wrong_k, "Invalid options!");
 
     return_error_if_m(places.keys_begin, c_error, args_wrong_k, "No keys were provided!");
@@ -194,6 +194,34 @@ typedef enum {
      * Apache Arrow buffers or standardized Tensor representations.
      */
     ustore_option_read_shared_memory_k = 1 << 5,
+    /**
+     * @brief Exports the addresses of values stored in the engine, instead of
+     * copying them into the `arena`. The values stay pinned and valid, even if
+     * overwritten or removed, until the `arena` is reused or freed. If the database
+     * is closed first, its resources are released only after the last such `arena`.
+     * Engines without such support ignore it and copy as usual.
+     */
+    ustore_option_read_pinned_k = 1 << 6,
+    /**
+     * @brief Treats the written values as graph neighborhoods to be merged into
+     * the stored ones, instead of replacing them. This allows adding edges
+     * without reading the vertices first. Only valid for engines, that report
+     * `ustore_supports_neighborhood_merges_k`.
+     */
+    ustore_option_write_merge_neighborhoods_k = 1 << 7,
+    /**
+     * @brief Hints, that the batch is a part of a large load, rather than an update.
+     * Engines may build their on-disk structures from it directly, bypassing the logs.
+     * Can't be combined with transactions. Engines without such support ignore it.
+     */
+    ustore_option_write_bulk_k = 1 << 8,
+    /**
+     * @brief Asks engines, that sample with random seeks instead of full scans,
+     * to weight the key ranges by their observed density. This improves the
+     * uniformity of samples from skewed collections, at the cost of metadata lookups.
+     * Engines sampling exactly ignore it.
+     */
+    ustore_option_sample_weighted_k = 1 << 9,
     /**
      * @brief When set, the underlying engine may avoid strict keys ordering
      * and may include irrelevant (deleted & duplicate) keys in order to maximize
@@ -229,6 +257,12 @@ extern bool const ustore_supports_transactions_k;
 extern bool const ustore_supports_named_collections_k;
 extern bool const ustore_supports_snapshots_k;
 
+/**
+ * @brief Declared weak, as engines built before it, like the prebuilt UDisk, don't define it.
+ * Check its address, before reading it: a missing definition means `false`.
+ */
+extern bool const ustore_supports_neighborhood_merges_k __attribute__((weak));
+
 /*********************************************************/
 /*****************	 Primary Functions	  ****************/
 /*********************************************************/
@@ -318,6 +352,12 @@ typedef struct ustore_snapshot_create_t {
     ustore_error_t* error;
     /** @brief Output for the snapshot id. */
     ustore_snapshot_t* id;
+    /**
+     * @brief Optional path of a new directory, where a consistent on-disk copy
+     * of the whole database is materialized, mostly with hard-links.
+     * It can be opened as a separate database. Not all engines support it.
+     */
+    ustore_str_view_t directory;
 } ustore_snapshot_create_t;
 
 void ustore_snapshot_create(ustore_snapshot_create_t*);
@@ -469,6 +509,23 @@ void ustore_collection_drop(ustore_collection_drop_t*);
  * - "compact": Flushes and compacts all the data in LSM-tree implementations.
  * - "info":    Metadata about the current software version, used for debugging.
  * - "usage":   Metadata about approximate collection sizes, RAM and disk usage.
+ *              UCSet responds with `{"memory_bytes":N,"reserved_bytes":N}`.
+ * - "flush":   Waits until every committed change is durable, responding with
+ *              the sequence number of the last durable log record.
+ * - "durable": Responds with the sequence number of the last durable log record,
+ *              without waiting.
+ *
+ * RocksDB responds with JSON objects to:
+ * - "statistics":   Tickers and histograms, if `statistics` are enabled in "DBOptions".
+ * - "properties":   Compactions, stalls and the block cache, and memtables, files and
+ *                   estimated keys under "collections", keyed by collection name.
+ * - "perf enable":  Starts counting the `PerfContext` of the calling thread.
+ * - "perf disable": Stops counting the `PerfContext` of the calling thread.
+ * - "perf":         Reports and resets the counters and timers of the calling thread.
+ * - "catch up":     Replays the latest changes of the primary on a secondary instance,
+ *                   responding with `{"sequence_number":N}`.
+ *
+ * Engines report an error on requests they don't support.
  */
 typedef struct ustore_database_control_t {
     /** @brief Already open database instance. */
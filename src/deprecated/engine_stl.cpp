@@ -42,6 +42,7 @@ ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max
 bool const ustore_supports_transactions_k = true;
 bool const ustore_supports_named_collections_k = true;
 bool const ustore_supports_snapshots_k = false;
+bool const ustore_supports_neighborhood_merges_k = false;
 
 /*********************************************************/
 /*****************	 C++ Implementation	  ****************/
@@ -3,15 +3,53 @@
  * @author Ashot Vardanian
  *
  * @brief Embedded Persistent Key-Value Store on top of @b LevelDB.
- * Has no support for collections, transactions or any non-CRUD jobs.
+ * Has no support for non-CRUD jobs.
+ *
+ * ## Named Collections
+ * LevelDB has a single key space, so named collections are emulated with key prefixes.
+ * The main collection keeps the plain 8-byte keys, and the named ones prepend their
+ * fixed-width ID, so each collection occupies a contiguous range of the key space.
+ * The IDs are assigned incrementally and persisted in a catalog, that occupies the last
+ * such range and maps IDs to names. The last assigned ID is kept there as well, so that
+ * the IDs of dropped collections are never reused. Dropping a collection deletes its range
+ * in batches of @c drop_batch_k keys and compacts it, as LevelDB has no range deletions.
+ * Every batch is collected and deleted under the locks of all stripes, so the writers are
+ * only blocked for a batch at a time. Their keys, written behind the progressing batches,
+ * may outlive the drop, as if written after it. Before the first batch, the catalog entry
+ * of a dropped handle is emptied, so that interrupted drops are finished on the next open.
+ *
+ * ## Transactions
+ * LevelDB only has atomic batches and snapshots, so transactions are optimistic.
+ * Each one reads from a snapshot, buffers its changes and remembers the watched keys.
+ * Keys are hashed into a table of @c lock_stripes_k stripes, each storing the generation
+ * of the last commit, that changed any of its keys. Commits lock the involved stripes,
+ * check that the watched ones haven't changed since the transaction began, apply a
+ * `WriteBatch` and stamp the changed stripes. Writes outside of transactions stamp
+ * the stripes as well. Unrelated keys sharing a stripe may cause spurious conflicts.
+ * The generations double as the sequence numbers of commits. Their upper bound is persisted
+ * in the catalog in blocks of @c generations_reservation_k, and the counter restarts from it
+ * on open, so the sequence numbers keep growing across restarts, but may skip some values.
+ *
+ * ## Filters and Parallel Reads
+ * Bloom filters with `"bits_per_key"` are enabled by default, and `"filter_policy": "none"`
+ * disables them. Reads of at least two @c parallel_reads_min_k chunks are split,
+ * fetched concurrently by `"read_threads"` threads, including the calling one, to keep more
+ * requests in the disk queue. The chunks are then copied into the arena in the original order.
  */
 #include <mutex>
+#include <atomic>
+#include <array>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include <numeric> // `std::iota`
 #include <fstream>
 
 #include <leveldb/db.h>
 #include <leveldb/comparator.h>
 #include <leveldb/write_batch.h>
-#include <leveldb/cache.h> // `NewLRUCache`
+#include <leveldb/cache.h>         // `NewLRUCache`
+#include <leveldb/filter_policy.h> // `NewBloomFilterPolicy`
 #include <nlohmann/json.hpp>
 
 #include "ustore/db.h"
@@ -19,6 +57,7 @@
 #include "helpers/linked_array.hpp"  // `uninitialized_array_gt`
 #include "helpers/full_scan.hpp"     // `reservoir_sample_iterator`
 #include "helpers/config_loader.hpp" // `config_loader_t`
+#include "helpers/thread_pool.hpp"   // `thread_pool_t`
 
 using namespace unum::ustore;
 using namespace unum;
@@ -33,23 +72,61 @@ using json_t = nlohmann::json;
 ustore_collection_t const ustore_collection_main_k = 0;
 ustore_length_t const ustore_length_missing_k = std::numeric_limits<ustore_length_t>::max();
 ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max();
-bool const ustore_supports_transactions_k = false;
-bool const ustore_supports_named_collections_k = false;
+bool const ustore_supports_transactions_k = true;
+bool const ustore_supports_named_collections_k = true;
 bool const ustore_supports_snapshots_k = true;
+bool const ustore_supports_neighborhood_merges_k = false;
 
 using level_native_t = leveldb::DB;
 using level_status_t = leveldb::Status;
 using level_options_t = leveldb::Options;
 using level_iter_uptr_t = std::unique_ptr<leveldb::Iterator>;
 
+/**
+ * @brief A key in its on-disk representation: the plain key for the main collection,
+ * or the collection ID followed by the key for the named ones.
+ */
+struct level_key_t {
+    ustore_collection_t collection = ustore_collection_main_k;
+    ustore_key_t key = 0;
+
+    level_key_t() = default;
+    level_key_t(ustore_collection_t collection, ustore_key_t key) noexcept : collection(collection), key(key) {}
+
+    static level_key_t decode(leveldb::Slice const& stored) noexcept {
+        level_key_t result;
+        if (stored.size() == sizeof(ustore_key_t))
+            std::memcpy(&result.key, stored.data(), sizeof(ustore_key_t));
+        else
+            std::memcpy(&result, stored.data(), sizeof(level_key_t));
+        return result;
+    }
+
+    bool operator<(level_key_t const& other) const noexcept {
+        return collection != other.collection ? collection < other.collection : key < other.key;
+    }
+
+    operator leveldb::Slice() const noexcept {
+        return collection == ustore_collection_main_k
+                   ? leveldb::Slice {reinterpret_cast<char const*>(&key), sizeof(ustore_key_t)}
+                   : leveldb::Slice {reinterpret_cast<char const*>(this), sizeof(level_key_t)};
+    }
+};
+
+static_assert(sizeof(level_key_t) == sizeof(ustore_collection_t) + sizeof(ustore_key_t), "Keys must be packed");
+
+/**
+ * @brief Orders the keys by collection first, so that the keys of the older
+ * databases without named collections preserve their order and the name.
+ */
 struct key_comparator_t final : public leveldb::Comparator {
 
     inline int Compare(leveldb::Slice const& a, leveldb::Slice const& b) const override {
-        auto ai = *reinterpret_cast<ustore_key_t const*>(a.data());
-        auto bi = *reinterpret_cast<ustore_key_t const*>(b.data());
-        if (ai == bi)
-            return 0;
-        return ai < bi ? -1 : 1;
+        auto ak = level_key_t::decode(a);
+        auto bk = level_key_t::decode(b);
+        if (ak < bk)
+            return -1;
+        return bk < ak ? 1 : 0;
     }
 
     char const* Name() const override { return "Integral"; }
@@ -57,6 +134,8 @@ struct key_comparator_t final : public leveldb::Comparator {
     void FindShortestSeparator(std::string*, leveldb::Slice const&) const override {}
 
     void FindShortSuccessor(std::string* key) const override {
+        if (key->size() != sizeof(ustore_key_t))
+            return;
         auto& int_key = *reinterpret_cast<ustore_key_t*>(key->data());
         ++int_key;
     }
@@ -64,24 +143,275 @@ struct key_comparator_t final : public leveldb::Comparator {
 
 static key_comparator_t const key_comparator_k = {};
 
+/**
+ * @brief The reserved prefix of the catalog, which maps IDs of named collections to their names.
+ */
+static constexpr ustore_collection_t catalog_collection_k = std::numeric_limits<ustore_collection_t>::max();
+
+/**
+ * @brief The entry of the catalog, that stores the last assigned collection ID.
+ * The main collection is never registered, so its ID is free to mark it.
+ */
+static level_key_t const catalog_last_id_k {catalog_collection_k, static_cast<ustore_key_t>(ustore_collection_main_k)};
+
+/**
+ * @brief The entry of the catalog, that stores the upper bound of the issued generations.
+ * Collection IDs never map to negative keys, so the smallest one is free to mark it.
+ */
+static level_key_t const catalog_generations_k {catalog_collection_k, std::numeric_limits<ustore_key_t>::min()};
+
+/**
+ * @brief Generations are reserved in blocks, so that persisting the bound costs a single
+ * synchronous write per @c generations_reservation_k / 2 commits.
+ */
+static constexpr std::uint64_t generations_reservation_k = 1ull << 20;
+
+/**
+ * @brief Collections are dropped in batches of this many keys, each blocking all the writers.
+ * The names in the catalog are never empty, so an empty one marks a drop, that is in progress.
+ */
+static constexpr std::size_t drop_batch_k = 4096;
+
 struct level_snapshot_t {
     leveldb::Snapshot const* snapshot = nullptr;
 };
 
+/**
+ * @brief Stripes are picked with Fibonacci hashing, so their count must be a power of two.
+ */
+static constexpr std::size_t lock_stripes_log2_k = 12;
+static constexpr std::size_t lock_stripes_k = std::size_t(1) << lock_stripes_log2_k;
+
+struct level_stripe_t {
+    std::mutex mutex;
+    /** @brief Generation of the last commit, that changed any key of this stripe. */
+    std::uint64_t generation = 0;
+};
+
+inline std::size_t stripe_of(level_key_t const& key) noexcept {
+    std::uint64_t constexpr golden_k = 0x9E3779B97F4A7C15ull;
+    std::uint64_t hash = static_cast<std::uint64_t>(key.key) ^ (key.collection * golden_k);
+    return static_cast<std::size_t>((hash * golden_k) >> (64 - lock_stripes_log2_k));
+}
+
+/**
+ * @brief Bloom filters with 10 bits per key have a false-positive rate of 1%.
+ */
+static constexpr int filter_bits_per_key_k = 10;
+
+/**
+ * @brief Chunks of parallel reads are at least this large, as handing off
+ * smaller ones would cost more than the lookups themselves.
+ */
+static constexpr std::size_t parallel_reads_min_k = 256;
+static constexpr std::size_t read_threads_max_k = 4;
+
 struct level_db_t {
     std::unordered_map<ustore_size_t, level_snapshot_t*> snapshots;
+    /** @brief Names of the named collections, loaded from the catalog. */
+    std::unordered_map<ustore_collection_t, std::string> collections;
+    ustore_collection_t last_collection = ustore_collection_main_k;
+    /** @brief Must outlive the @c native instance, that doesn't own it. */
+    std::unique_ptr<leveldb::FilterPolicy const> filter_policy;
+    std::unique_ptr<thread_pool_t> readers;
     std::unique_ptr<level_native_t> native;
     std::mutex mutex;
+    std::atomic<std::uint64_t> generation {0};
+    /** @brief The bound of @c generation, persisted in the catalog, see `reserve_generations`. */
+    std::atomic<std::uint64_t> reserved_generations {0};
+    std::mutex reservation_mutex;
+    std::array<level_stripe_t, lock_stripes_k> stripes;
+};
+
+/**
+ * @brief Buffered state of an optimistic transaction.
+ * Deletions are stored as empty optionals.
+ */
+struct level_txn_t {
+    level_db_t* db = nullptr;
+    leveldb::Snapshot const* snapshot = nullptr;
+    std::uint64_t generation = 0;
+    bool watch = true;
+    std::map<level_key_t, std::optional<std::string>> changes;
+    std::vector<std::size_t> watched_stripes;
+
+    void reset() noexcept {
+        if (snapshot)
+            db->native->ReleaseSnapshot(snapshot);
+        snapshot = nullptr;
+        changes.clear();
+        watched_stripes.clear();
+    }
+};
+
+/**
+ * @brief Holds the locks of several stripes, acquired in ascending order to avoid deadlocks.
+ */
+class level_stripes_lock_t {
+    level_db_t& db_;
+    std::vector<std::size_t> stripes_;
+
+  public:
+    level_stripes_lock_t(level_db_t& db, std::vector<std::size_t> stripes) noexcept(false)
+        : db_(db), stripes_(std::move(stripes)) {
+        std::sort(stripes_.begin(), stripes_.end());
+        stripes_.erase(std::unique(stripes_.begin(), stripes_.end()), stripes_.end());
+        for (std::size_t stripe : stripes_)
+            db_.stripes[stripe].mutex.lock();
+    }
+    ~level_stripes_lock_t() noexcept {
+        for (std::size_t stripe : stripes_)
+            db_.stripes[stripe].mutex.unlock();
+    }
+};
+
+/**
+ * @brief Persists a new bound of the generations, unless the current one is still far enough
+ * from the @p generation. On open the counter restarts from the persisted bound, so the
+ * sequence numbers keep growing across restarts, skipping the unused part of the last block.
+ */
+level_status_t reserve_generations(level_db_t& db, std::uint64_t generation) {
+    std::lock_guard<std::mutex> lock {db.reservation_mutex};
+    if (generation + generations_reservation_k / 2 <= db.reserved_generations.load())
+        return {};
+
+    std::uint64_t const bound = generation + generations_reservation_k;
+    leveldb::WriteOptions options;
+    options.sync = true;
+    leveldb::Slice const value {reinterpret_cast<char const*>(&bound), sizeof(bound)};
+    level_status_t status = db.native->Put(options, catalog_generations_k, value);
+    if (status.ok())
+        db.reserved_generations = bound;
+    return status;
+}
+
+/**
+ * @brief Applies the @p batch and stamps the @p changed stripes, which the caller must hold locked.
+ * The new generation is published after the write, so transactions, that begin in between,
+ * may see a spurious conflict, but never miss a change absent from their snapshot.
+ */
+level_status_t apply_batch(level_db_t& db,
+                           leveldb::WriteBatch& batch,
+                           std::vector<std::size_t> const& changed,
+                           leveldb::WriteOptions const& options,
+                           std::uint64_t& generation) {
+    level_status_t status = db.native->Write(options, &batch);
+    if (!status.ok())
+        return status;
+    generation = db.generation.fetch_add(1) + 1;
+    for (std::size_t stripe : changed)
+        db.stripes[stripe].generation = generation;
+
+    // A failed reservation only matters, if the issued generation isn't covered by the persisted bound
+    if (generation + generations_reservation_k / 2 > db.reserved_generations.load()) {
+        status = reserve_generations(db, generation);
+        if (generation <= db.reserved_generations.load())
+            status = level_status_t {};
+    }
+    return status;
+}
+
+/**
+ * @brief Removes the keys of collection @p id, or only empties their values, if @p keep_keys is set.
+ * Every batch of up to @c drop_batch_k keys is collected and written under the locks of all stripes,
+ * as the keys may hash into any of them, and stamps the changed stripes, conflicting with transactions.
+ */
+level_status_t clear_collection(level_db_t& db, ustore_collection_t id, bool keep_keys) noexcept(false) {
+    level_key_t const last {id, std::numeric_limits<ustore_key_t>::max()};
+    level_key_t next {id, std::numeric_limits<ustore_key_t>::min()};
+    leveldb::WriteOptions options;
+    options.sync = true;
+    std::vector<std::size_t> all_stripes(lock_stripes_k);
+    std::iota(all_stripes.begin(), all_stripes.end(), 0);
+
+    bool reached_end = false;
+    while (!reached_end) {
+        level_stripes_lock_t lock {db, all_stripes};
+        leveldb::WriteBatch batch;
+        std::vector<std::size_t> changed;
+        level_iter_uptr_t it {db.native->NewIterator(leveldb::ReadOptions())};
+        for (it->Seek(next); it->Valid() && changed.size() != drop_batch_k; it->Next()) {
+            level_key_t const key = level_key_t::decode(it->key());
+            if (last < key)
+                break;
+            if (keep_keys)
+                batch.Put(it->key(), leveldb::Slice());
+            else
+                batch.Delete(it->key());
+            changed.push_back(stripe_of(key));
+            next = key;
+        }
+        it.reset();
+
+        // The emptied values remain, so the next batch starts right after the last visited key
+        reached_end = changed.size() != drop_batch_k || next.key == last.key;
+        next.key += !reached_end;
+        if (changed.empty())
+            break;
+
+        std::uint64_t generation = 0;
+        level_status_t status = apply_batch(db, batch, changed, options, generation);
+        if (!status.ok())
+            return status;
+    }
+    return {};
+}
+
+/**
+ * @brief Deletes the keys and the catalog entry of a dropped collection, which is already
+ * missing from @c level_db_t::collections, and compacts its range.
+ */
+level_status_t finish_drop(level_db_t& db, ustore_collection_t id) noexcept(false) {
+    level_status_t status = clear_collection(db, id, false);
+    if (!status.ok())
+        return status;
+
+    leveldb::WriteOptions options;
+    options.sync = true;
+    status = db.native->Delete(options, level_key_t {catalog_collection_k, static_cast<ustore_key_t>(id)});
+    if (!status.ok())
+        return status;
+
+    // Without range deletions the tombstones would slow down the following scans, until compacted
+    level_key_t const first {id, std::numeric_limits<ustore_key_t>::min()};
+    level_key_t const last {id, std::numeric_limits<ustore_key_t>::max()};
+    leveldb::Slice begin = first, end = last;
+    db.native->CompactRange(&begin, &end);
+    return {};
+}
+
+/**
+ * @brief Confines a LevelDB iterator to a single collection, exposing the plain keys,
+ * so that it can be passed to `reservoir_sample_iterator`.
+ */
+class level_collection_iterator_t {
+    leveldb::Iterator& native_;
+    level_key_t first_;
+    level_key_t last_;
+    level_key_t current_;
+
+  public:
+    level_collection_iterator_t(leveldb::Iterator& native, ustore_collection_t collection) noexcept
+        : native_(native), first_(collection, std::numeric_limits<ustore_key_t>::min()),
+          last_(collection, std::numeric_limits<ustore_key_t>::max()) {}
+
+    void SeekToFirst() { native_.Seek(first_); }
+    void Next() { native_.Next(); }
+    bool Valid() {
+        if (!native_.Valid())
+            return false;
+        current_ = level_key_t::decode(native_.key());
+        return !(last_ < current_);
+    }
+    leveldb::Slice key() const noexcept {
+        return {reinterpret_cast<char const*>(&current_.key), sizeof(ustore_key_t)};
+    }
 };
 
 /*********************************************************/
 /*****************	 C++ Implementation	  ****************/
 /*********************************************************/
 
-inline leveldb::Slice to_slice(ustore_key_t const& key) noexcept {
-    return {reinterpret_cast<char const*>(&key), sizeof(ustore_key_t)};
-}
-
 inline leveldb::Slice to_slice(value_view_t value) noexcept {
     return {reinterpret_cast<const char*>(value.begin()), value.size()};
 }
@@ -141,7 +471,10 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
         // Engine config
         return_error_if_m(config.engine.config_url.empty(), c.error, args_wrong_k, "Doesn't support URL configs");
 
-        auto fill_options = [](json_t const& js, level_options_t& options) {
+        std::string filter_policy = "bloom";
+        int bits_per_key = filter_bits_per_key_k;
+        std::size_t read_threads = std::min<std::size_t>(std::thread::hardware_concurrency(), read_threads_max_k);
+        auto fill_options = [&](json_t const& js, level_options_t& options) {
             if (js.contains("write_buffer_size"))
                 options.write_buffer_size = js["write_buffer_size"];
             if (js.contains("max_file_size"))
@@ -159,6 +492,12 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
             if (js.contains("compression"))
                 if (js["compression"] == "kSnappyCompression" || js["compression"] == "snappy")
                     options.compression = leveldb::kSnappyCompression;
+            if (js.contains("filter_policy"))
+                filter_policy = js["filter_policy"];
+            if (js.contains("bits_per_key"))
+                bits_per_key = js["bits_per_key"];
+            if (js.contains("read_threads"))
+                read_threads = js["read_threads"];
         };
 
         // Load from file
@@ -172,7 +511,20 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
         if (!config.engine.config.empty())
             fill_options(config.engine.config, options);
 
-        level_db_t* db_ptr = new level_db_t;
+        return_error_if_m(filter_policy == "bloom" || filter_policy == "none",
+                          c.error,
+                          args_wrong_k,
+                          "Filter policy can be \"bloom\" or \"none\"");
+
+        // Owns the readers and the filter, until the database is open and handed out
+        auto db_ptr = std::make_unique<level_db_t>();
+        if (filter_policy == "bloom") {
+            db_ptr->filter_policy.reset(leveldb::NewBloomFilterPolicy(bits_per_key));
+            options.filter_policy = db_ptr->filter_policy.get();
+        }
+        if (read_threads > 1)
+            db_ptr->readers = std::make_unique<thread_pool_t>(read_threads - 1);
+
         level_native_t* native_db = nullptr;
         level_status_t status = leveldb::DB::Open(options, root, &native_db);
         if (!status.ok()) {
@@ -180,7 +532,49 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
             return;
         }
         db_ptr->native = std::unique_ptr<level_native_t>(native_db);
-        *c.db = db_ptr;
+
+        // Named collections, registered in the catalog
+        std::vector<ustore_collection_t> pending_drops;
+        level_iter_uptr_t it {native_db->NewIterator(leveldb::ReadOptions())};
+        for (it->Seek(level_key_t {catalog_collection_k, std::numeric_limits<ustore_key_t>::min()}); it->Valid();
+             it->Next()) {
+            level_key_t const key = level_key_t::decode(it->key());
+            if (key.key == catalog_generations_k.key) {
+                std::uint64_t bound = 0;
+                if (it->value().size() == sizeof(bound))
+                    std::memcpy(&bound, it->value().data(), sizeof(bound));
+                db_ptr->generation = bound;
+                continue;
+            }
+            auto id = static_cast<ustore_collection_t>(key.key);
+            if (id == ustore_collection_main_k) {
+                if (it->value().size() == sizeof(ustore_collection_t))
+                    std::memcpy(&id, it->value().data(), sizeof(ustore_collection_t));
+            }
+            else if (it->value().empty())
+                pending_drops.push_back(id);
+            else
+                db_ptr->collections.emplace(id, it->value().ToString());
+            db_ptr->last_collection = std::max(db_ptr->last_collection, id);
+        }
+        it.reset();
+
+        // Generations continue from the last persisted bound, covering every number issued before
+        status = reserve_generations(*db_ptr, db_ptr->generation.load());
+        if (!status.ok()) {
+            *c.error = "Couldn't reserve LevelDB generations";
+            return;
+        }
+
+        // Drops, interrupted by a crash, are finished before anyone can see their leftovers
+        for (ustore_collection_t id : pending_drops) {
+            status = finish_drop(*db_ptr, id);
+            if (!status.ok()) {
+                *c.error = "Couldn't finish dropping a LevelDB collection";
+                return;
+            }
+        }
+        *c.db = db_ptr.release();
     }
     catch (json_t::type_error const&) {
         *c.error = "Unsupported type in LevelDB configuration key";
@@ -215,6 +609,7 @@ void ustore_snapshot_list(ustore_snapshot_list_t* c_ptr) {
 void ustore_snapshot_create(ustore_snapshot_create_t* c_ptr) {
     ustore_snapshot_create_t& c = *c_ptr;
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(!c.directory, c.error, missing_feature_k, "On-disk checkpoints aren't supported");
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
     std::lock_guard<std::mutex> locker(db.mutex);
@@ -256,19 +651,24 @@ void ustore_snapshot_drop(ustore_snapshot_drop_t* c_ptr) {
     db.mutex.unlock();
 }
 
-void write_one( //
-    level_db_t& db,
+void write_txn( //
+    level_txn_t& txn,
     places_arg_t const& places,
     contents_arg_t const& contents,
-    leveldb::WriteOptions const& options,
-    ustore_error_t* c_error) {
+    bool watch) noexcept(false) {
 
-    auto place = places[0];
-    auto content = contents[0];
-    auto key = to_slice(place.key);
-    level_status_t status =
-        !content ? db.native->Delete(options, key) : db.native->Put(options, key, to_slice(content));
-    export_error(status, c_error);
+    for (std::size_t i = 0; i != places.size(); ++i) {
+        auto place = places[i];
+        auto content = contents[i];
+
+        level_key_t const key {place.collection, place.key};
+        if (!content)
+            txn.changes[key] = std::nullopt;
+        else
+            txn.changes[key] = std::string(reinterpret_cast<char const*>(content.begin()), content.size());
+        if (watch)
+            txn.watched_stripes.push_back(stripe_of(key));
+    }
 }
 
 void write_many( //
@@ -276,21 +676,25 @@ void write_many( //
     places_arg_t const& places,
     contents_arg_t const& contents,
     leveldb::WriteOptions const& options,
-    ustore_error_t* c_error) {
+    ustore_error_t* c_error) noexcept(false) {
 
     leveldb::WriteBatch batch;
+    std::vector<std::size_t> changed(places.size());
     for (std::size_t i = 0; i != places.size(); ++i) {
         auto place = places[i];
         auto content = contents[i];
 
-        auto key = to_slice(place.key);
+        level_key_t const key {place.collection, place.key};
+        changed[i] = stripe_of(key);
         if (!content)
             batch.Delete(key);
         else
             batch.Put(key, to_slice(content));
     }
 
-    level_status_t status = db.native->Write(options, &batch);
+    level_stripes_lock_t lock {db, changed};
+    std::uint64_t generation = 0;
+    level_status_t status = apply_batch(db, batch, changed, options, generation);
     export_error(status, c_error);
 }
 
@@ -300,6 +704,7 @@ void ustore_write(ustore_write_t* c_ptr) {
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
     strided_iterator_gt<ustore_bytes_cptr_t const> vals {c.values, c.values_stride};
@@ -318,8 +723,11 @@ void ustore_write(ustore_write_t* c_ptr) {
         options.sync = true;
 
     try {
-        auto func = c.tasks_count == 1 ? &write_one : &write_many;
-        func(db, places, contents, options, c.error);
+        bool const watch = !(c.options & ustore_option_transaction_dont_watch_k);
+        if (txn_ptr)
+            write_txn(*txn_ptr, places, contents, watch && txn_ptr->watch);
+        else
+            write_many(db, places, contents, options, c.error);
     }
     catch (...) {
         *c.error = "Write Failure";
@@ -329,15 +737,36 @@ void ustore_write(ustore_write_t* c_ptr) {
 template <typename value_enumerator_at>
 void read_enumerate( //
     level_db_t& db,
+    level_txn_t* txn_ptr,
+    bool watch,
     places_arg_t tasks,
+    std::size_t tasks_begin,
+    std::size_t tasks_end,
     leveldb::ReadOptions const& options,
     std::string& value,
-    value_enumerator_at enumerator,
+    value_enumerator_at&& enumerator,
     ustore_error_t* c_error) {
 
-    for (std::size_t i = 0; i != tasks.size(); ++i) {
+    for (std::size_t i = tasks_begin; i != tasks_end; ++i) {
         place_t place = tasks[i];
-        level_status_t status = db.native->Get(options, to_slice(place.key), &value);
+        level_key_t const key {place.collection, place.key};
+
+        // Transactions see their own changes first
+        if (txn_ptr) {
+            if (watch)
+                txn_ptr->watched_stripes.push_back(stripe_of(key));
+            auto change = txn_ptr->changes.find(key);
+            if (change != txn_ptr->changes.end()) {
+                auto const& changed_value = change->second;
+                enumerator(i,
+                           changed_value ? value_view_t {reinterpret_cast<ustore_bytes_cptr_t>(changed_value->data()),
+                                                         static_cast<ustore_length_t>(changed_value->size())}
+                                         : value_view_t {});
+                continue;
+            }
+        }
+
+        level_status_t status = db.native->Get(options, key, &value);
         if (!status.IsNotFound()) {
             if (export_error(status, c_error))
                 return;
@@ -350,6 +779,82 @@ void read_enumerate( //
     }
 }
 
+/**
+ * @brief Splits the batch into chunks, fetched by the `level_db_t::readers` into a buffer per chunk.
+ * If a @p tape is given, it is allocated once for all the values, which the readers copy into
+ * their slices of it. Then passes the values to the @p enumerator in the original order.
+ */
+template <typename value_enumerator_at>
+void read_parallel( //
+    level_db_t& db,
+    level_txn_t* txn_ptr,
+    bool watch,
+    places_arg_t tasks,
+    leveldb::ReadOptions const& options,
+    uninitialized_array_gt<byte_t>* tape,
+    value_enumerator_at&& enumerator,
+    ustore_error_t* c_error) noexcept(false) {
+
+    // Every chunk appends its values to a single growing buffer, and the views are rebuilt from
+    // the lengths once it stops growing, as appending may relocate the earlier values
+    struct chunk_t {
+        std::string bytes;
+        std::vector<ustore_length_t> lengths;
+        std::size_t offset_in_tape = 0;
+        ustore_error_t error = nullptr;
+    };
+
+    std::size_t const chunks_count = std::min(db.readers->size() + 1, tasks.size() / parallel_reads_min_k);
+    std::size_t const chunk_size = (tasks.size() + chunks_count - 1) / chunks_count;
+    std::vector<chunk_t> chunks(chunks_count);
+    db.readers->parallel_for(chunks_count, [&](std::size_t chunk_idx) noexcept {
+        chunk_t& chunk = chunks[chunk_idx];
+        std::size_t const begin = chunk_idx * chunk_size;
+        std::size_t const end = std::min(begin + chunk_size, tasks.size());
+        safe_section("Reading a chunk", &chunk.error, [&] {
+            chunk.lengths.reserve(end - begin);
+            auto chunk_enumerator = [&](std::size_t, value_view_t value) {
+                if (value)
+                    chunk.bytes.append(reinterpret_cast<char const*>(value.begin()), value.size());
+                chunk.lengths.push_back(value ? value.size() : ustore_length_missing_k);
+            };
+            std::string value;
+            read_enumerate(db, txn_ptr, false, tasks, begin, end, options, value, chunk_enumerator, &chunk.error);
+        });
+    });
+
+    std::size_t total_bytes = 0;
+    for (chunk_t& chunk : chunks) {
+        return_error_if_m(!chunk.error, c_error, error_unknown_k, chunk.error);
+        chunk.offset_in_tape = total_bytes;
+        total_bytes += chunk.bytes.size();
+    }
+
+    if (tape) {
+        tape->resize(total_bytes, c_error);
+        return_if_error_m(c_error);
+        db.readers->parallel_for(chunks_count, [&](std::size_t chunk_idx) noexcept {
+            chunk_t const& chunk = chunks[chunk_idx];
+            auto begin = reinterpret_cast<byte_t const*>(chunk.bytes.data());
+            std::copy(begin, begin + chunk.bytes.size(), tape->begin() + chunk.offset_in_tape);
+        });
+    }
+
+    // Transactions record the watched keys here, as their list isn't thread-safe
+    std::size_t i = 0;
+    for (chunk_t const& chunk : chunks) {
+        auto value_begin = reinterpret_cast<ustore_bytes_cptr_t>(chunk.bytes.data());
+        for (ustore_length_t length : chunk.lengths) {
+            if (watch)
+                txn_ptr->watched_stripes.push_back(stripe_of(level_key_t {tasks[i].collection, tasks[i].key}));
+            bool const present = length != ustore_length_missing_k;
+            enumerator(i, present ? value_view_t {value_begin, length} : value_view_t {});
+            value_begin += present ? length : 0;
+            ++i;
+        }
+    }
+}
+
 void ustore_read(ustore_read_t* c_ptr) {
 
     ustore_read_t& c = *c_ptr;
@@ -359,9 +864,11 @@ void ustore_read(ustore_read_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     level_snapshot_t& snap = *reinterpret_cast<level_snapshot_t*>(c.snapshot);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
-    places_arg_t places {{}, keys, {}, c.tasks_count};
+    places_arg_t places {collections, keys, {}, c.tasks_count};
 
     validate_read(c.transaction, places, c.options, c.error);
     return_if_error_m(c.error);
@@ -385,18 +892,44 @@ void ustore_read(ustore_read_t* c_ptr) {
             return_error_if_m(it != db.snapshots.end(), c.error, args_wrong_k, "The snapshot does'nt exist!");
             options.snapshot = snap.snapshot;
         }
+        else if (txn_ptr)
+            options.snapshot = txn_ptr->snapshot;
 
         std::string value_buffer;
         ustore_length_t progress_in_tape = 0;
-        auto data_enumerator = [&](std::size_t i, value_view_t value) {
+        auto metadata_enumerator = [&](std::size_t i, value_view_t value) {
             presences[i] = bool(value);
             lens[i] = value ? value.size() : ustore_length_missing_k;
-            offs[i] = contents.size();
+            offs[i] = progress_in_tape;
+            progress_in_tape += needs_export ? value.size() : 0;
+        };
+        auto data_enumerator = [&](std::size_t i, value_view_t value) {
+            metadata_enumerator(i, value);
             if (needs_export)
                 contents.insert(contents.size(), value.begin(), value.end(), c.error);
         };
-        read_enumerate(db, places, options, value_buffer, data_enumerator, c.error);
-        offs[places.count] = contents.size();
+        bool const watch = txn_ptr && txn_ptr->watch && !(c.options & ustore_option_transaction_dont_watch_k);
+        if (db.readers && places.count >= parallel_reads_min_k * 2)
+            read_parallel(db,
+                          txn_ptr,
+                          watch,
+                          places,
+                          options,
+                          needs_export ? &contents : nullptr,
+                          metadata_enumerator,
+                          c.error);
+        else
+            read_enumerate(db,
+                           txn_ptr,
+                           watch,
+                           places,
+                           0,
+                           places.count,
+                           options,
+                           value_buffer,
+                           data_enumerator,
+                           c.error);
+        offs[places.count] = progress_in_tape;
         if (needs_export)
             *c.values = reinterpret_cast<ustore_bytes_ptr_t>(contents.begin());
     }
@@ -414,10 +947,13 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     level_snapshot_t& snap = *reinterpret_cast<level_snapshot_t*>(c.snapshot);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_length_t const> limits {c.count_limits, c.count_limits_stride};
-    scans_arg_t scans {{}, start_keys, limits, c.tasks_count};
+    strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
+    scans_arg_t scans {collections, start_keys, limits, c.tasks_count, end_keys};
 
     return_if_error_m(c.error);
 
@@ -431,6 +967,13 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     auto keys_output = *c.keys = arena.alloc<ustore_key_t>(total_keys, c.error).begin();
     return_if_error_m(c.error);
 
+    bool const export_values = c.value_offsets || c.value_lengths || c.values;
+    growing_tape_t tape(arena);
+    if (export_values) {
+        tape.reserve(total_keys, c.error);
+        return_if_error_m(c.error);
+    }
+
     // 2. Fetch the data
     leveldb::ReadOptions options;
     options.fill_cache = false;
@@ -439,6 +982,8 @@ void ustore_scan(ustore_scan_t* c_ptr) {
         return_error_if_m(it != db.snapshots.end(), c.error, args_wrong_k, "The snapshot does'nt exist!");
         options.snapshot = snap.snapshot;
     }
+    else if (txn_ptr)
+        options.snapshot = txn_ptr->snapshot;
 
     level_iter_uptr_t it;
     try {
@@ -448,23 +993,84 @@ void ustore_scan(ustore_scan_t* c_ptr) {
         *c.error = "Fail To Create Iterator";
         return;
     }
+
+    auto export_entry = [&](ustore_key_t key, value_view_t value) {
+        *keys_output = key;
+        ++keys_output;
+        if (export_values)
+            tape.push_back(value, c.error);
+    };
+    auto stored_value = [&] {
+        leveldb::Slice value = it->value();
+        return value_view_t(value.data(), value.size());
+    };
+
     for (ustore_size_t i = 0; i != c.tasks_count; ++i) {
         scan_t task = scans[i];
-        it->Seek(to_slice(task.min_key));
+        it->Seek(level_key_t {task.collection, task.min_key});
         offsets[i] = keys_output - *c.keys;
 
+        // Following collections start past the bound, so a single comparison confines the scan
+        level_key_t const bound {task.collection, task.max_key};
         ustore_size_t j = 0;
-        while (it->Valid() && j != task.limit) {
-            std::memcpy(keys_output, it->key().data(), sizeof(ustore_key_t));
-            ++keys_output;
-            ++j;
-            it->Next();
+        if (!txn_ptr) {
+            while (it->Valid() && j != task.limit) {
+                level_key_t const found = level_key_t::decode(it->key());
+                if (bound < found)
+                    break;
+                export_entry(found.key, stored_value());
+                return_if_error_m(c.error);
+                ++j;
+                it->Next();
+            }
+        }
+        else {
+            // Changes of the transaction shadow the stored entries with the same keys
+            auto change = txn_ptr->changes.lower_bound(level_key_t {task.collection, task.min_key});
+            auto changes_end = txn_ptr->changes.upper_bound(bound);
+            while (j != task.limit) {
+                bool has_stored = it->Valid();
+                level_key_t found;
+                if (has_stored) {
+                    found = level_key_t::decode(it->key());
+                    has_stored = !(bound < found);
+                }
+                bool const has_change = change != changes_end;
+                if (!has_stored && !has_change)
+                    break;
+
+                if (!has_change || (has_stored && found < change->first)) {
+                    export_entry(found.key, stored_value());
+                    it->Next();
+                }
+                else {
+                    if (has_stored && !(change->first < found))
+                        it->Next();
+                    auto const& [key, value] = *change;
+                    ++change;
+                    if (!value)
+                        continue;
+                    export_entry(key.key,
+                                 value_view_t {reinterpret_cast<ustore_bytes_cptr_t>(value->data()),
+                                               static_cast<ustore_length_t>(value->size())});
+                }
+                return_if_error_m(c.error);
+                ++j;
+            }
         }
 
         counts[i] = j;
     }
 
     offsets[scans.size()] = keys_output - *c.keys;
+
+    // 3. Export the values
+    if (c.value_offsets)
+        *c.value_offsets = tape.offsets().begin().get();
+    if (c.value_lengths)
+        *c.value_lengths = tape.lengths().begin().get();
+    if (c.values)
+        *c.values = (ustore_bytes_ptr_t)tape.contents().begin().get();
 }
 
 void ustore_sample(ustore_sample_t* c_ptr) {
@@ -478,9 +1084,11 @@ void ustore_sample(ustore_sample_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t* txn_ptr = reinterpret_cast<level_txn_t*>(c.transaction);
     level_snapshot_t& snap = *reinterpret_cast<level_snapshot_t*>(c.snapshot);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_length_t const> lens {c.count_limits, c.count_limits_stride};
-    sample_args_t samples {{}, lens, c.tasks_count};
+    sample_args_t samples {collections, lens, c.tasks_count};
 
     // 1. Allocate a tape for all the values to be fetched
     auto offsets = arena.alloc_or_dummy(samples.count + 1, c.error, c.offsets);
@@ -500,6 +1108,8 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         return_error_if_m(it != db.snapshots.end(), c.error, args_wrong_k, "The snapshot does'nt exist!");
         options.snapshot = snap.snapshot;
     }
+    else if (txn_ptr)
+        options.snapshot = txn_ptr->snapshot;
 
     for (std::size_t task_idx = 0; task_idx != samples.count; ++task_idx) {
         sample_arg_t task = samples[task_idx];
@@ -512,7 +1122,8 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         return_if_error_m(c.error);
 
         ptr_range_gt<ustore_key_t> sampled_keys(keys_output, task.limit);
-        reservoir_sample_iterator(it, sampled_keys, c.error);
+        level_collection_iterator_t collection_it {*it, task.collection};
+        reservoir_sample_iterator(&collection_it, sampled_keys, c.error);
 
         counts[task_idx] = task.limit;
         keys_output += task.limit;
@@ -537,6 +1148,7 @@ void ustore_measure(ustore_measure_t* c_ptr) {
     return_if_error_m(c.error);
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
     uint64_t approximate_size = 0;
@@ -549,9 +1161,10 @@ void ustore_measure(ustore_measure_t* c_ptr) {
         min_value_bytes[i] = static_cast<ustore_size_t>(0);
         max_value_bytes[i] = static_cast<ustore_size_t>(0);
 
-        ustore_key_t const min_key = start_keys[i];
-        ustore_key_t const max_key = end_keys[i];
-        leveldb::Range range(to_slice(min_key), to_slice(max_key));
+        ustore_collection_t const collection = collections ? collections[i] : ustore_collection_main_k;
+        level_key_t const min_key {collection, start_keys[i]};
+        level_key_t const max_key {collection, end_keys[i]};
+        leveldb::Range range(min_key, max_key);
         try {
             db.native->GetApproximateSizes(&range, 1, &approximate_size);
             min_space_usages[i] = approximate_size;
@@ -574,7 +1187,35 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
 
     ustore_collection_create_t& c = *c_ptr;
     auto name_len = c.name ? std::strlen(c.name) : 0;
-    return_error_if_m(name_len, c.error, args_wrong_k, "Collections not supported by LevelDB!");
+    return_error_if_m(name_len, c.error, args_wrong_k, "Default collection is always present");
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    std::lock_guard<std::mutex> locker(db.mutex);
+    for (auto const& [id, name] : db.collections)
+        return_error_if_m(name != c.name, c.error, args_wrong_k, "Such collection already exists!");
+
+    ustore_collection_t const id = db.last_collection + 1;
+    return_error_if_m(id != catalog_collection_k, c.error, args_wrong_k, "Ran out of collection IDs");
+    safe_section("Registering the collection", c.error, [&] { db.collections.emplace(id, c.name); });
+    return_if_error_m(c.error);
+
+    leveldb::WriteOptions options;
+    options.sync = true;
+    level_key_t const catalog_key {catalog_collection_k, static_cast<ustore_key_t>(id)};
+    leveldb::WriteBatch batch;
+    level_status_t status;
+    safe_section("Registering the collection", c.error, [&] {
+        batch.Put(catalog_key, leveldb::Slice(c.name, name_len));
+        batch.Put(catalog_last_id_k, leveldb::Slice(reinterpret_cast<char const*>(&id), sizeof(id)));
+        status = db.native->Write(options, &batch);
+    });
+    if (*c.error || export_error(status, c.error)) {
+        db.collections.erase(id);
+        return;
+    }
+    db.last_collection = id;
+    *c.id = id;
 }
 
 void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
@@ -582,42 +1223,99 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
     ustore_collection_drop_t& c = *c_ptr;
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
     bool invalidate = c.mode == ustore_drop_keys_vals_handle_k;
-    return_error_if_m(c.id == ustore_collection_main_k && !invalidate,
+    return_error_if_m(c.id != ustore_collection_main_k || !invalidate,
                       c.error,
                       args_combo_k,
-                      "Collections not supported by LevelDB!");
+                      "Default collection can't be invalidated.");
 
     level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    std::string name;
+    {
+        std::lock_guard<std::mutex> locker(db.mutex);
+        auto it = db.collections.find(c.id);
+        return_error_if_m(c.id == ustore_collection_main_k || it != db.collections.end(),
+                          c.error,
+                          args_wrong_k,
+                          "Collection doesn't exist");
 
-    leveldb::WriteBatch batch;
-    auto it = std::unique_ptr<leveldb::Iterator>(db.native->NewIterator(leveldb::ReadOptions()));
-
-    if (c.mode == ustore_drop_keys_vals_k) {
-        for (it->SeekToFirst(); it->Valid(); it->Next())
-            batch.Delete(it->key());
+        // Handles disappear at once, so that the same collection isn't dropped twice
+        if (invalidate) {
+            name = std::move(it->second);
+            db.collections.erase(it);
+        }
     }
 
-    else if (c.mode == ustore_drop_vals_k) {
-        for (it->SeekToFirst(); it->Valid(); it->Next())
-            batch.Put(it->key(), leveldb::Slice());
-    }
+    // The catalog entry is emptied first, so that a crash in the middle doesn't leave a half-dropped collection
+    level_status_t status;
+    safe_section("Dropping the collection", c.error, [&] {
+        if (!invalidate) {
+            status = clear_collection(db, c.id, c.mode == ustore_drop_vals_k);
+            return;
+        }
 
-    leveldb::WriteOptions options;
-    options.sync = true;
-    level_status_t status = db.native->Write(options, &batch);
-    export_error(status, c.error);
+        leveldb::WriteOptions options;
+        options.sync = true;
+        level_key_t const catalog_key {catalog_collection_k, static_cast<ustore_key_t>(c.id)};
+        status = db.native->Put(options, catalog_key, leveldb::Slice());
+        if (status.ok())
+            status = finish_drop(db, c.id);
+        else {
+            std::lock_guard<std::mutex> locker(db.mutex);
+            db.collections.emplace(c.id, std::move(name));
+        }
+    });
+    return_if_error_m(c.error);
+    if (export_error(status, c.error))
+        return;
+
+    // Without range deletions the tombstones would slow down the following scans, until compacted
+    if (c.mode == ustore_drop_keys_vals_k) {
+        level_key_t const first {c.id, std::numeric_limits<ustore_key_t>::min()};
+        level_key_t const last {c.id, std::numeric_limits<ustore_key_t>::max()};
+        leveldb::Slice begin = first, end = last;
+        db.native->CompactRange(&begin, &end);
+    }
 }
 
 void ustore_collection_list(ustore_collection_list_t* c_ptr) {
 
     ustore_collection_list_t& c = *c_ptr;
-    *c.count = 0;
-    if (c.ids)
-        *c.ids = nullptr;
-    if (c.offsets)
-        *c.offsets = nullptr;
-    if (c.names)
-        *c.names = nullptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(c.count && c.names, c.error, args_combo_k, "Need names and outputs!");
+
+    linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
+    return_if_error_m(c.error);
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    std::lock_guard<std::mutex> locker(db.mutex);
+    std::size_t collections_count = db.collections.size();
+    *c.count = static_cast<ustore_size_t>(collections_count);
+
+    // Every string will be null-terminated
+    std::size_t strings_length = 0;
+    for (auto const& [id, name] : db.collections)
+        strings_length += name.size() + 1;
+
+    auto names = arena.alloc<char>(strings_length, c.error).begin();
+    *c.names = names;
+    return_if_error_m(c.error);
+
+    // For every collection we also need to export IDs and offsets
+    auto ids = arena.alloc_or_dummy(collections_count, c.error, c.ids);
+    return_if_error_m(c.error);
+    auto offs = arena.alloc_or_dummy(collections_count + 1, c.error, c.offsets);
+    return_if_error_m(c.error);
+
+    std::size_t i = 0;
+    for (auto const& [id, name] : db.collections) {
+        std::memcpy(names, name.data(), name.size());
+        names[name.size()] = '\0';
+        ids[i] = id;
+        offs[i] = static_cast<ustore_length_t>(names - *c.names);
+        names += name.size() + 1;
+        ++i;
+    }
+    offs[i] = static_cast<ustore_length_t>(names - *c.names);
 }
 
 void ustore_database_control(ustore_database_control_t* c_ptr) {
@@ -639,13 +1337,74 @@ void ustore_database_control(ustore_database_control_t* c_ptr) {
 void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
 
     ustore_transaction_init_t& c = *c_ptr;
-    *c.error = "Transactions not supported by LevelDB!";
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    validate_transaction_begin(c.transaction, c.options, c.error);
+    return_if_error_m(c.error);
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    safe_section("Initializing transaction state", c.error, [&] {
+        if (!*c.transaction)
+            *c.transaction = new level_txn_t();
+    });
+    return_if_error_m(c.error);
+
+    level_txn_t& txn = *reinterpret_cast<level_txn_t*>(*c.transaction);
+    txn.reset();
+    txn.db = &db;
+    txn.watch = !(c.options & ustore_option_transaction_dont_watch_k);
+
+    // The generation must be read before the snapshot is taken, see `apply_batch`
+    txn.generation = db.generation.load();
+    txn.snapshot = db.native->GetSnapshot();
+    return_error_if_m(txn.snapshot, c.error, error_unknown_k, "Couldn't get a snapshot!");
 }
 
 void ustore_transaction_commit(ustore_transaction_commit_t* c_ptr) {
 
     ustore_transaction_commit_t& c = *c_ptr;
-    *c.error = "Transactions not supported by LevelDB!";
+    if (!c.transaction)
+        return;
+
+    validate_transaction_commit(c.transaction, c.options, c.error);
+    return_if_error_m(c.error);
+
+    level_db_t& db = *reinterpret_cast<level_db_t*>(c.db);
+    level_txn_t& txn = *reinterpret_cast<level_txn_t*>(c.transaction);
+
+    leveldb::WriteOptions options;
+    options.sync = c.options & ustore_option_write_flush_k;
+
+    safe_section("Committing transaction", c.error, [&] {
+        leveldb::WriteBatch batch;
+        std::vector<std::size_t> changed;
+        changed.reserve(txn.changes.size());
+        for (auto const& [key, value] : txn.changes) {
+            changed.push_back(stripe_of(key));
+            if (value)
+                batch.Put(key, *value);
+            else
+                batch.Delete(key);
+        }
+
+        std::vector<std::size_t> locked {changed};
+        locked.insert(locked.end(), txn.watched_stripes.begin(), txn.watched_stripes.end());
+        level_stripes_lock_t lock {db, std::move(locked)};
+        for (std::size_t stripe : txn.watched_stripes)
+            return_error_if_m(db.stripes[stripe].generation <= txn.generation,
+                              c.error,
+                              consistency_k,
+                              "Watched keys were changed by a concurrent commit");
+
+        std::uint64_t generation = 0;
+        level_status_t status = apply_batch(db, batch, changed, options, generation);
+        if (export_error(status, c.error))
+            return;
+        if (c.sequence_number)
+            *c.sequence_number = generation;
+
+        // The snapshot must not outlive the database, if the transaction is freed after it
+        txn.reset();
+    });
 }
 
 /*********************************************************/
@@ -656,7 +1415,12 @@ void ustore_arena_free(ustore_arena_t c_arena) {
     clear_linked_memory(c_arena);
 }
 
-void ustore_transaction_free(ustore_transaction_t) {
+void ustore_transaction_free(ustore_transaction_t c_transaction) {
+    if (!c_transaction)
+        return;
+    level_txn_t* txn = reinterpret_cast<level_txn_t*>(c_transaction);
+    txn->reset();
+    delete txn;
 }
 
 void ustore_database_free(ustore_database_t c_db) {
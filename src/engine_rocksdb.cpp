@@ -15,22 +15,111 @@
  * Moreover, not being the default variant, its significantly less optimized,
  * so after numerous tests we decided to stick to `BlockBasedTable`.
  * https://github.com/facebook/rocksdb/wiki/PlainTable-Format
+ *
+ * ## Key Encoding
+ * New databases store keys as big-endian integers with a flipped sign bit,
+ * so that their byte order matches the numeric one, and the built-in bytewise
+ * comparator applies. It is much cheaper, than our custom one, and produces
+ * shorter separators in index blocks. Databases created before that keep
+ * the native byte order and the `key_comparator_t`. The choice is persisted in
+ * the @c key_encoding_marker_k file, and `ustore_migrate` converts old databases.
+ *
+ * ## Filters and Block Cache
+ * Graph updates and document patches probe many keys, that aren't present.
+ * Bloom or Ribbon filters answer those lookups without touching the disk,
+ * as long as they reside in the block cache, shared by all collections.
+ * Filters and indexes of L0 files are pinned in that cache, and the rest
+ * compete with data blocks. See `BlockBasedTableOptions` in the config.
+ *
+ * ## Merges
+ * Graph edges are added with `ustore_option_write_merge_neighborhoods_k`, which
+ * becomes a blind `Merge` of the new sorted neighborships. The @c neighborhoods_merge_t
+ * folds those into the stored adjacency lists on reads and compactions.
+ *
+ * ## Bulk Loads
+ * Batches written with `ustore_option_write_bulk_k` outside of transactions are
+ * sorted, dumped into SST files with `SstFileWriter` and moved into the tree with
+ * a single `IngestExternalFiles`, so the shares of all collections appear atomically.
+ * Files with key ranges not overlapping the stored data land directly in the bottommost
+ * level, so initial loads avoid the WAL, the memtable and most of the compactions.
+ * Batches should be large, as each produces a file per collection. The files are built
+ * in a scratch subdirectory, that is cleared on every open.
+ *
+ * ## Batched Reads
+ * Batches are read with `MultiGet`, keeping the values pinned in the block cache.
+ * With `"async_io_min_batch"` in the engine config, batches of at least that many keys
+ * also enable `async_io`, overlapping their reads from SST files. That only pays off
+ * in RocksDB builds with `io_uring`, unlike the bundled one, so it is off by default.
+ * Values exported with `ustore_option_read_pinned_k` keep the database open until their
+ * arenas are released, even if `ustore_database_free` is called first.
+ *
+ * ## Sampling
+ * Large collections are sampled with random seeks across the key span, rather than
+ * with a full reservoir scan. With `ustore_option_sample_weighted_k`, the seeks are
+ * distributed between SST files proportionally to their entry counts.
+ *
+ * ## Scans
+ * Tasks with `end_keys` set `iterate_upper_bound`, so that iterators don't wander
+ * past the range through tombstones. Consecutive tasks of the same collection
+ * and bound reuse one iterator, and large batches enable adaptive read-ahead.
+ *
+ * ## Blob Files
+ * Large documents and adjacency lists of hub vertices would be rewritten on every compaction,
+ * if kept inline in SSTs. With `enable_blob_files` in "CFOptions", values of at least
+ * `min_blob_size` bytes are separated into blob files, and only references to them are compacted.
+ * With `enable_blob_garbage_collection`, blobs in the oldest `blob_garbage_collection_age_cutoff`
+ * fraction of files are relocated by compactions, reclaiming the space of overwritten values.
+ * `ustore_measure` accounts for blob files in the upper bound of the space usage.
+ *
+ * ## Checkpoints and Secondary Instances
+ * Snapshots created with a `directory` also materialize a `Checkpoint` there: a consistent
+ * copy of the database, where immutable SST files are hard-linked rather than copied.
+ * It is taken right before the in-memory snapshot, so concurrent writes may fall in between.
+ * With `"secondary_directory"` in the engine config, the database is opened as a read-only
+ * secondary instance of the writer in the same root. It keeps its own logs in that directory
+ * and replays the writer's changes every `"catch_up_interval_ms"`, or on a "catch up" control.
+ * Collections, created by the writer after the secondary is opened, aren't visible to it.
+ *
+ * ## Controls
+ * `ustore_database_control` answers with JSON objects:
+ * - "statistics": tickers and histograms, if `statistics` is set in `DBOptions`.
+ * - "properties": memtables, compactions, stalls, blob files and the block cache, per collection.
+ *   Secondary instances also report the `"catch_up_error"` of their last catch up, or `null`.
+ * - "perf enable", "perf disable": toggle the `PerfContext` of the calling thread.
+ * - "perf": reports and resets the `PerfContext` counters and timers of the calling thread.
+ * - "catch up": replays the latest changes of the writer on a secondary instance.
  */
 
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <numeric>
+#include <random>
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
 
 #include <rocksdb/db.h>
+#include <rocksdb/cache.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/merge_operator.h>
+#include <rocksdb/perf_context.h>
+#include <rocksdb/sst_file_writer.h>
+#include <rocksdb/statistics.h>
+#include <rocksdb/table.h>
+#include <rocksdb/utilities/checkpoint.h>
 #include <rocksdb/utilities/options_util.h>
 #include <rocksdb/utilities/transaction.h>
 #include <rocksdb/utilities/optimistic_transaction_db.h>
 
 #include "ustore/db.h"
 #include "ustore/cpp/ranges_args.hpp" // `places_arg_t`
-#include "helpers/linked_array.hpp"   // `uninitialized_array_gt`
+#include "helpers/linked_array.hpp"   // `growing_tape_t`
 #include "helpers/full_scan.hpp"      // `reservoir_sample_iterator`
 #include "helpers/config_loader.hpp"  // `config_loader_t`
+#include "helpers/neighborhoods.hpp"  // `merge_neighborhoods`
 
 namespace stdfs = std::filesystem;
 using namespace unum::ustore;
@@ -46,8 +135,10 @@ ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max
 bool const ustore_supports_transactions_k = true;
 bool const ustore_supports_named_collections_k = true;
 bool const ustore_supports_snapshots_k = true;
+bool const ustore_supports_neighborhood_merges_k = true;
 
-using rocks_native_t = rocksdb::OptimisticTransactionDB;
+using rocks_native_t = rocksdb::DB;
+using rocks_txn_db_t = rocksdb::OptimisticTransactionDB;
 using rocks_status_t = rocksdb::Status;
 using rocks_value_t = rocksdb::PinnableSlice;
 using rocks_txn_t = rocksdb::Transaction;
@@ -74,6 +165,57 @@ struct key_comparator_t final : public rocksdb::Comparator {
 
 static key_comparator_t key_comparator_k = {};
 
+/**
+ * @brief Unites the stored neighborhood of a vertex with the blindly written ones.
+ */
+struct neighborhoods_merge_t final : public rocksdb::AssociativeMergeOperator {
+    bool Merge(rocksdb::Slice const&,
+               rocksdb::Slice const* existing_value,
+               rocksdb::Slice const& value,
+               std::string* new_value,
+               rocksdb::Logger*) const override {
+        auto view = [](rocksdb::Slice const& slice) {
+            return value_view_t {reinterpret_cast<ustore_bytes_cptr_t>(slice.data()),
+                                 static_cast<ustore_length_t>(slice.size())};
+        };
+        new_value->clear();
+        merge_neighborhoods(existing_value ? view(*existing_value) : value_view_t {}, view(value), *new_value);
+        return true;
+    }
+    const char* Name() const override { return "ustore_neighborhoods"; }
+};
+
+static std::shared_ptr<rocksdb::MergeOperator> const neighborhoods_merge_k = std::make_shared<neighborhoods_merge_t>();
+
+/**
+ * @brief Present in the directories of databases with bytewise-comparable keys.
+ */
+static constexpr char const* key_encoding_marker_k = "USTORE_BYTEWISE_KEYS";
+
+/**
+ * @brief Subdirectory of the DB directory with temporary SST files, built by bulk writes.
+ * Files left by interrupted writes are removed on every open.
+ */
+static constexpr char const* ingest_directory_k = "ustore_ingest";
+
+/**
+ * @brief How often secondary instances replay the changes of the writer by default.
+ */
+static constexpr std::size_t catch_up_interval_ms_k = 1000;
+
+/**
+ * @brief Settings of the integrated BlobDB, mirroring the `rocksdb::AdvancedColumnFamilyOptions`.
+ * Values below the @c min_size stay inline in SSTs, so small keys and counters aren't affected.
+ */
+struct rocks_blobs_config_t {
+    bool enabled = false;
+    std::size_t min_size = 4096;
+    std::size_t file_size = 256ul * 1024ul * 1024ul;
+    bool garbage_collection = false;
+    double garbage_collection_age_cutoff = 0.25;
+    double garbage_collection_force_threshold = 1.0;
+};
+
 struct rocks_snapshot_t {
     rocksdb::Snapshot const* snapshot = nullptr;
 };
@@ -82,25 +224,104 @@ struct rocks_db_t {
     std::vector<rocks_collection_t*> columns;
     std::unordered_map<ustore_size_t, rocks_snapshot_t*> snapshots;
     std::unique_ptr<rocks_native_t> native;
+    /** @brief Same as @c native for writers, and null for read-only secondary instances. */
+    rocks_txn_db_t* transactional = nullptr;
     std::mutex mutex;
+    bool bytewise_keys = false;
+    std::shared_ptr<rocksdb::TableFactory> table_factory;
+    rocks_blobs_config_t blobs;
+    std::atomic<std::size_t> ingested_files {0};
+    std::shared_ptr<rocksdb::Statistics> statistics;
+    /** @brief Smallest batch of reads to enable `async_io` for, or zero to never enable it. */
+    std::size_t async_io_min_batch = 0;
+
+    /**
+     * @brief Background thread of secondary instances, calling `TryCatchUpWithPrimary`.
+     * Sleeps on @c catch_up_cv for @c catch_up_interval between the calls.
+     * The @c catch_up_error of the last call, empty on success, is guarded by @c catch_up_mutex.
+     */
+    std::thread follower;
+    std::mutex catch_up_mutex;
+    std::condition_variable catch_up_cv;
+    std::chrono::milliseconds catch_up_interval {catch_up_interval_ms_k};
+    bool follower_stopping = false;
+    std::string catch_up_error;
+
+    /**
+     * @brief The database handle and every arena, holding values exported with
+     * `ustore_option_read_pinned_k`. The last one released closes the database.
+     */
+    std::atomic<std::size_t> holders {1};
+
+    bool is_secondary() const noexcept { return !transactional; }
+
+    rocksdb::Comparator const* comparator() const noexcept {
+        return bytewise_keys ? rocksdb::BytewiseComparator() : &key_comparator_k;
+    }
+
+    /**
+     * @brief Applies the settings shared by all collections, including the ones created later.
+     */
+    void configure(rocksdb::ColumnFamilyOptions& options) const noexcept {
+        options.comparator = comparator();
+        options.table_factory = table_factory;
+        options.merge_operator = neighborhoods_merge_k;
+        if (!blobs.enabled)
+            return;
+        options.enable_blob_files = true;
+        options.min_blob_size = blobs.min_size;
+        options.blob_file_size = blobs.file_size;
+        options.enable_blob_garbage_collection = blobs.garbage_collection;
+        options.blob_garbage_collection_age_cutoff = blobs.garbage_collection_age_cutoff;
+        options.blob_garbage_collection_force_threshold = blobs.garbage_collection_force_threshold;
+    }
 };
 
-inline rocksdb::Slice to_slice(ustore_key_t const& key) noexcept {
-    return {reinterpret_cast<char const*>(&key), sizeof(ustore_key_t)};
-}
+/**
+ * @brief Bloom filters with 10 bits per key have a false-positive rate of 1%.
+ */
+static constexpr double filter_bits_per_key_k = 10;
+static constexpr std::size_t block_cache_bytes_k = 512ul * 1024ul * 1024ul;
+
+/**
+ * @brief Scans of at least that many keys per batch use explicit, adaptive read-ahead,
+ * while shorter ones rely on the automatic one, that starts small.
+ */
+static constexpr std::size_t scan_readahead_min_keys_k = 1024;
+static constexpr std::size_t scan_readahead_bytes_k = 2ul * 1024ul * 1024ul;
+
+/**
+ * @brief A key in its on-disk representation.
+ * With bytewise encoding, keys are stored in big-endian order with a flipped sign bit,
+ * so that `memcmp` orders them the same way as signed integers.
+ */
+class rocks_key_t {
+    ustore_key_t stored_ = 0;
+
+    static std::uint64_t flip(std::uint64_t bits) noexcept {
+        return __builtin_bswap64(bits ^ (std::uint64_t(1) << 63));
+    }
+
+  public:
+    rocks_key_t() = default;
+    rocks_key_t(ustore_key_t key, bool bytewise) noexcept
+        : stored_(bytewise ? static_cast<ustore_key_t>(flip(static_cast<std::uint64_t>(key))) : key) {}
+
+    static ustore_key_t decode(char const* stored, bool bytewise) noexcept {
+        std::uint64_t bits;
+        std::memcpy(&bits, stored, sizeof(bits));
+        return static_cast<ustore_key_t>(bytewise ? __builtin_bswap64(bits) ^ (std::uint64_t(1) << 63) : bits);
+    }
+
+    operator rocksdb::Slice() const noexcept { return {reinterpret_cast<char const*>(&stored_), sizeof(stored_)}; }
+};
+
+static_assert(sizeof(ustore_key_t) == sizeof(std::uint64_t), "Key encoding assumes 64-bit keys");
 
 inline rocksdb::Slice to_slice(value_view_t value) noexcept {
     return {reinterpret_cast<const char*>(value.begin()), value.size()};
 }
 
-inline std::unique_ptr<rocks_value_t> make_value(ustore_error_t* c_error) noexcept {
-    std::unique_ptr<rocks_value_t> value_uptr;
-    safe_section("Allocating RocksDB-compatible value buffer", c_error, [&] {
-        value_uptr = std::make_unique<rocks_value_t>();
-    });
-    return value_uptr;
-}
-
 bool export_error(rocks_status_t const& status, ustore_error_t* c_error) {
     if (status.ok())
         return false;
@@ -121,6 +342,66 @@ rocks_collection_t* rocks_collection(rocks_db_t& db, ustore_collection_t collect
                                                   : reinterpret_cast<rocks_collection_t*>(collection);
 }
 
+/**
+ * @brief Replays the latest changes of the writer, remembering the outcome for the "properties" control.
+ */
+rocks_status_t catch_up(rocks_db_t& db) noexcept {
+    rocks_status_t status = db.native->TryCatchUpWithPrimary();
+    std::unique_lock lock {db.catch_up_mutex};
+    try {
+        db.catch_up_error = status.ok() ? std::string() : status.ToString();
+    }
+    catch (...) {
+        db.catch_up_error = "Failure";
+    }
+    return status;
+}
+
+void follower_loop(rocks_db_t& db) noexcept {
+    while (true) {
+        {
+            std::unique_lock lock {db.catch_up_mutex};
+            db.catch_up_cv.wait_for(lock, db.catch_up_interval, [&] { return db.follower_stopping; });
+            if (db.follower_stopping)
+                return;
+        }
+
+        catch_up(db);
+    }
+}
+
+void stop_follower(rocks_db_t& db) noexcept {
+    if (!db.follower.joinable())
+        return;
+    {
+        std::unique_lock lock {db.catch_up_mutex};
+        db.follower_stopping = true;
+    }
+    db.catch_up_cv.notify_one();
+    db.follower.join();
+}
+
+/**
+ * @brief Drops a holder of the database, closing it after the last one.
+ * Pinned values reference its memtables and cache entries, so they must be released first.
+ */
+void release_holder(rocks_db_t& db) noexcept {
+    if (--db.holders)
+        return;
+    for (rocks_collection_t* cf : db.columns)
+        db.native->DestroyColumnFamilyHandle(cf);
+    db.native.reset();
+    delete &db;
+}
+
+/**
+ * @brief Values exported with `ustore_option_read_pinned_k`, kept alive by an arena.
+ */
+struct rocks_pinned_t {
+    rocks_db_t* db = nullptr;
+    std::unique_ptr<rocks_value_t[]> values;
+};
+
 /*********************************************************/
 /*****************	    C Interface 	  ****************/
 /*********************************************************/
@@ -154,6 +435,7 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
         options.compression = rocksdb::kNoCompression;
         auto cf_options = rocksdb::ColumnFamilyOptions();
         std::vector<rocksdb::ColumnFamilyDescriptor> column_descriptors;
+        bool statistics = false;
         return_error_if_m(config.engine.config_url.empty(), c.error, args_wrong_k, "Doesn't support URL configs");
 
         // Load from file
@@ -180,6 +462,8 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
                     options.max_open_files = j_db["max_open_files"];
                 if (j_db.contains("max_file_opening_threads"))
                     options.max_file_opening_threads = j_db["max_file_opening_threads"];
+                if (j_db.contains("statistics"))
+                    statistics = j_db["statistics"];
             }
 
             if (js.contains("CFOptions")) {
@@ -205,34 +489,178 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
                         log_warning_m(
                             "We discourage general-purpose compression in favour "
                             "of modality-aware compression in UStore\n");
+
+                // Blob files are applied to the collections created later as well
+                auto& blobs = db_ptr->blobs;
+                blobs.enabled = j_cf.value("enable_blob_files", blobs.enabled);
+                blobs.garbage_collection = j_cf.value("enable_blob_garbage_collection", blobs.garbage_collection);
+                blobs.garbage_collection_age_cutoff =
+                    j_cf.value("blob_garbage_collection_age_cutoff", blobs.garbage_collection_age_cutoff);
+                blobs.garbage_collection_force_threshold =
+                    j_cf.value("blob_garbage_collection_force_threshold", blobs.garbage_collection_force_threshold);
+                return_error_if_m(config_loader_t::parse_volume(j_cf, "min_blob_size", blobs.min_size) &&
+                                      config_loader_t::parse_volume(j_cf, "blob_file_size", blobs.file_size),
+                                  c.error,
+                                  args_wrong_k,
+                                  "Invalid blob size volume");
+                return_error_if_m(blobs.garbage_collection_age_cutoff >= 0 &&
+                                      blobs.garbage_collection_age_cutoff <= 1,
+                                  c.error,
+                                  args_wrong_k,
+                                  "Blob garbage collection age cutoff must be in [0, 1]");
             }
         }
 
+        // Filters and the block cache, shared by all column families
+        rocksdb::BlockBasedTableOptions table_options;
+        std::string filter_policy = "bloom";
+        double filter_bits_per_key = filter_bits_per_key_k;
+        std::string block_cache = "lru";
+        std::size_t block_cache_size = block_cache_bytes_k;
+        table_options.cache_index_and_filter_blocks = true;
+        table_options.pin_l0_filter_and_index_blocks_in_cache = true;
+        if (config.engine.config.is_object() && config.engine.config.contains("BlockBasedTableOptions")) {
+            auto j_table = config.engine.config["BlockBasedTableOptions"];
+            filter_policy = j_table.value("filter_policy", filter_policy);
+            filter_bits_per_key = j_table.value("bits_per_key", filter_bits_per_key);
+            block_cache = j_table.value("block_cache", block_cache);
+            table_options.cache_index_and_filter_blocks =
+                j_table.value("cache_index_and_filter_blocks", table_options.cache_index_and_filter_blocks);
+            table_options.pin_l0_filter_and_index_blocks_in_cache =
+                j_table.value("pin_l0_filter_and_index_blocks_in_cache",
+                              table_options.pin_l0_filter_and_index_blocks_in_cache);
+            return_error_if_m(config_loader_t::parse_volume(j_table, "block_cache_size", block_cache_size) &&
+                                  config_loader_t::parse_volume(j_table, "block_size", table_options.block_size),
+                              c.error,
+                              args_wrong_k,
+                              "Invalid block cache volume");
+        }
+
+        return_error_if_m(filter_policy == "bloom" || filter_policy == "ribbon" || filter_policy == "none",
+                          c.error,
+                          args_wrong_k,
+                          "Filter policy can be \"bloom\", \"ribbon\" or \"none\"");
+        return_error_if_m(block_cache == "lru" || block_cache == "hyper_clock",
+                          c.error,
+                          args_wrong_k,
+                          "Block cache can be \"lru\" or \"hyper_clock\"");
+
+        if (filter_policy == "bloom")
+            table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(filter_bits_per_key));
+        else if (filter_policy == "ribbon")
+            table_options.filter_policy.reset(rocksdb::NewRibbonFilterPolicy(filter_bits_per_key));
+
+        // Hyper-clock cache needs an estimate of the entry size, which is the block size
+        if (block_cache == "lru")
+            table_options.block_cache = rocksdb::NewLRUCache(block_cache_size);
+        else
+            table_options.block_cache =
+                rocksdb::HyperClockCacheOptions(block_cache_size, table_options.block_size).MakeSharedCache();
+        db_ptr->table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
         rocksdb::ConfigOptions config_options;
         status = rocksdb::LoadLatestOptions(config_options, root, &options, &column_descriptors);
         return_error_if_m(status.ok() || status.IsNotFound(), c.error, error_unknown_k, "Recovering RocksDB state");
 
-        cf_options.comparator = &key_comparator_k;
+        // Existing databases define their key encoding, new ones follow the config
+        bool const is_new = status.IsNotFound();
+        std::string key_encoding = is_new ? "bytewise" : "native";
+        if (!is_new && stdfs::exists(root / key_encoding_marker_k))
+            key_encoding = "bytewise";
+        std::string requested_encoding = key_encoding;
+        if (config.engine.config.is_object())
+            requested_encoding = config.engine.config.value("key_encoding", key_encoding);
+        return_error_if_m(requested_encoding == "bytewise" || requested_encoding == "native",
+                          c.error,
+                          args_wrong_k,
+                          "Key encoding can be either \"bytewise\" or \"native\"");
+        return_error_if_m(is_new || requested_encoding == key_encoding,
+                          c.error,
+                          args_wrong_k,
+                          "Key encoding differs from the existing database, use `ustore_migrate` to convert it");
+        db_ptr->bytewise_keys = requested_encoding == "bytewise";
+        if (config.engine.config.is_object())
+            db_ptr->async_io_min_batch =
+                config.engine.config.value("async_io_min_batch", db_ptr->async_io_min_batch);
+
+        // Read-only instances, following the writer of the same root
+        std::string secondary_directory;
+        std::size_t catch_up_interval_ms = catch_up_interval_ms_k;
+        if (config.engine.config.is_object()) {
+            secondary_directory = config.engine.config.value("secondary_directory", secondary_directory);
+            catch_up_interval_ms = config.engine.config.value("catch_up_interval_ms", catch_up_interval_ms);
+        }
+        bool const is_secondary = !secondary_directory.empty();
+        return_error_if_m(!is_secondary || !is_new,
+                          c.error,
+                          args_wrong_k,
+                          "Secondary instances can only follow an existing database");
+        db_ptr->catch_up_interval = std::chrono::milliseconds(catch_up_interval_ms);
+
+        // The marker of a new database is created before the database itself, so that no crash can leave
+        // bytewise keys without it. Opening syncs the directory, making the marker durable with the rest.
+        // A stale one may remain from a creation, that failed earlier, and must not outlive it.
+        if (is_new) {
+            std::error_code removal_error;
+            stdfs::remove(root / key_encoding_marker_k, removal_error);
+            if (db_ptr->bytewise_keys) {
+                std::ofstream marker(root / key_encoding_marker_k);
+                return_error_if_m(marker.good(), c.error, error_unknown_k, "Couldn't persist the key encoding");
+            }
+        }
+
+        db_ptr->configure(cf_options);
         if (column_descriptors.empty())
             column_descriptors.push_back({rocksdb::kDefaultColumnFamilyName, std::move(cf_options)});
         else {
             for (auto& column_descriptor : column_descriptors)
-                column_descriptor.options.comparator = &key_comparator_k;
+                db_ptr->configure(column_descriptor.options);
         }
 
         options.create_if_missing = true;
-        options.comparator = &key_comparator_k;
+        db_ptr->configure(options);
+
+        // Tickers and histograms, exported through `ustore_database_control`
+        if (statistics) {
+            db_ptr->statistics = rocksdb::CreateDBStatistics();
+            options.statistics = db_ptr->statistics;
+        }
 
         // Storage paths
         for (auto const& disk : config.data_directories)
             options.db_paths.push_back({disk.path, disk.max_size});
 
-        rocks_native_t* native_db = nullptr;
-        rocksdb::OptimisticTransactionDBOptions txn_options;
-        status = rocks_native_t::Open(options, txn_options, root, column_descriptors, &db_ptr->columns, &native_db);
-        return_error_if_m(status.ok(), c.error, error_unknown_k, "Opening RocksDB with options");
+        // Only writers build SST files for bulk loads
+        if (!is_secondary) {
+            std::error_code scratch_error;
+            stdfs::remove_all(root / ingest_directory_k, scratch_error);
+            stdfs::create_directories(root / ingest_directory_k, scratch_error);
+            return_error_if_m(!scratch_error, c.error, error_unknown_k, "Couldn't prepare the bulk loads directory");
+        }
 
-        db_ptr->native = std::unique_ptr<rocks_native_t>(native_db);
+        if (is_secondary) {
+            // Secondaries must keep all the files open, as the writer may delete them at any time
+            options.max_open_files = -1;
+            rocks_native_t* native_db = nullptr;
+            status = rocks_native_t::OpenAsSecondary(options,
+                                                     root,
+                                                     secondary_directory,
+                                                     column_descriptors,
+                                                     &db_ptr->columns,
+                                                     &native_db);
+            return_error_if_m(status.ok(), c.error, error_unknown_k, "Opening RocksDB as a secondary instance");
+            db_ptr->native = std::unique_ptr<rocks_native_t>(native_db);
+            if (catch_up_interval_ms)
+                db_ptr->follower = std::thread(follower_loop, std::ref(*db_ptr));
+        }
+        else {
+            rocks_txn_db_t* native_db = nullptr;
+            rocksdb::OptimisticTransactionDBOptions txn_options;
+            status = rocks_txn_db_t::Open(options, txn_options, root, column_descriptors, &db_ptr->columns, &native_db);
+            return_error_if_m(status.ok(), c.error, error_unknown_k, "Opening RocksDB with options");
+            db_ptr->native = std::unique_ptr<rocks_native_t>(native_db);
+            db_ptr->transactional = native_db;
+        }
         *c.db = db_ptr;
     });
 }
@@ -266,6 +694,29 @@ void ustore_snapshot_create(ustore_snapshot_create_t* c_ptr) {
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
 
     rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c.db);
+    return_error_if_m(!db.is_secondary(), c.error, missing_feature_k, "Secondary instances don't support snapshots");
+
+    // Flushes the memtables and hard-links the files, so we don't hold the lock
+    if (c.directory) {
+        safe_section("Creating a checkpoint", c.error, [&] {
+            rocksdb::Checkpoint* checkpoint_ptr = nullptr;
+            rocks_status_t status = rocksdb::Checkpoint::Create(db.native.get(), &checkpoint_ptr);
+            if (export_error(status, c.error))
+                return;
+            std::unique_ptr<rocksdb::Checkpoint> checkpoint {checkpoint_ptr};
+            status = checkpoint->CreateCheckpoint(c.directory);
+            if (export_error(status, c.error))
+                return;
+
+            // The key encoding isn't a part of the RocksDB state, so the marker is copied separately
+            if (db.bytewise_keys) {
+                std::ofstream marker(stdfs::path(c.directory) / key_encoding_marker_k);
+                return_error_if_m(marker.good(), c.error, error_unknown_k, "Couldn't persist the key encoding");
+            }
+        });
+        return_if_error_m(c.error);
+    }
+
     std::lock_guard<std::mutex> locker(db.mutex);
     auto it = db.snapshots.find(*c.id);
     if (it != db.snapshots.end())
@@ -316,6 +767,7 @@ void write_one( //
 
     bool const safe = c_options & ustore_option_write_flush_k;
     bool const watch = !(c_options & ustore_option_transaction_dont_watch_k);
+    bool const merge = c_options & ustore_option_write_merge_neighborhoods_k;
 
     rocksdb::WriteOptions options;
     options.sync = safe;
@@ -324,7 +776,8 @@ void write_one( //
     auto place = places[0];
     auto content = contents[0];
     auto collection = rocks_collection(db, place.collection);
-    auto key = to_slice(place.key);
+    rocks_key_t const encoded_key {place.key, db.bytewise_keys};
+    rocksdb::Slice key = encoded_key;
     rocks_status_t status;
 
     if (txn_ptr)
@@ -333,6 +786,9 @@ void write_one( //
                 ? watch //
                       ? txn_ptr->Delete(collection, key)
                       : txn_ptr->DeleteUntracked(collection, key)
+                : merge ? watch //
+                              ? txn_ptr->Merge(collection, key, to_slice(content))
+                              : txn_ptr->MergeUntracked(collection, key, to_slice(content))
                 : watch //
                       ? txn_ptr->Put(collection, key, to_slice(content))
                       : txn_ptr->PutUntracked(collection, key, to_slice(content));
@@ -340,7 +796,8 @@ void write_one( //
         status =     //
             !content //
                 ? db.native->Delete(options, collection, key)
-                : db.native->Put(options, collection, key, to_slice(content));
+                : merge ? db.native->Merge(options, collection, key, to_slice(content))
+                        : db.native->Put(options, collection, key, to_slice(content));
 
     export_error(status, c_error);
 }
@@ -355,6 +812,7 @@ void write_many( //
 
     bool const safe = c_options & ustore_option_write_flush_k;
     bool const watch = !(c_options & ustore_option_transaction_dont_watch_k);
+    bool const merge = c_options & ustore_option_write_merge_neighborhoods_k;
 
     rocksdb::WriteOptions options;
     options.sync = safe;
@@ -365,12 +823,16 @@ void write_many( //
             auto place = places[i];
             auto content = contents[i];
             auto collection = rocks_collection(db, place.collection);
-            auto key = to_slice(place.key);
+            rocks_key_t const encoded_key {place.key, db.bytewise_keys};
+            rocksdb::Slice key = encoded_key;
             auto status =   //
                 !content    //
                     ? watch //
                           ? txn_ptr->Delete(collection, key)
                           : txn_ptr->DeleteUntracked(collection, key)
+                    : merge ? watch //
+                                  ? txn_ptr->Merge(collection, key, to_slice(content))
+                                  : txn_ptr->MergeUntracked(collection, key, to_slice(content))
                     : watch //
                           ? txn_ptr->Put(collection, key, to_slice(content))
                           : txn_ptr->PutUntracked(collection, key, to_slice(content));
@@ -384,10 +846,12 @@ void write_many( //
             auto place = places[i];
             auto content = contents[i];
             auto collection = rocks_collection(db, place.collection);
-            auto key = to_slice(place.key);
+            rocks_key_t const encoded_key {place.key, db.bytewise_keys};
+            rocksdb::Slice key = encoded_key;
             auto status = !content //
                               ? batch.Delete(collection, key)
-                              : batch.Put(collection, key, to_slice(content));
+                              : merge ? batch.Merge(collection, key, to_slice(content))
+                                      : batch.Put(collection, key, to_slice(content));
             export_error(status, c_error);
         }
 
@@ -396,6 +860,104 @@ void write_many( //
     }
 }
 
+/**
+ * @brief Sorts the batch and writes every collection's share into a separate SST file.
+ * All the files are then moved into the LSM tree at once, so either all or none of the
+ * collections change. Bypasses the memtable and the WAL, and spares compactions,
+ * when the keys don't overlap with the stored ones.
+ */
+void write_bulk( //
+    rocks_db_t& db,
+    places_arg_t const& places,
+    contents_arg_t const& contents,
+    ustore_options_t const c_options,
+    ustore_error_t* c_error) noexcept(false) {
+
+    bool const merge = c_options & ustore_option_write_merge_neighborhoods_k;
+
+    // SST files must be sorted and can't contain duplicates,
+    // so of the repeated keys, we only keep the latest state.
+    std::vector<std::size_t> order(places.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        auto place_a = places[a];
+        auto place_b = places[b];
+        return place_a.collection != place_b.collection ? place_a.collection < place_b.collection
+                                                        : place_a.key < place_b.key;
+    });
+
+    // On success, the files are already linked into the DB directory
+    std::vector<rocksdb::IngestExternalFileArg> ingested;
+    auto remove_files = [&]() noexcept {
+        std::error_code ignored;
+        for (auto const& arg : ingested)
+            for (auto const& path : arg.external_files)
+                stdfs::remove(path, ignored);
+    };
+
+    std::string merged, folded;
+    for (std::size_t begin = 0; begin != order.size();) {
+        ustore_collection_t const collection_id = places[order[begin]].collection;
+        std::size_t end = begin;
+        while (end != order.size() && places[order[end]].collection == collection_id)
+            ++end;
+
+        auto collection = rocks_collection(db, collection_id);
+        rocksdb::Options options = db.native->GetOptions(collection);
+        rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), options, collection);
+        std::string path = db.native->GetName() + "/" + ingest_directory_k + "/" +
+                           std::to_string(db.ingested_files.fetch_add(1)) + ".sst";
+        rocksdb::IngestExternalFileArg& arg = ingested.emplace_back();
+        arg.column_family = collection;
+        arg.external_files.push_back(path);
+        arg.options.move_files = true;
+        rocks_status_t status = writer.Open(path);
+        if (export_error(status, c_error))
+            return remove_files();
+
+        for (std::size_t i = begin; i != end;) {
+            ustore_key_t const key_id = places[order[i]].key;
+            std::size_t next = i + 1;
+            while (next != end && places[order[next]].key == key_id)
+                ++next;
+
+            rocks_key_t const encoded_key {key_id, db.bytewise_keys};
+            rocksdb::Slice key = encoded_key;
+            auto last = contents[order[next - 1]];
+            if (!last)
+                status = writer.Delete(key);
+            else if (!merge)
+                status = writer.Put(key, to_slice(last));
+            else {
+                // Fold the merges following the last removal of the key
+                std::size_t first = next - 1;
+                while (first != i && contents[order[first - 1]])
+                    --first;
+                merged.clear();
+                for (std::size_t j = first; j != next; ++j) {
+                    folded.clear();
+                    merge_neighborhoods(std::string_view(merged), contents[order[j]], folded);
+                    std::swap(merged, folded);
+                }
+                bool const removed = first != i;
+                status = removed ? writer.Put(key, merged) : writer.Merge(key, merged);
+            }
+            if (export_error(status, c_error))
+                break;
+            i = next;
+        }
+
+        if (!*c_error)
+            export_error(writer.Finish(), c_error);
+        if (*c_error)
+            return remove_files();
+        begin = end;
+    }
+
+    export_error(db.native->IngestExternalFiles(ingested), c_error);
+    remove_files();
+}
+
 void ustore_write(ustore_write_t* c_ptr) {
 
     ustore_write_t& c = *c_ptr;
@@ -417,8 +979,11 @@ void ustore_write(ustore_write_t* c_ptr) {
 
     validate_write(c.transaction, places, contents, c.options, c.error);
     return_if_error_m(c.error);
+    return_error_if_m(!db.is_secondary(), c.error, missing_feature_k, "Secondary instances are read-only");
 
     safe_section("Writing into RocksDB", c.error, [&] {
+        if (c.options & ustore_option_write_bulk_k)
+            return write_bulk(db, places, contents, c.options, c.error);
         auto func = c.tasks_count == 1 ? &write_one : &write_many;
         func(db, &txn, places, contents, c.options, c.error);
     });
@@ -431,6 +996,7 @@ void read_one( //
     rocks_snapshot_t* snap_ptr,
     places_arg_t places,
     ustore_options_t const c_options,
+    rocks_value_t* values,
     value_enumerator_at enumerator,
     ustore_error_t* c_error) noexcept(false) {
 
@@ -445,11 +1011,10 @@ void read_one( //
 
     place_t place = places[0];
     auto col = rocks_collection(db, place.collection);
-    auto key = to_slice(place.key);
-    auto value_uptr = make_value(c_error);
-    return_if_error_m(c_error);
+    rocks_key_t const encoded_key {place.key, db.bytewise_keys};
+    rocksdb::Slice key = encoded_key;
 
-    rocks_value_t& value = *value_uptr.get();
+    rocks_value_t& value = values[0];
     rocks_status_t status = //
         txn_ptr             //
             ? watch         //
@@ -467,6 +1032,11 @@ void read_one( //
         enumerator(0, value_view_t {});
 }
 
+/**
+ * @brief Uses the batched `MultiGet`, which shares the index lookups and
+ * the IO between keys. The @p values stay pinned in the block cache, if possible.
+ * Transactions only support it for a single collection, when the keys aren't watched.
+ */
 template <typename value_enumerator_at>
 void read_many( //
     rocks_db_t& db,
@@ -474,10 +1044,13 @@ void read_many( //
     rocks_snapshot_t* snap_ptr,
     places_arg_t places,
     ustore_options_t const c_options,
+    linked_memory_lock_t& arena,
+    rocks_value_t* values,
     value_enumerator_at enumerator,
     ustore_error_t* c_error) noexcept(false) {
 
     rocksdb::ReadOptions options;
+    options.async_io = db.async_io_min_batch && places.size() >= db.async_io_min_batch;
     if (snap_ptr) {
         auto it = db.snapshots.find(reinterpret_cast<std::size_t>(snap_ptr));
         return_error_if_m(it != db.snapshots.end(), c_error, args_wrong_k, "The snapshot does'nt exist!");
@@ -485,27 +1058,44 @@ void read_many( //
     }
 
     bool watch = !(c_options & ustore_option_transaction_dont_watch_k);
-    std::vector<rocks_collection_t*> cols(places.count);
-    std::vector<rocksdb::Slice> keys(places.count);
-    std::vector<std::string> vals(places.count);
+    auto cols = arena.alloc<rocks_collection_t*>(places.count, c_error);
+    return_if_error_m(c_error);
+    auto encoded_keys = arena.alloc<rocks_key_t>(places.count, c_error);
+    return_if_error_m(c_error);
+    auto keys = arena.alloc<rocksdb::Slice>(places.count, c_error);
+    return_if_error_m(c_error);
+
+    // Sorted inputs save `MultiGet` from sorting them again
+    bool sorted = true;
+    bool same_collection = true;
     for (std::size_t i = 0; i != places.size(); ++i) {
         place_t place = places[i];
         cols[i] = rocks_collection(db, place.collection);
-        keys[i] = to_slice(place.key);
+        new (&encoded_keys[i]) rocks_key_t(place.key, db.bytewise_keys);
+        new (&keys[i]) rocksdb::Slice(encoded_keys[i]);
+        if (!i)
+            continue;
+        same_collection &= cols[i] == cols[0];
+        sorted &= cols[i - 1] == cols[i] ? places[i - 1].key < place.key : cols[i - 1]->GetID() < cols[i]->GetID();
     }
 
-    std::vector<rocks_status_t> statuses = //
-        txn_ptr                            //
-            ? watch                        //
-                  ? txn_ptr->MultiGetForUpdate(options, cols, keys, &vals)
-                  : txn_ptr->MultiGet(options, cols, keys, &vals)
-            : db.native->MultiGet(options, cols, keys, &vals);
+    std::unique_ptr<rocks_status_t[]> statuses {new rocks_status_t[places.count]};
+    if (!txn_ptr)
+        db.native->MultiGet(options, places.count, cols.begin(), keys.begin(), values, statuses.get(), sorted);
+    else if (!watch && same_collection)
+        txn_ptr->MultiGet(options, cols[0], places.count, keys.begin(), values, statuses.get(), sorted);
+    else
+        for (std::size_t i = 0; i != places.size(); ++i)
+            statuses[i] = watch //
+                              ? txn_ptr->GetForUpdate(options, cols[i], keys[i], &values[i])
+                              : txn_ptr->Get(options, cols[i], keys[i], &values[i]);
+
     for (std::size_t i = 0; i != places.size(); ++i) {
         if (!statuses[i].IsNotFound()) {
             if (export_error(statuses[i], c_error))
                 return;
-            auto begin = reinterpret_cast<ustore_bytes_cptr_t>(vals[i].data());
-            auto length = static_cast<ustore_length_t>(vals[i].size());
+            auto begin = reinterpret_cast<ustore_bytes_cptr_t>(values[i].data());
+            auto length = static_cast<ustore_length_t>(values[i].size());
             enumerator(i, value_view_t {begin, length});
         }
         else
@@ -534,35 +1124,71 @@ void ustore_read(ustore_read_t* c_ptr) {
     validate_read(c.transaction, places, c.options, c.error);
     return_if_error_m(c.error);
 
-    // 1. Allocate a tape for all the values to be pulled
-    auto offs = arena.alloc_or_dummy(places.count + 1, c.error, c.offsets);
-    return_if_error_m(c.error);
+    // 1. Allocate the metadata outputs
+    bool const pinned = (c.options & ustore_option_read_pinned_k) && c.addresses;
     auto lens = arena.alloc_or_dummy(places.count, c.error, c.lengths);
     return_if_error_m(c.error);
     auto presences = arena.alloc_or_dummy(places.count, c.error, c.presences);
     return_if_error_m(c.error);
-    uninitialized_array_gt<byte_t> contents(arena);
+    auto addresses = arena.alloc_or_dummy(places.count, c.error, pinned ? c.addresses : nullptr);
+    return_if_error_m(c.error);
 
-    // 2. Pull metadata & data in one run, as reading from disk is expensive
-    bool const needs_export = c.values != nullptr;
-    auto data_enumerator = [&](std::size_t i, value_view_t value) {
+    // 2. Pull the values, pinned in the block cache, when possible
+    std::unique_ptr<rocks_value_t[]> values;
+    std::size_t total_bytes = 0;
+    auto metadata_enumerator = [&](std::size_t i, value_view_t value) {
         presences[i] = bool(value);
         lens[i] = value ? value.size() : ustore_length_missing_k;
-        if (needs_export) {
-            offs[i] = contents.size();
-            contents.insert(contents.size(), value.begin(), value.end(), c.error);
-        }
+        addresses[i] = reinterpret_cast<ustore_bytes_cptr_t>(value.data());
+        total_bytes += value.size();
     };
 
     safe_section("Reading from RocksDB", c.error, [&] {
-        c.tasks_count == 1 //
-            ? read_one(db, &txn, &snap, places, c.options, data_enumerator, c.error)
-            : read_many(db, &txn, &snap, places, c.options, data_enumerator, c.error);
-        offs[places.count] = contents.size();
-
-        if (needs_export)
-            *c.values = reinterpret_cast<ustore_bytes_ptr_t>(contents.begin());
+        values.reset(new rocks_value_t[places.count]);
+        c.tasks_count == 1
+            ? read_one(db, &txn, &snap, places, c.options, values.get(), metadata_enumerator, c.error)
+            : read_many(db, &txn, &snap, places, c.options, arena, values.get(), metadata_enumerator, c.error);
     });
+    return_if_error_m(c.error);
+
+    // 3. Either keep the values pinned until the arena is reused, or copy them once into the tape
+    if (pinned) {
+        auto unpin = [](void* payload) noexcept {
+            auto pinned = reinterpret_cast<rocks_pinned_t*>(payload);
+            rocks_db_t& db = *pinned->db;
+            delete pinned;
+            release_holder(db);
+        };
+        std::unique_ptr<rocks_pinned_t> pinned_values {new (std::nothrow) rocks_pinned_t {&db, std::move(values)}};
+        return_error_if_m(pinned_values && arena.memory.on_release(unpin, pinned_values.get()),
+                          c.error,
+                          out_of_memory_k,
+                          "Failed to pin values");
+        ++db.holders;
+        pinned_values.release();
+        if (c.offsets)
+            *c.offsets = nullptr;
+        if (c.values)
+            *c.values = nullptr;
+        return;
+    }
+
+    auto offs = arena.alloc_or_dummy(places.count + 1, c.error, c.offsets);
+    return_if_error_m(c.error);
+    auto contents = arena.alloc<byte_t>(c.values ? total_bytes : 0, c.error);
+    return_if_error_m(c.error);
+
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i != places.size(); ++i) {
+        offs[i] = static_cast<ustore_length_t>(offset);
+        if (c.values && values[i].size()) {
+            std::memcpy(contents.begin() + offset, values[i].data(), values[i].size());
+            offset += values[i].size();
+        }
+    }
+    offs[places.count] = static_cast<ustore_length_t>(offset);
+    if (c.values)
+        *c.values = reinterpret_cast<ustore_bytes_ptr_t>(contents.begin());
 }
 
 void ustore_scan(ustore_scan_t* c_ptr) {
@@ -579,7 +1205,8 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_length_t const> limits {c.count_limits, c.count_limits_stride};
-    scans_arg_t tasks {collections, start_keys, limits, c.tasks_count};
+    strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
+    scans_arg_t tasks {collections, start_keys, limits, c.tasks_count, end_keys};
 
     validate_scan(c.transaction, tasks, c.options, c.error);
     return_if_error_m(c.error);
@@ -594,6 +1221,13 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     auto keys_output = *c.keys = arena.alloc<ustore_key_t>(total_keys, c.error).begin();
     return_if_error_m(c.error);
 
+    bool const export_values = c.value_offsets || c.value_lengths || c.values;
+    growing_tape_t tape(arena);
+    if (export_values) {
+        tape.reserve(total_keys, c.error);
+        return_if_error_m(c.error);
+    }
+
     // 2. Fetch the data
     rocksdb::ReadOptions options;
     options.fill_cache = false;
@@ -601,33 +1235,148 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     if (c.snapshot)
         options.snapshot = snap.snapshot;
 
+    // Long scans prefetch larger chunks, growing the read-ahead as they proceed
+    if (total_keys >= scan_readahead_min_keys_k) {
+        options.readahead_size = scan_readahead_bytes_k;
+        options.adaptive_readahead = true;
+    }
+
+    // Consecutive tasks in the same collection and with the same bound share an iterator.
+    // The bound must outlive it, and lets RocksDB skip the tombstones past the range.
+    std::unique_ptr<rocksdb::Iterator> it;
+    rocks_collection_t* it_collection = nullptr;
+    ustore_key_t it_max_key = 0;
+    rocks_key_t upper_bound;
+    rocksdb::Slice upper_bound_slice;
+
     for (ustore_size_t i = 0; i != c.tasks_count; ++i) {
         scan_t task = tasks[i];
         auto collection = rocks_collection(db, task.collection);
-
-        std::unique_ptr<rocksdb::Iterator> it;
-        safe_section("Creating a RocksDB iterator", c.error, [&] {
-            it = c.transaction //
-                     ? std::unique_ptr<rocksdb::Iterator>(txn.GetIterator(options, collection))
-                     : std::unique_ptr<rocksdb::Iterator>(db.native->NewIterator(options, collection));
-        });
-        return_if_error_m(c.error);
-
         offsets[i] = keys_output - *c.keys;
+        counts[i] = 0;
+        if (!task.limit)
+            continue;
+
+        if (!it || it_collection != collection || it_max_key != task.max_key) {
+            it.reset();
+            bool const bounded = task.max_key != std::numeric_limits<ustore_key_t>::max();
+            upper_bound = rocks_key_t {bounded ? task.max_key + 1 : task.max_key, db.bytewise_keys};
+            upper_bound_slice = upper_bound;
+            options.iterate_upper_bound = bounded ? &upper_bound_slice : nullptr;
+            safe_section("Creating a RocksDB iterator", c.error, [&] {
+                it = c.transaction //
+                         ? std::unique_ptr<rocksdb::Iterator>(txn.GetIterator(options, collection))
+                         : std::unique_ptr<rocksdb::Iterator>(db.native->NewIterator(options, collection));
+            });
+            return_if_error_m(c.error);
+            it_collection = collection;
+            it_max_key = task.max_key;
+        }
 
         ustore_size_t j = 0;
-        it->Seek(to_slice(task.min_key));
-        while (it->Valid() && j != task.limit) {
-            std::memcpy(keys_output, it->key().data(), sizeof(ustore_key_t));
+        it->Seek(rocks_key_t {task.min_key, db.bytewise_keys});
+        for (; it->Valid() && j != task.limit; ++j, it->Next()) {
+            *keys_output = rocks_key_t::decode(it->key().data(), db.bytewise_keys);
             ++keys_output;
-            ++j;
-            it->Next();
+            if (export_values) {
+                rocksdb::Slice value = it->value();
+                tape.push_back(value_view_t(value.data(), value.size()), c.error);
+                return_if_error_m(c.error);
+            }
         }
+        if (export_error(it->status(), c.error))
+            return;
 
         counts[i] = j;
     }
 
     offsets[tasks.size()] = keys_output - *c.keys;
+
+    // 3. Export the values
+    if (c.value_offsets)
+        *c.value_offsets = tape.offsets().begin().get();
+    if (c.value_lengths)
+        *c.value_lengths = tape.lengths().begin().get();
+    if (c.values)
+        *c.values = (ustore_bytes_ptr_t)tape.contents().begin().get();
+}
+
+/**
+ * @brief Collections with fewer entries than that many times the sample size
+ * are sampled with a full scan, which is exact and cheap at that scale.
+ */
+static constexpr std::size_t seek_sampling_min_ratio_k = 16;
+static constexpr std::size_t seek_sampling_rounds_k = 4;
+
+/**
+ * @brief Samples distinct keys with random seeks, instead of a full scan.
+ * Seek targets are uniform across the key span. If @p weighted, the span is first
+ * split into the ranges of SST files and memtables, picked proportionally to their
+ * entry counts, which compensates for uneven key distributions.
+ * @return false, if not enough distinct keys were met.
+ */
+bool sample_with_seeks( //
+    rocks_db_t& db,
+    rocks_collection_t* collection,
+    rocksdb::Iterator& it,
+    bool weighted,
+    ptr_range_gt<ustore_key_t> sampled_keys,
+    std::mt19937_64& generator) noexcept(false) {
+
+    auto decode = [&](rocksdb::Slice const& key) { return rocks_key_t::decode(key.data(), db.bytewise_keys); };
+    it.SeekToFirst();
+    if (!it.Valid())
+        return false;
+    ustore_key_t const min_key = decode(it.key());
+    it.SeekToLast();
+    ustore_key_t const max_key = decode(it.key());
+
+    struct span_t {
+        ustore_key_t min;
+        ustore_key_t max;
+    };
+    std::vector<span_t> spans {{min_key, max_key}};
+    std::vector<double> weights {1};
+    if (weighted) {
+        // Memtables have no key bounds, so their entries are spread across the whole span
+        std::uint64_t active_entries = 0, immutable_entries = 0;
+        db.native->GetIntProperty(collection, "rocksdb.num-entries-active-mem-table", &active_entries);
+        db.native->GetIntProperty(collection, "rocksdb.num-entries-imm-mem-tables", &immutable_entries);
+        weights[0] = static_cast<double>(active_entries + immutable_entries);
+
+        rocksdb::ColumnFamilyMetaData metadata;
+        db.native->GetColumnFamilyMetaData(collection, &metadata);
+        for (auto const& level : metadata.levels) {
+            for (auto const& file : level.files) {
+                span_t span {std::max(decode(file.smallestkey), min_key),
+                             std::min(decode(file.largestkey), max_key)};
+                if (span.min > span.max || file.num_entries <= file.num_deletions)
+                    continue;
+                spans.push_back(span);
+                weights.push_back(static_cast<double>(file.num_entries - file.num_deletions));
+            }
+        }
+        if (spans.size() == 1)
+            weights[0] = 1;
+    }
+
+    std::discrete_distribution<std::size_t> pick_span(weights.begin(), weights.end());
+    std::size_t count = 0;
+    for (std::size_t round = 0; round != seek_sampling_rounds_k && count != sampled_keys.size(); ++round) {
+        for (; count != sampled_keys.size(); ++count) {
+            span_t span = spans[pick_span(generator)];
+            std::uniform_int_distribution<ustore_key_t> pick_key(span.min, span.max);
+            rocks_key_t const target {pick_key(generator), db.bytewise_keys};
+            it.Seek(target);
+            if (!it.Valid())
+                return false;
+            sampled_keys[count] = decode(it.key());
+        }
+        // Seeks into the same gap land on the same key
+        std::sort(sampled_keys.begin(), sampled_keys.begin() + count);
+        count = std::unique(sampled_keys.begin(), sampled_keys.begin() + count) - sampled_keys.begin();
+    }
+    return count == sampled_keys.size();
 }
 
 void ustore_sample(ustore_sample_t* c_ptr) {
@@ -664,6 +1413,9 @@ void ustore_sample(ustore_sample_t* c_ptr) {
     if (c.snapshot)
         options.snapshot = snap.snapshot;
 
+    bool const weighted = c.options & ustore_option_sample_weighted_k;
+    std::mt19937_64 generator(std::random_device {}());
+
     for (std::size_t task_idx = 0; task_idx != samples.count; ++task_idx) {
         sample_arg_t task = samples[task_idx];
         auto collection = rocks_collection(db, task.collection);
@@ -678,7 +1430,23 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         return_if_error_m(c.error);
 
         ptr_range_gt<ustore_key_t> sampled_keys(keys_output, task.limit);
-        reservoir_sample_iterator(it, sampled_keys, c.error);
+        bool sampled = false;
+        safe_section("Sampling with RocksDB seeks", c.error, [&] {
+            std::uint64_t estimated_keys = 0;
+            bool const large =
+                db.native->GetIntProperty(collection, "rocksdb.estimate-num-keys", &estimated_keys) &&
+                estimated_keys / seek_sampling_min_ratio_k > task.limit;
+            sampled = large && sample_with_seeks(db, collection, *it, weighted, sampled_keys, generator);
+        });
+        return_if_error_m(c.error);
+
+        if (!sampled) {
+            auto decode = [&](rocksdb::Slice const& key) noexcept {
+                return rocks_key_t::decode(key.data(), db.bytewise_keys);
+            };
+            reservoir_sample_iterator(it, sampled_keys, c.error, decode);
+            return_if_error_m(c.error);
+        }
 
         counts[task_idx] = task.limit;
         keys_output += task.limit;
@@ -712,19 +1480,23 @@ void ustore_measure(ustore_measure_t* c_ptr) {
     uint64_t approximate_size = 0;
     uint64_t keys_count = 0;
     uint64_t sst_files_size = 0;
+    uint64_t blob_files_size = 0;
     rocks_status_t status;
 
     for (ustore_size_t i = 0; i != c.tasks_count; ++i) {
         auto collection = rocks_collection(db, collections[i]);
-        ustore_key_t const min_key = start_keys[i];
-        ustore_key_t const max_key = end_keys[i];
-        range = rocksdb::Range(to_slice(min_key), to_slice(max_key));
+        rocks_key_t const min_key {start_keys[i], db.bytewise_keys};
+        rocks_key_t const max_key {end_keys[i], db.bytewise_keys};
+        range = rocksdb::Range(min_key, max_key);
         safe_section("Retrieving properties from RocksDB", c.error, [&] {
             status = db.native->GetApproximateSizes(options, collection, &range, 1, &approximate_size);
             if (export_error(status, c.error))
                 return;
             db.native->GetIntProperty(collection, "rocksdb.estimate-num-keys", &keys_count);
             db.native->GetIntProperty(collection, "rocksdb.total-sst-files-size", &sst_files_size);
+            // Approximate sizes only cover the references to blobs, so they only extend the upper bound
+            if (!db.native->GetIntProperty(collection, "rocksdb.total-blob-file-size", &blob_files_size))
+                blob_files_size = 0;
         });
         return_if_error_m(c.error);
 
@@ -733,7 +1505,7 @@ void ustore_measure(ustore_measure_t* c_ptr) {
         min_value_bytes[i] = static_cast<ustore_size_t>(0);
         max_value_bytes[i] = std::numeric_limits<ustore_size_t>::max();
         min_space_usages[i] = approximate_size;
-        max_space_usages[i] = sst_files_size;
+        max_space_usages[i] = sst_files_size + blob_files_size;
     }
 }
 
@@ -745,6 +1517,7 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
 
     rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c.db);
+    return_error_if_m(!db.is_secondary(), c.error, missing_feature_k, "Secondary instances are read-only");
 
     for (auto handle : db.columns) {
         if (handle)
@@ -753,7 +1526,7 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
 
     rocks_collection_t* collection = nullptr;
     auto cf_options = rocksdb::ColumnFamilyOptions();
-    cf_options.comparator = &key_comparator_k;
+    db.configure(cf_options);
     rocks_status_t status = db.native->CreateColumnFamily(std::move(cf_options), c.name, &collection);
     if (!export_error(status, c.error)) {
         db.columns.push_back(collection);
@@ -773,6 +1546,7 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
                       "Default collection can't be invalidated.");
 
     rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c.db);
+    return_error_if_m(!db.is_secondary(), c.error, missing_feature_k, "Secondary instances are read-only");
     rocks_collection_t* collection_ptr = reinterpret_cast<rocks_collection_t*>(c.id);
     rocks_collection_t* collection_ptr_to_clear = nullptr;
 
@@ -868,11 +1642,168 @@ void ustore_collection_list(ustore_collection_list_t* c_ptr) {
     offs[i] = static_cast<ustore_length_t>(names - *c.names);
 }
 
+/**
+ * @brief Exports the integer properties of a column family, skipping the unavailable ones.
+ */
+void export_properties(rocks_db_t& db,
+                       rocks_collection_t* collection,
+                       std::initializer_list<std::pair<char const*, char const*>> names,
+                       nlohmann::json& exported) {
+    std::uint64_t value = 0;
+    for (auto const& [name, property] : names)
+        if (db.native->GetIntProperty(collection, property, &value))
+            exported[name] = value;
+}
+
 void ustore_database_control(ustore_database_control_t* c_ptr) {
 
     ustore_database_control_t& c = *c_ptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(c.request, c.error, uninitialized_state_k, "Request is uninitialized");
+
     *c.response = NULL;
-    *c.error = "Controls aren't supported in this implementation!";
+    rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c.db);
+    std::string_view request {c.request};
+    nlohmann::json response = nlohmann::json::object();
+
+    if (request == "statistics") {
+        return_error_if_m(db.statistics,
+                          c.error,
+                          missing_feature_k,
+                          "Statistics are disabled, enable them in \"DBOptions\"");
+        safe_section("Collecting RocksDB statistics", c.error, [&] {
+            auto& tickers = response["tickers"] = nlohmann::json::object();
+            for (auto const& [ticker, name] : rocksdb::TickersNameMap)
+                tickers[name] = db.statistics->getTickerCount(ticker);
+
+            auto& histograms = response["histograms"] = nlohmann::json::object();
+            rocksdb::HistogramData data;
+            for (auto const& [histogram, name] : rocksdb::HistogramsNameMap) {
+                db.statistics->histogramData(histogram, &data);
+                if (!data.count)
+                    continue;
+                histograms[name] = {
+                    {"count", data.count},
+                    {"average", data.average},
+                    {"median", data.median},
+                    {"p95", data.percentile95},
+                    {"p99", data.percentile99},
+                    {"max", data.max},
+                };
+            }
+        });
+    }
+    else if (request == "properties") {
+        safe_section("Collecting RocksDB properties", c.error, [&] {
+            auto main = db.native->DefaultColumnFamily();
+            export_properties(db,
+                              main,
+                              {
+                                  {"running_compactions", "rocksdb.num-running-compactions"},
+                                  {"running_flushes", "rocksdb.num-running-flushes"},
+                                  {"delayed_write_rate", "rocksdb.actual-delayed-write-rate"},
+                                  {"is_write_stopped", "rocksdb.is-write-stopped"},
+                              },
+                              response);
+
+            auto& cache = response["block_cache"] = nlohmann::json::object();
+            export_properties(db,
+                              main,
+                              {
+                                  {"capacity", "rocksdb.block-cache-capacity"},
+                                  {"usage", "rocksdb.block-cache-usage"},
+                                  {"pinned_usage", "rocksdb.block-cache-pinned-usage"},
+                              },
+                              cache);
+            if (db.statistics) {
+                auto hits = db.statistics->getTickerCount(rocksdb::BLOCK_CACHE_HIT);
+                auto misses = db.statistics->getTickerCount(rocksdb::BLOCK_CACHE_MISS);
+                cache["hit_ratio"] = hits + misses ? double(hits) / double(hits + misses) : 0.0;
+            }
+
+            // The main collection has no name in UStore
+            auto& collections = response["collections"] = nlohmann::json::object();
+            for (auto handle : db.columns) {
+                std::string name = handle == main ? std::string() : handle->GetName();
+                export_properties(db,
+                                  handle,
+                                  {
+                                      {"memtables_bytes", "rocksdb.cur-size-all-mem-tables"},
+                                      {"immutable_memtables", "rocksdb.num-immutable-mem-table"},
+                                      {"pending_compaction_bytes", "rocksdb.estimate-pending-compaction-bytes"},
+                                      {"is_compaction_pending", "rocksdb.compaction-pending"},
+                                      {"level0_files", "rocksdb.num-files-at-level0"},
+                                      {"live_sst_bytes", "rocksdb.live-sst-files-size"},
+                                      {"blob_files", "rocksdb.num-blob-files"},
+                                      {"live_blob_bytes", "rocksdb.live-blob-file-size"},
+                                      {"garbage_blob_bytes", "rocksdb.live-blob-file-garbage-size"},
+                                      {"estimated_keys", "rocksdb.estimate-num-keys"},
+                                  },
+                                  collections[name]);
+            }
+
+            if (db.is_secondary()) {
+                std::unique_lock lock {db.catch_up_mutex};
+                response["catch_up_error"] =
+                    db.catch_up_error.empty() ? nlohmann::json() : nlohmann::json(db.catch_up_error);
+            }
+        });
+    }
+    else if (request == "perf enable") {
+        rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTimeExceptForMutex);
+        rocksdb::get_perf_context()->Reset();
+    }
+    else if (request == "perf disable")
+        rocksdb::SetPerfLevel(rocksdb::PerfLevel::kDisable);
+    else if (request == "perf") {
+        // Counters and timers in nanoseconds, accumulated by this thread since the last report
+        rocksdb::PerfContext& perf = *rocksdb::get_perf_context();
+        response = {
+            {"user_key_comparisons", perf.user_key_comparison_count},
+            {"block_cache_hits", perf.block_cache_hit_count},
+            {"block_reads", perf.block_read_count},
+            {"block_read_bytes", perf.block_read_byte},
+            {"block_read_time", perf.block_read_time},
+            {"block_decompress_time", perf.block_decompress_time},
+            {"bloom_sst_hits", perf.bloom_sst_hit_count},
+            {"bloom_sst_misses", perf.bloom_sst_miss_count},
+            {"internal_keys_skipped", perf.internal_key_skipped_count},
+            {"internal_deletes_skipped", perf.internal_delete_skipped_count},
+            {"get_from_memtable_time", perf.get_from_memtable_time},
+            {"get_from_output_files_time", perf.get_from_output_files_time},
+            {"seek_on_memtable_time", perf.seek_on_memtable_time},
+            {"seek_internal_seek_time", perf.seek_internal_seek_time},
+            {"find_next_user_entry_time", perf.find_next_user_entry_time},
+            {"write_wal_time", perf.write_wal_time},
+            {"write_memtable_time", perf.write_memtable_time},
+            {"write_delay_time", perf.write_delay_time},
+            {"write_scheduling_time", perf.write_scheduling_flushes_compactions_time},
+        };
+        perf.Reset();
+    }
+    else if (request == "catch up") {
+        return_error_if_m(db.is_secondary(), c.error, args_wrong_k, "Only secondary instances can catch up");
+        rocks_status_t status = catch_up(db);
+        if (export_error(status, c.error))
+            return;
+        response["sequence_number"] = db.native->GetLatestSequenceNumber();
+    }
+    else {
+        log_error_m(c.error,
+                    missing_feature_k,
+                    "Only \"statistics\", \"properties\", \"perf\", \"perf enable\", \"perf disable\" "
+                    "and \"catch up\" controls are supported!");
+        return;
+    }
+    return_if_error_m(c.error);
+
+    linked_memory_lock_t arena = linked_memory(c.arena, ustore_options_default_k, c.error);
+    return_if_error_m(c.error);
+    std::string dumped = response.dump();
+    auto exported = arena.alloc<char>(dumped.size() + 1, c.error);
+    return_if_error_m(c.error);
+    std::memcpy(exported.begin(), dumped.c_str(), dumped.size() + 1);
+    *c.response = exported.begin();
 }
 
 void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
@@ -884,13 +1815,14 @@ void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
 
     bool const safe = c.options & ustore_option_write_flush_k;
     rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c.db);
+    return_error_if_m(!db.is_secondary(), c.error, missing_feature_k, "Secondary instances are read-only");
     rocks_txn_t& txn = **reinterpret_cast<rocks_txn_t**>(c.transaction);
     rocksdb::OptimisticTransactionOptions txn_options;
     txn_options.set_snapshot = false;
     rocksdb::WriteOptions options;
     options.sync = safe;
     options.disableWAL = !safe;
-    auto new_txn = db.native->BeginTransaction(options, txn_options, &txn);
+    auto new_txn = db.transactional->BeginTransaction(options, txn_options, &txn);
     if (!new_txn)
         *c.error = "Couldn't start a transaction!";
     else
@@ -933,10 +1865,8 @@ void ustore_database_free(ustore_database_t c_db) {
     if (!c_db)
         return;
     rocks_db_t& db = *reinterpret_cast<rocks_db_t*>(c_db);
-    for (rocks_collection_t* cf : db.columns)
-        db.native->DestroyColumnFamilyHandle(cf);
-    db.native.reset();
-    delete &db;
+    stop_follower(db);
+    release_holder(db);
 }
 
 void ustore_error_free(ustore_error_t const) {
@@ -7,37 +7,50 @@
  * It keeps all the pairs sorted and is pretty fast for a BST-based container.
  */
 
-#include <stdio.h> // Saving/reading from disk
+#include <stdio.h>  // Saving/reading from disk
+#include <fcntl.h>  // `::open` for the write-ahead log
+#include <unistd.h> // `::fdatasync`
+#include <sys/mman.h> // `::mmap` for the spill file
 
 #include <map>
+#include <deque>
+#include <array>
+#include <algorithm>
 #include <vector>
+#include <bitset>
+#include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <shared_mutex>
-#include <mutex>      // `std::unique_lock`
-#include <numeric>    // `std::accumulate`
-#include <atomic>     // Thread-safe generation counters
-#include <filesystem> // Enumerating the directory
-#include <fstream>    // Passing file contents to JSON parser
+#include <mutex>              // `std::unique_lock`
+#include <numeric>            // `std::accumulate`
+#include <atomic>             // Thread-safe generation counters
+#include <thread>             // Background checkpoints
+#include <condition_variable> // Group commit
+#include <chrono>             // Periodic checkpoints
+#include <filesystem>         // Enumerating the directory
+#include <fstream>            // Passing file contents to JSON parser
 
 // TODO: These alternative containers need further testing:
 // #include <ucset/consistent_avl.hpp> // `ucset::consistent_avl_gt`
-// #include <ucset/partitioned.hpp>    // `ucset::partitioned_gt`
 #include <ucset/consistent_set.hpp> // `ucset::consistent_set_gt`
-#include <ucset/locked.hpp>         // `ucset::locked_gt`
 
 #include <nlohmann/json.hpp>       // `nlohmann::json`
 #include <arrow/io/file.h>         // `arrow::io::ReadableFile`
-#include <parquet/stream_reader.h> // `parquet::StreamReader`
+#include <arrow/array.h>           // `arrow::BinaryArray`
+#include <arrow/record_batch.h>    // `arrow::RecordBatchReader`
+#include <parquet/arrow/reader.h>  // `parquet::arrow::FileReader`
 #include <parquet/stream_writer.h> // `parquet::StreamWriter`
 
 #include "ustore/db.h"
 #include "helpers/file.hpp"
-#include "helpers/linked_memory.hpp" // `linked_memory_t`
-#include "helpers/linked_array.hpp"  // `unintialized_vector_gt`
-#include "helpers/config_loader.hpp" // `config_loader_t`
+#include "helpers/linked_memory.hpp"  // `linked_memory_t`
+#include "helpers/linked_array.hpp"   // `unintialized_vector_gt`
+#include "helpers/config_loader.hpp"  // `config_loader_t`
+#include "helpers/slab_allocator.hpp" // `slab_allocator_t`
 #include "ustore/cpp/ranges_args.hpp"   // `places_arg_t`
 
 /*********************************************************/
@@ -49,7 +62,8 @@ ustore_length_t const ustore_length_missing_k = std::numeric_limits<ustore_lengt
 ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max();
 bool const ustore_supports_transactions_k = true;
 bool const ustore_supports_named_collections_k = true;
-bool const ustore_supports_snapshots_k = false;
+bool const ustore_supports_snapshots_k = true;
+bool const ustore_supports_neighborhood_merges_k = false;
 
 /*********************************************************/
 /*****************	 C++ Implementation	  ****************/
@@ -62,360 +76,3273 @@ using namespace unum;
 namespace stdfs = std::filesystem;
 using json_t = nlohmann::json;
 
-using blob_allocator_t = std::allocator<byte_t>;
+using blob_allocator_t = slab_allocator_t;
 
 struct ucset_options_t {
     bool encryption = false;
     bool compression = false;
     size_t memory_limit = 0;
+
+    /**
+     * @brief Once the write-ahead log grows beyond this size, a background
+     * thread folds it into the Parquet files and starts a new log.
+     */
+    size_t checkpoint_bytes = 64ul * 1024ul * 1024ul;
+
+    /**
+     * @brief Logs, that stay below @c checkpoint_bytes, are still checkpointed this often,
+     * so that restarts after a quiet period don't replay them. Zero disables the timer.
+     */
+    size_t checkpoint_interval_ms = 60ul * 1000ul;
+
+    /**
+     * @brief Number of independently locked partitions of the set.
+     * More partitions let concurrent writes scale, but slow down ordered scans.
+     */
+    size_t partitions = 1;
 };
 
-struct pair_t {
-    collection_key_t collection_key;
-    value_view_t range;
+/**
+ * @brief Bytes of values kept in RAM by a single UCSet database,
+ * compared against its `ucset_options_t::memory_limit`.
+ * Spread across cache lines, as every write updates it.
+ */
+class memory_usage_t {
+    static constexpr std::size_t shards_k = 64;
 
-    pair_t() = default;
-    pair_t(pair_t const&) = delete;
-    pair_t& operator=(pair_t const&) = delete;
+    struct alignas(64) shard_t {
+        std::atomic<std::int64_t> bytes = 0;
+    };
 
-    pair_t(collection_key_t collection_key) noexcept : collection_key(collection_key) {}
+    shard_t shards_[shards_k];
 
-    pair_t(collection_key_t collection_key, value_view_t other, ustore_error_t* c_error) noexcept
-        : collection_key(collection_key) {
-        if (other.size()) {
-            auto begin = blob_allocator_t {}.allocate(other.size());
-            return_error_if_m(begin != nullptr, c_error, out_of_memory_k, "Failed to copy a blob");
-            range = {begin, other.size()};
-            std::memcpy(begin, other.begin(), other.size());
-        }
-        else
-            range = other;
+    static std::size_t shard_idx() noexcept {
+        static std::atomic<std::size_t> threads = 0;
+        thread_local std::size_t idx = threads.fetch_add(1, std::memory_order_relaxed) % shards_k;
+        return idx;
     }
 
-    ~pair_t() noexcept {
-        if (range.size())
-            blob_allocator_t {}.deallocate((byte_t*)range.data(), range.size());
-        range = {};
+  public:
+    void add(std::int64_t bytes) noexcept { shards_[shard_idx()].bytes.fetch_add(bytes, std::memory_order_relaxed); }
+
+    std::size_t total() const noexcept {
+        std::int64_t bytes = 0;
+        for (shard_t const& shard : shards_)
+            bytes += shard.bytes.load(std::memory_order_relaxed);
+        return bytes > 0 ? static_cast<std::size_t>(bytes) : 0;
     }
+};
 
-    pair_t(pair_t&& other) noexcept
-        : collection_key(other.collection_key), range(std::exchange(other.range, value_view_t {})) {}
+class spill_file_t;
 
-    pair_t& operator=(pair_t&& other) noexcept {
-        std::swap(collection_key, other.collection_key);
-        std::swap(range, other.range);
-        return *this;
+/**
+ * @brief Aligned block of memory, shared by many values loaded from disk at once.
+ * The header is found by rounding the address of any value down to @c size_k,
+ * and the block is freed, when the last value it holds is overwritten or removed.
+ * Chunks of evicted values are mapped from a `spill_file_t` instead of the heap.
+ */
+struct bulk_chunk_t {
+    static constexpr std::size_t size_k = 4ul * 1024ul * 1024ul;
+    static constexpr std::size_t header_size_k = 64;
+    static constexpr std::size_t capacity_k = size_k - header_size_k;
+
+    std::atomic<std::size_t> references = 1;
+    memory_usage_t* memory = nullptr;
+    spill_file_t* spill = nullptr;
+    std::uint64_t spill_offset = 0;
+
+    byte_t* begin() noexcept { return reinterpret_cast<byte_t*>(this) + header_size_k; }
+    byte_t* end() noexcept { return reinterpret_cast<byte_t*>(this) + size_k; }
+
+    static bulk_chunk_t* make(memory_usage_t& usage) noexcept {
+        void* memory = std::aligned_alloc(size_k, size_k);
+        if (!memory)
+            return nullptr;
+        usage.add(size_k);
+        auto chunk = new (memory) bulk_chunk_t {};
+        chunk->memory = &usage;
+        return chunk;
     }
 
-    operator collection_key_t() const noexcept { return collection_key; }
-    explicit operator bool() const noexcept { return range; }
-};
+    static bulk_chunk_t* of(byte_t const* value) noexcept {
+        return reinterpret_cast<bulk_chunk_t*>(reinterpret_cast<std::uintptr_t>(value) & ~(size_k - 1));
+    }
 
-struct pair_compare_t {
-    using value_type = collection_key_t;
-    bool operator()(collection_key_t const& a, collection_key_t const& b) const noexcept { return a < b; }
-    bool operator()(collection_key_t const& a, ustore_collection_t b) const noexcept { return a.collection < b; }
-    bool operator()(ustore_collection_t a, collection_key_t const& b) const noexcept { return a < b.collection; }
+    void release() noexcept;
 };
 
-/*********************************************************/
-/*****************  Using Consistent Sets ****************/
-/*********************************************************/
+/**
+ * @brief Unlinked file, that receives the coldest values, once the `ucset_options_t::memory_limit`
+ * is exceeded. It is split into `bulk_chunk_t`s, each mapped into memory, so the evicted values
+ * are still addressed directly, while the OS pages them in on reads and out under pressure.
+ */
+class spill_file_t {
+    int file_ = -1;
+    std::mutex mutex_;
+    std::uint64_t length_ = 0;
+    std::vector<std::uint64_t> free_offsets_;
+
+    void recycle(std::uint64_t offset) noexcept {
+        std::lock_guard _ {mutex_};
+        try {
+            free_offsets_.push_back(offset);
+        }
+        catch (...) {
+            // The space just won't be reused
+        }
+    }
 
-// using ucset_t = ucset_gt<pair_t, pair_compare_t>;
-// using ucset_t = consistent_avl_gt<pair_t, pair_compare_t>;
-// using ucset_t = partitioned_gt< //
-//     ucset_gt<pair_t, pair_compare_t>,
-//     std::hash<collection_key_t>,
-//     std::shared_mutex,
-//     64>;
-using ucset_t = locked_gt<consistent_set_gt<pair_t, pair_compare_t>, std::shared_mutex>;
-using transaction_t = typename ucset_t::transaction_t;
-using generation_t = typename ucset_t::generation_t;
+  public:
+    spill_file_t() = default;
+    spill_file_t(spill_file_t const&) = delete;
+    spill_file_t& operator=(spill_file_t const&) = delete;
+    ~spill_file_t() noexcept {
+        if (file_ >= 0)
+            ::close(file_);
+    }
 
-template <typename set_or_transaction_at, typename callback_at>
-ucset::status_t find_and_watch(set_or_transaction_at& set_or_transaction,
-                               collection_key_t collection_key,
-                               ustore_options_t options,
-                               callback_at&& callback) noexcept {
+    bool is_open() const noexcept { return file_ >= 0; }
 
-    if constexpr (!std::is_same<set_or_transaction_at, ucset_t>()) {
-        bool dont_watch = options & ustore_option_transaction_dont_watch_k;
-        if (!dont_watch)
-            if (auto watch_status = set_or_transaction.watch(collection_key); !watch_status)
-                return watch_status;
+    void open(stdfs::path const& directory, ustore_error_t* c_error) noexcept(false) {
+        std::string path = (directory / "ucset.spill.XXXXXX").string();
+        file_ = ::mkstemp(path.data());
+        return_error_if_m(file_ >= 0, c_error, error_unknown_k, "Couldn't create a spill file");
+        // Nobody else needs it, so the space is reclaimed even after a crash
+        ::unlink(path.c_str());
     }
 
-    auto find_status = set_or_transaction.find(
-        collection_key,
-        [&](pair_t const& pair) noexcept { callback(pair.range); },
-        [&]() noexcept { callback(value_view_t {}); });
-    return find_status;
-}
+    bulk_chunk_t* make_chunk() noexcept {
+        constexpr std::size_t size = bulk_chunk_t::size_k;
+        std::uint64_t offset = 0;
+        {
+            std::lock_guard _ {mutex_};
+            if (free_offsets_.size()) {
+                offset = free_offsets_.back();
+                free_offsets_.pop_back();
+            }
+            else {
+                if (::ftruncate(file_, static_cast<off_t>(length_ + size)) != 0)
+                    return nullptr;
+                offset = length_;
+                length_ += size;
+            }
+        }
 
-template <typename set_or_transaction_at, typename callback_at>
-ucset::status_t scan_and_watch(set_or_transaction_at& set_or_transaction,
-                               collection_key_t start,
-                               std::size_t range_limit,
-                               ustore_options_t options,
-                               callback_at&& callback) noexcept {
+        // `bulk_chunk_t::of` expects chunks to be aligned to their size,
+        // so we reserve twice the range and trim it around an aligned address.
+        void* reserved = ::mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) {
+            recycle(offset);
+            return nullptr;
+        }
+        auto reserved_begin = reinterpret_cast<std::uintptr_t>(reserved);
+        auto aligned_begin = (reserved_begin + size - 1) & ~(size - 1);
+        if (aligned_begin != reserved_begin)
+            ::munmap(reserved, aligned_begin - reserved_begin);
+        ::munmap(reinterpret_cast<void*>(aligned_begin + size), reserved_begin + size - aligned_begin);
+
+        void* memory = ::mmap(reinterpret_cast<void*>(aligned_begin),
+                              size,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_FIXED,
+                              file_,
+                              static_cast<off_t>(offset));
+        if (memory == MAP_FAILED) {
+            ::munmap(reinterpret_cast<void*>(aligned_begin), size);
+            recycle(offset);
+            return nullptr;
+        }
 
-    std::size_t match_idx = 0;
-    collection_key_t previous = start;
-    bool reached_end = false;
-    auto watch_status = ucset::status_t();
-    auto callback_pair = [&](pair_t const& pair) noexcept {
-        reached_end = pair.collection_key.collection != previous.collection;
-        if (reached_end)
-            return;
+        auto chunk = new (memory) bulk_chunk_t {};
+        chunk->spill = this;
+        chunk->spill_offset = offset;
+        return chunk;
+    }
 
-        if constexpr (!std::is_same<set_or_transaction_at, ucset_t>()) {
-            bool dont_watch = options & ustore_option_transaction_dont_watch_k;
-            if (!dont_watch)
-                if (watch_status = set_or_transaction.watch(pair); !watch_status)
-                    return;
-        }
+    void release(bulk_chunk_t* chunk) noexcept {
+        std::uint64_t offset = chunk->spill_offset;
+        chunk->~bulk_chunk_t();
+        ::munmap(chunk, bulk_chunk_t::size_k);
+#if defined(FALLOC_FL_PUNCH_HOLE)
+        ::fallocate(file_,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(offset),
+                    static_cast<off_t>(bulk_chunk_t::size_k));
+#endif
+        recycle(offset);
+    }
+};
 
-        callback(pair);
-        previous.key = pair.collection_key.key;
-        ++match_idx;
-    };
+void bulk_chunk_t::release() noexcept {
+    if (references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    if (spill)
+        return spill->release(this);
+    memory_usage_t& usage = *memory;
+    this->~bulk_chunk_t();
+    std::free(this);
+    usage.add(-static_cast<std::int64_t>(size_k));
+}
 
-    auto find_status = set_or_transaction.find(start, callback_pair, {});
-    if (!find_status)
-        return find_status;
-    if (!watch_status)
-        return watch_status;
+static_assert(sizeof(bulk_chunk_t) <= bulk_chunk_t::header_size_k);
 
-    while (match_idx != range_limit && !reached_end) {
-        find_status = set_or_transaction.upper_bound(previous, callback_pair, [&]() noexcept { reached_end = true; });
-        if (!find_status)
-            return find_status;
-        if (!watch_status)
-            return watch_status;
-    }
+/**
+ * @brief Describes where the bytes of a value live and how to release them.
+ */
+enum class value_kind_t : std::uint8_t {
+    heap_k = 0, ///< Individually allocated with `blob_allocator_t`.
+    bulk_k,     ///< Part of a `bulk_chunk_t`, filled while loading from disk.
+};
 
-    return {};
+void free_value(byte_t const* begin, ustore_length_t length, value_kind_t kind, memory_usage_t& usage) noexcept {
+    switch (kind) {
+    case value_kind_t::heap_k:
+        blob_allocator_t {}.deallocate((byte_t*)begin, length);
+        usage.add(-static_cast<std::int64_t>(blob_allocator_t::capacity(length)));
+        break;
+    case value_kind_t::bulk_k: bulk_chunk_t::of(begin)->release(); break;
+    }
 }
 
-template <typename set_or_transaction_at, typename callback_at>
-ucset::status_t scan_full(set_or_transaction_at& set_or_transaction, callback_at&& callback) noexcept {
+/**
+ * @brief Epoch-based reclamation of values, exported by reads without copies.
+ * Threads pin and retire through their own slots, so they rarely share a lock.
+ * A pinned slot holds the epoch of its oldest pin, while the retired values are
+ * stamped with the epoch of their release and freed once no slot holds an older one.
+ * Readers pin before locking the set and writers retire under its locks,
+ * so a value seen by a reader can't be freed before that reader unpins.
+ * Every pin also holds the `owner_t`, so pins outliving the database keep its values.
+ */
+struct owner_t;
+void release_owner(owner_t*) noexcept;
+
+class pins_t {
+  public:
+    struct slot_t;
+
+  private:
+    static constexpr std::size_t slots_k = 64;
+    static constexpr std::size_t reclaim_period_k = 64;
+    static constexpr std::uint64_t unpinned_k = std::numeric_limits<std::uint64_t>::max();
+
+    struct retired_t {
+        std::uint64_t epoch;
+        byte_t const* begin;
+        ustore_length_t length;
+        value_kind_t kind;
+    };
 
-    collection_key_t previous {
-        std::numeric_limits<ustore_collection_t>::min(),
-        std::numeric_limits<ustore_key_t>::min(),
+  public:
+    /**
+     * @brief Pins and retired values of the threads, mapped to it.
+     * Only the @c epoch is accessed without locking the @c mutex.
+     */
+    struct alignas(64) slot_t {
+        pins_t* pins = nullptr;
+        std::mutex mutex;
+        std::size_t count = 0;
+        std::atomic<std::uint64_t> epoch = unpinned_k;
+        std::size_t retired_since_reclaim = 0;
+        std::deque<retired_t> retired;
     };
-    while (true) {
-        auto callback_pair = [&](pair_t const& pair) noexcept {
-            callback(pair);
-            previous = pair.collection_key;
-        };
 
-        auto reached_end = false;
-        auto callback_nothing = [&]() noexcept {
-            reached_end = true;
-        };
+  private:
+    owner_t* owner_ = nullptr;
+    memory_usage_t* memory_ = nullptr;
+    std::atomic<std::size_t> active_ = 0;
+    /** @brief The database and the @c active_ pins. The last one released frees the @c owner_. */
+    std::atomic<std::size_t> holders_ = 1;
+    std::atomic<std::uint64_t> epoch_ = 0;
+    slot_t slots_[slots_k];
+
+    static std::size_t slot_idx() noexcept {
+        static std::atomic<std::size_t> threads = 0;
+        thread_local std::size_t idx = threads.fetch_add(1, std::memory_order_relaxed) % slots_k;
+        return idx;
+    }
 
-        auto status = set_or_transaction.upper_bound(previous, callback_pair, callback_nothing);
-        if (reached_end)
-            break;
-        if (!status)
-            return status;
+    std::uint64_t oldest_pin() const noexcept {
+        std::uint64_t oldest = unpinned_k;
+        for (slot_t const& slot : slots_)
+            oldest = std::min(oldest, slot.epoch.load());
+        return oldest;
     }
 
-    return {};
-}
+    /**
+     * @brief Frees the values retired into the @p slot before every live pin.
+     * The caller must hold the @c slot_t::mutex.
+     */
+    void reclaim(slot_t& slot) noexcept {
+        slot.retired_since_reclaim = 0;
+        if (slot.retired.empty())
+            return;
+        std::uint64_t oldest = oldest_pin();
+        while (slot.retired.size() && slot.retired.front().epoch < oldest) {
+            retired_t const& retired = slot.retired.front();
+            free_value(retired.begin, retired.length, retired.kind, *memory_);
+            slot.retired.pop_front();
+        }
+    }
 
-/*********************************************************/
-/***************** Collections Management ****************/
-/*********************************************************/
+  public:
+    pins_t(owner_t& owner, memory_usage_t& memory) noexcept : owner_(&owner), memory_(&memory) {
+        for (slot_t& slot : slots_)
+            slot.pins = this;
+    }
 
-struct string_hash_t {
-    using stl_t = std::hash<std::string_view>;
-    using is_transparent = void;
+    pins_t(pins_t const&) = delete;
+    pins_t& operator=(pins_t const&) = delete;
 
-    auto operator()(const char* str) const { return stl_t {}(str); }
-    auto operator()(std::string_view str) const { return stl_t {}(str); }
-    auto operator()(std::string const& str) const { return stl_t {}(str); }
-};
+    ~pins_t() noexcept {
+        for (slot_t& slot : slots_)
+            for (retired_t const& retired : slot.retired)
+                free_value(retired.begin, retired.length, retired.kind, *memory_);
+    }
 
-struct string_eq_t : public std::equal_to<std::string_view> {
-    using is_transparent = void;
-};
+    bool active() const noexcept { return active_.load() != 0; }
 
-struct string_less_t : public std::less<std::string_view> {
-    using is_transparent = void;
-};
+    /**
+     * @brief Releases the hold of the database or of a pin, freeing the `owner_t` after the last one.
+     */
+    void release_holder() noexcept {
+        if (!--holders_)
+            release_owner(owner_);
+    }
+
+    slot_t& pin() noexcept {
+        slot_t& slot = slots_[slot_idx()];
+        ++holders_;
+        ++active_;
+        std::lock_guard _ {slot.mutex};
+        if (!slot.count++)
+            slot.epoch.store(epoch_.load());
+        return slot;
+    }
 
-struct database_t {
     /**
-     * @brief Rarely-used mutex for global reorganizations, like:
-     * - Removing existing collections or adding new ones.
-     * - Listing present collections.
+     * @brief Releases a pin, potentially from a different thread, than the one that took it.
+     * The last pin released reclaims everything retired so far.
      */
-    std::shared_mutex restructuring_mutex;
+    static void unpin(slot_t& slot) noexcept {
+        pins_t& pins = *slot.pins;
+        {
+            std::lock_guard _ {slot.mutex};
+            if (!--slot.count)
+                slot.epoch.store(unpinned_k);
+        }
+        if (!--pins.active_)
+            for (slot_t& other : pins.slots_) {
+                std::lock_guard _ {other.mutex};
+                pins.reclaim(other);
+            }
+        pins.release_holder();
+    }
 
     /**
-     * @brief Primary database state.
+     * @brief Holds a pin until the end of the scope.
      */
-    ucset_t pairs;
+    class scoped_pin_t {
+        slot_t& slot_;
+
+      public:
+        scoped_pin_t(pins_t& pins) noexcept : slot_(pins.pin()) {}
+        scoped_pin_t(scoped_pin_t const&) = delete;
+        ~scoped_pin_t() noexcept { unpin(slot_); }
+    };
 
     /**
-     * @brief A variable-size set of named collections.
-     * It's cleaner to implement it with heterogenous lookups as
-     * an @c std::unordered_map, but it requires GCC11 and C++20.
+     * @return False, if nothing is pinned and the value can be freed immediately.
      */
-    std::map<std::string, ustore_collection_t, string_less_t> names;
+    bool retire(byte_t const* begin, ustore_length_t length, value_kind_t kind) noexcept {
+        if (!active_)
+            return false;
+        slot_t& slot = slots_[slot_idx()];
+        std::lock_guard _ {slot.mutex};
+        try {
+            slot.retired.push_back({epoch_++, begin, length, kind});
+        }
+        catch (...) {
+            // Leaking is the only safe option, when we can't track the value
+            return true;
+        }
+        if (++slot.retired_since_reclaim == reclaim_period_k)
+            reclaim(slot);
+        return true;
+    }
+};
 
+/**
+ * @brief State of a single UCSet database, shared by all the values it owns.
+ */
+struct owner_t {
+    std::uint16_t index = 0;
+    memory_usage_t memory;
     /**
-     * @brief Path on disk, from which the data will be read.
-     * When closed, we will try saving the DB on disk.
+     * @brief Receives the cold values past the @c ucset_options_t::memory_limit.
+     * Declared before the @c pins, as the retired values may be mapped from it.
      */
-    std::string persisted_directory;
+    spill_file_t spill;
+    pins_t pins {*this, memory};
+};
 
-    database_t(ucset_t&& set) noexcept(false) : pairs(std::move(set)) {}
+/**
+ * @brief Open UCSet databases, indexed with 16 bits, so that every `pair_t` can
+ * refer to the owner of its value from its padding, without growing.
+ */
+class owners_t {
+  public:
+    static constexpr std::size_t capacity_k = std::numeric_limits<std::uint16_t>::max() + 1ul;
 
-    database_t(database_t&& other) noexcept
-        : pairs(std::move(other.pairs)), names(std::move(other.names)),
-          persisted_directory(std::move(other.persisted_directory)) {}
-};
+  private:
+    std::mutex mutex_;
+    std::size_t next_ = 0;
+    owner_t* owners_[capacity_k] {};
 
-ustore_collection_t new_collection(database_t& db) noexcept {
-    bool is_new = false;
-    ustore_collection_t new_handle = ustore_collection_main_k;
-    while (!is_new) {
-        auto top = static_cast<std::uint64_t>(std::rand());
-        auto bottom = static_cast<std::uint64_t>(std::rand());
-        new_handle = static_cast<ustore_collection_t>((top << 32) | bottom);
-        is_new = new_handle != ustore_collection_main_k;
-        for (auto const& [name, existing_handle] : db.names)
-            is_new &= new_handle != existing_handle;
+  public:
+    owner_t& operator[](std::uint16_t index) noexcept { return *owners_[index]; }
+
+    /**
+     * @return NULL, if too many databases are open or the memory is exhausted.
+     */
+    owner_t* acquire() noexcept {
+        std::lock_guard _ {mutex_};
+        for (std::size_t i = 0; i != capacity_k; ++i) {
+            std::size_t index = (next_ + i) % capacity_k;
+            if (owners_[index])
+                continue;
+            owner_t* owner = new (std::nothrow) owner_t;
+            if (!owner)
+                return nullptr;
+            owner->index = static_cast<std::uint16_t>(index);
+            owners_[index] = owner;
+            next_ = index + 1;
+            return owner;
+        }
+        return nullptr;
     }
-    return new_handle;
+
+    void release(owner_t* owner) noexcept {
+        std::lock_guard _ {mutex_};
+        owners_[owner->index] = nullptr;
+        delete owner;
+    }
+};
+
+owners_t& owners() noexcept {
+    static owners_t* registry = new owners_t;
+    return *registry;
 }
 
-void export_error_code(ucset::status_t code, ustore_error_t* c_error) noexcept {
-    if (!code)
-        *c_error = "Faced error!";
+void release_owner(owner_t* owner) noexcept {
+    owners().release(owner);
 }
 
-/*********************************************************/
-/*****************	 Writing to Disk	  ****************/
-/*********************************************************/
+/**
+ * @brief Releases the hold of the database, while the values exported by pinned reads may still hold it.
+ */
+struct owner_release_t {
+    void operator()(owner_t* owner) const noexcept { owner->pins.release_holder(); }
+};
 
-void write_collection( //
-    database_t const& db,
-    ustore_collection_t collection_id,
-    std::string const& collection_path,
-    ustore_error_t* c_error) noexcept(false) {
+using owner_ptr_t = std::unique_ptr<owner_t, owner_release_t>;
 
-    std::shared_ptr<arrow::io::FileOutputStream> out_file;
-    PARQUET_ASSIGN_OR_THROW(out_file, arrow::io::FileOutputStream::Open(collection_path));
+/**
+ * @brief The entry stored in the set. The value is kept unpacked, rather than
+ * as a `value_view_t`, so that its kind, the CLOCK bit of the eviction policy
+ * and the index of its `owner_t` fit into padding, keeping it at 32 bytes.
+ */
+struct pair_t {
+    collection_key_t collection_key;
+    byte_t const* value_begin = nullptr;
+    ustore_length_t value_length = ustore_length_missing_k;
+    value_kind_t value_kind = value_kind_t::heap_k;
+    mutable std::atomic<std::uint8_t> referenced = 0;
+    std::uint16_t owner = 0;
 
-    parquet::schema::NodeVector columns {};
-    columns.push_back(parquet::schema::PrimitiveNode::Make( //
-        "key",
-        parquet::Repetition::REQUIRED,
-        parquet::Type::INT64,
-        parquet::ConvertedType::INT_64));
-    columns.push_back(parquet::schema::PrimitiveNode::Make( //
-        "value",
-        parquet::Repetition::OPTIONAL,
-        parquet::Type::BYTE_ARRAY,
-        parquet::ConvertedType::UTF8));
-    auto schema = std::static_pointer_cast<parquet::schema::GroupNode>(
-        parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED, columns));
-    parquet::WriterProperties::Builder builder;
-    parquet::StreamWriter os {parquet::ParquetFileWriter::Open(out_file, schema, builder.build())};
-
-    collection_key_t min(collection_id, std::numeric_limits<ustore_key_t>::min());
-    collection_key_t max(collection_id, std::numeric_limits<ustore_key_t>::max());
-    auto status = db.pairs.range(min, max, [&](pair_t& pair) noexcept {
-        std::optional<std::string_view> value;
-        if (pair.range.size())
-            value = std::string_view(pair.range);
-        os << pair.collection_key.key << value << parquet::EndRow;
-    });
-    export_error_code(status, c_error);
-    return_if_error_m(c_error);
+    pair_t() = default;
+    pair_t(pair_t const&) = delete;
+    pair_t& operator=(pair_t const&) = delete;
+
+    pair_t(collection_key_t collection_key) noexcept : collection_key(collection_key) {}
+
+    pair_t(collection_key_t collection_key, value_view_t other, owner_t& owner, ustore_error_t* c_error) noexcept
+        : collection_key(collection_key), owner(owner.index) {
+        if (other.size()) {
+            auto begin = blob_allocator_t {}.allocate(other.size());
+            return_error_if_m(begin != nullptr, c_error, out_of_memory_k, "Failed to copy a blob");
+            std::memcpy(begin, other.begin(), other.size());
+            value_begin = begin;
+            value_length = static_cast<ustore_length_t>(other.size());
+            owner.memory.add(static_cast<std::int64_t>(blob_allocator_t::capacity(other.size())));
+        }
+        else
+            value_begin = other.data(), value_length = other ? 0 : ustore_length_missing_k;
+    }
+
+    ~pair_t() noexcept { release(); }
+
+    pair_t(pair_t&& other) noexcept
+        : collection_key(other.collection_key), value_begin(std::exchange(other.value_begin, nullptr)),
+          value_length(std::exchange(other.value_length, ustore_length_missing_k)),
+          value_kind(std::exchange(other.value_kind, value_kind_t::heap_k)),
+          referenced(other.referenced.exchange(0, std::memory_order_relaxed)), owner(other.owner) {}
+
+    pair_t& operator=(pair_t&& other) noexcept {
+        std::swap(collection_key, other.collection_key);
+        std::swap(value_begin, other.value_begin);
+        std::swap(value_length, other.value_length);
+        std::swap(value_kind, other.value_kind);
+        std::swap(owner, other.owner);
+        referenced.store(other.referenced.exchange(referenced.load(std::memory_order_relaxed),
+                                                   std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+        return *this;
+    }
+
+    value_view_t value() const noexcept { return {value_begin, value_length}; }
+
+    /**
+     * @brief Marks the value as recently read, protecting it from the next eviction pass.
+     * Avoids writing to the shared cache line, if the bit is already set.
+     */
+    void touch() const noexcept {
+        if (!referenced.load(std::memory_order_relaxed))
+            referenced.store(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept {
+        if (value().size()) {
+            owner_t& value_owner = owners()[owner];
+            if (!(value_owner.pins.active() && value_owner.pins.retire(value_begin, value_length, value_kind)))
+                free_value(value_begin, value_length, value_kind, value_owner.memory);
+        }
+        value_begin = nullptr;
+        value_length = ustore_length_missing_k;
+        value_kind = value_kind_t::heap_k;
+    }
+
+    operator collection_key_t() const noexcept { return collection_key; }
+    explicit operator bool() const noexcept { return value_length != ustore_length_missing_k; }
+};
+
+static_assert(sizeof(pair_t) == 32);
+
+/**
+ * @brief Upper bound on the memory the set spends on every entry, besides the `pair_t` itself.
+ */
+constexpr std::size_t node_overhead_k = 4 * sizeof(void*);
+
+/**
+ * @brief Copies values into a sequence of `bulk_chunk_t`s,
+ * so that every value is copied exactly once and without individual allocations.
+ */
+class bulk_loader_t {
+    owner_t& owner_;
+    spill_file_t* spill_ = nullptr;
+    bulk_chunk_t* chunk_ = nullptr;
+    byte_t* tail_ = nullptr;
+
+  public:
+    bulk_loader_t(owner_t& owner, spill_file_t* spill = nullptr) noexcept : owner_(owner), spill_(spill) {}
+    bulk_loader_t(bulk_loader_t const&) = delete;
+
+    /**
+     * @brief Places the following chunks into the @p spill file, instead of RAM.
+     */
+    void spill_into(spill_file_t* spill) noexcept { spill_ = spill; }
+    ~bulk_loader_t() noexcept {
+        if (chunk_)
+            chunk_->release();
+    }
+
+    void copy(std::string_view value, pair_t& pair, ustore_error_t* c_error) noexcept {
+        if (value.empty()) {
+            pair.value_length = 0;
+            return;
+        }
+
+        // Large values don't share the chunk
+        if (value.size() > bulk_chunk_t::capacity_k) {
+            pair_t copy {pair.collection_key, value_view_t {value.data(), value.size()}, owner_, c_error};
+            pair = std::move(copy);
+            return;
+        }
+
+        if (!chunk_ || static_cast<std::size_t>(chunk_->end() - tail_) < value.size()) {
+            if (chunk_)
+                chunk_->release();
+            chunk_ = spill_ ? spill_->make_chunk() : bulk_chunk_t::make(owner_.memory);
+            return_error_if_m(chunk_ != nullptr, c_error, out_of_memory_k, "Failed to allocate a chunk");
+            tail_ = chunk_->begin();
+        }
+
+        std::memcpy(tail_, value.data(), value.size());
+        chunk_->references.fetch_add(1, std::memory_order_relaxed);
+        pair.value_begin = tail_;
+        pair.value_length = static_cast<ustore_length_t>(value.size());
+        pair.value_kind = value_kind_t::bulk_k;
+        pair.owner = owner_.index;
+        tail_ += value.size();
+    }
+};
+
+struct pair_compare_t {
+    using value_type = collection_key_t;
+    bool operator()(collection_key_t const& a, collection_key_t const& b) const noexcept { return a < b; }
+    bool operator()(collection_key_t const& a, ustore_collection_t b) const noexcept { return a.collection < b; }
+    bool operator()(ustore_collection_t a, collection_key_t const& b) const noexcept { return a < b.collection; }
+};
+
+/*********************************************************/
+/*****************  Using Consistent Sets ****************/
+/*********************************************************/
+
+/**
+ * @brief Default for the `log` callbacks of `partitioned_set_t`, which are invoked
+ * right before the changes are published, while the changed partitions are locked.
+ * Returning `false` aborts the change, leaving the partitions intact.
+ */
+struct no_log_t {
+    bool operator()() const noexcept { return true; }
+};
+
+/**
+ * @brief Splits the entries between independently locked `consistent_set_gt`s,
+ * hashed by `collection_key_t`, so that writes into different partitions don't contend.
+ *
+ * Point operations lock just the partition they target. Batches, drops and transactions
+ * lock every partition they touch exclusively, always in the order of partition indexes,
+ * so their changes become visible atomically and without deadlocks.
+ * Ordered traversals have to merge all the partitions, becoming proportionally slower.
+ * With a single partition it is equivalent to a `locked_gt`.
+ */
+class partitioned_set_t {
+  public:
+    using part_t = consistent_set_gt<pair_t, pair_compare_t>;
+    using part_transaction_t = typename part_t::transaction_t;
+    using generation_t = typename part_t::generation_t;
+    using hash_t = std::hash<collection_key_t>;
+
+    static constexpr std::size_t max_parts_k = 256;
+    using parts_mask_t = std::bitset<max_parts_k>;
+
+    /**
+     * @brief Longest run of entries, fetched from a single partition under one lock by `scan_runs()`.
+     */
+    static constexpr std::size_t max_scan_run_k = 64;
+
+    /**
+     * @brief Running totals over the entries of a collection or its part.
+     * The reserved bytes account for the rounding of slab allocations
+     * and the pointers of the search tree nodes.
+     */
+    struct stats_t {
+        std::size_t count = 0;
+        std::size_t value_bytes = 0;
+        std::size_t reserved_bytes = 0;
+
+        static std::size_t reserved(ustore_length_t length) noexcept {
+            return blob_allocator_t::capacity(length) + sizeof(pair_t) + node_overhead_k;
+        }
+
+        void add(ustore_length_t length) noexcept {
+            count += 1;
+            value_bytes += length;
+            reserved_bytes += reserved(length);
+        }
+
+        void remove(ustore_length_t length) noexcept {
+            count -= 1;
+            value_bytes -= length;
+            reserved_bytes -= reserved(length);
+        }
+
+        stats_t& operator+=(stats_t const& other) noexcept {
+            count += other.count;
+            value_bytes += other.value_bytes;
+            reserved_bytes += other.reserved_bytes;
+            return *this;
+        }
+    };
+
+    /**
+     * @brief Histogram of a collection over logarithmic buckets of keys:
+     * negative keys fill the first half and the others the second one,
+     * grouped by the number of significant bits. The order of keys is preserved,
+     * so any range is split into fully covered buckets and at most two partial ones.
+     */
+    static constexpr std::size_t buckets_k = 128;
+
+    /**
+     * @brief Partially covered buckets with fewer entries are counted exactly.
+     */
+    static constexpr std::size_t exact_bucket_limit_k = 4096;
+
+    /**
+     * @brief Sorted lookups walk through a run of keys in order, instead of searching for each
+     * of them, if the run is expected to pass no more than this many entries per requested key.
+     * Longer runs are split to make the estimates more local.
+     */
+    static constexpr double walk_density_k = 4;
+    static constexpr std::size_t walk_run_k = 256;
+
+    struct histogram_t {
+        stats_t total;
+        std::array<stats_t, buckets_k> buckets;
+
+        static std::size_t significant_bits(std::uint64_t x) noexcept { return x ? 64 - __builtin_clzll(x) : 0; }
+
+        static std::size_t bucket_of(ustore_key_t key) noexcept {
+            return key >= 0 ? 64 + significant_bits(static_cast<std::uint64_t>(key))
+                            : 63 - significant_bits(~static_cast<std::uint64_t>(key));
+        }
+
+        static ustore_key_t bucket_min(std::size_t bucket) noexcept {
+            std::size_t bits = bucket >= 64 ? bucket - 64 : 63 - bucket;
+            std::uint64_t smallest = bits ? 1ull << (bits - 1) : 0;
+            std::uint64_t largest = (1ull << bits) - 1;
+            return bucket >= 64 ? static_cast<ustore_key_t>(smallest) : ~static_cast<ustore_key_t>(largest);
+        }
+
+        static ustore_key_t bucket_max(std::size_t bucket) noexcept {
+            std::size_t bits = bucket >= 64 ? bucket - 64 : 63 - bucket;
+            std::uint64_t smallest = bits ? 1ull << (bits - 1) : 0;
+            std::uint64_t largest = (1ull << bits) - 1;
+            return bucket >= 64 ? static_cast<ustore_key_t>(largest) : ~static_cast<ustore_key_t>(smallest);
+        }
+    };
+
+  private:
+    struct alignas(64) partition_t {
+        mutable std::shared_mutex mutex;
+        part_t set;
+        std::unordered_map<ustore_collection_t, histogram_t> stats;
+
+        partition_t(part_t&& set) noexcept : set(std::move(set)) {}
+
+        /**
+         * @brief Prepares the histogram of a collection, before anything is added to it.
+         */
+        bool reserve_stats(ustore_collection_t collection) noexcept {
+            try {
+                stats.try_emplace(collection);
+                return true;
+            }
+            catch (...) {
+                return false;
+            }
+        }
+
+        /**
+         * @brief Updates the histogram, after an entry changes its length or appears or disappears,
+         * in which case the @c ustore_length_missing_k is passed.
+         */
+        void account(collection_key_t const& key, ustore_length_t old_length, ustore_length_t new_length) noexcept {
+            if (old_length == new_length)
+                return;
+            auto it = stats.find(key.collection);
+            if (it == stats.end())
+                return;
+            histogram_t& histogram = it->second;
+            stats_t& bucket = histogram.buckets[histogram_t::bucket_of(key.key)];
+            if (old_length != ustore_length_missing_k)
+                histogram.total.remove(old_length), bucket.remove(old_length);
+            if (new_length != ustore_length_missing_k)
+                histogram.total.add(new_length), bucket.add(new_length);
+            if (!histogram.total.count)
+                stats.erase(it);
+        }
+
+        ustore_length_t length_of(collection_key_t const& key) const noexcept {
+            ustore_length_t length = ustore_length_missing_k;
+            set.find(key, [&](pair_t const& pair) noexcept { length = pair.value_length; });
+            return length;
+        }
+
+        /**
+         * @brief Expected number of entries of a collection in `[min_key, max_key]`,
+         * assuming the keys are spread uniformly within every bucket of its histogram.
+         */
+        double expected_count(ustore_collection_t collection,
+                              ustore_key_t min_key,
+                              ustore_key_t max_key) const noexcept {
+            auto it = stats.find(collection);
+            if (it == stats.end())
+                return 0;
+
+            histogram_t const& histogram = it->second;
+            double expected = 0;
+            std::size_t const last_bucket = histogram_t::bucket_of(max_key);
+            for (std::size_t bucket = histogram_t::bucket_of(min_key); bucket <= last_bucket; ++bucket) {
+                std::size_t count = histogram.buckets[bucket].count;
+                if (!count)
+                    continue;
+                double bucket_min = static_cast<double>(histogram_t::bucket_min(bucket));
+                double bucket_max = static_cast<double>(histogram_t::bucket_max(bucket));
+                double covered = std::min<double>(max_key, bucket_max) - std::max<double>(min_key, bucket_min) + 1;
+                expected += count * covered / (bucket_max - bucket_min + 1);
+            }
+            return expected;
+        }
+
+        /**
+         * @brief Inserts an entry, keeping the histogram up to date, while the partition is locked.
+         */
+        template <typename log_at>
+        ucset::status_t upsert(pair_t&& pair, log_at&& log) noexcept {
+            if (pair && !reserve_stats(pair.collection_key.collection))
+                return {errc_t::out_of_memory_heap_k};
+            collection_key_t key = pair.collection_key;
+            ustore_length_t old_length = length_of(key);
+            ustore_length_t new_length = pair.value_length;
+            if (!log())
+                return {errc_t::consistency_k};
+            auto status = set.upsert(std::move(pair));
+            if (status)
+                account(key, old_length, new_length);
+            return status;
+        }
+    };
+
+    std::vector<std::unique_ptr<partition_t>> parts_;
+
+    /**
+     * @brief Number of committed transactions, which also numbers them.
+     */
+    std::atomic<generation_t> commits_ = 0;
+
+    /**
+     * @brief Locks a subset of partitions in the order of their indexes.
+     */
+    template <bool exclusive_ak>
+    class locks_gt {
+        partitioned_set_t const& set_;
+        parts_mask_t mask_;
+
+      public:
+        locks_gt(partitioned_set_t const& set, parts_mask_t mask) noexcept : set_(set), mask_(mask) {
+            for (std::size_t i = 0; i != set_.parts_.size(); ++i)
+                if (mask_[i])
+                    exclusive_ak ? set_.parts_[i]->mutex.lock() : set_.parts_[i]->mutex.lock_shared();
+        }
+        ~locks_gt() noexcept {
+            for (std::size_t i = set_.parts_.size(); i != 0; --i)
+                if (mask_[i - 1])
+                    exclusive_ak ? set_.parts_[i - 1]->mutex.unlock() : set_.parts_[i - 1]->mutex.unlock_shared();
+        }
+    };
+
+    parts_mask_t all_parts() const noexcept {
+        parts_mask_t mask;
+        for (std::size_t i = 0; i != parts_.size(); ++i)
+            mask.set(i);
+        return mask;
+    }
+
+    std::size_t part_idx(collection_key_t const& key) const noexcept {
+        return parts_.size() == 1 ? 0 : hash_t {}(key) % parts_.size();
+    }
+
+    /**
+     * @brief Visits the entries following @p previous in ascending order, until the @p callback
+     * returns false or the entries run out. Every round locks all the partitions once, fetches
+     * a run of successors from each with @p successor, and merges the runs. Only the entries up
+     * to the end of the shortest complete run are visited, as the following ones may be missing
+     * from that run. The runs start short for the @p expected number of entries and grow.
+     */
+    template <typename successor_at, typename callback_at>
+    ucset::status_t scan_runs(collection_key_t previous,
+                              std::size_t expected,
+                              successor_at&& successor,
+                              callback_at&& callback) const noexcept {
+        std::size_t run_length = std::min(expected / parts_.size(), max_scan_run_k - 1) + 1;
+        std::vector<pair_t const*> merged;
+        try {
+            merged.reserve(max_scan_run_k * parts_.size());
+        }
+        catch (...) {
+            return {errc_t::out_of_memory_heap_k};
+        }
+
+        auto less = [](pair_t const* a, pair_t const* b) noexcept { return a->collection_key < b->collection_key; };
+        while (true) {
+            locks_gt<false> _ {*this, all_parts()};
+            merged.clear();
+            pair_t const* bound = nullptr;
+            for (std::size_t idx = 0; idx != parts_.size(); ++idx) {
+                collection_key_t key = previous;
+                pair_t const* last = nullptr;
+                bool exhausted = false;
+                for (std::size_t fetched = 0; fetched != run_length && !exhausted; ++fetched) {
+                    auto found = [&](pair_t const& pair) noexcept {
+                        merged.push_back(last = &pair);
+                        key = pair.collection_key;
+                    };
+                    auto missing = [&]() noexcept { exhausted = true; };
+                    if (auto status = successor(idx, key, found, missing); !status)
+                        return status;
+                }
+                if (!exhausted && (!bound || less(last, bound)))
+                    bound = last;
+            }
+
+            std::sort(merged.begin(), merged.end(), less);
+            for (pair_t const* pair : merged) {
+                if (bound && less(bound, pair))
+                    break;
+                previous = pair->collection_key;
+                if (!callback(*pair))
+                    return {};
+            }
+            if (!bound)
+                return {};
+            run_length = std::min(run_length * 2, max_scan_run_k);
+        }
+    }
+
+    /**
+     * @brief Stably groups the indexes of @p keys by partitions, so that sorted keys stay sorted
+     * within every group. The group of the `i`-th partition is `[offsets[i], offsets[i + 1])`.
+     */
+    ucset::status_t group_by_parts(collection_key_t const* keys,
+                                   std::size_t count,
+                                   std::vector<std::size_t>& grouped,
+                                   std::vector<std::size_t>& offsets) const noexcept {
+        try {
+            grouped.resize(count);
+            offsets.assign(parts_.size() + 1, 0);
+            for (std::size_t i = 0; i != count; ++i)
+                ++offsets[part_idx(keys[i]) + 1];
+            for (std::size_t i = 0; i != parts_.size(); ++i)
+                offsets[i + 1] += offsets[i];
+            std::vector<std::size_t> tails {offsets.begin(), offsets.end() - 1};
+            for (std::size_t i = 0; i != count; ++i)
+                grouped[tails[part_idx(keys[i])]++] = i;
+            return {};
+        }
+        catch (...) {
+            return {errc_t::out_of_memory_heap_k};
+        }
+    }
+
+    /**
+     * @brief Looks up the sorted keys `keys[grouped[begin]]`, ..., `keys[grouped[end - 1]]`
+     * in a single locked partition, walking through the dense runs of them in order.
+     */
+    template <typename callback_at>
+    static ucset::status_t find_sorted(partition_t& part,
+                                       collection_key_t const* keys,
+                                       std::size_t const* grouped,
+                                       std::size_t begin,
+                                       std::size_t const end,
+                                       callback_at&& callback) noexcept {
+        while (begin != end) {
+            // Split the keys into runs within the same collection
+            collection_key_t const first = keys[grouped[begin]];
+            std::size_t run_end = begin + 1;
+            while (run_end != end && run_end - begin != walk_run_k &&
+                   keys[grouped[run_end]].collection == first.collection)
+                ++run_end;
+            collection_key_t const last = keys[grouped[run_end - 1]];
+
+            std::size_t const run_length = run_end - begin;
+            bool const walk = run_length > 1 && last.key != std::numeric_limits<ustore_key_t>::max() &&
+                              part.expected_count(first.collection, first.key, last.key) <=
+                                  walk_density_k * run_length;
+            ucset::status_t status;
+            if (walk) {
+                std::size_t cursor = begin;
+                collection_key_t const after_last {last.collection, last.key + 1};
+                status = part.set.range(first, after_last, [&](pair_t& pair) noexcept {
+                    for (; cursor != run_end && keys[grouped[cursor]] < pair.collection_key; ++cursor)
+                        callback(grouped[cursor], nullptr);
+                    for (; cursor != run_end && keys[grouped[cursor]] == pair.collection_key; ++cursor)
+                        callback(grouped[cursor], &pair);
+                });
+                for (; status && cursor != run_end; ++cursor)
+                    callback(grouped[cursor], nullptr);
+            }
+            else
+                for (std::size_t j = begin; status && j != run_end; ++j) {
+                    std::size_t i = grouped[j];
+                    status = part.set.find(
+                        keys[i],
+                        [&](pair_t const& pair) noexcept { callback(i, &pair); },
+                        [&]() noexcept { callback(i, nullptr); });
+                }
+            if (!status)
+                return status;
+            begin = run_end;
+        }
+        return {};
+    }
+
+    using part_transactions_t = std::vector<std::optional<part_transaction_t>>;
+
+    /**
+     * @brief Stages the transactions of the @p touched partitions, which the caller holds locked exclusively.
+     * If any of them fails, the already staged ones are rolled back, and nothing becomes visible.
+     */
+    static ucset::status_t stage(part_transactions_t& txns, parts_mask_t touched) noexcept {
+        for (std::size_t i = 0; i != txns.size(); ++i) {
+            if (!touched[i])
+                continue;
+            if (auto status = txns[i]->stage(); !status) {
+                for (std::size_t j = 0; j != i; ++j)
+                    if (touched[j])
+                        txns[j]->rollback();
+                return status;
+            }
+        }
+        return {};
+    }
+
+    /**
+     * @brief Rolls back the staged transactions of the @p touched partitions.
+     */
+    static void rollback(part_transactions_t& txns, parts_mask_t touched) noexcept {
+        for (std::size_t i = 0; i != txns.size(); ++i)
+            if (touched[i])
+                txns[i]->rollback();
+    }
+
+    /**
+     * @brief Publishes the transactions, staged by `stage()` under the same locks.
+     * Staged entries already reside in their partitions and passed the conflict checks,
+     * so committing them only makes them visible, which can't fail.
+     */
+    static void publish(part_transactions_t& txns, parts_mask_t touched) noexcept {
+        for (std::size_t i = 0; i != txns.size(); ++i)
+            if (touched[i])
+                txns[i]->commit();
+    }
+
+  public:
+    class transaction_t {
+        friend class partitioned_set_t;
+        partitioned_set_t* set_ = nullptr;
+        part_transactions_t parts_;
+        std::vector<std::vector<collection_key_t>> updated_keys_;
+        generation_t generation_ = 0;
+
+        transaction_t(partitioned_set_t& set) noexcept(false)
+            : set_(&set), parts_(set.parts_.size()), updated_keys_(set.parts_.size()) {}
+
+        struct change_t {
+            collection_key_t key;
+            ustore_length_t old_length;
+            ustore_length_t new_length;
+        };
+
+        ucset::status_t track(std::size_t idx, collection_key_t const& key) noexcept {
+            try {
+                updated_keys_[idx].push_back(key);
+                return {};
+            }
+            catch (...) {
+                return {errc_t::out_of_memory_heap_k};
+            }
+        }
+
+        /**
+         * @brief Resolves the lengths of the updated entries before and after the commit,
+         * while the touched partitions are locked, to keep their histograms up to date.
+         */
+        ucset::status_t resolve_changes(parts_mask_t touched, std::vector<change_t>& changes) noexcept {
+            try {
+                for (std::size_t i = 0; i != parts_.size(); ++i) {
+                    if (!touched[i])
+                        continue;
+                    partition_t& part = *set_->parts_[i];
+                    auto& keys = updated_keys_[i];
+                    std::sort(keys.begin(), keys.end());
+                    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+                    for (collection_key_t const& key : keys) {
+                        ustore_length_t new_length = ustore_length_missing_k;
+                        parts_[i]->find(key, [&](pair_t const& pair) noexcept { new_length = pair.value_length; });
+                        if (new_length != ustore_length_missing_k && !part.reserve_stats(key.collection))
+                            return {errc_t::out_of_memory_heap_k};
+                        changes.push_back({key, part.length_of(key), new_length});
+                    }
+                }
+                return {};
+            }
+            catch (...) {
+                return {errc_t::out_of_memory_heap_k};
+            }
+        }
+
+        parts_mask_t touched_parts() const noexcept {
+            parts_mask_t mask;
+            for (std::size_t i = 0; i != parts_.size(); ++i)
+                mask.set(i, parts_[i].has_value());
+            return mask;
+        }
+
+        /**
+         * @brief Partitions are joined lazily, so that short transactions only lock what they touched.
+         */
+        ucset::status_t join(std::size_t idx) noexcept {
+            if (parts_[idx])
+                return {};
+            std::shared_lock _ {set_->parts_[idx]->mutex};
+            auto maybe_txn = set_->parts_[idx]->set.transaction();
+            if (!maybe_txn)
+                return maybe_txn.status;
+            parts_[idx].emplace(std::move(maybe_txn).value());
+            return {};
+        }
+
+      public:
+        transaction_t(transaction_t&&) noexcept = default;
+        transaction_t& operator=(transaction_t&&) noexcept = default;
+
+        generation_t generation() const noexcept { return generation_; }
+
+        ucset::status_t watch(collection_key_t const& key) noexcept {
+            std::size_t idx = set_->part_idx(key);
+            if (auto status = join(idx); !status)
+                return status;
+            std::shared_lock _ {set_->parts_[idx]->mutex};
+            return parts_[idx]->watch(key);
+        }
+
+        ucset::status_t watch(pair_t const& pair) noexcept { return watch(pair.collection_key); }
+
+        // Changes are buffered within the transaction until staged
+        ucset::status_t upsert(pair_t&& pair) noexcept {
+            std::size_t idx = set_->part_idx(pair.collection_key);
+            if (auto status = join(idx); !status)
+                return status;
+            if (auto status = track(idx, pair.collection_key); !status)
+                return status;
+            return parts_[idx]->upsert(std::move(pair));
+        }
+
+        ucset::status_t erase(collection_key_t const& key) noexcept {
+            std::size_t idx = set_->part_idx(key);
+            if (auto status = join(idx); !status)
+                return status;
+            if (auto status = track(idx, key); !status)
+                return status;
+            return parts_[idx]->erase(key);
+        }
+
+        template <typename callback_found_at, typename callback_missing_at = no_op_t>
+        ucset::status_t find(collection_key_t const& key,
+                      callback_found_at&& callback_found,
+                      callback_missing_at&& callback_missing = {}) noexcept {
+            std::size_t idx = set_->part_idx(key);
+            if (!parts_[idx])
+                return set_->find(key, callback_found, callback_missing);
+            std::shared_lock _ {set_->parts_[idx]->mutex};
+            return parts_[idx]->find(key, callback_found, callback_missing);
+        }
+
+        /**
+         * @brief Looks up and optionally watches a batch of keys, sorted in ascending order,
+         * joining and locking every touched partition once.
+         * The @p callback receives the index of the key and the found entry or `nullptr`.
+         */
+        template <typename callback_at>
+        ucset::status_t find_sorted(collection_key_t const* keys,
+                                    std::size_t count,
+                                    bool watch,
+                                    callback_at&& callback) noexcept {
+            std::vector<std::size_t> grouped, offsets;
+            if (auto status = set_->group_by_parts(keys, count, grouped, offsets); !status)
+                return status;
+
+            for (std::size_t idx = 0; idx != parts_.size(); ++idx) {
+                std::size_t const begin = offsets[idx], end = offsets[idx + 1];
+                if (begin == end)
+                    continue;
+                if (watch)
+                    if (auto status = join(idx); !status)
+                        return status;
+
+                std::shared_lock _ {set_->parts_[idx]->mutex};
+                for (std::size_t j = begin; j != end; ++j) {
+                    std::size_t i = grouped[j];
+                    if (watch)
+                        if (auto status = parts_[idx]->watch(keys[i]); !status)
+                            return status;
+                    auto found = [&](pair_t const& pair) noexcept { callback(i, &pair); };
+                    auto missing = [&]() noexcept { callback(i, nullptr); };
+                    auto status = parts_[idx] //
+                                      ? parts_[idx]->find(keys[i], found, missing)
+                                      : set_->parts_[idx]->set.find(keys[i], found, missing);
+                    if (!status)
+                        return status;
+                }
+            }
+            return {};
+        }
+
+        template <typename callback_found_at, typename callback_missing_at = no_op_t>
+        ucset::status_t upper_bound(collection_key_t const& key,
+                             callback_found_at&& callback_found,
+                             callback_missing_at&& callback_missing = {}) noexcept {
+            locks_gt<false> _ {*set_, set_->all_parts()};
+            pair_t const* closest = nullptr;
+            auto compare = [&](pair_t const& pair) noexcept {
+                if (!closest || pair.collection_key < closest->collection_key)
+                    closest = &pair;
+            };
+            for (std::size_t i = 0; i != parts_.size(); ++i) {
+                auto status = parts_[i] //
+                                  ? parts_[i]->upper_bound(key, compare, no_op_t {})
+                                  : set_->parts_[i]->set.upper_bound(key, compare, no_op_t {});
+                if (!status)
+                    return status;
+            }
+            closest ? callback_found(*closest) : callback_missing();
+            return {};
+        }
+
+        /**
+         * @brief Visits the entries following @p previous in ascending order, including the uncommitted
+         * changes, until the @p callback returns false. See `partitioned_set_t::scan_runs()`.
+         */
+        template <typename callback_at>
+        ucset::status_t scan(collection_key_t const& previous, std::size_t expected, callback_at&& callback) noexcept {
+            auto successor = [&](std::size_t i, collection_key_t const& key, auto&& found, auto&& missing) noexcept {
+                return parts_[i] //
+                           ? parts_[i]->upper_bound(key, found, missing)
+                           : set_->parts_[i]->set.upper_bound(key, found, missing);
+            };
+            return set_->scan_runs(previous, expected, successor, callback);
+        }
+
+        /**
+         * @brief Stages and commits all the touched partitions, without releasing their locks in between.
+         * Everything, that may fail, happens before the first partition is published, so the commit
+         * is all-or-nothing. Commits are numbered by a counter shared by all the partitions.
+         * The @p log is invoked once everything is staged, and its failure rolls the stages back.
+         */
+        template <typename log_at = no_log_t>
+        ucset::status_t commit(log_at&& log = {}) noexcept {
+            parts_mask_t touched = touched_parts();
+            locks_gt<true> _ {*set_, touched};
+            std::vector<change_t> changes;
+            if (auto status = resolve_changes(touched, changes); !status)
+                return status;
+            if (auto status = stage(parts_, touched); !status)
+                return status;
+            if (!log()) {
+                rollback(parts_, touched);
+                return {errc_t::consistency_k};
+            }
+
+            publish(parts_, touched);
+            generation_ = touched.any() ? ++set_->commits_ : set_->commits_.load();
+            // Removals go last, as the histograms are dropped, once they have no entries left
+            for (bool removals : {false, true})
+                for (change_t const& change : changes)
+                    if ((change.new_length == ustore_length_missing_k) == removals)
+                        set_->parts_[set_->part_idx(change.key)]->account(change.key,
+                                                                          change.old_length,
+                                                                          change.new_length);
+            for (auto& keys : updated_keys_)
+                keys.clear();
+            return {};
+        }
+
+        ucset::status_t reset() noexcept {
+            parts_mask_t touched = touched_parts();
+            locks_gt<true> _ {*set_, touched};
+            for (std::size_t i = 0; i != parts_.size(); ++i) {
+                if (!touched[i])
+                    continue;
+                if (auto status = parts_[i]->reset(); !status)
+                    return status;
+                parts_[i].reset();
+                updated_keys_[i].clear();
+            }
+            return {};
+        }
+    };
+
+    partitioned_set_t() = default;
+    partitioned_set_t(partitioned_set_t&& other) noexcept
+        : parts_(std::move(other.parts_)), commits_(other.commits_.load()) {}
+
+    static std::optional<partitioned_set_t> make(std::size_t parts_count) noexcept {
+        if (!parts_count || parts_count > max_parts_k)
+            return std::nullopt;
+        try {
+            partitioned_set_t set;
+            set.parts_.reserve(parts_count);
+            for (std::size_t i = 0; i != parts_count; ++i) {
+                auto maybe_part = part_t::make();
+                if (!maybe_part)
+                    return std::nullopt;
+                set.parts_.push_back(std::make_unique<partition_t>(std::move(maybe_part).value()));
+            }
+            return set;
+        }
+        catch (...) {
+            return std::nullopt;
+        }
+    }
+
+    std::optional<transaction_t> transaction() noexcept {
+        try {
+            return transaction_t {*this};
+        }
+        catch (...) {
+            return std::nullopt;
+        }
+    }
+
+    std::size_t parts() const noexcept { return parts_.size(); }
+
+    std::size_t size() const noexcept {
+        std::size_t count = 0;
+        for (auto const& part : parts_) {
+            std::shared_lock _ {part->mutex};
+            count += part->set.size();
+        }
+        return count;
+    }
+
+    template <typename log_at = no_log_t>
+    ucset::status_t upsert(pair_t&& pair, log_at&& log = {}) noexcept {
+        partition_t& part = *parts_[part_idx(pair.collection_key)];
+        std::unique_lock _ {part.mutex};
+        return part.upsert(std::move(pair), log);
+    }
+
+    /**
+     * @brief Stages the parts of a batch in the @p touched partitions, which the caller holds locked
+     * exclusively, and publishes them together, once all of them are staged and logged.
+     */
+    template <typename iterator_at, typename log_at>
+    ucset::status_t upsert_staged(iterator_at begin, iterator_at end, parts_mask_t touched, log_at&& log) noexcept {
+        part_transactions_t txns;
+        try {
+            txns.resize(parts_.size());
+        }
+        catch (...) {
+            return {errc_t::out_of_memory_heap_k};
+        }
+        for (std::size_t idx = 0; idx != parts_.size(); ++idx) {
+            if (!touched[idx])
+                continue;
+            auto maybe_txn = parts_[idx]->set.transaction();
+            if (!maybe_txn)
+                return maybe_txn.status;
+            txns[idx].emplace(std::move(maybe_txn).value());
+        }
+
+        for (; begin != end; ++begin) {
+            auto&& pair = *begin;
+            part_transaction_t& txn = *txns[part_idx(pair.collection_key)];
+            auto status = pair ? txn.upsert(std::move(pair)) : txn.erase(pair.collection_key);
+            if (!status)
+                return status;
+        }
+        if (auto status = stage(txns, touched); !status)
+            return status;
+        if (!log()) {
+            rollback(txns, touched);
+            return {errc_t::consistency_k};
+        }
+        publish(txns, touched);
+        return {};
+    }
+
+    /**
+     * @brief Atomically inserts a batch, that may span several partitions.
+     * The lengths it replaces are gathered beforehand, in a single ordered pass over its
+     * sorted keys, so that a single partition receives the whole batch in one bulk insertion.
+     * Several partitions stage their parts of the batch first, so that either all or none
+     * of them are changed. The @p log is invoked, once nothing but the insertion itself can fail.
+     */
+    template <typename iterator_at, typename log_at = no_log_t>
+    ucset::status_t upsert(iterator_at begin, iterator_at end, log_at&& log = {}) noexcept {
+        // The last entry of every key wins, so the equal keys keep the order of the batch
+        std::vector<collection_key_t> keys;
+        std::vector<ustore_length_t> lengths;
+        std::vector<std::size_t> sorted, grouped, offsets;
+        try {
+            for (auto it = begin; it != end; ++it) {
+                auto&& pair = *it;
+                keys.push_back(pair.collection_key);
+                lengths.push_back(pair.value_length);
+            }
+            sorted.resize(keys.size());
+            std::iota(sorted.begin(), sorted.end(), 0);
+            if (!std::is_sorted(keys.begin(), keys.end()))
+                std::stable_sort(sorted.begin(), sorted.end(), [&](std::size_t a, std::size_t b) noexcept {
+                    return keys[a] < keys[b];
+                });
+            std::vector<collection_key_t> sorted_keys(keys.size());
+            for (std::size_t i = 0; i != sorted.size(); ++i)
+                sorted_keys[i] = keys[sorted[i]];
+            keys = std::move(sorted_keys);
+        }
+        catch (...) {
+            return {errc_t::out_of_memory_heap_k};
+        }
+        if (auto status = group_by_parts(keys.data(), keys.size(), grouped, offsets); !status)
+            return status;
+
+        parts_mask_t touched;
+        for (std::size_t idx = 0; idx != parts_.size(); ++idx)
+            touched[idx] = offsets[idx] != offsets[idx + 1];
+        locks_gt<true> _ {*this, touched};
+
+        // Collect the replaced lengths and prepare the histograms, before changing anything
+        std::vector<ustore_length_t> replaced;
+        try {
+            replaced.resize(keys.size(), ustore_length_missing_k);
+        }
+        catch (...) {
+            return {errc_t::out_of_memory_heap_k};
+        }
+        for (std::size_t idx = 0; idx != parts_.size(); ++idx) {
+            partition_t& part = *parts_[idx];
+            auto remember = [&](std::size_t i, pair_t const* pair) noexcept {
+                if (pair)
+                    replaced[i] = pair->value_length;
+            };
+            if (auto status = find_sorted(part, keys.data(), grouped.data(), offsets[idx], offsets[idx + 1], remember);
+                !status)
+                return status;
+            for (std::size_t j = offsets[idx]; j != offsets[idx + 1]; ++j) {
+                std::size_t const i = grouped[j];
+                if (lengths[sorted[i]] != ustore_length_missing_k && !part.reserve_stats(keys[i].collection))
+                    return {errc_t::out_of_memory_heap_k};
+            }
+        }
+
+        if (parts_.size() == 1) {
+            if (!log())
+                return {errc_t::consistency_k};
+            if (auto status = parts_.front()->set.upsert(std::move(begin), std::move(end)); !status)
+                return status;
+        }
+        else if (auto status = upsert_staged(std::move(begin), std::move(end), touched, log); !status)
+            return status;
+
+        // Account every key once, for the last of its entries. Removals go last,
+        // as the histograms are dropped, once they have no entries left.
+        for (bool removals : {false, true})
+            for (std::size_t idx = 0; idx != parts_.size(); ++idx)
+                for (std::size_t j = offsets[idx]; j != offsets[idx + 1]; ++j) {
+                    std::size_t const i = grouped[j];
+                    ustore_length_t const length = lengths[sorted[i]];
+                    bool const is_last = j + 1 == offsets[idx + 1] || keys[grouped[j + 1]] != keys[i];
+                    if (is_last && (length == ustore_length_missing_k) == removals)
+                        parts_[idx]->account(keys[i], replaced[i], length);
+                }
+        return {};
+    }
+
+    template <typename callback_found_at, typename callback_missing_at = no_op_t>
+    ucset::status_t find(collection_key_t const& key,
+                  callback_found_at&& callback_found,
+                  callback_missing_at&& callback_missing = {}) const noexcept {
+        partition_t const& part = *parts_[part_idx(key)];
+        std::shared_lock _ {part.mutex};
+        return part.set.find(key, callback_found, callback_missing);
+    }
+
+    /**
+     * @brief Looks up a batch of keys, sorted in ascending order, locking every partition once.
+     * Where the requested keys are dense, compared to the stored ones, they are resolved with
+     * a single ordered walk over the partition, instead of descending the tree for each.
+     * The @p callback receives the index of the key and the found entry or `nullptr`.
+     */
+    template <typename callback_at>
+    ucset::status_t find_sorted(collection_key_t const* keys,
+                                std::size_t count,
+                                callback_at&& callback) const noexcept {
+        std::vector<std::size_t> grouped, offsets;
+        if (auto status = group_by_parts(keys, count, grouped, offsets); !status)
+            return status;
+
+        for (std::size_t idx = 0; idx != parts_.size(); ++idx) {
+            if (offsets[idx] == offsets[idx + 1])
+                continue;
+            partition_t& part = *parts_[idx];
+            std::shared_lock _ {part.mutex};
+            if (auto status = find_sorted(part, keys, grouped.data(), offsets[idx], offsets[idx + 1], callback);
+                !status)
+                return status;
+        }
+        return {};
+    }
+
+    template <typename callback_found_at, typename callback_missing_at = no_op_t>
+    ucset::status_t upper_bound(collection_key_t const& key,
+                         callback_found_at&& callback_found,
+                         callback_missing_at&& callback_missing = {}) const noexcept {
+        if (parts_.size() == 1) {
+            std::shared_lock _ {parts_.front()->mutex};
+            return parts_.front()->set.upper_bound(key, callback_found, callback_missing);
+        }
+
+        locks_gt<false> _ {*this, all_parts()};
+        pair_t const* closest = nullptr;
+        auto compare = [&](pair_t const& pair) noexcept {
+            if (!closest || pair.collection_key < closest->collection_key)
+                closest = &pair;
+        };
+        for (auto const& part : parts_)
+            if (auto status = part->set.upper_bound(key, compare, no_op_t {}); !status)
+                return status;
+        closest ? callback_found(*closest) : callback_missing();
+        return {};
+    }
+
+    /**
+     * @brief Visits the entries following @p previous in ascending order, until the @p callback
+     * returns false. Unlike repeated `upper_bound()` calls, every partition is locked and probed
+     * once per run of entries, rather than once per entry, see `scan_runs()`.
+     */
+    template <typename callback_at>
+    ucset::status_t scan(collection_key_t const& previous, std::size_t expected, callback_at&& callback) const noexcept {
+        auto successor = [&](std::size_t i, collection_key_t const& key, auto&& found, auto&& missing) noexcept {
+            return parts_[i]->set.upper_bound(key, found, missing);
+        };
+        return scan_runs(previous, expected, successor, callback);
+    }
+
+    /**
+     * @brief Visits every entry in the range without changing them, holding all the partitions
+     * locked shared, so that no entry is added or removed during the pass.
+     * Unlike the other operations, the entries are not sorted across partitions.
+     */
+    template <typename lower_at, typename upper_at, typename callback_at>
+    ucset::status_t visit_range(lower_at&& lower, upper_at&& upper, callback_at&& callback) const noexcept {
+        locks_gt<false> _ {*this, all_parts()};
+        for (auto const& part : parts_) {
+            auto status = part->set.range(lower, upper, [&](pair_t const& pair) noexcept { callback(pair); });
+            if (!status)
+                return status;
+        }
+        return {};
+    }
+
+    /**
+     * @brief Visits every entry in the range, one exclusively locked partition at a time,
+     * so that the @p callback may replace the values, but not remove them.
+     * Read-only passes should prefer `visit_range()`, which doesn't block the readers.
+     */
+    template <typename lower_at, typename upper_at, typename callback_at>
+    ucset::status_t range(lower_at&& lower, upper_at&& upper, callback_at&& callback) noexcept {
+        for (auto const& part : parts_) {
+            std::unique_lock _ {part->mutex};
+            auto status = part->set.range(lower, upper, [&](pair_t& pair) noexcept {
+                collection_key_t key = pair.collection_key;
+                ustore_length_t old_length = pair.value_length;
+                callback(pair);
+                part->account(key, old_length, pair.value_length);
+            });
+            if (!status)
+                return status;
+        }
+        return {};
+    }
+
+    /**
+     * @brief Like `range()`, but locks all the partitions up front, so that the replaced values
+     * become visible together, and invokes the @p log before replacing anything.
+     */
+    template <typename lower_at, typename upper_at, typename callback_at, typename log_at = no_log_t>
+    ucset::status_t replace_range(lower_at&& lower,
+                                  upper_at&& upper,
+                                  callback_at&& callback,
+                                  log_at&& log = {}) noexcept {
+        locks_gt<true> _ {*this, all_parts()};
+        if (!log())
+            return {errc_t::consistency_k};
+        for (auto const& part : parts_) {
+            auto status = part->set.range(lower, upper, [&](pair_t& pair) noexcept {
+                collection_key_t key = pair.collection_key;
+                ustore_length_t old_length = pair.value_length;
+                callback(pair);
+                part->account(key, old_length, pair.value_length);
+            });
+            if (!status)
+                return status;
+        }
+        return {};
+    }
+
+    template <typename lower_at, typename upper_at, typename callback_at, typename log_at = no_log_t>
+    ucset::status_t erase_range(lower_at&& lower,
+                                upper_at&& upper,
+                                callback_at&& callback,
+                                log_at&& log = {}) noexcept {
+        locks_gt<true> _ {*this, all_parts()};
+        if (!log())
+            return {errc_t::consistency_k};
+        for (auto const& part : parts_) {
+            auto status = part->set.erase_range(lower, upper, [&](pair_t& pair) noexcept {
+                part->account(pair.collection_key, pair.value_length, ustore_length_missing_k);
+                callback(pair);
+            });
+            if (!status)
+                return status;
+        }
+        return {};
+    }
+
+    /**
+     * @brief Reservoir-samples the range, continuing the same reservoir in every partition.
+     */
+    template <typename lower_at, typename upper_at, typename generator_at, typename output_iterator_at>
+    ucset::status_t sample_range(lower_at&& lower,
+                          upper_at&& upper,
+                          generator_at&& generator,
+                          std::size_t& seen,
+                          std::size_t reservoir_capacity,
+                          output_iterator_at&& reservoir) const noexcept {
+        for (auto const& part : parts_) {
+            std::shared_lock _ {part->mutex};
+            auto status = part->set.sample_range(lower, upper, generator, seen, reservoir_capacity, reservoir);
+            if (!status)
+                return status;
+        }
+        return {};
+    }
+
+    ucset::status_t clear() noexcept {
+        locks_gt<true> _ {*this, all_parts()};
+        for (auto const& part : parts_) {
+            if (auto status = part->set.clear(); !status)
+                return status;
+            part->stats.clear();
+        }
+        return {};
+    }
+
+    /**
+     * @brief Bounds the statistics of the `[min_key, max_key)` range of a collection from the histograms,
+     * without visiting the entries, unless a partially covered bucket is small enough to be counted exactly.
+     * The largest key is reserved for `ustore_key_unknown_k`, so it closes the range inclusively,
+     * making whole-collection estimates exact.
+     */
+    void estimate(ustore_collection_t collection,
+                  ustore_key_t min_key,
+                  ustore_key_t max_key,
+                  stats_t& lower,
+                  stats_t& upper) const noexcept {
+        lower = upper = {};
+        if (min_key >= max_key)
+            return;
+
+        bool const open_ended = max_key == std::numeric_limits<ustore_key_t>::max();
+        std::size_t const first_bucket = histogram_t::bucket_of(min_key);
+        std::size_t const last_bucket = histogram_t::bucket_of(open_ended ? max_key : max_key - 1);
+        for (auto const& part : parts_) {
+            std::shared_lock _ {part->mutex};
+            auto it = part->stats.find(collection);
+            if (it == part->stats.end())
+                continue;
+
+            histogram_t const& histogram = it->second;
+            for (std::size_t bucket = first_bucket; bucket <= last_bucket; ++bucket) {
+                stats_t const& bucket_stats = histogram.buckets[bucket];
+                if (!bucket_stats.count)
+                    continue;
+
+                ustore_key_t bucket_min = histogram_t::bucket_min(bucket);
+                ustore_key_t bucket_max = histogram_t::bucket_max(bucket);
+                bool const covered = min_key <= bucket_min && (open_ended || bucket_max < max_key);
+                if (covered) {
+                    lower += bucket_stats;
+                    upper += bucket_stats;
+                }
+                else if (bucket_stats.count <= exact_bucket_limit_k) {
+                    stats_t exact;
+                    collection_key_t scan_min {collection, std::max(min_key, bucket_min)};
+                    collection_key_t scan_max {collection, bucket_max < max_key ? bucket_max + 1 : max_key};
+                    part->set.range(scan_min, scan_max, [&](pair_t const& pair) noexcept {
+                        exact.add(pair.value_length);
+                    });
+                    lower += exact;
+                    upper += exact;
+                }
+                else
+                    upper += bucket_stats;
+            }
+        }
+    }
+};
+
+using ucset_t = partitioned_set_t;
+using pairs_transaction_t = typename ucset_t::transaction_t;
+using generation_t = typename ucset_t::generation_t;
+
+template <typename set_or_transaction_at, typename callback_at>
+ucset::status_t find_and_watch(set_or_transaction_at& set_or_transaction,
+                               collection_key_t collection_key,
+                               ustore_options_t options,
+                               callback_at&& callback) noexcept {
+
+    if constexpr (!std::is_same<set_or_transaction_at, ucset_t>()) {
+        bool dont_watch = options & ustore_option_transaction_dont_watch_k;
+        if (!dont_watch)
+            if (auto watch_status = set_or_transaction.watch(collection_key); !watch_status)
+                return watch_status;
+    }
+
+    auto find_status = set_or_transaction.find(
+        collection_key,
+        [&](pair_t const& pair) noexcept {
+            pair.touch();
+            callback(pair.value());
+        },
+        [&]() noexcept { callback(value_view_t {}); });
+    return find_status;
+}
+
+template <typename set_or_transaction_at, typename callback_at>
+ucset::status_t scan_and_watch(set_or_transaction_at& set_or_transaction,
+                               collection_key_t start,
+                               collection_key_t end,
+                               std::size_t range_limit,
+                               ustore_options_t options,
+                               callback_at&& callback) noexcept {
+
+    std::size_t match_idx = 0;
+    collection_key_t previous = start;
+    bool reached_end = false;
+    auto watch_status = ucset::status_t();
+    auto callback_pair = [&](pair_t const& pair) noexcept {
+        reached_end = !(pair.collection_key < end);
+        if (reached_end)
+            return;
+
+        if constexpr (!std::is_same<set_or_transaction_at, ucset_t>()) {
+            bool dont_watch = options & ustore_option_transaction_dont_watch_k;
+            if (!dont_watch)
+                if (watch_status = set_or_transaction.watch(pair); !watch_status)
+                    return;
+        }
+
+        callback(pair);
+        previous.key = pair.collection_key.key;
+        ++match_idx;
+    };
+
+    auto find_status = set_or_transaction.find(start, callback_pair, {});
+    if (!find_status)
+        return find_status;
+    if (!watch_status)
+        return watch_status;
+    if (match_idx == range_limit || reached_end)
+        return {};
+
+    find_status = set_or_transaction.scan(previous, range_limit - match_idx, [&](pair_t const& pair) noexcept {
+        callback_pair(pair);
+        return match_idx != range_limit && !reached_end && watch_status;
+    });
+    if (!find_status)
+        return find_status;
+    return watch_status;
+}
+
+template <typename set_or_transaction_at, typename callback_at>
+ucset::status_t scan_full(set_or_transaction_at& set_or_transaction, callback_at&& callback) noexcept {
+
+    collection_key_t previous {
+        std::numeric_limits<ustore_collection_t>::min(),
+        std::numeric_limits<ustore_key_t>::min(),
+    };
+    return set_or_transaction.scan(previous, std::numeric_limits<std::size_t>::max(), [&](pair_t const& pair) noexcept {
+        callback(pair);
+        return true;
+    });
+}
+
+/*********************************************************/
+/*****************	   Write-Ahead Log	  ****************/
+/*********************************************************/
+
+/**
+ * @brief Types of records in the write-ahead log.
+ * Every record is framed as `[length:u32][checksum:u32][type:u8][payload]`,
+ * where the checksum covers the type and the payload. On recovery the log is
+ * replayed until the end of file or the first torn/corrupted record.
+ * Changes are logged before they are published, so the ones that fail to apply afterwards
+ * are followed by a `cancel_k` record, pointing back at them.
+ */
+enum class wal_record_t : std::uint8_t {
+    /**
+     * @brief Names of all collections, always the first record: `[count:u32]{[id:u64][length:u32][name]}`.
+     * Logs, appended to the previous ones, start with it as well, so it also marks the segment of every file.
+     */
+    catalog_k = 1,
+    /** @brief New named collection: `[id:u64][length:u32][name]`. */
+    create_k = 2,
+    /** @brief Dropped collection contents and/or handle: `[id:u64][mode:u8]`. */
+    drop_k = 3,
+    /** @brief Atomic batch of writes: `[count:u32]{[collection:u64][key:i64][length:u32][bytes]}`. */
+    batch_k = 4,
+    /** @brief Change, that was logged, but failed to apply: `[offset:u64]` of its record in the same segment. */
+    cancel_k = 5,
+};
+
+constexpr std::size_t wal_header_size_k = sizeof(std::uint32_t) + sizeof(std::uint32_t) + sizeof(wal_record_t);
+
+/**
+ * @brief 32-bit FNV-1a over the record type and payload.
+ */
+inline std::uint32_t wal_checksum(wal_record_t type, std::string_view payload) noexcept {
+    std::uint32_t hash = 2166136261u;
+    hash = (hash ^ static_cast<std::uint8_t>(type)) * 16777619u;
+    for (char c : payload)
+        hash = (hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+    return hash;
+}
+
+template <typename scalar_at>
+void wal_push(std::string& buffer, scalar_at scalar) noexcept(false) {
+    buffer.append(reinterpret_cast<char const*>(&scalar), sizeof(scalar_at));
+}
+
+template <typename scalar_at>
+bool wal_pop(std::string_view& buffer, scalar_at& scalar) noexcept {
+    if (buffer.size() < sizeof(scalar_at))
+        return false;
+    std::memcpy(&scalar, buffer.data(), sizeof(scalar_at));
+    buffer.remove_prefix(sizeof(scalar_at));
+    return true;
+}
+
+inline void wal_push_name(std::string& buffer, ustore_collection_t id, std::string_view name) noexcept(false) {
+    wal_push(buffer, id);
+    wal_push(buffer, static_cast<std::uint32_t>(name.size()));
+    buffer.append(name);
+}
+
+inline bool wal_pop_name(std::string_view& buffer, ustore_collection_t& id, std::string_view& name) noexcept {
+    std::uint32_t length = 0;
+    if (!wal_pop(buffer, id) || !wal_pop(buffer, length) || buffer.size() < length)
+        return false;
+    name = buffer.substr(0, length);
+    buffer.remove_prefix(length);
+    return true;
+}
+
+/**
+ * @brief Serialized payload of a `wal_record_t::batch_k` record.
+ * Filled outside of any locks, so that the critical section only has to append it.
+ */
+struct wal_batch_t {
+    std::string payload;
+    std::uint32_t count = 0;
+
+    void clear() noexcept {
+        payload.clear();
+        count = 0;
+    }
+
+    void push_back(collection_key_t collection_key, value_view_t value) noexcept(false) {
+        if (payload.empty())
+            wal_push(payload, count);
+        ++count;
+        std::memcpy(payload.data(), &count, sizeof(count));
+
+        wal_push(payload, collection_key.collection);
+        wal_push(payload, collection_key.key);
+        wal_push(payload, value ? static_cast<ustore_length_t>(value.size()) : ustore_length_missing_k);
+        payload.append(reinterpret_cast<char const*>(value.data()), value.size());
+    }
+};
+
+/**
+ * @brief Append-only log file with group commit.
+ *
+ * Records get their sequence numbers in the order they are written to the file.
+ * Writers append them while holding the partitions they change, right before publishing,
+ * so conflicting changes are logged in the order of their effects, and independent ones
+ * don't wait for each other beyond the @c write itself. Making them durable is a separate
+ * step: concurrent committers wait for a single @c fdatasync that covers all of them,
+ * instead of issuing one each.
+ */
+class wal_t {
+    int file_ = -1;
+    std::atomic<std::size_t> size_ = 0;
+    std::atomic<std::uint64_t> appended_ = 0;
+    std::mutex append_mutex_;
+
+    std::mutex sync_mutex_;
+    std::condition_variable synced_cv_;
+    std::uint64_t synced_ = 0;
+    bool syncing_ = false;
+
+  public:
+    wal_t() = default;
+    wal_t(wal_t const&) = delete;
+    wal_t& operator=(wal_t const&) = delete;
+    ~wal_t() noexcept { close(); }
+
+    bool is_open() const noexcept { return file_ >= 0; }
+    std::size_t size() const noexcept { return size_.load(); }
+    std::uint64_t appended() const noexcept { return appended_.load(); }
+
+    /**
+     * @brief Sequence number of the last record known to be on disk.
+     */
+    std::uint64_t synced() noexcept {
+        std::unique_lock lock {sync_mutex_};
+        return synced_;
+    }
+
+    void open(std::string const& path, ustore_error_t* c_error) noexcept {
+        file_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        return_error_if_m(file_ >= 0, c_error, error_unknown_k, "Couldn't open the write-ahead log");
+        auto end = ::lseek(file_, 0, SEEK_END);
+        return_error_if_m(end >= 0, c_error, error_unknown_k, "Couldn't seek the write-ahead log");
+        size_ = static_cast<std::size_t>(end);
+    }
+
+    void close() noexcept {
+        if (file_ < 0)
+            return;
+        ::fdatasync(file_);
+        ::close(file_);
+        file_ = -1;
+    }
+
+    /**
+     * @brief Appends a record without waiting for it to become durable.
+     * @param[out] offset Position of the record in the current file, to `cancel_k` it later.
+     * @return Sequence number to be passed into `sync()`, or zero on failure.
+     */
+    std::uint64_t append(wal_record_t type,
+                         std::string_view payload,
+                         ustore_error_t* c_error,
+                         std::uint64_t* offset = nullptr) noexcept {
+        std::string frame;
+        safe_section("Framing WAL record", c_error, [&] {
+            frame.reserve(wal_header_size_k + payload.size());
+            wal_push(frame, static_cast<std::uint32_t>(payload.size()));
+            wal_push(frame, wal_checksum(type, payload));
+            wal_push(frame, type);
+            frame.append(payload);
+        });
+        if (*c_error)
+            return 0;
+
+        // A partial write would make every later record unreachable on replay,
+        // so we cut the file back to its previous size.
+        std::unique_lock lock {append_mutex_};
+        std::size_t written = 0;
+        while (written != frame.size()) {
+            auto result = ::write(file_, frame.data() + written, frame.size() - written);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0) {
+                [[maybe_unused]] auto truncated = ::ftruncate(file_, static_cast<off_t>(size_.load()));
+                log_error_m(c_error, error_unknown_k, "Couldn't append to the write-ahead log");
+                return 0;
+            }
+            written += static_cast<std::size_t>(result);
+        }
+        if (offset)
+            *offset = size_.load();
+        size_ += frame.size();
+        return ++appended_;
+    }
+
+    /**
+     * @brief Blocks until the record with the given sequence number is on disk.
+     * Only one thread calls @c fdatasync at a time, covering all the records
+     * appended before it started. Others just wait for it to finish.
+     */
+    void sync(std::uint64_t sequence, ustore_error_t* c_error) noexcept {
+        std::unique_lock lock {sync_mutex_};
+        while (synced_ < sequence) {
+            if (syncing_) {
+                synced_cv_.wait(lock);
+                continue;
+            }
+
+            syncing_ = true;
+            std::uint64_t target = appended_.load();
+            int file = file_;
+            lock.unlock();
+            bool synced = ::fdatasync(file) == 0;
+            lock.lock();
+            syncing_ = false;
+            if (synced)
+                synced_ = std::max(synced_, target);
+            synced_cv_.notify_all();
+            return_error_if_m(synced, c_error, error_unknown_k, "Couldn't flush the write-ahead log");
+        }
+    }
+
+    /**
+     * @brief Moves the current log to @p old_path and starts a new empty one.
+     * If the @p old_path is still there, as the last checkpoint failed, the current log is appended to it,
+     * so that the records of both are folded by the next checkpoint. A crash right after appending replays
+     * the current records twice, which is harmless, as they start with the catalog and overwrite the same keys.
+     * The caller must make sure, that no changes are being logged and published meanwhile.
+     */
+    void rotate(std::string const& path, std::string const& old_path, ustore_error_t* c_error) noexcept {
+        std::unique_lock append_lock {append_mutex_};
+        std::unique_lock lock {sync_mutex_};
+        synced_cv_.wait(lock, [&] { return !syncing_; });
+        close();
+        std::error_code moved;
+        if (stdfs::exists(old_path, moved)) {
+            append_file(path, old_path, c_error);
+            if (!*c_error)
+                stdfs::remove(path, moved);
+        }
+        else if (!moved)
+            stdfs::rename(path, old_path, moved);
+        synced_ = appended_.load();
+        open(path, c_error);
+        return_if_error_m(c_error);
+        return_error_if_m(!moved, c_error, error_unknown_k, "Couldn't rotate the write-ahead log");
+    }
+
+  private:
+    /**
+     * @brief Appends the contents of @p source to @p target and flushes it.
+     * On failure the @p target is cut back to its previous size.
+     */
+    static void append_file(std::string const& source, std::string const& target, ustore_error_t* c_error) noexcept {
+        int input = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        return_error_if_m(input >= 0, c_error, error_unknown_k, "Couldn't open the write-ahead log");
+        int output = ::open(target.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (output < 0) {
+            ::close(input);
+            log_error_m(c_error, error_unknown_k, "Couldn't open the previous write-ahead log");
+            return;
+        }
+
+        auto const previous_size = ::lseek(output, 0, SEEK_END);
+        char buffer[64 * 1024];
+        bool copied = previous_size >= 0;
+        while (copied) {
+            auto result = ::read(input, buffer, sizeof(buffer));
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0) {
+                copied = result == 0;
+                break;
+            }
+            for (std::size_t written = 0; copied && written != static_cast<std::size_t>(result);) {
+                auto step = ::write(output, buffer + written, static_cast<std::size_t>(result) - written);
+                if (step < 0 && errno == EINTR)
+                    continue;
+                copied = step > 0;
+                written += copied ? static_cast<std::size_t>(step) : 0;
+            }
+        }
+        copied = copied && ::fdatasync(output) == 0;
+        if (!copied && previous_size >= 0) {
+            [[maybe_unused]] auto truncated = ::ftruncate(output, previous_size);
+        }
+        ::close(output);
+        ::close(input);
+        return_error_if_m(copied, c_error, error_unknown_k, "Couldn't append to the previous write-ahead log");
+    }
+};
+
+/**
+ * @brief Flushes a file or a directory entry, so that the preceding writes or renames are durable.
+ */
+inline void sync_path(std::string const& path, ustore_error_t* c_error) noexcept {
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    return_error_if_m(file >= 0, c_error, error_unknown_k, "Couldn't open a file to flush it");
+    bool synced = ::fsync(file) == 0;
+    ::close(file);
+    return_error_if_m(synced, c_error, error_unknown_k, "Couldn't flush a file");
+}
+
+/*********************************************************/
+/***************** Collections Management ****************/
+/*********************************************************/
+
+struct string_hash_t {
+    using stl_t = std::hash<std::string_view>;
+    using is_transparent = void;
+
+    auto operator()(const char* str) const { return stl_t {}(str); }
+    auto operator()(std::string_view str) const { return stl_t {}(str); }
+    auto operator()(std::string const& str) const { return stl_t {}(str); }
+};
+
+struct string_eq_t : public std::equal_to<std::string_view> {
+    using is_transparent = void;
+};
+
+struct string_less_t : public std::less<std::string_view> {
+    using is_transparent = void;
+};
+
+/**
+ * @brief The set only keeps the latest version of every entry, so writers
+ * preserve the previous one here, right before the first change made after
+ * the snapshot was taken. Entries are never modified or removed afterwards,
+ * so views into them stay valid until the snapshot is dropped.
+ *
+ * This keeps reads and writes free of version checks, while no snapshots exist,
+ * which is the common case. The cost is paid only by the writes, that overwrite
+ * a key for the first time since a snapshot was taken: the old value is copied
+ * once and shared by all the snapshots, that still miss it. So a snapshot never
+ * holds more than one version of every key, and the memory of all of them
+ * together is bounded by the number of keys overwritten since the oldest one,
+ * plus a map node per snapshot and key.
+ */
+struct snapshot_t {
+    std::shared_mutex mutex;
+    std::map<collection_key_t, std::shared_ptr<pair_t const>> originals;
+};
+
+using snapshot_ptr_t = std::shared_ptr<snapshot_t>;
+
+struct database_t {
+    /**
+     * @brief Reclaims the values of this database, exported by pinned reads.
+     * Declared first, as all the other members may own values.
+     * Outlives the database, until the last pinned read is released.
+     */
+    owner_ptr_t owner;
+
+    /**
+     * @brief Rarely-used mutex for global reorganizations, like:
+     * - Removing existing collections or adding new ones.
+     * - Listing present collections.
+     */
+    std::shared_mutex restructuring_mutex;
+
+    /**
+     * @brief Primary database state.
+     */
+    ucset_t pairs;
+
+    /**
+     * @brief A variable-size set of named collections.
+     * It's cleaner to implement it with heterogenous lookups as
+     * an @c std::unordered_map, but it requires GCC11 and C++20.
+     */
+    std::map<std::string, ustore_collection_t, string_less_t> names;
+
+    /**
+     * @brief Path on disk, from which the data will be read.
+     * When closed, we will try saving the DB on disk.
+     */
+    std::string persisted_directory;
+
+    /**
+     * @brief Live snapshots by their IDs.
+     * Writers lock the mutex shared, while preserving the previous values, logging and
+     * applying their changes, so that no snapshot or checkpoint can be taken mid-write.
+     */
+    std::shared_mutex snapshots_mutex;
+    std::unordered_map<ustore_snapshot_t, snapshot_ptr_t> snapshots;
+
+    /**
+     * @brief Internal snapshot, pinning the state the running checkpoint dumps.
+     * Hidden from the users, zero if no checkpoint is in progress.
+     */
+    ustore_snapshot_t checkpoint_snapshot = 0;
+
+    ucset_options_t options;
+
+    /**
+     * @brief Log of changes applied since the last checkpoint.
+     * Only open, if the @c persisted_directory is set.
+     */
+    wal_t wal;
+
+    /**
+     * @brief Sequence number of the last @c wal record, covered by a completed checkpoint.
+     * Once it matches `wal_t::appended()`, the Parquet files hold the whole state.
+     */
+    std::atomic<std::uint64_t> checkpointed = 0;
+
+    /**
+     * @brief Background thread, folding the @c wal into Parquet files.
+     * Woken up through @c checkpoint_cv, when the log grows too large,
+     * or by the `ucset_options_t::checkpoint_interval_ms` timer.
+     */
+    std::thread checkpointer;
+    std::mutex checkpoint_mutex;
+    std::condition_variable checkpoint_cv;
+    bool checkpoint_requested = false;
+    bool checkpointer_stopping = false;
+
+    /**
+     * @brief Background thread, moving cold values into the `owner_t::spill` file.
+     * Woken up through @c eviction_cv, when the memory usage exceeds the limit.
+     * The @c eviction_hand is the last key visited by the CLOCK policy.
+     */
+    std::thread evictor;
+    std::mutex eviction_mutex;
+    std::condition_variable eviction_cv;
+    bool eviction_requested = false;
+    bool evictor_stopping = false;
+    collection_key_t eviction_hand;
+
+    database_t(owner_ptr_t&& owner, ucset_t&& set) noexcept(false) : owner(std::move(owner)), pairs(std::move(set)) {}
+};
+
+/**
+ * @brief Transaction state, extended with a copy of the changes,
+ * to be appended to the write-ahead log on commit, and the list of
+ * updated keys, which must be preserved for live snapshots.
+ */
+struct transaction_t {
+    pairs_transaction_t pairs;
+    wal_batch_t changes;
+    std::vector<collection_key_t> updated_keys;
+
+    transaction_t(pairs_transaction_t&& pairs) noexcept : pairs(std::move(pairs)) {}
+};
+
+ustore_collection_t new_collection(database_t& db) noexcept {
+    bool is_new = false;
+    ustore_collection_t new_handle = ustore_collection_main_k;
+    while (!is_new) {
+        auto top = static_cast<std::uint64_t>(std::rand());
+        auto bottom = static_cast<std::uint64_t>(std::rand());
+        new_handle = static_cast<ustore_collection_t>((top << 32) | bottom);
+        is_new = new_handle != ustore_collection_main_k;
+        for (auto const& [name, existing_handle] : db.names)
+            is_new &= new_handle != existing_handle;
+    }
+    return new_handle;
+}
+
+void export_error_code(ucset::status_t code, ustore_error_t* c_error) noexcept {
+    if (!code)
+        *c_error = "Faced error!";
+}
+
+/*********************************************************/
+/*****************	      Snapshots	      ****************/
+/*********************************************************/
+
+ustore_snapshot_t new_snapshot_id(database_t const& db) noexcept {
+    ustore_snapshot_t new_id = 0;
+    while (!new_id || db.snapshots.count(new_id)) {
+        auto top = static_cast<std::uint64_t>(std::rand());
+        auto bottom = static_cast<std::uint64_t>(std::rand());
+        new_id = static_cast<ustore_snapshot_t>((top << 32) | bottom);
+    }
+    return new_id;
+}
+
+snapshot_ptr_t find_snapshot(database_t& db, ustore_snapshot_t id) noexcept {
+    std::shared_lock _ {db.snapshots_mutex};
+    auto it = db.snapshots.find(id);
+    return it != db.snapshots.end() ? it->second : snapshot_ptr_t {};
+}
+
+/**
+ * @brief Preserves the current values of the keys in every snapshot, that hasn't seen them change yet.
+ * The caller must hold `database_t::snapshots_mutex` shared, until the new values are applied.
+ */
+template <typename key_at>
+void preserve(database_t& db, std::size_t count, key_at&& key_at_idx, ustore_error_t* c_error) noexcept {
+    if (db.snapshots.empty())
+        return;
+
+    for (std::size_t i = 0; i != count; ++i) {
+        collection_key_t key = key_at_idx(i);
+        bool needed = false;
+        for (auto const& id_and_snapshot : db.snapshots) {
+            snapshot_t& snapshot = *id_and_snapshot.second;
+            std::shared_lock _ {snapshot.mutex};
+            needed |= !snapshot.originals.count(key);
+        }
+        if (!needed)
+            continue;
+
+        // Never hold the snapshot lock, while locking the set
+        pair_t original {key};
+        auto status = db.pairs.find(
+            key,
+            [&](pair_t const& pair) noexcept { original = pair_t {key, pair.value(), *db.owner, c_error}; },
+            ucset::no_op_t {});
+        if (!status)
+            return export_error_code(status, c_error);
+        return_if_error_m(c_error);
+
+        std::shared_ptr<pair_t const> shared;
+        safe_section("Preserving original value", c_error, [&] {
+            shared = std::make_shared<pair_t const>(std::move(original));
+        });
+        return_if_error_m(c_error);
+        for (auto const& id_and_snapshot : db.snapshots) {
+            snapshot_t& snapshot = *id_and_snapshot.second;
+            std::unique_lock _ {snapshot.mutex};
+            safe_section("Preserving original value", c_error, [&] { snapshot.originals.emplace(key, shared); });
+            return_if_error_m(c_error);
+        }
+    }
+}
+
+/**
+ * @brief Preserves all the entries of a collection, before it is dropped or cleared.
+ * The caller must hold `database_t::snapshots_mutex` shared.
+ */
+void preserve_collection(database_t& db, ustore_collection_t collection, ustore_error_t* c_error) noexcept {
+    if (db.snapshots.empty())
+        return;
+
+    // The keys are listed in a single pass, while writers are blocked, and the entries changed
+    // after it are preserved by their writers, as snapshots already exist
+    std::vector<collection_key_t> keys;
+    auto status = db.pairs.visit_range(collection, collection + 1, [&](pair_t const& pair) noexcept {
+        if (!*c_error)
+            safe_section("Listing keys to preserve", c_error, [&] { keys.push_back(pair.collection_key); });
+    });
+    if (!status)
+        return export_error_code(status, c_error);
+    return_if_error_m(c_error);
+    preserve(db, keys.size(), [&](std::size_t i) noexcept { return keys[i]; }, c_error);
+}
+
+/**
+ * @brief Resolves the value an entry had, when the snapshot was taken.
+ * Must be called, while the @p head value is protected by the lock of the set,
+ * to make sure it wasn't overwritten between the two lookups.
+ */
+value_view_t in_snapshot(snapshot_t& snapshot, collection_key_t key, value_view_t head) noexcept {
+    std::shared_lock _ {snapshot.mutex};
+    auto it = snapshot.originals.find(key);
+    return it != snapshot.originals.end() ? it->second->value() : head;
+}
+
+template <typename callback_at>
+ucset::status_t find_in_snapshot(database_t& db,
+                                 snapshot_t& snapshot,
+                                 collection_key_t key,
+                                 callback_at&& callback) noexcept {
+    return db.pairs.find(
+        key,
+        [&](pair_t const& pair) noexcept { callback(in_snapshot(snapshot, key, pair.value())); },
+        [&]() noexcept { callback(in_snapshot(snapshot, key, value_view_t {})); });
+}
+
+/**
+ * @brief The exclusive upper bound of a collection, so that its largest key is included in scans.
+ */
+inline collection_key_t collection_end(ustore_collection_t collection) noexcept {
+    return {collection + 1, std::numeric_limits<ustore_key_t>::min()};
+}
+
+/**
+ * @brief The exclusive upper bound of a scan task.
+ */
+inline collection_key_t scan_end(scan_t const& scan) noexcept {
+    return scan.max_key == std::numeric_limits<ustore_key_t>::max()
+               ? collection_end(scan.collection)
+               : collection_key_t {scan.collection, scan.max_key + 1};
+}
+
+/**
+ * @brief Iterates over the entries present in the snapshot in `[start, end)`,
+ * merging the latest state of the set with the preserved original values.
+ * The @p callback receives the key and the value, valid only during the call.
+ */
+template <typename callback_at>
+ucset::status_t scan_snapshot(database_t& db,
+                              snapshot_t& snapshot,
+                              collection_key_t start,
+                              collection_key_t end,
+                              std::size_t range_limit,
+                              callback_at&& callback) noexcept {
+
+    std::size_t match_idx = 0;
+    collection_key_t previous = start;
+    bool reached_end = !range_limit || !(start < end);
+    if (reached_end)
+        return {};
+
+    auto status = find_in_snapshot(db, snapshot, start, [&](value_view_t value) noexcept {
+        if (!value)
+            return;
+        callback(start, value);
+        ++match_idx;
+    });
+    if (!status)
+        return status;
+
+    // The original values are checked after the set is positioned, as an
+    // entry missing from it was preserved before being erased.
+    auto callback_next = [&](pair_t const* head) noexcept {
+        std::shared_lock _ {snapshot.mutex};
+        auto original = snapshot.originals.upper_bound(previous);
+        auto const originals_end = snapshot.originals.end();
+        while (original != originals_end && !*original->second &&
+               (!head || original->first < head->collection_key))
+            ++original;
+
+        collection_key_t key;
+        value_view_t value;
+        if (original != originals_end && (!head || !(head->collection_key < original->first)))
+            key = original->first, value = original->second->value();
+        else if (head)
+            key = head->collection_key, value = head->value();
+        else {
+            reached_end = true;
+            return;
+        }
+
+        previous = key;
+        reached_end = !(key < end);
+        if (reached_end || !value)
+            return;
+        callback(key, value);
+        ++match_idx;
+    };
+
+    // Every head is visited until the originals preceding it are exhausted
+    if (match_idx != range_limit && !reached_end)
+        status = db.pairs.scan(previous, range_limit - match_idx, [&](pair_t const& head) noexcept {
+            do
+                callback_next(&head);
+            while (match_idx != range_limit && !reached_end && previous < head.collection_key);
+            return match_idx != range_limit && !reached_end;
+        });
+    if (!status)
+        return status;
+    while (match_idx != range_limit && !reached_end)
+        callback_next(nullptr);
+    return {};
+}
+
+/*********************************************************/
+/*****************	 Writing to Disk	  ****************/
+/*********************************************************/
+
+/**
+ * @brief Row groups are the unit of parallelism, when loading collections back.
+ */
+constexpr std::int64_t row_group_bytes_k = 64l * 1024l * 1024l;
+
+/**
+ * @brief Dumps the state of a collection, as seen by the @p snapshot.
+ * Entries are visited in short runs, so the writers are only blocked for a single run at a time.
+ */
+void write_collection( //
+    database_t& db,
+    snapshot_t& snapshot,
+    ustore_collection_t collection_id,
+    std::string const& collection_path,
+    ustore_error_t* c_error) noexcept(false) {
+
+    std::shared_ptr<arrow::io::FileOutputStream> out_file;
+    PARQUET_ASSIGN_OR_THROW(out_file, arrow::io::FileOutputStream::Open(collection_path));
+
+    parquet::schema::NodeVector columns {};
+    columns.push_back(parquet::schema::PrimitiveNode::Make( //
+        "key",
+        parquet::Repetition::REQUIRED,
+        parquet::Type::INT64,
+        parquet::ConvertedType::INT_64));
+    columns.push_back(parquet::schema::PrimitiveNode::Make( //
+        "value",
+        parquet::Repetition::OPTIONAL,
+        parquet::Type::BYTE_ARRAY,
+        parquet::ConvertedType::UTF8));
+    auto schema = std::static_pointer_cast<parquet::schema::GroupNode>(
+        parquet::schema::GroupNode::Make("schema", parquet::Repetition::REQUIRED, columns));
+    parquet::WriterProperties::Builder builder;
+    {
+        parquet::StreamWriter os {parquet::ParquetFileWriter::Open(out_file, schema, builder.build())};
+        os.SetMaxRowGroupSize(row_group_bytes_k);
+
+        collection_key_t min(collection_id, std::numeric_limits<ustore_key_t>::min());
+        collection_key_t end = collection_end(collection_id);
+        auto limit = std::numeric_limits<std::size_t>::max();
+        auto status = scan_snapshot(db, snapshot, min, end, limit, [&](collection_key_t key, value_view_t value) {
+            std::optional<std::string_view> column;
+            if (value.size())
+                column = std::string_view(value);
+            os << key.key << column << parquet::EndRow;
+        });
+        export_error_code(status, c_error);
+        return_if_error_m(c_error);
+    }
+    PARQUET_THROW_NOT_OK(out_file->Close());
+}
+
+bool ends_with(std::string_view str, std::string_view suffix) noexcept {
+    return str.size() >= suffix.size() &&
+           0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix.data(), suffix.size());
+}
+
+using names_t = std::map<std::string, ustore_collection_t, string_less_t>;
+
+/**
+ * @brief Dumps the listed collections, as seen by the @p snapshot, in parallel.
+ * Every one goes into a temporary file, atomically renamed into place, so that a
+ * crash never leaves a half-written collection behind. Files of collections,
+ * that no longer exist, are removed afterwards.
+ */
+void write(database_t& db,
+           std::string const& dir_path,
+           names_t names,
+           snapshot_t& snapshot,
+           ustore_error_t* c_error) noexcept(false) {
+
+    // Check if the source directory even exists
+    if (!std::filesystem::is_directory(dir_path))
+        return;
+
+    names.emplace(std::string(), ustore_collection_main_k);
+    std::vector<std::pair<std::string, ustore_collection_t>> collections {names.begin(), names.end()};
+
+    // Dump the collections in parallel, keeping the first error
+    std::string_view extension {".parquet"};
+    std::atomic<std::size_t> next_collection = 0;
+    std::mutex error_mutex;
+    auto dump = [&]() noexcept {
+        std::size_t i;
+        while ((i = next_collection.fetch_add(1)) < collections.size()) {
+            ustore_error_t collection_error = nullptr;
+            auto const& [collection_name, collection_id] = collections[i];
+            safe_section("Dumping collection", &collection_error, [&] {
+                auto const collection_path = stdfs::path(dir_path) / (collection_name + std::string(extension));
+                auto const temporary_path = collection_path.string() + ".tmp";
+                write_collection(db, snapshot, collection_id, temporary_path, &collection_error);
+                return_if_error_m(&collection_error);
+                sync_path(temporary_path, &collection_error);
+                return_if_error_m(&collection_error);
+                stdfs::rename(temporary_path, collection_path);
+            });
+            if (!collection_error)
+                continue;
+
+            std::lock_guard _ {error_mutex};
+            if (!*c_error)
+                *c_error = collection_error;
+            next_collection = collections.size();
+        }
+    };
+
+    std::size_t threads_count = std::min<std::size_t>(std::thread::hardware_concurrency(), collections.size());
+    std::vector<std::thread> threads;
+    safe_section("Spawning writers", c_error, [&] {
+        for (std::size_t i = 1; i < threads_count; ++i)
+            threads.emplace_back(dump);
+    });
+    dump();
+    for (auto& thread : threads)
+        thread.join();
+    return_if_error_m(c_error);
+
+    for (auto const& dir_entry : std::filesystem::directory_iterator {dir_path}) {
+        std::string collection_name = dir_entry.path().filename();
+        if (!ends_with(collection_name, extension))
+            continue;
+        collection_name.resize(collection_name.size() - extension.size());
+        if (names.find(collection_name) == names.end())
+            stdfs::remove(dir_entry.path());
+    }
+    sync_path(dir_path, c_error);
+}
+
+/**
+ * @brief Checks if the values of the database occupy more RAM than its `ucset_options_t::memory_limit`.
+ * Sums the usage across many cache lines, so shouldn't be called on every write.
+ */
+bool exceeds_memory_limit(database_t const& db) noexcept {
+    return db.options.memory_limit && db.owner->memory.total() > db.options.memory_limit;
+}
+
+/**
+ * @brief Loads a single row group of a persisted collection with columnar reads.
+ * Values are copied straight from Arrow buffers into shared chunks and every
+ * record batch lands in the set with a single bulk insertion.
+ */
+void read_row_group( //
+    database_t& db,
+    std::string const& collection_path,
+    ustore_collection_t collection_id,
+    int row_group,
+    ustore_error_t* c_error) noexcept(false) {
+
+    std::shared_ptr<arrow::io::ReadableFile> in_file;
+    PARQUET_ASSIGN_OR_THROW(in_file, arrow::io::ReadableFile::Open(collection_path));
+    std::unique_ptr<parquet::arrow::FileReader> reader;
+    PARQUET_THROW_NOT_OK(parquet::arrow::OpenFile(in_file, arrow::default_memory_pool(), &reader));
+    reader->set_use_threads(false);
+    std::unique_ptr<arrow::RecordBatchReader> batches;
+    PARQUET_THROW_NOT_OK(reader->GetRecordBatchReader({row_group}, &batches));
+
+    bulk_loader_t loader {*db.owner};
+    std::vector<pair_t> pairs;
+    while (true) {
+        std::shared_ptr<arrow::RecordBatch> batch;
+        PARQUET_THROW_NOT_OK(batches->ReadNext(&batch));
+        if (!batch)
+            break;
+
+        // Once the RAM is full, the remaining values are loaded straight into the spill file
+        if (exceeds_memory_limit(db))
+            loader.spill_into(&db.owner->spill);
+
+        auto keys = std::static_pointer_cast<arrow::Int64Array>(batch->column(0));
+        auto values = std::static_pointer_cast<arrow::BinaryArray>(batch->column(1));
+        auto const count = static_cast<std::size_t>(batch->num_rows());
+        pairs.clear();
+        pairs.reserve(count);
+        for (std::size_t i = 0; i != count; ++i) {
+            pair_t& pair = pairs.emplace_back(collection_key_t {collection_id, keys->Value(i)});
+            if (values->IsNull(i))
+                pair.value_length = 0;
+            else
+                loader.copy(values->GetView(i), pair, c_error);
+            return_if_error_m(c_error);
+        }
+
+        // Every record batch is inserted under a single acquisition of the partition locks
+        auto status = db.pairs.upsert(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+        export_error_code(status, c_error);
+        return_if_error_m(c_error);
+    }
+}
+
+/**
+ * @brief Loads all the persisted collections, splitting the work
+ * across all available cores at the granularity of Parquet row groups.
+ */
+void read(database_t& db, std::string const& path, ustore_error_t* c_error) noexcept(false) {
+
+    // Clear the DB, before refilling it
+    db.names.clear();
+    auto status = db.pairs.clear();
+    export_error_code(status, c_error);
+    return_if_error_m(c_error);
+
+    // Check if the source directory even exists
+    if (!std::filesystem::is_directory(path))
+        return;
+
+    // Enumerate all persisted collections, assigning their IDs upfront,
+    // as `new_collection` isn't thread-safe
+    struct row_group_t {
+        std::string collection_path;
+        ustore_collection_t collection_id;
+        int row_group;
+    };
+    std::vector<row_group_t> row_groups;
+    std::string_view extension {".parquet"};
+    for (auto const& dir_entry : std::filesystem::directory_iterator {path}) {
+        auto const& collection_path = dir_entry.path();
+        std::string collection_name = collection_path.filename();
+        if (!ends_with(collection_name, extension))
+            continue;
+
+        collection_name.resize(collection_name.size() - extension.size());
+        ustore_collection_t collection_id = collection_name.empty() ? ustore_collection_main_k : new_collection(db);
+        if (!collection_name.empty())
+            db.names.emplace(collection_name, collection_id);
+
+        std::shared_ptr<arrow::io::ReadableFile> in_file;
+        PARQUET_ASSIGN_OR_THROW(in_file, arrow::io::ReadableFile::Open(collection_path));
+        std::unique_ptr<parquet::arrow::FileReader> reader;
+        PARQUET_THROW_NOT_OK(parquet::arrow::OpenFile(in_file, arrow::default_memory_pool(), &reader));
+        for (int row_group = 0; row_group != reader->num_row_groups(); ++row_group)
+            row_groups.push_back({collection_path, collection_id, row_group});
+    }
+
+    // Load the row groups in parallel, keeping the first error
+    std::atomic<std::size_t> next_row_group = 0;
+    std::mutex error_mutex;
+    auto load = [&]() noexcept {
+        std::size_t i;
+        while ((i = next_row_group.fetch_add(1)) < row_groups.size()) {
+            ustore_error_t row_group_error = nullptr;
+            row_group_t const& task = row_groups[i];
+            safe_section("Loading row group", &row_group_error, [&] {
+                read_row_group(db, task.collection_path, task.collection_id, task.row_group, &row_group_error);
+            });
+            if (!row_group_error)
+                continue;
+
+            std::lock_guard _ {error_mutex};
+            if (!*c_error)
+                *c_error = row_group_error;
+            next_row_group = row_groups.size();
+        }
+    };
+
+    std::size_t threads_count = std::min<std::size_t>(std::thread::hardware_concurrency(), row_groups.size());
+    std::vector<std::thread> threads;
+    safe_section("Spawning loaders", c_error, [&] {
+        for (std::size_t i = 1; i < threads_count; ++i)
+            threads.emplace_back(load);
+    });
+    load();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+/*********************************************************/
+/*****************	  Logging & Recovery   ****************/
+/*********************************************************/
+
+std::string wal_path(database_t const& db) noexcept(false) {
+    return stdfs::path(db.persisted_directory) / "ucset.wal";
+}
+
+std::string wal_old_path(database_t const& db) noexcept(false) {
+    return stdfs::path(db.persisted_directory) / "ucset.wal.old";
+}
+
+/**
+ * @brief Applies the drop to the in-memory state, invoking the @p log once all partitions are locked.
+ * The caller must hold the `database_t::restructuring_mutex` exclusively
+ * and the `database_t::snapshots_mutex` shared.
+ */
+template <typename log_at = no_log_t>
+void drop_collection(database_t& db,
+                     ustore_collection_t id,
+                     ustore_drop_mode_t mode,
+                     ustore_error_t* c_error,
+                     log_at&& log = {}) noexcept {
+
+    preserve_collection(db, id, c_error);
+    return_if_error_m(c_error);
+
+    auto export_status = [&](ucset::status_t const& status) noexcept {
+        if (!*c_error)
+            export_error_code(status, c_error);
+    };
+
+    if (mode == ustore_drop_keys_vals_handle_k) {
+        auto status = db.pairs.erase_range(id, id + 1, no_op_t {}, log);
+        if (!status)
+            return export_status(status);
+
+        for (auto it = db.names.begin(); it != db.names.end(); ++it) {
+            if (id != it->second)
+                continue;
+            db.names.erase(it);
+            break;
+        }
+    }
+
+    else if (mode == ustore_drop_keys_vals_k) {
+        auto status = db.pairs.erase_range(id, id + 1, no_op_t {}, log);
+        return export_status(status);
+    }
+
+    else if (mode == ustore_drop_vals_k) {
+        auto status = db.pairs.replace_range(
+            id,
+            id + 1,
+            [&](pair_t& pair) noexcept {
+                pair = pair_t {pair.collection_key, value_view_t::make_empty(), *db.owner, nullptr};
+            },
+            log);
+        return export_status(status);
+    }
+}
+
+std::string wal_catalog(database_t const& db) noexcept(false) {
+    std::string payload;
+    wal_push(payload, static_cast<std::uint32_t>(db.names.size()));
+    for (auto const& [name, id] : db.names)
+        wal_push_name(payload, id, name);
+    return payload;
+}
+
+/**
+ * @brief Replays a single log file on top of the current state.
+ * Collection IDs are regenerated on every load, so the ones in the log are mapped by name.
+ * @param[out] replayed Incremented for every change that was applied.
+ */
+void replay(database_t& db, std::string const& path, std::size_t& replayed, ustore_error_t* c_error) noexcept(false) {
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return;
+    std::string const content {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    std::string_view remaining = content;
+
+    std::unordered_map<ustore_collection_t, ustore_collection_t> ids;
+    ids.emplace(ustore_collection_main_k, ustore_collection_main_k);
+    auto map_name = [&](ustore_collection_t logged_id, std::string_view name) {
+        auto it = db.names.find(name);
+        if (it == db.names.end()) {
+            it = db.names.emplace(std::string(name), new_collection(db)).first;
+            ++replayed;
+        }
+        ids[logged_id] = it->second;
+    };
+
+    // Cancellations follow the records they refer to, so we collect them first
+    struct record_t {
+        std::uint64_t offset;
+        wal_record_t type;
+        std::string_view payload;
+    };
+    std::vector<record_t> records;
+    std::unordered_set<std::uint64_t> cancelled;
+    std::uint64_t segment_offset = 0;
+    while (remaining.size() >= wal_header_size_k) {
+        std::uint64_t offset = content.size() - remaining.size();
+        std::uint32_t length = 0;
+        std::uint32_t checksum = 0;
+        wal_record_t type;
+        wal_pop(remaining, length);
+        wal_pop(remaining, checksum);
+        wal_pop(remaining, type);
+
+        // A torn write at the tail is expected after a crash
+        if (remaining.size() < length)
+            break;
+        std::string_view payload = remaining.substr(0, length);
+        remaining.remove_prefix(length);
+        if (wal_checksum(type, payload) != checksum)
+            break;
+
+        // Cancellations point into their own segment, that may have been appended to an older log
+        if (type == wal_record_t::catalog_k)
+            segment_offset = offset;
+        if (type == wal_record_t::cancel_k) {
+            std::uint64_t cancelled_offset = 0;
+            return_error_if_m(wal_pop(payload, cancelled_offset),
+                              c_error,
+                              consistency_k,
+                              "Corrupted write-ahead log");
+            cancelled.insert(segment_offset + cancelled_offset);
+        }
+        else
+            records.push_back({offset, type, payload});
+    }
+
+    for (auto [offset, type, payload] : records) {
+        if (cancelled.count(offset))
+            continue;
+
+        switch (type) {
+        case wal_record_t::catalog_k: {
+            std::uint32_t count = 0;
+            std::map<std::string_view, ustore_collection_t> catalog;
+            return_error_if_m(wal_pop(payload, count), c_error, consistency_k, "Corrupted write-ahead log");
+            for (std::uint32_t i = 0; i != count; ++i) {
+                ustore_collection_t logged_id;
+                std::string_view name;
+                return_error_if_m(wal_pop_name(payload, logged_id, name),
+                                  c_error,
+                                  consistency_k,
+                                  "Corrupted write-ahead log");
+                catalog.emplace(name, logged_id);
+            }
+
+            // The catalog is authoritative: anything missing in it was dropped
+            std::vector<ustore_collection_t> dropped;
+            for (auto const& [name, id] : db.names)
+                if (catalog.find(name) == catalog.end())
+                    dropped.push_back(id);
+            for (auto id : dropped) {
+                drop_collection(db, id, ustore_drop_keys_vals_handle_k, c_error);
+                return_if_error_m(c_error);
+                ++replayed;
+            }
+            for (auto const& [name, logged_id] : catalog)
+                map_name(logged_id, name);
+            break;
+        }
+
+        case wal_record_t::create_k: {
+            ustore_collection_t logged_id;
+            std::string_view name;
+            return_error_if_m(wal_pop_name(payload, logged_id, name),
+                              c_error,
+                              consistency_k,
+                              "Corrupted write-ahead log");
+            map_name(logged_id, name);
+            break;
+        }
+
+        case wal_record_t::drop_k: {
+            ustore_collection_t logged_id;
+            std::uint8_t mode;
+            return_error_if_m(wal_pop(payload, logged_id) && wal_pop(payload, mode),
+                              c_error,
+                              consistency_k,
+                              "Corrupted write-ahead log");
+            auto it = ids.find(logged_id);
+            if (it == ids.end())
+                break;
+            drop_collection(db, it->second, static_cast<ustore_drop_mode_t>(mode), c_error);
+            return_if_error_m(c_error);
+            if (mode == ustore_drop_keys_vals_handle_k)
+                ids.erase(it);
+            ++replayed;
+            break;
+        }
+
+        case wal_record_t::batch_k: {
+            std::uint32_t count = 0;
+            return_error_if_m(wal_pop(payload, count), c_error, consistency_k, "Corrupted write-ahead log");
+            std::vector<pair_t> pairs;
+            pairs.reserve(count);
+            for (std::uint32_t i = 0; i != count; ++i) {
+                collection_key_t collection_key;
+                ustore_length_t value_length = 0;
+                return_error_if_m(wal_pop(payload, collection_key.collection) &&
+                                      wal_pop(payload, collection_key.key) && wal_pop(payload, value_length),
+                                  c_error,
+                                  consistency_k,
+                                  "Corrupted write-ahead log");
+
+                value_view_t value;
+                if (value_length != ustore_length_missing_k) {
+                    return_error_if_m(payload.size() >= value_length,
+                                      c_error,
+                                      consistency_k,
+                                      "Corrupted write-ahead log");
+                    value = value_view_t {payload.data(), value_length};
+                    payload.remove_prefix(value_length);
+                }
+
+                auto it = ids.find(collection_key.collection);
+                if (it == ids.end())
+                    continue;
+                collection_key.collection = it->second;
+                pairs.emplace_back(collection_key, value, *db.owner, c_error);
+                return_if_error_m(c_error);
+            }
+
+            auto status = db.pairs.upsert(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+            export_error_code(status, c_error);
+            return_if_error_m(c_error);
+            ++replayed;
+            break;
+        }
+
+        default: return;
+        }
+    }
+}
+
+/**
+ * @brief Starts a new log and folds the previous one into Parquet files.
+ *
+ * The log is rotated and an internal snapshot is taken at the same moment, while
+ * no writer is in progress, so the dump is an exact cut of the state, matching the
+ * start of the new log. The locks are released before any IO, and the writers only
+ * pay for preserving the values they overwrite, until the dump completes. If we
+ * crash midway, the old log remains and is replayed first on the next start.
+ * If we fail midway, the old log remains as well, and the next checkpoint appends
+ * the current log to it, so that both are folded into the following dump.
+ */
+void checkpoint(database_t& db, ustore_error_t* c_error) noexcept(false) {
+
+    auto const path = wal_path(db);
+    auto const old_path = wal_old_path(db);
+    names_t names;
+    snapshot_ptr_t snapshot;
+    std::uint64_t cut = 0;
+    {
+        std::shared_lock restructuring_lock {db.restructuring_mutex};
+        std::unique_lock snapshots_lock {db.snapshots_mutex};
+        // If the last checkpoint failed, the old log is still needed, and the current one is appended to it
+        db.wal.rotate(path, old_path, c_error);
+        return_if_error_m(c_error);
+        db.wal.append(wal_record_t::catalog_k, wal_catalog(db), c_error);
+        return_if_error_m(c_error);
+
+        cut = db.wal.appended();
+        names = db.names;
+        snapshot = std::make_shared<snapshot_t>();
+        db.checkpoint_snapshot = new_snapshot_id(db);
+        db.snapshots.emplace(db.checkpoint_snapshot, snapshot);
+    }
+
+    write(db, db.persisted_directory, std::move(names), *snapshot, c_error);
+    {
+        std::unique_lock snapshots_lock {db.snapshots_mutex};
+        db.snapshots.erase(db.checkpoint_snapshot);
+        db.checkpoint_snapshot = 0;
+    }
+    return_if_error_m(c_error);
+    stdfs::remove(old_path);
+    sync_path(db.persisted_directory, c_error);
+    return_if_error_m(c_error);
+    db.checkpointed = cut;
+}
+
+void checkpointer_loop(database_t& db) noexcept {
+    auto const interval = std::chrono::milliseconds(db.options.checkpoint_interval_ms);
+    while (true) {
+        {
+            std::unique_lock lock {db.checkpoint_mutex};
+            auto woken = [&] { return db.checkpoint_requested || db.checkpointer_stopping; };
+            if (interval.count())
+                db.checkpoint_cv.wait_for(lock, interval, woken);
+            else
+                db.checkpoint_cv.wait(lock, woken);
+            if (db.checkpointer_stopping)
+                return;
+            db.checkpoint_requested = false;
+        }
+
+        // The timer fires regardless of the writes, but the state is only dumped, if anything was logged
+        if (db.wal.appended() == db.checkpointed.load())
+            continue;
+
+        ustore_error_t c_error = nullptr;
+        safe_section("Checkpointing", &c_error, [&] { checkpoint(db, &c_error); });
+    }
 }
 
-void write(database_t const& db, std::string const& dir_path, ustore_error_t* c_error) noexcept(false) {
-
-    // Check if the source directory even exists
-    if (!std::filesystem::is_directory(dir_path))
+void stop_checkpointer(database_t& db) noexcept {
+    if (!db.checkpointer.joinable())
         return;
+    {
+        std::unique_lock lock {db.checkpoint_mutex};
+        db.checkpointer_stopping = true;
+    }
+    db.checkpoint_cv.notify_one();
+    db.checkpointer.join();
+}
+
+/**
+ * @brief Recovers the changes logged since the last checkpoint, persists them
+ * into Parquet files and starts a new log.
+ */
+void recover(database_t& db, ustore_error_t* c_error) noexcept(false) {
 
-    auto main_path = stdfs::path(dir_path) / ".parquet";
-    write_collection(db, ustore_collection_main_k, main_path, c_error);
+    auto const path = wal_path(db);
+    auto const old_path = wal_old_path(db);
+    std::size_t replayed = 0;
+    replay(db, old_path, replayed, c_error);
+    return_if_error_m(c_error);
+    replay(db, path, replayed, c_error);
     return_if_error_m(c_error);
 
-    for (auto const& collection : db.names) {
-        auto const& collection_name = collection.first;
-        auto const collection_path = stdfs::path(dir_path) / (collection_name + ".parquet");
-        write_collection(db, collection.second, collection_path, c_error);
+    // Nothing else is running yet, so an empty snapshot sees the latest state
+    if (replayed) {
+        snapshot_t snapshot;
+        write(db, db.persisted_directory, db.names, snapshot, c_error);
         return_if_error_m(c_error);
     }
-}
+    stdfs::remove(old_path);
+    stdfs::remove(path);
 
-bool ends_with(std::string_view str, std::string_view suffix) noexcept {
-    return str.size() >= suffix.size() &&
-           0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix.data(), suffix.size());
+    db.wal.open(path, c_error);
+    return_if_error_m(c_error);
+    db.checkpointed = db.wal.append(wal_record_t::catalog_k, wal_catalog(db), c_error);
+    return_if_error_m(c_error);
+    sync_path(db.persisted_directory, c_error);
+    return_if_error_m(c_error);
+
+    db.checkpointer = std::thread(checkpointer_loop, std::ref(db));
 }
 
-void read(database_t& db, std::string const& path, ustore_error_t* c_error) noexcept(false) {
+/**
+ * @brief The `log` callback of `partitioned_set_t`, which appends the record of a change
+ * right before it is published, while the changed partitions are still locked.
+ * The caller holds the `database_t::snapshots_mutex` shared, so a checkpoint can't cut
+ * between the record and its effect. Does nothing, unless @c enabled.
+ */
+struct logged_change_t {
+    database_t& db;
+    wal_record_t type;
+    std::string_view payload;
+    bool enabled;
+    ustore_error_t* c_error;
+    std::uint64_t sequence = 0;
+    std::uint64_t offset = 0;
+
+    bool operator()() noexcept {
+        if (!enabled)
+            return true;
+        sequence = db.wal.append(type, payload, c_error, &offset);
+        return sequence != 0;
+    }
 
-    // Clear the DB, before refilling it
-    db.names.clear();
-    auto status = db.pairs.clear();
-    export_error_code(status, c_error);
-    return_if_error_m(c_error);
+    /**
+     * @brief Marks the record void, if the change failed to apply after being logged.
+     * Failing that, the change may resurface after a restart, which we can only report.
+     */
+    void cancel() noexcept {
+        if (!sequence)
+            return;
+        std::string cancel_payload;
+        ustore_error_t cancel_error = nullptr;
+        safe_section("Cancelling WAL record", &cancel_error, [&] { wal_push(cancel_payload, offset); });
+        if (!cancel_error)
+            db.wal.append(wal_record_t::cancel_k, cancel_payload, &cancel_error);
+        if (cancel_error && !*c_error)
+            *c_error = cancel_error;
+        sequence = 0;
+    }
 
-    // Check if the source directory even exists
-    if (!std::filesystem::is_directory(path))
-        return;
+    /**
+     * @brief Requests a checkpoint, if the log grew large enough, and,
+     * if requested, waits for the record to become durable.
+     */
+    void finish(ustore_options_t options) noexcept {
+        if (!sequence)
+            return;
+        if (db.wal.size() >= db.options.checkpoint_bytes) {
+            std::unique_lock lock {db.checkpoint_mutex};
+            if (!db.checkpoint_requested) {
+                db.checkpoint_requested = true;
+                db.checkpoint_cv.notify_one();
+            }
+        }
 
-    // Loop over all persisted collections, reading them one by one
-    std::string_view extension {".parquet"};
-    for (auto const& dir_entry : std::filesystem::directory_iterator {path}) {
-        auto const& collection_path = dir_entry.path();
-        std::string collection_name = collection_path.filename();
-        if (!ends_with(collection_name, extension))
-            continue;
+        if (options & ustore_option_write_flush_k)
+            db.wal.sync(sequence, c_error);
+    }
+};
 
-        collection_name.resize(collection_name.size() - extension.size());
-        ustore_collection_t collection_id = collection_name.empty() ? ustore_collection_main_k : new_collection(db);
-        if (!collection_name.empty())
-            db.names.emplace(collection_name, collection_id);
+/**
+ * @brief Number of keys the CLOCK hand passes under one set of exclusive locks.
+ */
+constexpr std::size_t eviction_window_k = 1024;
 
-        std::shared_ptr<arrow::io::ReadableFile> in_file;
-        PARQUET_ASSIGN_OR_THROW(in_file, arrow::io::ReadableFile::Open(collection_path));
-        parquet::StreamReader os {parquet::ParquetFileReader::Open(in_file)};
+/**
+ * @brief Smaller individually allocated values aren't worth the spill file space.
+ * Small values in loaded chunks are still evicted, as they keep whole chunks alive.
+ */
+constexpr std::size_t min_evictable_length_k = 64;
+
+bool is_evictable(pair_t const& pair) noexcept {
+    std::size_t length = pair.value().size();
+    if (!length || length > bulk_chunk_t::capacity_k)
+        return false;
+    if (pair.value_kind == value_kind_t::heap_k)
+        return length >= min_evictable_length_k;
+    return !bulk_chunk_t::of(pair.value_begin)->spill;
+}
 
-        ustore_key_t key;
-        std::optional<std::string> value;
-        while (!os.eof()) {
-            os >> key >> value >> parquet::EndRow;
+bool evictor_stopping(database_t& db) noexcept {
+    std::unique_lock lock {db.eviction_mutex};
+    return db.evictor_stopping;
+}
 
-            pair_t pair;
-            pair.collection_key.collection = collection_id;
-            pair.collection_key.key = key;
+/**
+ * @brief Moves the values, that weren't read since the previous pass of the CLOCK hand,
+ * into the spill file, until the memory usage drops 10% below the limit, or a whole pass
+ * over the set frees nothing. Evicted values stay mapped, so they are read without copies.
+ */
+void evict(database_t& db, ustore_error_t* c_error) noexcept(false) {
+    std::size_t const limit = db.options.memory_limit;
+    std::size_t const target = limit - limit / 10;
+    collection_key_t const start {ustore_collection_main_k, std::numeric_limits<ustore_key_t>::min()};
+
+    bulk_loader_t loader {*db.owner, &db.owner->spill};
+    std::vector<collection_key_t> window;
+    window.reserve(eviction_window_k);
+    bool evicted_in_pass = false;
+    std::size_t idle_passes = 0;
+
+    while (db.owner->memory.total() > target && idle_passes < 2 && !evictor_stopping(db)) {
+        // Collect the keys following the hand under shared locks
+        window.clear();
+        auto status = db.pairs.scan(db.eviction_hand, eviction_window_k, [&](pair_t const& pair) noexcept {
+            window.push_back(pair.collection_key);
+            return window.size() != eviction_window_k;
+        });
+        if (!status)
+            return export_error_code(status, c_error);
 
-            // Converting to our internal representation would require a copy
-            if (value) {
-                auto buf_len = value->size();
-                auto buf_ptr = blob_allocator_t {}.allocate(buf_len);
-                return_error_if_m(buf_ptr != nullptr, c_error, out_of_memory_k, "Failed to allocate a blob");
-                pair.range = value_view_t {buf_ptr, buf_len};
-                std::memcpy(buf_ptr, value->data(), value->size());
-            }
-            else
-                pair.range = value_view_t::make_empty();
+        if (window.empty()) {
+            db.eviction_hand = start;
+            idle_passes = evicted_in_pass ? 0 : idle_passes + 1;
+            evicted_in_pass = false;
+            continue;
+        }
 
-            auto status = db.pairs.upsert(std::move(pair));
-            export_error_code(status, c_error);
-            return_if_error_m(c_error);
+        // Give a second chance to the recently read values and spill the rest
+        collection_key_t upper = window.back();
+        upper = upper.key == std::numeric_limits<ustore_key_t>::max()
+                    ? collection_key_t {upper.collection + 1, std::numeric_limits<ustore_key_t>::min()}
+                    : collection_key_t {upper.collection, upper.key + 1};
+        auto status = db.pairs.range(window.front(), upper, [&](pair_t& pair) noexcept {
+            if (pair.referenced.exchange(0, std::memory_order_relaxed) || !is_evictable(pair) || *c_error)
+                return;
+            pair_t spilled {pair.collection_key};
+            loader.copy(pair.value(), spilled, c_error);
+            if (*c_error)
+                return;
+            pair = std::move(spilled);
+            evicted_in_pass = true;
+        });
+        if (!status)
+            return export_error_code(status, c_error);
+        return_if_error_m(c_error);
+        db.eviction_hand = window.back();
+    }
+}
+
+void evictor_loop(database_t& db) noexcept {
+    while (true) {
+        {
+            std::unique_lock lock {db.eviction_mutex};
+            db.eviction_cv.wait(lock, [&] { return db.eviction_requested || db.evictor_stopping; });
+            if (db.evictor_stopping)
+                return;
+            db.eviction_requested = false;
         }
+
+        ustore_error_t c_error = nullptr;
+        safe_section("Evicting", &c_error, [&] { evict(db, &c_error); });
+    }
+}
+
+void stop_evictor(database_t& db) noexcept {
+    if (!db.evictor.joinable())
+        return;
+    {
+        std::unique_lock lock {db.eviction_mutex};
+        db.evictor_stopping = true;
+    }
+    db.eviction_cv.notify_one();
+    db.evictor.join();
+}
+
+/**
+ * @brief Opens the spill file, if the memory is limited.
+ * Must precede loading the persisted collections, which may not fit into RAM.
+ */
+void open_spill(database_t& db, ustore_error_t* c_error) noexcept(false) {
+    if (!db.options.memory_limit)
+        return;
+    db.owner->spill.open(db.persisted_directory.empty() ? stdfs::temp_directory_path() : stdfs::path(db.persisted_directory),
+                  c_error);
+}
+
+/**
+ * @brief Starts the evictor, if the memory is limited.
+ */
+void start_evictor(database_t& db) noexcept(false) {
+    if (!db.options.memory_limit)
+        return;
+    db.eviction_hand = {ustore_collection_main_k, std::numeric_limits<ustore_key_t>::min()};
+    db.eviction_requested = exceeds_memory_limit(db);
+    db.evictor = std::thread(evictor_loop, std::ref(db));
+}
+
+/**
+ * @brief Wakes up the evictor, if the memory usage exceeds the limit.
+ * Summing the usage touches many cache lines, so every thread checks it once in a few insertions.
+ */
+void limit_memory(database_t& db) noexcept {
+    thread_local std::size_t insertions = 0;
+    if (!db.options.memory_limit || ++insertions % 64)
+        return;
+    if (!exceeds_memory_limit(db))
+        return;
+    std::unique_lock lock {db.eviction_mutex};
+    if (!db.eviction_requested) {
+        db.eviction_requested = true;
+        db.eviction_cv.notify_one();
     }
 }
 
@@ -427,11 +3354,8 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
 
     ustore_database_init_t& c = *c_ptr;
     safe_section("Initializing DBMS", c.error, [&] {
-        auto maybe_pairs = ucset_t::make();
-        return_error_if_m(maybe_pairs, c.error, error_unknown_k, "Couldn't build consistent set");
-        auto db = database_t(std::move(maybe_pairs).value());
-        auto db_ptr = std::make_unique<database_t>(std::move(db)).release();
-
+        ucset_options_t options;
+        stdfs::path root;
         if (c.config && std::strlen(c.config) > 0) {
             // Load config
             config_t config;
@@ -439,7 +3363,7 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
             return_error_if_m(status, c.error, args_wrong_k, status.message());
 
             // Root path
-            stdfs::path root = config.directory;
+            root = config.directory;
             stdfs::file_status root_status = stdfs::status(root);
             return_error_if_m(root_status.type() == stdfs::file_type::directory,
                               c.error,
@@ -451,49 +3375,122 @@ void ustore_database_init(ustore_database_init_t* c_ptr) {
 
             // Engine config
             return_error_if_m(config.engine.config_url.empty(), c.error, args_wrong_k, "Doesn't support URL configs");
-            return_error_if_m(config.engine.config.empty(), c.error, args_wrong_k, "Doesn't support nested configs");
 
             auto fill_options = [](json_t const& js, ucset_options_t& options) {
                 if (js.contains("encryption"))
                     options.encryption = js["encryption"];
                 if (js.contains("compression"))
                     options.compression = js["compression"];
-                if (js.contains("memory_limit"))
-                    options.memory_limit = js["memory_limit"];
+                if (js.contains("partitions"))
+                    options.partitions = js["partitions"].get<size_t>();
+                if (js.contains("checkpoint_interval_ms"))
+                    options.checkpoint_interval_ms = js["checkpoint_interval_ms"].get<size_t>();
+                return config_loader_t::parse_volume(js, "memory_limit", options.memory_limit) &&
+                       config_loader_t::parse_volume(js, "checkpoint_bytes", options.checkpoint_bytes);
             };
 
             // Load from file
-            ucset_options_t options;
             if (!config.engine.config_file_path.empty()) {
                 std::ifstream ifs(config.engine.config_file_path);
                 return_error_if_m(ifs, c.error, args_wrong_k, "Config file not found");
                 auto js = json_t::parse(ifs);
-                fill_options(js, options);
+                return_error_if_m(fill_options(js, options), c.error, args_wrong_k, "Invalid engine config");
             }
             // Override with nested
             if (!config.engine.config.empty())
-                fill_options(config.engine.config, options);
+                return_error_if_m(fill_options(config.engine.config, options),
+                                  c.error,
+                                  args_wrong_k,
+                                  "Invalid engine config");
+            return_error_if_m(options.partitions && options.partitions <= ucset_t::max_parts_k,
+                              c.error,
+                              args_wrong_k,
+                              "Partitions count must be between 1 and 256");
+        }
 
-            db_ptr->persisted_directory = root;
-            read(*db_ptr, db_ptr->persisted_directory, c.error);
+        owner_ptr_t owner {owners().acquire()};
+        return_error_if_m(owner, c.error, out_of_memory_k, "Too many open databases");
+        auto maybe_pairs = ucset_t::make(options.partitions);
+        return_error_if_m(maybe_pairs, c.error, error_unknown_k, "Couldn't build consistent set");
+        auto db = std::make_unique<database_t>(std::move(owner), std::move(maybe_pairs).value());
+        db->options = options;
+
+        db->persisted_directory = root.string();
+        open_spill(*db, c.error);
+        return_if_error_m(c.error);
+        if (!root.empty()) {
+            read(*db, db->persisted_directory, c.error);
+            return_if_error_m(c.error);
+            recover(*db, c.error);
+            return_if_error_m(c.error);
         }
-        *c.db = db_ptr;
+        start_evictor(*db);
+        *c.db = db.release();
     });
 }
 
 void ustore_snapshot_list(ustore_snapshot_list_t* c_ptr) {
+
     ustore_snapshot_list_t& c = *c_ptr;
-    *c.count = 0;
-    if (c.ids)
-        *c.ids = nullptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(c.count && c.ids, c.error, args_combo_k, "Need outputs!");
+
+    linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
+    return_if_error_m(c.error);
+
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    std::shared_lock _ {db.snapshots_mutex};
+    std::size_t snapshots_count = db.snapshots.size() - (db.checkpoint_snapshot != 0);
+    *c.count = static_cast<ustore_size_t>(snapshots_count);
+
+    // For every snapshot we also need to export IDs
+    auto ids = arena.alloc_or_dummy(snapshots_count, c.error, c.ids);
+    return_if_error_m(c.error);
+
+    std::size_t i = 0;
+    for (auto const& id_and_snapshot : db.snapshots)
+        if (id_and_snapshot.first != db.checkpoint_snapshot)
+            ids[i++] = id_and_snapshot.first;
 }
 
-void ustore_snapshot_create(ustore_snapshot_create_t*) {
-    // TODO
+void ustore_snapshot_create(ustore_snapshot_create_t* c_ptr) {
+
+    ustore_snapshot_create_t& c = *c_ptr;
+    return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(c.id, c.error, args_combo_k, "Need an output for the ID!");
+    return_error_if_m(!c.directory, c.error, missing_feature_k, "On-disk checkpoints aren't supported");
+
+    // Taking the lock exclusively waits for the writers in progress,
+    // and keeps the new ones from changing anything before the snapshot is registered.
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    std::unique_lock _ {db.snapshots_mutex};
+    safe_section("Allocating snapshot handle", c.error, [&] {
+        ustore_snapshot_t id = new_snapshot_id(db);
+        db.snapshots.emplace(id, std::make_shared<snapshot_t>());
+        *c.id = id;
+    });
 }
 
-void ustore_snapshot_drop(ustore_snapshot_drop_t*) {
-    // TODO
+void ustore_snapshot_drop(ustore_snapshot_drop_t* c_ptr) {
+
+    if (!c_ptr)
+        return;
+
+    ustore_snapshot_drop_t& c = *c_ptr;
+    if (!c.id || !c.db)
+        return;
+
+    // Preserved values are released outside of the lock,
+    // or later by the readers still holding a reference
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    snapshot_ptr_t dropped;
+    std::unique_lock lock {db.snapshots_mutex};
+    auto it = db.snapshots.find(c.id);
+    if (it == db.snapshots.end() || c.id == db.checkpoint_snapshot)
+        return;
+    dropped = std::move(it->second);
+    db.snapshots.erase(it);
+    lock.unlock();
 }
 
 void ustore_read(ustore_read_t* c_ptr) {
@@ -514,24 +3511,137 @@ void ustore_read(ustore_read_t* c_ptr) {
     validate_read(c.transaction, places, c.options, c.error);
     return_if_error_m(c.error);
 
+    // Snapshot reads take precedence over transactional ones and aren't watched
+    snapshot_ptr_t snapshot;
+    if (c.snapshot) {
+        snapshot = find_snapshot(db, c.snapshot);
+        return_error_if_m(snapshot != nullptr, c.error, args_wrong_k, "The snapshot doesn't exist!");
+    }
+
+    auto find = [&](collection_key_t key, auto&& callback) noexcept {
+        return snapshot            //
+                   ? find_in_snapshot(db, *snapshot, key, callback)
+                   : c.transaction //
+                         ? find_and_watch(txn.pairs, key, c.options, callback)
+                         : find_and_watch(db.pairs, key, c.options, callback);
+    };
+
+    // Batches are resolved in the order of keys, visiting every partition once and walking
+    // through dense runs of keys, instead of descending the tree for each of them.
+    // Snapshot reads have to merge the preserved values, so they remain one by one.
+    bool const batched = !snapshot && places.size() > 1;
+    bool in_order = true;
+    ptr_range_gt<std::size_t> order;
+    ptr_range_gt<collection_key_t> sorted_keys;
+    if (batched) {
+        order = arena.alloc<std::size_t>(places.size(), c.error);
+        return_if_error_m(c.error);
+        sorted_keys = arena.alloc<collection_key_t>(places.size(), c.error);
+        return_if_error_m(c.error);
+        for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx) {
+            order[task_idx] = task_idx;
+            sorted_keys[task_idx] = places[task_idx].collection_key();
+            in_order &= !task_idx || !(sorted_keys[task_idx] < sorted_keys[task_idx - 1]);
+        }
+        if (!in_order) {
+            std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) noexcept {
+                return sorted_keys[a] < sorted_keys[b];
+            });
+            for (std::size_t i = 0; i != places.size(); ++i)
+                sorted_keys[i] = places[order[i]].collection_key();
+        }
+    }
+
+    // Passes the task index and the value to the @p callback. Batches are visited in the order
+    // of keys within every partition, which matches the order of tasks only for sorted inputs
+    // and a single partition.
+    bool const visits_in_order = !batched || (in_order && db.pairs.parts() == 1);
+    auto lookup = [&](auto&& callback) noexcept -> ucset::status_t {
+        if (!batched) {
+            for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx) {
+                auto status = find(places[task_idx].collection_key(), [&](value_view_t value) noexcept {
+                    callback(task_idx, value);
+                });
+                if (!status)
+                    return status;
+            }
+            return {};
+        }
+
+        auto found = [&](std::size_t i, pair_t const* pair) noexcept {
+            if (pair)
+                pair->touch();
+            callback(order[i], pair ? pair->value() : value_view_t {});
+        };
+        bool const watch = !(c.options & ustore_option_transaction_dont_watch_k);
+        return c.transaction //
+                   ? txn.pairs.find_sorted(sorted_keys.begin(), places.size(), watch, found)
+                   : db.pairs.find_sorted(sorted_keys.begin(), places.size(), found);
+    };
+
+    // Export the addresses of stored values, pinning them until the arena is reused
+    if ((c.options & ustore_option_read_pinned_k) && c.addresses) {
+        pins_t::slot_t& slot = db.owner->pins.pin();
+        auto unpin = [](void* payload) noexcept { pins_t::unpin(*reinterpret_cast<pins_t::slot_t*>(payload)); };
+        if (!arena.memory.on_release(unpin, &slot)) {
+            pins_t::unpin(slot);
+            log_error_m(c.error, out_of_memory_k, "Failed to pin values");
+            return;
+        }
+
+        auto presences = arena.alloc_or_dummy(places.size(), c.error, c.presences);
+        return_if_error_m(c.error);
+        auto lengths = arena.alloc_or_dummy(places.size(), c.error, c.lengths);
+        return_if_error_m(c.error);
+        auto addresses = arena.alloc_or_dummy(places.size(), c.error, c.addresses);
+        return_if_error_m(c.error);
+        if (c.offsets)
+            *c.offsets = nullptr;
+        if (c.values)
+            *c.values = nullptr;
+
+        auto status = lookup([&](std::size_t task_idx, value_view_t value) noexcept {
+            presences[task_idx] = bool(value);
+            lengths[task_idx] = value ? static_cast<ustore_length_t>(value.size()) : ustore_length_missing_k;
+            addresses[task_idx] = reinterpret_cast<ustore_bytes_cptr_t>(value.data());
+        });
+        return export_error_code(status, c.error);
+    }
+
     // 1. Allocate a tape for all the values to be pulled
     growing_tape_t tape(arena);
     tape.reserve(places.size(), c.error);
     return_if_error_m(c.error);
-    auto back_inserter = [&](value_view_t value) noexcept {
+    auto back_inserter = [&](std::size_t, value_view_t value) noexcept {
         tape.push_back(value, c.error);
     };
 
-    // 2. Pull the data
-    for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx) {
-        place_t place = places[task_idx];
-        collection_key_t key = place.collection_key();
-        auto status = c.transaction //
-                          ? find_and_watch(txn, key, c.options, back_inserter)
-                          : find_and_watch(db.pairs, key, c.options, back_inserter);
+    // 2. Pull the data, reordering it back into the order of tasks, if needed.
+    // Out of order, the values are pinned during the lookup, to size the tape from their lengths
+    // and then copy every value just once, straight into its place.
+    if (visits_in_order) {
+        auto status = lookup(back_inserter);
+        if (!status)
+            return export_error_code(status, c.error);
+    }
+    else {
+        pins_t::scoped_pin_t pin {db.owner->pins};
+        auto found = arena.alloc<value_view_t>(places.size(), c.error);
+        return_if_error_m(c.error);
+        std::size_t found_bytes = 0;
+        auto status = lookup([&](std::size_t task_idx, value_view_t value) noexcept {
+            found[task_idx] = value;
+            found_bytes += value.size();
+        });
         if (!status)
             return export_error_code(status, c.error);
+
+        tape.reserve(places.size(), found_bytes, c.error);
+        return_if_error_m(c.error);
+        for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx)
+            tape.push_back(found[task_idx], c.error);
     }
+    return_if_error_m(c.error);
 
     // 3. Export the results
     if (c.presences)
@@ -568,11 +3678,13 @@ void ustore_write(ustore_write_t* c_ptr) {
 
     validate_write(c.transaction, places, contents, c.options, c.error);
     return_if_error_m(c.error);
+    limit_memory(db);
 
     // Writes are the only operations that significantly differ
     // in terms of transactional and batch operations.
     // The latter will also differ depending on the number
     // pairs you are working with - one or more.
+    bool const logged = !db.persisted_directory.empty();
     if (c.transaction) {
         bool dont_watch = c.options & ustore_option_transaction_dont_watch_k;
         for (std::size_t i = 0; i != places.size(); ++i) {
@@ -580,27 +3692,57 @@ void ustore_write(ustore_write_t* c_ptr) {
             value_view_t content = contents[i];
             collection_key_t key = place.collection_key();
             if (!dont_watch)
-                if (auto watch_status = txn.watch(key); !watch_status)
+                if (auto watch_status = txn.pairs.watch(key); !watch_status)
                     return export_error_code(watch_status, c.error);
 
             ucset::status_t status;
             if (content) {
-                pair_t pair {key, content, c.error};
+                pair_t pair {key, content, *db.owner, c.error};
                 return_if_error_m(c.error);
-                status = txn.upsert(std::move(pair));
+                status = txn.pairs.upsert(std::move(pair));
             }
             else
-                status = txn.erase(key);
+                status = txn.pairs.erase(key);
 
             if (!status)
                 return export_error_code(status, c.error);
+            safe_section("Tracking transaction", c.error, [&] {
+                txn.updated_keys.push_back(key);
+                if (logged)
+                    txn.changes.push_back(key, content);
+            });
+            return_if_error_m(c.error);
         }
         return;
     }
 
+    // Serialize the log record before entering the critical section
+    wal_batch_t changes;
+    if (logged)
+        safe_section("Logging batch", c.error, [&] {
+            for (std::size_t i = 0; i != places.size(); ++i)
+                changes.push_back(places[i].collection_key(), contents[i]);
+        });
+    return_if_error_m(c.error);
+
+    std::shared_lock snapshots_lock {db.snapshots_mutex};
+    preserve(
+        db,
+        places.size(),
+        [&](std::size_t i) noexcept { return places[i].collection_key(); },
+        c.error);
+    return_if_error_m(c.error);
+
+    logged_change_t change {db, wal_record_t::batch_k, changes.payload, logged, c.error};
+    auto export_status = [&](ucset::status_t const& status) noexcept {
+        if (!*c.error)
+            export_error_code(status, c.error);
+        change.cancel();
+    };
+
     // Non-transactional but atomic batch-write operation.
     // It requires producing a copy of input data.
-    else if (c.tasks_count > 1) {
+    if (c.tasks_count > 1) {
         uninitialized_array_gt<pair_t> copies(places.count, arena, c.error);
         return_if_error_m(c.error);
         initialized_range_gt<pair_t> copies_constructed(copies);
@@ -610,13 +3752,15 @@ void ustore_write(ustore_write_t* c_ptr) {
             value_view_t content = contents[i];
             collection_key_t key = place.collection_key();
 
-            pair_t pair {key, content, c.error};
+            pair_t pair {key, content, *db.owner, c.error};
             return_if_error_m(c.error);
             copies[i] = std::move(pair);
         }
 
-        auto status = db.pairs.upsert(std::make_move_iterator(copies.begin()), std::make_move_iterator(copies.end()));
-        return export_error_code(status, c.error);
+        auto status =
+            db.pairs.upsert(std::make_move_iterator(copies.begin()), std::make_move_iterator(copies.end()), change);
+        if (!status)
+            return export_status(status);
     }
 
     // Just a single non-batch write
@@ -625,11 +3769,14 @@ void ustore_write(ustore_write_t* c_ptr) {
         value_view_t content = contents[0];
         collection_key_t key = place.collection_key();
 
-        pair_t pair {key, content, c.error};
+        pair_t pair {key, content, *db.owner, c.error};
         return_if_error_m(c.error);
-        auto status = db.pairs.upsert(std::move(pair));
-        return export_error_code(status, c.error);
+        auto status = db.pairs.upsert(std::move(pair), change);
+        if (!status)
+            return export_status(status);
     }
+
+    change.finish(c.options);
 }
 
 void ustore_scan(ustore_scan_t* c_ptr) {
@@ -647,11 +3794,18 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_length_t const> lens {c.count_limits, c.count_limits_stride};
-    scans_arg_t scans {collections, start_keys, lens, c.tasks_count};
+    strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
+    scans_arg_t scans {collections, start_keys, lens, c.tasks_count, end_keys};
 
     validate_scan(c.transaction, scans, c.options, c.error);
     return_if_error_m(c.error);
 
+    snapshot_ptr_t snapshot;
+    if (c.snapshot) {
+        snapshot = find_snapshot(db, c.snapshot);
+        return_error_if_m(snapshot != nullptr, c.error, args_wrong_k, "The snapshot doesn't exist!");
+    }
+
     // 1. Allocate a tape for all the values to be fetched
     auto offsets = arena.alloc_or_dummy(scans.count + 1, c.error, c.offsets);
     return_if_error_m(c.error);
@@ -662,28 +3816,53 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     auto keys_output = *c.keys = arena.alloc<ustore_key_t>(total_keys, c.error).begin();
     return_if_error_m(c.error);
 
+    bool const export_values = c.value_offsets || c.value_lengths || c.values;
+    growing_tape_t tape(arena);
+    if (export_values) {
+        tape.reserve(total_keys, c.error);
+        return_if_error_m(c.error);
+    }
+
     // 2. Fetch the data
     for (std::size_t task_idx = 0; task_idx != scans.count; ++task_idx) {
         scan_t scan = scans[task_idx];
         offsets[task_idx] = keys_output - *c.keys;
+        counts[task_idx] = 0;
+        if (!scan.limit)
+            continue;
 
         ustore_length_t matched_pairs_count = 0;
-        auto found_pair = [&](pair_t const& pair) noexcept {
-            *keys_output = pair.collection_key.key;
+        auto found_key = [&](collection_key_t key, value_view_t value) noexcept {
+            *keys_output = key.key;
             ++keys_output;
             ++matched_pairs_count;
+            if (export_values)
+                tape.push_back(value, c.error);
         };
+        auto found_pair = [&](pair_t const& pair) noexcept { found_key(pair.collection_key, pair.value()); };
 
         auto previous_key = collection_key_t {scan.collection, scan.min_key};
-        auto status = c.transaction //
-                          ? scan_and_watch(txn, previous_key, scan.limit, c.options, found_pair)
-                          : scan_and_watch(db.pairs, previous_key, scan.limit, c.options, found_pair);
+        auto end_key = scan_end(scan);
+        auto status = snapshot //
+                          ? scan_snapshot(db, *snapshot, previous_key, end_key, scan.limit, found_key)
+                          : c.transaction //
+                                ? scan_and_watch(txn.pairs, previous_key, end_key, scan.limit, c.options, found_pair)
+                                : scan_and_watch(db.pairs, previous_key, end_key, scan.limit, c.options, found_pair);
         if (!status)
             return export_error_code(status, c.error);
+        return_if_error_m(c.error);
 
         counts[task_idx] = matched_pairs_count;
     }
     offsets[scans.count] = keys_output - *c.keys;
+
+    // 3. Export the values
+    if (c.value_offsets)
+        *c.value_offsets = tape.offsets().begin().get();
+    if (c.value_lengths)
+        *c.value_lengths = tape.lengths().begin().get();
+    if (c.values)
+        *c.values = (ustore_bytes_ptr_t)tape.contents().begin().get();
 }
 
 struct key_from_pair_t {
@@ -723,6 +3902,12 @@ void ustore_sample(ustore_sample_t* c_ptr) {
     strided_iterator_gt<ustore_length_t const> lens {c.count_limits, c.count_limits_stride};
     sample_args_t samples {collections, lens, c.tasks_count};
 
+    snapshot_ptr_t snapshot;
+    if (c.snapshot) {
+        snapshot = find_snapshot(db, c.snapshot);
+        return_error_if_m(snapshot != nullptr, c.error, args_wrong_k, "The snapshot doesn't exist!");
+    }
+
     auto offsets = arena.alloc_or_dummy(samples.count + 1, c.error, c.offsets);
     return_if_error_m(c.error);
     auto counts = arena.alloc_or_dummy(samples.count, c.error, c.counts);
@@ -743,7 +3928,27 @@ void ustore_sample(ustore_sample_t* c_ptr) {
         collection_key_t min(task.collection, std::numeric_limits<ustore_key_t>::min());
         collection_key_t max(task.collection, std::numeric_limits<ustore_key_t>::max());
 
-        auto status = db.pairs.sample_range(min, max, random_generator, seen, task.limit, iter);
+        // Snapshots are sampled with a reservoir over the merged state
+        ucset::status_t status;
+        if (snapshot) {
+            status = scan_snapshot( //
+                db,
+                *snapshot,
+                min,
+                collection_end(task.collection),
+                std::numeric_limits<std::size_t>::max(),
+                [&](collection_key_t key, value_view_t) noexcept {
+                    std::size_t slot = seen;
+                    if (seen >= task.limit)
+                        slot = std::uniform_int_distribution<std::size_t>(0, seen)(random_generator);
+                    if (slot < task.limit)
+                        keys_output[slot] = key.key;
+                    ++seen;
+                });
+            task.limit = static_cast<ustore_length_t>(std::min<std::size_t>(seen, task.limit));
+        }
+        else
+            status = db.pairs.sample_range(min, max, random_generator, seen, task.limit, iter);
         export_error_code(status, c.error);
         return_if_error_m(c.error);
 
@@ -777,31 +3982,42 @@ void ustore_measure(ustore_measure_t* c_ptr) {
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
 
+    snapshot_ptr_t snapshot;
+    if (c.snapshot) {
+        snapshot = find_snapshot(db, c.snapshot);
+        return_error_if_m(snapshot != nullptr, c.error, args_wrong_k, "The snapshot doesn't exist!");
+    }
+
     for (ustore_size_t i = 0; i != c.tasks_count; ++i) {
         auto collection = collections[i];
         ustore_key_t const min_key = start_keys[i];
         ustore_key_t const max_key = end_keys[i];
 
-        collection_key_t min(collection, min_key);
-        collection_key_t max(collection, max_key);
-
-        std::size_t cardinality = 0;
-        std::size_t value_bytes = 0;
-        std::size_t space_usage = 0;
-        auto status = db.pairs.range(min, max, [&](pair_t& pair) noexcept {
-            ++cardinality;
-            value_bytes += pair.range.size();
-            space_usage += pair.range.size() + sizeof(pair_t);
-        });
-        export_error_code(status, c.error);
-        return_if_error_m(c.error);
-
-        min_cardinalities[i] = static_cast<ustore_size_t>(cardinality);
-        max_cardinalities[i] = std::numeric_limits<ustore_size_t>::max();
-        min_value_bytes[i] = value_bytes;
-        max_value_bytes[i] = std::numeric_limits<ustore_size_t>::max();
-        min_space_usages[i] = space_usage;
-        max_space_usages[i] = std::numeric_limits<ustore_size_t>::max();
+        // The HEAD state is answered from the incrementally maintained histograms,
+        // while snapshots have to be scanned
+        ucset_t::stats_t lower, upper;
+        if (snapshot) {
+            auto status = scan_snapshot(db,
+                                        *snapshot,
+                                        collection_key_t {collection, min_key},
+                                        collection_key_t {collection, max_key},
+                                        std::numeric_limits<std::size_t>::max(),
+                                        [&](collection_key_t, value_view_t value) noexcept {
+                                            lower.add(static_cast<ustore_length_t>(value.size()));
+                                        });
+            export_error_code(status, c.error);
+            return_if_error_m(c.error);
+            upper = lower;
+        }
+        else
+            db.pairs.estimate(collection, min_key, max_key, lower, upper);
+
+        min_cardinalities[i] = static_cast<ustore_size_t>(lower.count);
+        max_cardinalities[i] = static_cast<ustore_size_t>(upper.count);
+        min_value_bytes[i] = lower.value_bytes;
+        max_value_bytes[i] = upper.value_bytes;
+        min_space_usages[i] = lower.reserved_bytes;
+        max_space_usages[i] = upper.reserved_bytes;
     }
 }
 
@@ -823,8 +4039,22 @@ void ustore_collection_create(ustore_collection_create_t* c_ptr) {
     return_error_if_m(collection_it == db.names.end(), c.error, args_wrong_k, "Such collection already exists!");
 
     auto new_collection_id = new_collection(db);
+    bool const logged = !db.persisted_directory.empty();
+    std::string payload;
+    if (logged)
+        safe_section("Logging new collection", c.error, [&] {
+            wal_push_name(payload, new_collection_id, collection_name);
+        });
+    return_if_error_m(c.error);
+
+    logged_change_t change {db, wal_record_t::create_k, payload, logged, c.error};
+    if (!change())
+        return;
     safe_section("Inserting new collection", c.error, [&] { db.names.emplace(collection_name, new_collection_id); });
+    if (*c.error)
+        return change.cancel();
     *c.id = new_collection_id;
+    change.finish(ustore_options_default_k);
 }
 
 void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
@@ -841,30 +4071,21 @@ void ustore_collection_drop(ustore_collection_drop_t* c_ptr) {
     database_t& db = *reinterpret_cast<database_t*>(c.db);
     std::unique_lock _ {db.restructuring_mutex};
 
-    if (c.mode == ustore_drop_keys_vals_handle_k) {
-        auto status = db.pairs.erase_range(c.id, c.id + 1, no_op_t {});
-        if (!status)
-            return export_error_code(status, c.error);
-
-        for (auto it = db.names.begin(); it != db.names.end(); ++it) {
-            if (c.id != it->second)
-                continue;
-            db.names.erase(it);
-            break;
-        }
-    }
-
-    else if (c.mode == ustore_drop_keys_vals_k) {
-        auto status = db.pairs.erase_range(c.id, c.id + 1, no_op_t {});
-        return export_error_code(status, c.error);
-    }
-
-    else if (c.mode == ustore_drop_vals_k) {
-        auto status = db.pairs.range(c.id, c.id + 1, [&](pair_t& pair) noexcept {
-            pair = pair_t {pair.collection_key, value_view_t::make_empty(), nullptr};
+    bool const logged = !db.persisted_directory.empty();
+    std::string payload;
+    if (logged)
+        safe_section("Logging collection drop", c.error, [&] {
+            wal_push(payload, c.id);
+            wal_push(payload, static_cast<std::uint8_t>(c.mode));
         });
-        return export_error_code(status, c.error);
-    }
+    return_if_error_m(c.error);
+
+    std::shared_lock snapshots_lock {db.snapshots_mutex};
+    logged_change_t change {db, wal_record_t::drop_k, payload, logged, c.error};
+    drop_collection(db, c.id, c.mode, c.error, change);
+    if (*c.error)
+        return change.cancel();
+    change.finish(ustore_options_default_k);
 }
 
 void ustore_collection_list(ustore_collection_list_t* c_ptr) {
@@ -915,7 +4136,49 @@ void ustore_database_control(ustore_database_control_t* c_ptr) {
     return_error_if_m(c.request, c.error, uninitialized_state_k, "Request is uninitialized");
 
     *c.response = NULL;
-    log_error_m(c.error, missing_feature_k, "Controls aren't supported in this implementation!");
+    database_t& db = *reinterpret_cast<database_t*>(c.db);
+    std::string_view request {c.request};
+
+    // Slabs are shared by all the databases in the process and are never returned to the system
+    if (request == "usage") {
+        linked_memory_lock_t arena = linked_memory(c.arena, ustore_options_default_k, c.error);
+        return_if_error_m(c.error);
+        constexpr std::size_t max_length_k = 96;
+        auto response = arena.alloc<char>(max_length_k, c.error);
+        return_if_error_m(c.error);
+        std::snprintf(response.begin(),
+                      max_length_k,
+                      "{\"memory_bytes\":%llu,\"reserved_bytes\":%llu}",
+                      static_cast<unsigned long long>(db.owner->memory.total()),
+                      static_cast<unsigned long long>(blob_allocator_t::reserved_bytes()));
+        *c.response = response.begin();
+        return;
+    }
+
+    // Commits without `ustore_option_write_flush_k` return before their log records
+    // are on disk, and clients wait for all of them at once, only when they need it
+    std::uint64_t durable = 0;
+    if (request == "flush") {
+        if (db.wal.is_open()) {
+            db.wal.sync(db.wal.appended(), c.error);
+            return_if_error_m(c.error);
+        }
+        durable = db.wal.synced();
+    }
+    else if (request == "durable")
+        durable = db.wal.synced();
+    else {
+        log_error_m(c.error, missing_feature_k, "Only \"usage\", \"flush\" and \"durable\" controls are supported!");
+        return;
+    }
+
+    linked_memory_lock_t arena = linked_memory(c.arena, ustore_options_default_k, c.error);
+    return_if_error_m(c.error);
+    constexpr std::size_t max_digits_k = 24;
+    auto response = arena.alloc<char>(max_digits_k, c.error);
+    return_if_error_m(c.error);
+    std::snprintf(response.begin(), max_digits_k, "%llu", static_cast<unsigned long long>(durable));
+    *c.response = response.begin();
 }
 
 /*********************************************************/
@@ -941,7 +4204,9 @@ void ustore_transaction_init(ustore_transaction_init_t* c_ptr) {
     return_if_error_m(c.error);
 
     transaction_t& txn = *reinterpret_cast<transaction_t*>(*c.transaction);
-    auto status = txn.reset();
+    txn.changes.clear();
+    txn.updated_keys.clear();
+    auto status = txn.pairs.reset();
     return export_error_code(status, c.error);
 }
 
@@ -954,19 +4219,38 @@ void ustore_transaction_commit(ustore_transaction_commit_t* c_ptr) {
     validate_transaction_commit(c.transaction, c.options, c.error);
     return_if_error_m(c.error);
     transaction_t& txn = *reinterpret_cast<transaction_t*>(c.transaction);
-    auto status = txn.stage();
-    if (!status)
-        return export_error_code(status, c.error);
-    status = txn.commit();
-    if (!status)
-        return export_error_code(status, c.error);
 
-    if (c.sequence_number)
-        *c.sequence_number = txn.generation();
+    std::shared_lock snapshots_lock {db.snapshots_mutex};
+    preserve(
+        db,
+        txn.updated_keys.size(),
+        [&](std::size_t i) noexcept { return txn.updated_keys[i]; },
+        c.error);
+    return_if_error_m(c.error);
 
-    // TODO: Degrade the lock to "shared" state before starting expensive IO
-    if (c.options & ustore_option_write_flush_k)
-        safe_section("Saving to disk", c.error, [&] { write(db, db.persisted_directory, c.error); });
+    // Commits reach the log, once they can't fail, but before they become visible.
+    // Only the changes of this transaction are written and flushed, not the whole state.
+    bool const logged = !db.persisted_directory.empty() && txn.changes.count;
+    logged_change_t change {db, wal_record_t::batch_k, txn.changes.payload, logged, c.error};
+    auto status = txn.pairs.commit(change);
+    if (!status) {
+        if (!*c.error)
+            export_error_code(status, c.error);
+        return;
+    }
+    limit_memory(db);
+
+    // Persisted commits are numbered by their log records, like the "flush" and "durable" controls.
+    // Commits without changes get the last number assigned, as they add no records.
+    std::uint64_t sequence = db.persisted_directory.empty() ? txn.pairs.generation()
+                             : logged                       ? change.sequence
+                                                            : db.wal.appended();
+    change.finish(c.options);
+    txn.changes.clear();
+    txn.updated_keys.clear();
+    return_if_error_m(c.error);
+    if (c.sequence_number)
+        *c.sequence_number = sequence;
 }
 
 /*********************************************************/
@@ -989,9 +4273,14 @@ void ustore_database_free(ustore_database_t c_db) {
         return;
 
     database_t& db = *reinterpret_cast<database_t*>(c_db);
-    if (!db.persisted_directory.empty()) {
+    stop_evictor(db);
+    stop_checkpointer(db);
+
+    // The log is replayed on the next start anyway, so we only fold it into Parquet files,
+    // if it has anything on top of them. The failures can't be returned, and lose no data.
+    if (!db.persisted_directory.empty() && db.wal.appended() != db.checkpointed) {
         ustore_error_t c_error = nullptr;
-        safe_section("Saving to disk", &c_error, [&] { write(db, db.persisted_directory, &c_error); });
+        safe_section("Saving to disk", &c_error, [&] { checkpoint(db, &c_error); });
     }
 
     delete &db;
@@ -32,6 +32,7 @@ ustore_key_t const ustore_key_unknown_k = std::numeric_limits<ustore_key_t>::max
 bool const ustore_supports_transactions_k = true;
 bool const ustore_supports_named_collections_k = true;
 bool const ustore_supports_snapshots_k = true;
+bool const ustore_supports_neighborhood_merges_k = false;
 
 /*********************************************************/
 /*****************	 C++ Implementation	  ****************/
@@ -1013,7 +1014,8 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> start_keys {c.start_keys, c.start_keys_stride};
     strided_iterator_gt<ustore_length_t const> limits {c.count_limits, c.count_limits_stride};
-    scans_arg_t scans {collections, start_keys, limits, c.tasks_count};
+    strided_iterator_gt<ustore_key_t const> end_keys {c.end_keys, c.end_keys_stride};
+    scans_arg_t scans {collections, start_keys, limits, c.tasks_count, end_keys};
     places_arg_t places {collections, start_keys, {}, c.tasks_count};
 
     bool const same_collection = places.same_collection();
@@ -1141,6 +1143,27 @@ void ustore_scan(ustore_scan_t* c_ptr) {
     auto offs_array = std::static_pointer_cast<ar::NumericArray<ar::UInt32Type>>(table->column(1)->chunk(0));
     auto data_ptr = (ustore_key_t*)keys_array->raw_values();
     auto offs_ptr = (ustore_length_t*)offs_array->raw_values();
+    db.readers.push_back(std::move(result->reader));
+
+    // Bounds and values aren't a part of the protocol yet, so they are applied on the client side
+    if (c.end_keys && offs_ptr) {
+        auto bounded_offs = arena.alloc<ustore_length_t>(places.count + 1, c.error).begin();
+        return_if_error_m(c.error);
+        auto bounded_keys = arena.alloc<ustore_key_t>(offs_ptr[places.count], c.error).begin();
+        return_if_error_m(c.error);
+        ustore_length_t bounded_count = 0;
+        for (std::size_t i = 0; i != places.count; ++i) {
+            scan_t task = scans[i];
+            bounded_offs[i] = bounded_count;
+            ustore_length_t const received = offs_ptr[i + 1] - offs_ptr[i];
+            ustore_length_t const end = offs_ptr[i] + std::min(received, task.limit);
+            for (ustore_length_t j = offs_ptr[i]; j != end && data_ptr[j] <= task.max_key; ++j)
+                bounded_keys[bounded_count++] = data_ptr[j];
+        }
+        bounded_offs[places.count] = bounded_count;
+        offs_ptr = bounded_offs;
+        data_ptr = bounded_keys;
+    }
 
     if (c.offsets)
         *c.offsets = offs_ptr;
@@ -1153,7 +1176,31 @@ void ustore_scan(ustore_scan_t* c_ptr) {
             lens[i] = offs_ptr ? offs_ptr[i + 1] - offs_ptr[i] : 0;
     }
 
-    db.readers.push_back(std::move(result->reader));
+    if (c.value_offsets || c.value_lengths || c.values) {
+        ustore_length_t const found_count = offs_ptr ? offs_ptr[places.count] : 0;
+        auto found_collections = arena.alloc<ustore_collection_t>(found_count, c.error).begin();
+        return_if_error_m(c.error);
+        for (std::size_t i = 0; i != places.count; ++i)
+            std::fill(found_collections + offs_ptr[i], found_collections + offs_ptr[i + 1], scans[i].collection);
+
+        ustore_read_t read {};
+        read.db = c.db;
+        read.error = c.error;
+        read.transaction = c.transaction;
+        read.snapshot = c.snapshot;
+        read.arena = c.arena;
+        read.options = ustore_options_t(ustore_option_dont_discard_memory_k |
+                                        (c.options & ustore_option_transaction_dont_watch_k));
+        read.tasks_count = found_count;
+        read.collections = found_collections;
+        read.collections_stride = sizeof(ustore_collection_t);
+        read.keys = data_ptr;
+        read.keys_stride = sizeof(ustore_key_t);
+        read.offsets = c.value_offsets;
+        read.lengths = c.value_lengths;
+        read.values = c.values;
+        ustore_read(&read);
+    }
 }
 
 void ustore_sample(ustore_sample_t* c_ptr) {
@@ -1466,6 +1513,7 @@ void ustore_snapshot_list(ustore_snapshot_list_t* c_ptr) {
 void ustore_snapshot_create(ustore_snapshot_create_t* c_ptr) {
     ustore_snapshot_create_t& c = *c_ptr;
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
+    return_error_if_m(!c.directory, c.error, missing_feature_k, "On-disk checkpoints aren't supported");
 
     rpc_client_t& db = *reinterpret_cast<rpc_client_t*>(c.db);
 
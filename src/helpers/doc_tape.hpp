@@ -0,0 +1,407 @@
+/**
+ * @file doc_tape.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Pre-parsed binary representation of JSON-like documents.
+ *
+ * A tape starts with a @c doc_tape_header_t, followed by three sections:
+ * 1. @c doc_entry_t's for every value and every object key in document order,
+ * 2. `u32` tables with the entry indices of the children of every container,
+ * 3. NULL-terminated strings and object keys.
+ *
+ * Every container entry knows where its descendants end, so siblings are skipped
+ * without visiting the nested values. Array tables are in the original order,
+ * making indexing constant-time, while object tables are sorted by key and
+ * searched with a binary search. Reading never allocates and never parses,
+ * and works on unaligned buffers, as engines return values packed back-to-back.
+ */
+#pragma once
+#include <algorithm>   // `std::sort`
+#include <charconv>    // `std::from_chars`
+#include <cstring>     // `std::memcpy`
+#include <string_view> // `std::string_view`
+
+#include "linked_array.hpp" // `uninitialized_array_gt`
+
+namespace unum::ustore {
+
+enum class doc_kind_t : std::uint8_t {
+    null_k = 0,
+    false_k,
+    true_k,
+    uint_k,
+    sint_k,
+    real_k,
+    str_k,
+    arr_k,
+    obj_k,
+};
+
+struct doc_tape_header_t {
+    char magic[4];
+    std::uint32_t entries_count;
+    std::uint32_t tables_count;
+    std::uint32_t strings_length;
+};
+
+struct doc_entry_t {
+    doc_kind_t kind;
+    std::uint8_t reserved[3];
+    /// Bytes in strings, elements in arrays, members in objects.
+    std::uint32_t length;
+    union {
+        std::uint64_t u64;
+        std::int64_t i64;
+        double f64;
+        /// Offset of the string or the table within its section,
+        /// and for containers the index of the entry past the last descendant.
+        std::uint32_t refs[2];
+    };
+};
+
+static_assert(sizeof(doc_tape_header_t) == 16, "Tapes are shared between builds");
+static_assert(sizeof(doc_entry_t) == 16, "Tapes are shared between builds");
+
+/**
+ * @brief Starts with a byte that can't begin a JSON text,
+ * distinguishing tapes from documents stored as plain JSON.
+ */
+constexpr char doc_tape_magic_k[4] = {'\x7F', 'u', 'd', '1'};
+
+inline bool is_doc_tape(value_view_t bytes) noexcept {
+    doc_tape_header_t header;
+    if (bytes.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::size_t expected_size = sizeof(header) + std::size_t(header.entries_count) * sizeof(doc_entry_t) +
+                                std::size_t(header.tables_count) * sizeof(std::uint32_t) + header.strings_length;
+    return std::memcmp(header.magic, doc_tape_magic_k, sizeof(doc_tape_magic_k)) == 0 && header.entries_count &&
+           expected_size == bytes.size();
+}
+
+/**
+ * @brief Single value within a tape. Default-constructed views represent missing values.
+ */
+class doc_view_t {
+
+    byte_t const* tape_ = nullptr;
+    std::uint32_t idx_ = 0;
+    doc_entry_t entry_ {};
+
+    doc_tape_header_t header() const noexcept {
+        doc_tape_header_t header;
+        std::memcpy(&header, tape_, sizeof(header));
+        return header;
+    }
+
+    byte_t const* tables() const noexcept {
+        return tape_ + sizeof(doc_tape_header_t) + std::size_t(header().entries_count) * sizeof(doc_entry_t);
+    }
+
+    std::uint32_t table_at(std::size_t i) const noexcept {
+        std::uint32_t idx;
+        std::memcpy(&idx, tables() + (std::size_t(entry_.refs[0]) + i) * sizeof(idx), sizeof(idx));
+        return idx;
+    }
+
+    char const* strings() const noexcept {
+        doc_tape_header_t header = this->header();
+        return reinterpret_cast<char const*>(tape_ + sizeof(doc_tape_header_t) +
+                                             std::size_t(header.entries_count) * sizeof(doc_entry_t) +
+                                             std::size_t(header.tables_count) * sizeof(std::uint32_t));
+    }
+
+    /**
+     * @brief Compares an object key to a JSON-Pointer token, which may contain "~0" and "~1" escapes.
+     */
+    static bool equals_escaped(std::string_view key, std::string_view token) noexcept {
+        std::size_t key_idx = 0;
+        for (std::size_t token_idx = 0; token_idx != token.size(); ++token_idx, ++key_idx) {
+            char c = token[token_idx];
+            if (c == '~') {
+                if (++token_idx == token.size())
+                    return false;
+                c = token[token_idx] == '0' ? '~' : token[token_idx] == '1' ? '/' : '\0';
+                if (!c)
+                    return false;
+            }
+            if (key_idx == key.size() || key[key_idx] != c)
+                return false;
+        }
+        return key_idx == key.size();
+    }
+
+    doc_view_t find_escaped(std::string_view token) const noexcept {
+        if (token.find('~') == std::string_view::npos)
+            return find(token);
+        doc_view_t result;
+        for_each_member([&](std::string_view key, doc_view_t value) {
+            if (!result && equals_escaped(key, token))
+                result = value;
+        });
+        return result;
+    }
+
+    /**
+     * @brief Index of the entry following this value and all of its descendants,
+     * which is the next element of the parent array or the next key of the parent object.
+     */
+    std::uint32_t next_idx() const noexcept { return is_container() ? entry_.refs[1] : idx_ + 1; }
+
+    doc_view_t at_token(std::string_view token) const noexcept {
+        std::size_t idx = 0;
+        bool is_canonical = !token.empty() && (token.size() == 1 || token.front() != '0');
+        auto result = std::from_chars(token.data(), token.data() + token.size(), idx);
+        if (!is_canonical || result.ec != std::errc() || result.ptr != token.data() + token.size())
+            return {};
+        return at(idx);
+    }
+
+  public:
+    doc_view_t() noexcept = default;
+    doc_view_t(byte_t const* tape, std::uint32_t idx) noexcept : tape_(tape), idx_(idx) {
+        byte_t const* entry = tape_ + sizeof(doc_tape_header_t) + std::size_t(idx) * sizeof(doc_entry_t);
+        std::memcpy(&entry_, entry, sizeof(entry_));
+    }
+
+    /**
+     * @brief Views the root of a tape, previously checked with `is_doc_tape`.
+     */
+    explicit doc_view_t(value_view_t tape) noexcept : doc_view_t(tape.data(), 0) {}
+
+    explicit operator bool() const noexcept { return tape_; }
+    doc_kind_t kind() const noexcept { return entry_.kind; }
+
+    bool is_null() const noexcept { return entry_.kind == doc_kind_t::null_k; }
+    bool is_bool() const noexcept { return entry_.kind == doc_kind_t::false_k || entry_.kind == doc_kind_t::true_k; }
+    bool is_str() const noexcept { return entry_.kind == doc_kind_t::str_k; }
+    bool is_arr() const noexcept { return entry_.kind == doc_kind_t::arr_k; }
+    bool is_obj() const noexcept { return entry_.kind == doc_kind_t::obj_k; }
+    bool is_container() const noexcept { return is_arr() || is_obj(); }
+
+    bool get_bool() const noexcept { return entry_.kind == doc_kind_t::true_k; }
+    std::uint64_t get_uint() const noexcept { return entry_.u64; }
+    std::int64_t get_sint() const noexcept { return entry_.i64; }
+    double get_real() const noexcept { return entry_.f64; }
+    std::string_view get_str() const noexcept { return {strings() + entry_.refs[0], entry_.length}; }
+
+    /**
+     * @brief Bytes occupied by the whole tape, this value belongs to.
+     */
+    std::size_t tape_size() const noexcept {
+        doc_tape_header_t header = this->header();
+        return sizeof(header) + std::size_t(header.entries_count) * sizeof(doc_entry_t) +
+               std::size_t(header.tables_count) * sizeof(std::uint32_t) + header.strings_length;
+    }
+
+    /**
+     * @brief Number of elements in an array or members in an object.
+     */
+    std::size_t size() const noexcept { return is_container() ? entry_.length : 0; }
+
+    doc_view_t at(std::size_t i) const noexcept {
+        return is_arr() && i < entry_.length ? doc_view_t {tape_, table_at(i)} : doc_view_t {};
+    }
+
+    /**
+     * @brief Searches the sorted keys of an object. Duplicate keys resolve to the first one in the document.
+     */
+    doc_view_t find(std::string_view key) const noexcept {
+        if (!is_obj())
+            return {};
+        std::size_t low = 0, high = entry_.length;
+        while (low < high) {
+            std::size_t mid = low + (high - low) / 2;
+            if (doc_view_t {tape_, table_at(mid)}.get_str() < key)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if (low == entry_.length)
+            return {};
+        doc_view_t found_key {tape_, table_at(low)};
+        return found_key.get_str() == key ? doc_view_t {tape_, found_key.idx_ + 1} : doc_view_t {};
+    }
+
+    /**
+     * @brief Resolves an RFC 6901 JSON-Pointer, like "/person/0/name".
+     */
+    doc_view_t pointer(std::string_view path) const noexcept {
+        doc_view_t node = *this;
+        while (!path.empty() && node) {
+            if (path.front() != '/')
+                return {};
+            path.remove_prefix(1);
+            std::size_t token_length = std::min(path.find('/'), path.size());
+            std::string_view token = path.substr(0, token_length);
+            path.remove_prefix(token_length);
+            node = node.is_arr() ? node.at_token(token) : node.is_obj() ? node.find_escaped(token) : doc_view_t {};
+        }
+        return node;
+    }
+
+    /**
+     * @brief Follows the conventions of the C API: no field means the whole document,
+     * fields starting with a slash are JSON-Pointers, and the rest are top-level keys.
+     */
+    doc_view_t lookup(ustore_str_view_t field) const noexcept {
+        return !field ? *this : field[0] == '/' ? pointer(field) : find(field);
+    }
+
+    template <typename callback_at>
+    void for_each_element(callback_at&& callback) const {
+        if (!is_arr())
+            return;
+        std::uint32_t element_idx = idx_ + 1;
+        for (std::size_t i = 0; i != entry_.length; ++i) {
+            doc_view_t element {tape_, element_idx};
+            callback(element);
+            element_idx = element.next_idx();
+        }
+    }
+
+    /**
+     * @brief Visits the members of an object in their original order.
+     */
+    template <typename callback_at>
+    void for_each_member(callback_at&& callback) const {
+        if (!is_obj())
+            return;
+        std::uint32_t key_idx = idx_ + 1;
+        for (std::size_t i = 0; i != entry_.length; ++i) {
+            doc_view_t value {tape_, key_idx + 1};
+            callback(doc_view_t {tape_, key_idx}.get_str(), value);
+            key_idx = value.next_idx();
+        }
+    }
+};
+
+/**
+ * @brief Serializes documents into tapes, visiting values in document order.
+ * Containers are started with `open` and finished with `close`, object members
+ * are passed as a key string followed by the value. Reusable across documents.
+ */
+class doc_builder_t {
+
+    uninitialized_array_gt<doc_entry_t> entries_;
+    uninitialized_array_gt<std::uint32_t> tables_;
+    uninitialized_array_gt<char> strings_;
+    uninitialized_array_gt<byte_t> tape_;
+    ustore_error_t* c_error_ = nullptr;
+
+    void add(doc_kind_t kind, std::uint64_t bits) noexcept {
+        doc_entry_t entry {};
+        entry.kind = kind;
+        entry.u64 = bits;
+        entries_.push_back(entry, c_error_);
+    }
+
+    std::uint32_t skip(std::uint32_t idx) const noexcept {
+        doc_entry_t const& entry = entries_.begin()[idx];
+        bool is_container = entry.kind == doc_kind_t::arr_k || entry.kind == doc_kind_t::obj_k;
+        return is_container ? entry.refs[1] : idx + 1;
+    }
+
+    std::string_view key_at(std::uint32_t idx) const noexcept {
+        doc_entry_t const& entry = entries_.begin()[idx];
+        return {strings_.begin() + entry.refs[0], entry.length};
+    }
+
+  public:
+    doc_builder_t(linked_memory_lock_t& arena, ustore_error_t* c_error) noexcept
+        : entries_(arena), tables_(arena), strings_(arena), tape_(arena), c_error_(c_error) {}
+
+    void clear() noexcept {
+        entries_.clear();
+        tables_.clear();
+        strings_.clear();
+        tape_.clear();
+    }
+
+    void add_null() noexcept { add(doc_kind_t::null_k, 0); }
+    void add_bool(bool value) noexcept { add(value ? doc_kind_t::true_k : doc_kind_t::false_k, 0); }
+    void add_uint(std::uint64_t value) noexcept { add(doc_kind_t::uint_k, value); }
+    void add_sint(std::int64_t value) noexcept { add(doc_kind_t::sint_k, static_cast<std::uint64_t>(value)); }
+    void add_real(double value) noexcept {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        add(doc_kind_t::real_k, bits);
+    }
+
+    void add_str(std::string_view value) noexcept {
+        doc_entry_t entry {};
+        entry.kind = doc_kind_t::str_k;
+        entry.length = static_cast<std::uint32_t>(value.size());
+        entry.refs[0] = static_cast<std::uint32_t>(strings_.size());
+        entries_.push_back(entry, c_error_);
+        return_if_error_m(c_error_);
+        strings_.insert(strings_.size(), value.data(), value.data() + value.size(), c_error_);
+        return_if_error_m(c_error_);
+        strings_.push_back('\0', c_error_);
+    }
+
+    /**
+     * @return The index of the container, to be passed to `close`.
+     */
+    std::uint32_t open(doc_kind_t kind) noexcept {
+        std::uint32_t idx = static_cast<std::uint32_t>(entries_.size());
+        add(kind, 0);
+        return idx;
+    }
+
+    /**
+     * @brief Counts the children of the container and exports their table.
+     */
+    void close(std::uint32_t idx) noexcept {
+        return_if_error_m(c_error_);
+        std::uint32_t const end = static_cast<std::uint32_t>(entries_.size());
+        bool const is_obj = entries_[idx].kind == doc_kind_t::obj_k;
+        std::uint32_t const table_offset = static_cast<std::uint32_t>(tables_.size());
+        std::uint32_t count = 0;
+        for (std::uint32_t child = idx + 1; child != end; ++count) {
+            tables_.push_back(child, c_error_);
+            return_if_error_m(c_error_);
+            child = is_obj ? skip(child + 1) : skip(child);
+        }
+
+        doc_entry_t& entry = entries_[idx];
+        entry.length = count;
+        entry.refs[0] = table_offset;
+        entry.refs[1] = end;
+        if (is_obj)
+            std::sort(tables_.begin() + table_offset, tables_.end(), [&](std::uint32_t a, std::uint32_t b) {
+                std::string_view a_key = key_at(a), b_key = key_at(b);
+                return a_key < b_key || (a_key == b_key && a < b);
+            });
+    }
+
+    /**
+     * @brief Concatenates the sections. The result stays valid until the next `clear`.
+     */
+    value_view_t finish() noexcept {
+        if (*c_error_)
+            return {};
+        doc_tape_header_t header;
+        std::memcpy(header.magic, doc_tape_magic_k, sizeof(doc_tape_magic_k));
+        header.entries_count = static_cast<std::uint32_t>(entries_.size());
+        header.tables_count = static_cast<std::uint32_t>(tables_.size());
+        header.strings_length = static_cast<std::uint32_t>(strings_.size());
+
+        std::size_t const entries_bytes = entries_.size() * sizeof(doc_entry_t);
+        std::size_t const tables_bytes = tables_.size() * sizeof(std::uint32_t);
+        tape_.resize(sizeof(header) + entries_bytes + tables_bytes + strings_.size(), c_error_);
+        if (*c_error_)
+            return {};
+
+        byte_t* output = tape_.begin();
+        std::memcpy(output, &header, sizeof(header));
+        std::memcpy(output + sizeof(header), entries_.begin(), entries_bytes);
+        if (tables_bytes)
+            std::memcpy(output + sizeof(header) + entries_bytes, tables_.begin(), tables_bytes);
+        if (strings_.size())
+            std::memcpy(output + sizeof(header) + entries_bytes + tables_bytes, strings_.begin(), strings_.size());
+        return {tape_.begin(), tape_.size()};
+    }
+};
+
+} // namespace unum::ustore
@@ -80,14 +80,28 @@ void full_scan_collection( //
     }
 }
 
+/**
+ * @brief Reads the plain keys, stored in the native byte order.
+ */
+struct native_key_decoder_t {
+    template <typename slice_at>
+    ustore_key_t operator()(slice_at const& stored) const noexcept {
+        ustore_key_t key;
+        std::memcpy(&key, stored.data(), sizeof(ustore_key_t));
+        return key;
+    }
+};
+
 /**
  * @brief Implements reservoir sampling for RocksDB or LevelDB collections.
+ * The @p decode callback maps the key slices of the @p iterator to the keys.
  * @see https://en.wikipedia.org/wiki/Reservoir_sampling
  */
-template <typename level_or_rocks_iterator_at>
+template <typename level_or_rocks_iterator_at, typename key_decoder_at = native_key_decoder_t>
 void reservoir_sample_iterator(level_or_rocks_iterator_at&& iterator,
                                ptr_range_gt<ustore_key_t> sampled_keys,
-                               ustore_error_t* c_error) noexcept {
+                               ustore_error_t* c_error,
+                               key_decoder_at&& decode = {}) noexcept {
 
     std::random_device random_device;
     std::mt19937 random_generator(random_device());
@@ -96,13 +110,13 @@ void reservoir_sample_iterator(level_or_rocks_iterator_at&& iterator,
     std::size_t i = 0;
     for (iterator->SeekToFirst(); i < sampled_keys.size(); ++i, iterator->Next()) {
         return_error_if_m(iterator->Valid(), c_error, 0, "Sample Failure!");
-        std::memcpy(&sampled_keys[i], iterator->key().data(), sizeof(ustore_key_t));
+        sampled_keys[i] = decode(iterator->key());
     }
 
     for (std::size_t j = 0; iterator->Valid(); ++i, iterator->Next()) {
         j = dist(random_generator) % (i + 1);
         if (j < sampled_keys.size())
-            std::memcpy(&sampled_keys[j], iterator->key().data(), sizeof(ustore_key_t));
+            sampled_keys[j] = decode(iterator->key());
     }
 }
 
@@ -215,6 +215,15 @@ class growing_tape_t {
         lengths_.reserve(new_cap, c_error);
     }
 
+    /**
+     * @brief Also reserves the contents, so that appending @p new_bytes doesn't move them.
+     */
+    void reserve(size_t new_cap, size_t new_bytes, ustore_error_t* c_error) {
+        reserve(new_cap, c_error);
+        return_if_error_m(c_error);
+        contents_.reserve(new_bytes, c_error);
+    }
+
     void clear() {
         presences_.clear();
         offsets_.clear();
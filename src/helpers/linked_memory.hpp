@@ -26,9 +26,20 @@ struct linked_memory_t {
     struct arena_header_t;
     arena_header_t* first_ptr_ = nullptr;
 
+    /**
+     * @brief Callback to be invoked before the memory is reused or released,
+     * letting engines unpin the data, they've exported without copies.
+     */
+    struct cleanup_t {
+        void (*callback)(void*) = nullptr;
+        void* payload = nullptr;
+        cleanup_t* next = nullptr;
+    };
+
     enum class kind_t { sys_k = 0, shared_k, unified_k };
     struct arena_header_t {
         arena_header_t* next = nullptr;
+        cleanup_t* cleanups = nullptr;
         std::size_t capacity = 0;
         std::size_t used = 0;
         kind_t kind = kind_t::sys_k;
@@ -81,6 +92,7 @@ struct linked_memory_t {
         if (first_ptr_ && first_ptr_->kind == kind)
             return true;
 
+        run_cleanups();
         first_ptr_ = alloc_arena(initial_size_k, kind);
         first_ptr_->can_release_memory = true;
         return first_ptr_;
@@ -127,7 +139,27 @@ struct linked_memory_t {
         return new_arena->alloc_internally(length, alignment);
     }
 
+    bool on_release(void (*callback)(void*), void* payload) noexcept {
+        auto cleanup = static_cast<cleanup_t*>(alloc(sizeof(cleanup_t), alignof(cleanup_t)));
+        if (!cleanup)
+            return false;
+        *cleanup = {callback, payload, first_ptr_->cleanups};
+        first_ptr_->cleanups = cleanup;
+        return true;
+    }
+
+    void run_cleanups() noexcept {
+        if (!first_ptr_)
+            return;
+        cleanup_t* current = std::exchange(first_ptr_->cleanups, nullptr);
+        while (current != nullptr) {
+            current->callback(current->payload);
+            current = current->next;
+        }
+    }
+
     void release_all() noexcept {
+        run_cleanups();
         arena_header_t* current = first_ptr_;
         while (current != nullptr)
             release_arena(std::exchange(current, current->next));
@@ -137,6 +169,7 @@ struct linked_memory_t {
     void release_partially() noexcept {
         if (!first_ptr_)
             return;
+        run_cleanups();
         arena_header_t* current = first_ptr_->next;
         while (current != nullptr)
             release_arena(std::exchange(current, current->next));
@@ -0,0 +1,66 @@
+/**
+ * @file neighborhoods.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Merging of serialized vertex neighborhoods, shared by the graph modality and engines.
+ */
+#pragma once
+#include <algorithm> // `std::set_union`
+#include <cstring>   // `std::memcpy`
+#include <string>    // `std::string`
+
+#include "ustore/graph.h"       // `ustore_vertex_degree_t`
+#include "ustore/cpp/types.hpp" // `neighborship_t`
+
+namespace unum::ustore {
+
+/**
+ * @brief Every neighborhood starts with the outgoing and incoming degrees,
+ * followed by the sorted outgoing and the sorted incoming @c neighborship_t's.
+ */
+constexpr std::size_t neighborhood_header_bytes_k = 2 * sizeof(ustore_vertex_degree_t);
+
+/**
+ * @brief Appends the union of two neighborhoods to @p merged, keeping both halves sorted.
+ * Entries shorter than the header are treated as empty. The operation is associative,
+ * so a batch of insertions can be merged into the stored state in any grouping.
+ */
+inline void merge_neighborhoods(value_view_t a, value_view_t b, std::string& merged) {
+
+    auto parse = [](value_view_t bytes, ustore_vertex_degree_t* degrees) noexcept {
+        if (bytes.size() < neighborhood_header_bytes_k) {
+            degrees[0] = degrees[1] = 0;
+            return static_cast<neighborship_t const*>(nullptr);
+        }
+        std::memcpy(degrees, bytes.begin(), neighborhood_header_bytes_k);
+        return reinterpret_cast<neighborship_t const*>(bytes.begin() + neighborhood_header_bytes_k);
+    };
+
+    ustore_vertex_degree_t a_degrees[2], b_degrees[2];
+    neighborship_t const* a_ships = parse(a, a_degrees);
+    neighborship_t const* b_ships = parse(b, b_degrees);
+
+    std::size_t const header_offset = merged.size();
+    std::size_t const capacity = a_degrees[0] + a_degrees[1] + b_degrees[0] + b_degrees[1];
+    merged.resize(header_offset + neighborhood_header_bytes_k + capacity * sizeof(neighborship_t));
+
+    auto ships = reinterpret_cast<neighborship_t*>(merged.data() + header_offset + neighborhood_header_bytes_k);
+    auto outgoing_end = std::set_union(a_ships,
+                                       a_ships + a_degrees[0],
+                                       b_ships,
+                                       b_ships + b_degrees[0],
+                                       ships);
+    auto incoming_end = std::set_union(a_ships + a_degrees[0],
+                                       a_ships + a_degrees[0] + a_degrees[1],
+                                       b_ships + b_degrees[0],
+                                       b_ships + b_degrees[0] + b_degrees[1],
+                                       outgoing_end);
+
+    ustore_vertex_degree_t degrees[2];
+    degrees[0] = static_cast<ustore_vertex_degree_t>(outgoing_end - ships);
+    degrees[1] = static_cast<ustore_vertex_degree_t>(incoming_end - outgoing_end);
+    std::memcpy(merged.data() + header_offset, degrees, neighborhood_header_bytes_k);
+    merged.resize(reinterpret_cast<char*>(incoming_end) - merged.data());
+}
+
+} // namespace unum::ustore
@@ -0,0 +1,216 @@
+/**
+ * @file helpers/slab_allocator.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Size-classed pools for small variable-length blobs.
+ */
+#pragma once
+#include <cstdint> // `std::uint8_t`
+#include <cstdlib> // `std::aligned_alloc`
+#include <array>   // `std::array`
+#include <atomic>  // `std::atomic`
+#include <mutex>   // `std::mutex`
+#include <new>     // `std::nothrow`
+
+#include "ustore/cpp/types.hpp" // `byte_t`
+
+namespace unum::ustore {
+
+/**
+ * @brief Serves small blobs from slabs of equally-sized blocks, one pool per size class,
+ * avoiding per-allocation headers and keeping similar values close in memory.
+ * Larger blobs are forwarded to the global `operator new`.
+ *
+ * Every thread keeps a few free blocks of every class, exchanging them with the
+ * shared pools in batches, so the common path takes no locks. Slabs are never
+ * returned to the system, but the freed blocks are reused by any thread.
+ * Unlike `std::allocator`, it reports failures with `nullptr`, rather than exceptions.
+ */
+class slab_allocator_t {
+  public:
+    using value_type = byte_t;
+
+    static constexpr std::size_t slab_size_k = 64ul * 1024ul;
+    static constexpr std::size_t batch_size_k = 32;
+    static constexpr std::size_t granularity_k = 8;
+    static constexpr std::size_t classes_count_k = 20;
+    static constexpr std::array<std::size_t, classes_count_k> class_sizes_k {
+        8, 16, 24, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512, 640, 768, 1024, 1536, 2048,
+    };
+    static constexpr std::size_t max_class_size_k = class_sizes_k.back();
+
+  private:
+    struct block_t {
+        block_t* next;
+    };
+
+    struct alignas(64) pool_t {
+        std::mutex mutex;
+        block_t* free = nullptr;
+        byte_t* tail = nullptr;
+        byte_t* end = nullptr;
+    };
+
+    struct shared_t {
+        pool_t pools[classes_count_k];
+        std::atomic<std::size_t> reserved_bytes {0};
+    };
+
+    struct cache_t {
+        block_t* heads[classes_count_k] {};
+        std::size_t counts[classes_count_k] {};
+
+        ~cache_t() noexcept {
+            for (std::size_t class_idx = 0; class_idx != classes_count_k; ++class_idx)
+                give_back(*this, class_idx, counts[class_idx]);
+        }
+    };
+
+    using class_lookup_t = std::array<std::uint8_t, max_class_size_k / granularity_k>;
+
+    static constexpr class_lookup_t make_class_lookup() noexcept {
+        class_lookup_t lookup {};
+        std::size_t class_idx = 0;
+        for (std::size_t i = 0; i != lookup.size(); ++i) {
+            std::size_t size = (i + 1) * granularity_k;
+            while (class_sizes_k[class_idx] < size)
+                ++class_idx;
+            lookup[i] = static_cast<std::uint8_t>(class_idx);
+        }
+        return lookup;
+    }
+
+    static std::size_t class_of(std::size_t size) noexcept {
+        static constexpr class_lookup_t lookup = make_class_lookup();
+        return lookup[(size - 1) / granularity_k];
+    }
+
+    /**
+     * @brief The shared state must outlive the caches of all threads, so it is never destroyed.
+     */
+    static shared_t& shared() noexcept {
+        static shared_t* state = new shared_t;
+        return *state;
+    }
+
+    static bool& cache_released() noexcept {
+        thread_local bool released = false;
+        return released;
+    }
+
+    struct thread_cache_t : public cache_t {
+        ~thread_cache_t() noexcept { cache_released() = true; }
+    };
+
+    /**
+     * @brief Returns the cache of the current thread, unless it was already destroyed,
+     * which happens when blobs are freed by destructors of static objects.
+     */
+    static cache_t* cache() noexcept {
+        thread_local thread_cache_t thread_cache;
+        return cache_released() ? nullptr : &thread_cache;
+    }
+
+    static void give_back(cache_t& cache, std::size_t class_idx, std::size_t count) noexcept {
+        if (!count)
+            return;
+
+        block_t* first = cache.heads[class_idx];
+        block_t* last = first;
+        for (std::size_t i = 1; i != count; ++i)
+            last = last->next;
+        cache.heads[class_idx] = last->next;
+        cache.counts[class_idx] -= count;
+
+        pool_t& pool = shared().pools[class_idx];
+        std::lock_guard _ {pool.mutex};
+        last->next = pool.free;
+        pool.free = first;
+    }
+
+    static bool take(cache_t& cache, std::size_t class_idx) noexcept {
+        std::size_t const block_size = class_sizes_k[class_idx];
+        pool_t& pool = shared().pools[class_idx];
+        std::lock_guard _ {pool.mutex};
+
+        std::size_t taken = 0;
+        for (; taken != batch_size_k && pool.free; ++taken) {
+            block_t* block = pool.free;
+            pool.free = block->next;
+            block->next = cache.heads[class_idx];
+            cache.heads[class_idx] = block;
+        }
+
+        for (; taken != batch_size_k; ++taken) {
+            if (static_cast<std::size_t>(pool.end - pool.tail) < block_size) {
+                auto slab = static_cast<byte_t*>(std::aligned_alloc(slab_size_k, slab_size_k));
+                if (!slab)
+                    break;
+                shared().reserved_bytes.fetch_add(slab_size_k, std::memory_order_relaxed);
+                pool.tail = slab;
+                pool.end = slab + slab_size_k;
+            }
+            auto block = reinterpret_cast<block_t*>(pool.tail);
+            pool.tail += block_size;
+            block->next = cache.heads[class_idx];
+            cache.heads[class_idx] = block;
+        }
+
+        cache.counts[class_idx] += taken;
+        return taken != 0;
+    }
+
+  public:
+    /**
+     * @brief Number of bytes actually occupied by a blob of the given size.
+     */
+    static std::size_t capacity(std::size_t size) noexcept {
+        return !size || size > max_class_size_k ? size : class_sizes_k[class_of(size)];
+    }
+
+    /**
+     * @brief Number of bytes requested from the system, including the free blocks.
+     */
+    static std::size_t reserved_bytes() noexcept { return shared().reserved_bytes.load(std::memory_order_relaxed); }
+
+    byte_t* allocate(std::size_t size) noexcept {
+        if (size > max_class_size_k) {
+            auto begin = static_cast<byte_t*>(::operator new(size, std::nothrow));
+            if (begin)
+                shared().reserved_bytes.fetch_add(size, std::memory_order_relaxed);
+            return begin;
+        }
+
+        std::size_t class_idx = class_of(size);
+        cache_t* thread_cache = cache();
+        cache_t temporary_cache;
+        cache_t& used_cache = thread_cache ? *thread_cache : temporary_cache;
+        if (!used_cache.heads[class_idx] && !take(used_cache, class_idx))
+            return nullptr;
+
+        block_t* block = used_cache.heads[class_idx];
+        used_cache.heads[class_idx] = block->next;
+        --used_cache.counts[class_idx];
+        return reinterpret_cast<byte_t*>(block);
+    }
+
+    void deallocate(byte_t* begin, std::size_t size) noexcept {
+        if (size > max_class_size_k) {
+            ::operator delete(begin);
+            shared().reserved_bytes.fetch_sub(size, std::memory_order_relaxed);
+            return;
+        }
+
+        std::size_t class_idx = class_of(size);
+        cache_t* thread_cache = cache();
+        cache_t temporary_cache;
+        cache_t& used_cache = thread_cache ? *thread_cache : temporary_cache;
+        auto block = reinterpret_cast<block_t*>(begin);
+        block->next = used_cache.heads[class_idx];
+        used_cache.heads[class_idx] = block;
+        if (++used_cache.counts[class_idx] > batch_size_k * 2)
+            give_back(used_cache, class_idx, batch_size_k);
+    }
+};
+
+} // namespace unum::ustore
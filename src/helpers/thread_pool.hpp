@@ -0,0 +1,125 @@
+/**
+ * @file thread_pool.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Small fixed-size pool of threads for data-parallel loops inside engines and modalities.
+ */
+#pragma once
+#include <algorithm>          // `std::min`
+#include <atomic>             // `std::atomic`
+#include <condition_variable> // `std::condition_variable`
+#include <deque>              // `std::deque`
+#include <functional>         // `std::function`
+#include <memory>             // `std::shared_ptr`
+#include <mutex>              // `std::mutex`
+#include <thread>             // `std::thread`
+#include <vector>             // `std::vector`
+
+namespace unum::ustore {
+
+/**
+ * @brief Runs the iterations of `parallel_for` loops on a fixed set of threads.
+ *
+ * The calling thread takes iterations as well, so a busy or an empty pool degrades
+ * into a sequential loop instead of blocking. Several loops may run concurrently,
+ * sharing the threads. Callbacks must not throw.
+ */
+class thread_pool_t {
+
+    /**
+     * @brief Shared between the caller and the helpers, which may outlive the loop,
+     * if they were dequeued after all the iterations were already taken.
+     */
+    struct loop_t {
+        std::function<void(std::size_t)> const* callback = nullptr;
+        std::size_t count = 0;
+        std::atomic<std::size_t> next {0};
+        std::atomic<std::size_t> done {0};
+        std::mutex mutex;
+        std::condition_variable done_cv;
+
+        void run() noexcept {
+            for (std::size_t i = next++; i < count; i = next++) {
+                (*callback)(i);
+                if (++done != count)
+                    continue;
+                std::lock_guard lock {mutex};
+                done_cv.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads_;
+    std::deque<std::shared_ptr<loop_t>> queue_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    bool stopping_ = false;
+
+    void work() noexcept {
+        while (true) {
+            std::shared_ptr<loop_t> loop;
+            {
+                std::unique_lock lock {queue_mutex_};
+                queue_cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+                loop = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            loop->run();
+        }
+    }
+
+  public:
+    explicit thread_pool_t(std::size_t threads_count) noexcept(false) {
+        threads_.reserve(threads_count);
+        for (std::size_t i = 0; i != threads_count; ++i)
+            threads_.emplace_back(&thread_pool_t::work, this);
+    }
+
+    ~thread_pool_t() noexcept {
+        {
+            std::lock_guard lock {queue_mutex_};
+            stopping_ = true;
+        }
+        queue_cv_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+    }
+
+    thread_pool_t(thread_pool_t const&) = delete;
+    thread_pool_t& operator=(thread_pool_t const&) = delete;
+
+    std::size_t size() const noexcept { return threads_.size(); }
+
+    /**
+     * @brief Calls @p callback for every index in `[0, count)` and returns, once all are done.
+     */
+    template <typename callback_at>
+    void parallel_for(std::size_t count, callback_at&& callback) noexcept(false) {
+
+        std::size_t const helpers_count = std::min(threads_.size(), count ? count - 1 : 0);
+        if (!helpers_count) {
+            for (std::size_t i = 0; i != count; ++i)
+                callback(i);
+            return;
+        }
+
+        std::function<void(std::size_t)> const function {std::ref(callback)};
+        auto loop = std::make_shared<loop_t>();
+        loop->callback = &function;
+        loop->count = count;
+        {
+            std::lock_guard lock {queue_mutex_};
+            for (std::size_t i = 0; i != helpers_count; ++i)
+                queue_.push_back(loop);
+        }
+        queue_cv_.notify_all();
+
+        loop->run();
+        std::unique_lock lock {loop->mutex};
+        loop->done_cv.wait(lock, [&] { return loop->done == count; });
+    }
+};
+
+} // namespace unum::ustore
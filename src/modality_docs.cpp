@@ -2,13 +2,16 @@
  * @file modality_docs.cpp
  * @author Ashot Vardanian
  *
- * @brief Document storage using "YYJSON" lib.
+ * @brief Document storage using pre-parsed binary tapes and the "YYJSON" lib for modifications.
  * Sits on top of any @see "ustore.h"-compatible system.
  */
+#include <cmath>       // `std::isfinite`
 #include <cstdio>      // `std::snprintf`
 #include <cctype>      // `std::isdigit`
 #include <charconv>    // `std::to_chars`
 #include <string_view> // `std::string_view`
+#include <thread>      // `std::thread::hardware_concurrency`
+#include <vector>      // `std::vector`
 
 #include <fmt/format.h> // `fmt::format_int`
 
@@ -21,6 +24,8 @@
 #include "helpers/linked_memory.hpp" // `linked_memory_lock_t`
 #include "helpers/linked_array.hpp"  // `growing_tape_t`
 #include "helpers/algorithm.hpp"     // `transform_n`
+#include "helpers/doc_tape.hpp"      // `doc_view_t`
+#include "helpers/thread_pool.hpp"   // `thread_pool_t`
 #include "ustore/cpp/ranges_args.hpp"   // `places_arg_t`
 
 /*********************************************************/
@@ -32,8 +37,6 @@ using namespace unum;
 
 namespace sj = simdjson;
 
-constexpr ustore_doc_field_type_t internal_format_k = ustore_doc_field_json_k;
-
 static constexpr char const* null_k = "null";
 
 static constexpr char const* true_k = "true";
@@ -64,6 +67,12 @@ constexpr std::size_t field_path_len_limit_k = 512;
 using printed_number_buffer_t = char[printed_number_length_limit_k];
 using field_path_buffer_t = char[field_path_len_limit_k];
 
+/**
+ * @brief Gathers are split across threads only into chunks of at least this many documents,
+ * as smaller ones would spend more time on hand-offs and separate arenas, than on lookups.
+ */
+constexpr std::size_t parallel_gather_min_k = 1024;
+
 /*********************************************************/
 /*****************	 STL Compatibility	  ****************/
 /*********************************************************/
@@ -134,6 +143,26 @@ std::string_view print_number(char* begin, char* end, at scalar) {
     }
 }
 
+/**
+ * @brief Prints the shorter of "%.15g" and "%.17g" representations, that parses back into the same number.
+ * Integral values get a ".0" suffix, to be parsed back as floating-point numbers.
+ * @return The string-view until the termination character. Empty string on failure.
+ */
+std::string_view print_real(char* begin, char* end, double scalar) {
+    int length = std::snprintf(begin, end - begin, "%.15g", scalar);
+    if (length > 0 && std::strtod(begin, nullptr) != scalar)
+        length = std::snprintf(begin, end - begin, "%.17g", scalar);
+    if (length <= 0 || length + 2 >= end - begin)
+        return {};
+
+    if (std::strspn(begin, "-0123456789") == static_cast<std::size_t>(length)) {
+        begin[length++] = '.';
+        begin[length++] = '0';
+        begin[length] = '\0';
+    }
+    return {begin, static_cast<std::size_t>(length)};
+}
+
 /*********************************************************/
 /*****************	 Working with JSONs	  ****************/
 /*********************************************************/
@@ -208,10 +237,6 @@ yyjson_alc wrap_allocator(linked_memory_lock_t& arena) {
     return allocator;
 }
 
-auto simdjson_lookup(sj::ondemand::value& json, ustore_str_view_t field) noexcept {
-    return !field ? json : field[0] == '/' ? json.at_pointer(field) : json[field];
-}
-
 yyjson_val* json_lookup(yyjson_val* json, ustore_str_view_t field) noexcept {
     return !field ? json : field[0] == '/' ? yyjson_get_pointer(json, field) : yyjson_obj_get(json, field);
 }
@@ -249,54 +274,170 @@ json_t json_parse(value_view_t bytes, linked_memory_lock_t& arena, ustore_error_
     return result;
 }
 
-value_view_t json_dump(json_branch_t json,
-                       linked_memory_lock_t& arena,
-                       growing_tape_t& output,
-                       ustore_error_t* c_error) noexcept {
+/**
+ * @brief Appends a parsed document to the @p builder, preserving the order of object members.
+ */
+void doc_encode(yyjson_mut_val* value, doc_builder_t& builder) noexcept {
 
-    if (!json)
-        return output.push_back(value_view_t {}, c_error);
+    switch (yyjson_mut_get_type(value)) {
+    case YYJSON_TYPE_BOOL: builder.add_bool(yyjson_mut_get_bool(value)); break;
+    case YYJSON_TYPE_STR: builder.add_str({yyjson_mut_get_str(value), yyjson_mut_get_len(value)}); break;
+    case YYJSON_TYPE_NUM: {
+        switch (yyjson_mut_get_subtype(value)) {
+        case YYJSON_SUBTYPE_UINT: builder.add_uint(yyjson_mut_get_uint(value)); break;
+        case YYJSON_SUBTYPE_SINT: builder.add_sint(yyjson_mut_get_sint(value)); break;
+        default: builder.add_real(yyjson_mut_get_real(value)); break;
+        }
+        break;
+    }
+    case YYJSON_TYPE_ARR: {
+        std::uint32_t idx = builder.open(doc_kind_t::arr_k);
+        yyjson_mut_val* element;
+        yyjson_mut_arr_iter iter;
+        yyjson_mut_arr_iter_init(value, &iter);
+        while ((element = yyjson_mut_arr_iter_next(&iter)))
+            doc_encode(element, builder);
+        builder.close(idx);
+        break;
+    }
+    case YYJSON_TYPE_OBJ: {
+        std::uint32_t idx = builder.open(doc_kind_t::obj_k);
+        yyjson_mut_val* key;
+        yyjson_mut_obj_iter iter;
+        yyjson_mut_obj_iter_init(value, &iter);
+        while ((key = yyjson_mut_obj_iter_next(&iter))) {
+            builder.add_str({yyjson_mut_get_str(key), yyjson_mut_get_len(key)});
+            doc_encode(yyjson_mut_obj_iter_get_val(key), builder);
+        }
+        builder.close(idx);
+        break;
+    }
+    default: builder.add_null(); break;
+    }
+}
+
+/**
+ * @brief Unpacks a tape into a mutable document for modifications.
+ * Strings aren't copied and keep referencing the tape.
+ */
+yyjson_mut_val* doc_to_yyjson(doc_view_t value, yyjson_mut_doc* doc) noexcept {
+
+    switch (value.kind()) {
+    case doc_kind_t::null_k: return yyjson_mut_null(doc);
+    case doc_kind_t::false_k:
+    case doc_kind_t::true_k: return yyjson_mut_bool(doc, value.get_bool());
+    case doc_kind_t::uint_k: return yyjson_mut_uint(doc, value.get_uint());
+    case doc_kind_t::sint_k: return yyjson_mut_sint(doc, value.get_sint());
+    case doc_kind_t::real_k: return yyjson_mut_real(doc, value.get_real());
+    case doc_kind_t::str_k: return yyjson_mut_strn(doc, value.get_str().data(), value.get_str().size());
+    case doc_kind_t::arr_k: {
+        yyjson_mut_val* array = yyjson_mut_arr(doc);
+        value.for_each_element([&](doc_view_t element) { yyjson_mut_arr_append(array, doc_to_yyjson(element, doc)); });
+        return array;
+    }
+    case doc_kind_t::obj_k: {
+        yyjson_mut_val* object = yyjson_mut_obj(doc);
+        value.for_each_member([&](std::string_view key, doc_view_t member) {
+            yyjson_mut_obj_add(object, yyjson_mut_strn(doc, key.data(), key.size()), doc_to_yyjson(member, doc));
+        });
+        return object;
+    }
+    }
+    return nullptr;
+}
 
-    size_t result_length = 0;
-    yyjson_write_flag flg = 0;
+/**
+ * @brief Views a stored document without parsing it.
+ * Documents stored as JSON texts by older versions are converted on the fly.
+ * @return The view, that stays valid until the next use of the @p builder.
+ */
+doc_view_t doc_view(value_view_t bytes,
+                    doc_builder_t& builder,
+                    linked_memory_lock_t& arena,
+                    ustore_error_t* c_error) noexcept {
+
+    if (bytes.empty())
+        return {};
+    if (is_doc_tape(bytes))
+        return doc_view_t {bytes};
+
+    json_t json = json_parse(bytes, arena, c_error);
+    if (*c_error)
+        return {};
+
+    builder.clear();
+    doc_encode(json.mut_handle->root, builder);
+    value_view_t tape = builder.finish();
+    return tape ? doc_view_t {tape} : doc_view_t {};
+}
+
+/**
+ * @brief Unpacks a stored document into a mutable one.
+ */
+json_t doc_parse(value_view_t bytes, linked_memory_lock_t& arena, ustore_error_t* c_error) noexcept {
+
+    if (!is_doc_tape(bytes))
+        return json_parse(bytes, arena, c_error);
+
+    json_t result;
     yyjson_alc allocator = wrap_allocator(arena);
-    char* result_begin = json.mut_handle
-                             ? yyjson_mut_val_write_opts(json.mut_handle, flg, &allocator, &result_length, NULL)
-                             : yyjson_val_write_opts(json.handle, flg, &allocator, &result_length, NULL);
-    log_error_if_m(result_begin, c_error, 0, "Failed to serialize the document!");
-    auto result = value_view_t {reinterpret_cast<byte_t const*>(result_begin), result_length};
-    result = output.push_back(result, c_error);
-    output.add_terminator(byte_t {0}, c_error);
+    result.mut_handle = yyjson_mut_doc_new(&allocator);
+    log_error_if_m(result.mut_handle, c_error, 0, "Failed to allocate the document!");
+    if (result.mut_handle)
+        yyjson_mut_doc_set_root(result.mut_handle, doc_to_yyjson(doc_view_t {bytes}, result.mut_handle));
     return result;
 }
 
-template <typename scalar_at>
-void json_to_scalar(yyjson_val* value,
-                    ustore_octet_t mask,
-                    ustore_octet_t& valid,
-                    ustore_octet_t& convert,
-                    ustore_octet_t& collide,
-                    scalar_at& scalar) noexcept {
+/**
+ * @brief Lays out the document as a tape and appends it to the @p output.
+ * Missing documents are appended as missing values, deleting the stored ones.
+ */
+value_view_t doc_dump(yyjson_mut_val* root,
+                      doc_builder_t& builder,
+                      growing_tape_t& output,
+                      ustore_error_t* c_error) noexcept {
 
-    yyjson_type const type = yyjson_get_type(value);
-    yyjson_subtype const subtype = yyjson_get_subtype(value);
+    if (!root)
+        return output.push_back(value_view_t {}, c_error);
 
-    switch (type) {
-    case YYJSON_TYPE_NULL:
+    builder.clear();
+    doc_encode(root, builder);
+    value_view_t tape = builder.finish();
+    return *c_error ? value_view_t {} : output.push_back(tape, c_error);
+}
+
+template <typename scalar_at>
+void doc_to_scalar(doc_view_t value,
+                   ustore_octet_t mask,
+                   ustore_octet_t& valid,
+                   ustore_octet_t& convert,
+                   ustore_octet_t& collide,
+                   scalar_at& scalar) noexcept {
+
+    // Missing fields are reported as collisions, just like nested objects
+    if (!value) {
+        convert &= ~mask;
+        collide |= mask;
+        valid &= ~mask;
+        return;
+    }
+
+    switch (value.kind()) {
+    case doc_kind_t::null_k:
         convert &= ~mask;
         collide &= ~mask;
         valid &= ~mask;
         break;
-    case YYJSON_TYPE_NONE:
-    case YYJSON_TYPE_OBJ:
-    case YYJSON_TYPE_ARR:
+    case doc_kind_t::obj_k:
+    case doc_kind_t::arr_k:
         convert &= ~mask;
         collide |= mask;
         valid &= ~mask;
         break;
 
-    case YYJSON_TYPE_BOOL:
-        scalar = yyjson_is_true(value);
+    case doc_kind_t::false_k:
+    case doc_kind_t::true_k:
+        scalar = value.get_bool();
         if constexpr (std::is_same_v<scalar_at, bool>)
             convert &= ~mask;
         else
@@ -305,10 +446,9 @@ void json_to_scalar(yyjson_val* value,
         valid |= mask;
         break;
 
-    case YYJSON_TYPE_STR: {
-        char const* str_begin = yyjson_get_str(value);
-        size_t str_len = yyjson_get_len(value);
-        if (parse_entire_number(str_begin, str_begin + str_len, scalar)) {
+    case doc_kind_t::str_k: {
+        std::string_view str = value.get_str();
+        if (parse_entire_number(str.data(), str.data() + str.size(), scalar)) {
             convert |= mask;
             collide &= ~mask;
             valid |= mask;
@@ -321,174 +461,95 @@ void json_to_scalar(yyjson_val* value,
         break;
     }
 
-    case YYJSON_TYPE_NUM: {
-
-        switch (subtype) {
-        case YYJSON_SUBTYPE_UINT:
-            scalar = static_cast<scalar_at>(yyjson_get_uint(value));
-            if constexpr (std::is_unsigned_v<scalar_at>)
-                convert &= ~mask;
-            else
-                convert |= mask;
-            collide &= ~mask;
-            valid |= mask;
-            break;
+    case doc_kind_t::uint_k:
+        scalar = static_cast<scalar_at>(value.get_uint());
+        if constexpr (std::is_unsigned_v<scalar_at>)
+            convert &= ~mask;
+        else
+            convert |= mask;
+        collide &= ~mask;
+        valid |= mask;
+        break;
 
-        case YYJSON_SUBTYPE_SINT:
-            scalar = static_cast<scalar_at>(yyjson_get_sint(value));
-            if constexpr (std::is_integral_v<scalar_at> && std::is_signed_v<scalar_at>)
-                convert &= ~mask;
-            else
-                convert |= mask;
-            collide &= ~mask;
-            valid |= mask;
-            break;
+    case doc_kind_t::sint_k:
+        scalar = static_cast<scalar_at>(value.get_sint());
+        if constexpr (std::is_integral_v<scalar_at> && std::is_signed_v<scalar_at>)
+            convert &= ~mask;
+        else
+            convert |= mask;
+        collide &= ~mask;
+        valid |= mask;
+        break;
 
-        case YYJSON_SUBTYPE_REAL:
-            scalar = static_cast<scalar_at>(yyjson_get_real(value));
-            if constexpr (std::is_floating_point_v<scalar_at>)
-                convert &= ~mask;
-            else
-                convert |= mask;
-            collide &= ~mask;
-            valid |= mask;
-            break;
-        }
-    }
+    case doc_kind_t::real_k:
+        scalar = static_cast<scalar_at>(value.get_real());
+        if constexpr (std::is_floating_point_v<scalar_at>)
+            convert &= ~mask;
+        else
+            convert |= mask;
+        collide &= ~mask;
+        valid |= mask;
+        break;
     }
 }
 
-std::string_view json_to_string(yyjson_val* value,
-                                ustore_octet_t mask,
-                                ustore_octet_t& valid,
-                                ustore_octet_t& convert,
-                                ustore_octet_t& collide,
-                                printed_number_buffer_t& print_buffer) noexcept {
+std::string_view doc_to_string(doc_view_t value,
+                               ustore_octet_t mask,
+                               ustore_octet_t& valid,
+                               ustore_octet_t& convert,
+                               ustore_octet_t& collide,
+                               printed_number_buffer_t& print_buffer) noexcept {
 
-    yyjson_type const type = yyjson_get_type(value);
-    yyjson_subtype const subtype = yyjson_get_subtype(value);
     std::string_view result;
+    if (!value) {
+        convert &= ~mask;
+        collide |= mask;
+        valid &= ~mask;
+        return result;
+    }
 
-    switch (type) {
-    case YYJSON_TYPE_NULL:
+    switch (value.kind()) {
+    case doc_kind_t::null_k:
         convert &= ~mask;
         collide &= ~mask;
         valid &= ~mask;
         break;
-    case YYJSON_TYPE_NONE:
-    case YYJSON_TYPE_OBJ:
-    case YYJSON_TYPE_ARR:
+    case doc_kind_t::obj_k:
+    case doc_kind_t::arr_k:
         convert &= ~mask;
         collide |= mask;
         valid &= ~mask;
         break;
 
-    case YYJSON_TYPE_BOOL: {
-        result = yyjson_is_true(value) ? std::string_view(true_k, 5) : std::string_view(false_k, 6);
+    case doc_kind_t::false_k:
+    case doc_kind_t::true_k: {
+        result = value.get_bool() ? std::string_view(true_k, 5) : std::string_view(false_k, 6);
         convert |= mask;
         collide &= ~mask;
         valid |= mask;
         break;
     }
 
-    case YYJSON_TYPE_STR: {
-        char const* str_begin = yyjson_get_str(value);
-        size_t str_len = yyjson_get_len(value);
-
-        result = std::string_view(str_begin, str_len);
+    case doc_kind_t::str_k: {
+        result = value.get_str();
         convert &= ~mask;
         collide &= ~mask;
         valid |= mask;
         break;
     }
 
-    case YYJSON_TYPE_NUM: {
-
-        switch (subtype) {
-        case YYJSON_SUBTYPE_UINT:
-            result = print_number(print_buffer, print_buffer + printed_number_length_limit_k, yyjson_get_uint(value));
-            convert |= mask;
-            collide = !result.empty() ? (collide & ~mask) : (collide | mask);
-            valid = result.empty() ? (valid & ~mask) : (valid | mask);
-            break;
-
-        case YYJSON_SUBTYPE_SINT:
-            result = print_number(print_buffer, print_buffer + printed_number_length_limit_k, yyjson_get_sint(value));
-            convert |= mask;
-            collide = !result.empty() ? (collide & ~mask) : (collide | mask);
-            valid = result.empty() ? (valid & ~mask) : (valid | mask);
-            break;
-
-        case YYJSON_SUBTYPE_REAL:
-            result = print_number(print_buffer, print_buffer + printed_number_length_limit_k, yyjson_get_real(value));
-            convert |= mask;
-            collide = !result.empty() ? (collide & ~mask) : (collide | mask);
-            valid = result.empty() ? (valid & ~mask) : (valid | mask);
-            break;
-        default: break;
-        }
-    }
-    default: break;
+    case doc_kind_t::uint_k:
+    case doc_kind_t::sint_k:
+    case doc_kind_t::real_k: {
+        char* print_end = print_buffer + printed_number_length_limit_k;
+        result = value.kind() == doc_kind_t::uint_k   ? print_number(print_buffer, print_end, value.get_uint())
+                 : value.kind() == doc_kind_t::sint_k ? print_number(print_buffer, print_end, value.get_sint())
+                                                      : print_real(print_buffer, print_end, value.get_real());
+        convert |= mask;
+        collide = !result.empty() ? (collide & ~mask) : (collide | mask);
+        valid = result.empty() ? (valid & ~mask) : (valid | mask);
+        break;
     }
-
-    return result;
-}
-
-template <typename value_at>
-std::string_view get_value( //
-    value_at& value,
-    ustore_doc_field_type_t field_type,
-    printed_number_buffer_t& print_buffer) noexcept {
-
-    std::string_view result;
-
-    if (field_type == ustore_doc_field_json_k) {
-        if (value.type().value() == sj::ondemand::json_type::object)
-            result = value.get_object().value().raw_json();
-        else if (value.type().value() == sj::ondemand::json_type::array)
-            result = value.get_array().value().raw_json();
-        else
-            result = value.raw_json_token();
-    }
-    else if (field_type == ustore_doc_field_str_k) {
-        auto type = value.type().value();
-        switch (type) {
-        case sj::ondemand::json_type::null: break;
-        case sj::ondemand::json_type::object: {
-            result = value.get_object().value().raw_json();
-            break;
-        }
-        case sj::ondemand::json_type::array: {
-            result = value.get_object().value().raw_json();
-            break;
-        }
-        case sj::ondemand::json_type::boolean: {
-            result = value.get_bool() ? std::string_view(true_k, 5) : std::string_view(false_k, 6);
-            break;
-        }
-        case sj::ondemand::json_type::string: {
-            result = value.get_string();
-            break;
-        }
-        case sj::ondemand::json_type::number: {
-            auto number_type = value.get_number_type().value();
-            switch (number_type) {
-            case sj::ondemand::number_type::signed_integer: {
-                result =
-                    print_number(print_buffer, print_buffer + printed_number_length_limit_k, value.get_int64().value());
-                break;
-            }
-            case sj::ondemand::number_type::unsigned_integer: {
-                result = print_number(print_buffer,
-                                      print_buffer + printed_number_length_limit_k,
-                                      value.get_uint64().value());
-                break;
-            }
-            default: break;
-            }
-        }
-        default: break;
-        }
     }
 
     return result;
@@ -528,6 +589,80 @@ void to_json_number(string_t& json_str, at scalar, ustore_error_t* c_error) {
     json_str.insert(json_str.size(), result.data(), result.data() + result.size(), c_error);
 }
 
+void to_json_escaped(string_t& json_str, std::string_view str, ustore_error_t* c_error) {
+    to_json_string(json_str, "\"", 1, c_error);
+    char const* unescaped_begin = str.data();
+    for (char const* it = str.data(); it != str.data() + str.size(); ++it) {
+        unsigned char c = static_cast<unsigned char>(*it);
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        char escaped[8] = {'\\', static_cast<char>(c)};
+        std::size_t escaped_length = 2;
+        switch (c) {
+        case '"':
+        case '\\': break;
+        case '\b': escaped[1] = 'b'; break;
+        case '\f': escaped[1] = 'f'; break;
+        case '\n': escaped[1] = 'n'; break;
+        case '\r': escaped[1] = 'r'; break;
+        case '\t': escaped[1] = 't'; break;
+        default: escaped_length = std::snprintf(escaped, sizeof(escaped), "\\u%04x", c); break;
+        }
+        to_json_string(json_str, unescaped_begin, it - unescaped_begin, c_error);
+        to_json_string(json_str, escaped, escaped_length, c_error);
+        unescaped_begin = it + 1;
+    }
+    to_json_string(json_str, unescaped_begin, str.data() + str.size() - unescaped_begin, c_error);
+    to_json_string(json_str, "\"", 1, c_error);
+}
+
+// Tape to Json
+void doc_to_json(doc_view_t value, string_t& json_str, ustore_error_t* c_error) {
+    switch (value.kind()) {
+    case doc_kind_t::null_k: to_json_string(json_str, null_k, c_error); break;
+    case doc_kind_t::false_k: to_json_string(json_str, false_k, c_error); break;
+    case doc_kind_t::true_k: to_json_string(json_str, true_k, c_error); break;
+    case doc_kind_t::uint_k: to_json_number(json_str, value.get_uint(), c_error); break;
+    case doc_kind_t::sint_k: to_json_number(json_str, value.get_sint(), c_error); break;
+    case doc_kind_t::real_k: {
+        // JSON has no representation for infinities and NaNs
+        printed_number_buffer_t print_buffer;
+        double real = value.get_real();
+        std::string_view result = std::isfinite(real)
+                                      ? print_real(print_buffer, print_buffer + printed_number_length_limit_k, real)
+                                      : std::string_view(null_k);
+        to_json_string(json_str, result.data(), result.size(), c_error);
+        break;
+    }
+    case doc_kind_t::str_k: to_json_escaped(json_str, value.get_str(), c_error); break;
+    case doc_kind_t::arr_k: {
+        to_json_string(json_str, open_arr_k, c_error);
+        bool is_first = true;
+        value.for_each_element([&](doc_view_t element) {
+            if (!std::exchange(is_first, false))
+                to_json_string(json_str, separator_k, c_error);
+            doc_to_json(element, json_str, c_error);
+        });
+        to_json_string(json_str, close_arr_k, c_error);
+        break;
+    }
+    case doc_kind_t::obj_k: {
+        to_json_string(json_str, open_k, c_error);
+        bool is_first = true;
+        value.for_each_member([&](std::string_view key, doc_view_t member) {
+            if (!std::exchange(is_first, false))
+                to_json_string(json_str, separator_k, c_error);
+            to_json_escaped(json_str, key, c_error);
+            to_json_string(json_str, ":", 1, c_error);
+            doc_to_json(member, json_str, c_error);
+        });
+        to_json_string(json_str, close_k, c_error);
+        break;
+    }
+    }
+}
+
 static bool bson_visit_array(bson_iter_t const*, char const*, bson_t const*, void*);
 static bool bson_visit_document(bson_iter_t const*, char const*, bson_t const*, void*);
 
@@ -844,101 +979,56 @@ bool iterate_over_mpack_data(value_view_t data, string_t& json_str, ustore_error
     return true;
 }
 
-// Json to MsgPack
-void sample_leafs(mpack_writer_t& writer, sj::simdjson_result<sj::ondemand::value> value) {
-    auto type = value.type().value();
-    switch (type) {
-    case sj::ondemand::json_type::object: {
-        mpack_build_map(&writer);
-        auto object = value.get_object().value();
-        auto begin = object.begin().value();
-        auto end = object.end().value();
-        while (begin != end) {
-            auto field = *begin;
-            std::string_view key = field.unescaped_key();
-            mpack_write_str(&writer, key.data(), key.size());
-            sample_leafs(writer, field.value().value());
-            ++begin;
-        }
-        mpack_complete_map(&writer);
-        break;
-    }
-    case sj::ondemand::json_type::array: {
-        mpack_build_array(&writer);
-        auto array = value.get_array();
-        auto begin = array.begin().value();
-        auto end = array.end().value();
-        while (begin != end) {
-            auto value = *begin;
-            sample_leafs(writer, value);
-            ++begin;
-        }
-        mpack_complete_array(&writer);
-        break;
-    }
-    case sj::ondemand::json_type::null: {
-        mpack_write_nil(&writer);
+// Tape to MsgPack
+void doc_to_mpack(doc_view_t value, mpack_writer_t& writer) {
+    switch (value.kind()) {
+    case doc_kind_t::null_k: mpack_write_nil(&writer); break;
+    case doc_kind_t::false_k:
+    case doc_kind_t::true_k: mpack_write_bool(&writer, value.get_bool()); break;
+    case doc_kind_t::uint_k: mpack_write_u64(&writer, value.get_uint()); break;
+    case doc_kind_t::sint_k: mpack_write_i64(&writer, value.get_sint()); break;
+    case doc_kind_t::real_k: mpack_write_double(&writer, value.get_real()); break;
+    case doc_kind_t::str_k: {
+        std::string_view str = value.get_str();
+        mpack_write_str(&writer, str.data(), static_cast<uint32_t>(str.size()));
         break;
     }
-    case sj::ondemand::json_type::boolean: {
-        mpack_write_bool(&writer, value.get_bool().value());
+    case doc_kind_t::arr_k: {
+        mpack_start_array(&writer, static_cast<uint32_t>(value.size()));
+        value.for_each_element([&](doc_view_t element) { doc_to_mpack(element, writer); });
+        mpack_finish_array(&writer);
         break;
     }
-    case sj::ondemand::json_type::string: {
-        mpack_write_str(&writer, value.get_string().value().data(), value.get_string().value().size());
-        break;
-    }
-    case sj::ondemand::json_type::number: {
-        auto number_type = value.get_number_type().value();
-        switch (number_type) {
-        case sj::ondemand::number_type::floating_point_number: {
-            mpack_write_double(&writer, value.get_double().value());
-            break;
-        }
-        case sj::ondemand::number_type::signed_integer: {
-            mpack_write_i64(&writer, value.get_int64().value());
-            break;
-        }
-        case sj::ondemand::number_type::unsigned_integer: {
-            mpack_write_u64(&writer, value.get_uint64().value());
-            break;
-        }
-        }
+    case doc_kind_t::obj_k: {
+        mpack_start_map(&writer, static_cast<uint32_t>(value.size()));
+        value.for_each_member([&](std::string_view key, doc_view_t member) {
+            mpack_write_str(&writer, key.data(), static_cast<uint32_t>(key.size()));
+            doc_to_mpack(member, writer);
+        });
+        mpack_finish_map(&writer);
         break;
     }
-    default: break;
     }
 }
 
-void json_to_mpack(sj::padded_string_view doc, string_t& output, ustore_error_t* c_error) {
-    sj::ondemand::parser parser;
+/**
+ * @brief MsgPack is never larger than the tape, as every entry of the latter takes 16 bytes,
+ * while the former needs at most 9 bytes for numbers and headers of strings and containers.
+ */
+void doc_to_mpack(doc_view_t value, std::size_t tape_size, string_t& output, ustore_error_t* c_error) {
 
-    output.resize(doc.size(), c_error);
+    output.resize(tape_size, c_error);
     return_if_error_m(c_error);
 
     mpack_writer_t writer;
-    mpack_writer_init(&writer, output.data(), doc.size());
-
-    auto result = parser.iterate(doc);
-    mpack_build_map(&writer);
-    auto object = result.get_object().value();
-    auto begin = object.begin().value();
-    auto end = object.end().value();
-    while (begin != end) {
-        auto field = *begin;
-        std::string_view key = field.unescaped_key();
-        mpack_write_str(&writer, key.data(), key.size());
-        sample_leafs(writer, field.value().value());
-        ++begin;
-    }
-    mpack_complete_map(&writer);
+    mpack_writer_init(&writer, output.data(), tape_size);
+    doc_to_mpack(value, writer);
 
     auto end_ptr = writer.position;
     size_t new_size = end_ptr - writer.buffer;
 
     output.resize(new_size, c_error);
-    mpack_writer_destroy(&writer);
-    return_if_error_m(c_error);
+    log_error_if_m(mpack_writer_destroy(&writer) == mpack_ok, c_error, 0, "Failed to export MsgPack!");
 }
 
 json_t any_parse(value_view_t bytes,
@@ -1014,26 +1104,53 @@ json_t any_parse(value_view_t bytes,
     return result;
 }
 
-value_view_t any_dump(json_branch_t json,
-                      ustore_doc_field_type_t const field_type,
-                      linked_memory_lock_t& arena,
-                      growing_tape_t& output,
-                      ustore_error_t* c_error) noexcept {
+/**
+ * @brief Exports a document or its part into one of the public formats, appending it to the @p output.
+ * Missing parts are exported as empty strings.
+ */
+value_view_t doc_export(doc_view_t value,
+                        ustore_doc_field_type_t const field_type,
+                        string_t& buffer,
+                        growing_tape_t& output,
+                        ustore_error_t* c_error) noexcept {
 
-    if (field_type == ustore_doc_field_str_k) {
+    buffer.clear();
+    switch (value ? field_type : ustore_doc_field_null_k) {
+    case ustore_doc_field_json_k: doc_to_json(value, buffer, c_error); break;
+    case ustore_doc_field_msgpack_k: doc_to_mpack(value, value.tape_size(), buffer, c_error); break;
+    case ustore_doc_field_str_k: {
+        if (value.is_container()) {
+            doc_to_json(value, buffer, c_error);
+            break;
+        }
         ustore_octet_t dummy;
         printed_number_buffer_t print_buffer;
-        auto str = json_to_string(json.punned(), 0, dummy, dummy, dummy, print_buffer);
-        auto result = output.push_back(str, c_error);
+        auto str = doc_to_string(value, 0, dummy, dummy, dummy, print_buffer);
+        buffer.insert(0, str.data(), str.data() + str.size(), c_error);
+        break;
+    }
+    case ustore_doc_field_bson_k: {
+        doc_to_json(value, buffer, c_error);
+        if (*c_error)
+            return {};
+        bson_error_t error;
+        bson_t* bson = bson_new_from_json(reinterpret_cast<uint8_t const*>(buffer.data()), buffer.size(), &error);
+        log_error_if_m(bson, c_error, 0, "Failed to export BSON!");
+        if (!bson)
+            return {};
+        auto result = output.push_back(value_view_t {bson_get_data(bson), bson->len}, c_error);
         output.add_terminator(byte_t {0}, c_error);
+        bson_destroy(bson);
         return result;
     }
+    default: break;
+    }
 
-    else if (field_type == ustore_doc_field_json_k)
-        return json_dump(json, arena, output, c_error);
-
-    *c_error = "Output type not supported!";
-    return {};
+    if (*c_error)
+        return {};
+    auto result = output.push_back(value_view_t {buffer.data(), buffer.size()}, c_error);
+    output.add_terminator(byte_t {0}, c_error);
+    return result;
 }
 
 /*********************************************************/
@@ -1260,6 +1377,7 @@ template <typename callback_at>
 void read_unique_docs( //
     ustore_database_t const c_db,
     ustore_transaction_t const c_txn,
+    ustore_snapshot_t const c_snapshot,
     places_arg_t const& places,
     ustore_options_t const c_options,
     linked_memory_lock_t& arena,
@@ -1274,6 +1392,7 @@ void read_unique_docs( //
     read.db = c_db;
     read.error = c_error;
     read.transaction = c_txn;
+    read.snapshot = c_snapshot;
     read.arena = arena;
     read.options = c_options;
     read.tasks_count = places.count;
@@ -1286,30 +1405,15 @@ void read_unique_docs( //
     read.values = &found_binary_begin;
 
     ustore_read(&read);
-
-    auto found_binaries = joined_blobs_t(places.count, found_binary_offs, found_binary_begin);
-    auto found_binary_it = found_binaries.begin();
-
-    ustore_length_t max_length =
-        *std::max_element(found_binary_lens, found_binary_lens + places.count, [](ustore_length_t lhs, ustore_length_t rhs) {
-            return ((lhs < rhs) | (lhs == ustore_length_missing_k)) & (rhs != ustore_length_missing_k);
-        });
-
-    if (max_length == ustore_length_missing_k) {
-        for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx, ++found_binary_it)
-            callback(task_idx, {}, value_view_t::make_empty());
-        return;
-    }
-
-    auto document = arena.alloc<byte_t>(max_length + sj::SIMDJSON_PADDING, c_error);
     return_if_error_m(c_error);
 
+    // Tapes are never parsed, so the documents are passed without copies or padding
+    embedded_blobs_t found_binaries {places.count, found_binary_offs, found_binary_lens, found_binary_begin};
+    auto found_binary_it = found_binaries.begin();
     for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx, ++found_binary_it) {
-        value_view_t binary_doc = *found_binary_it;
-        std::memcpy(document.begin(), binary_doc.data(), binary_doc.size());
-        std::memset(document.begin() + binary_doc.size(), 0, sj::SIMDJSON_PADDING);
         ustore_str_view_t field = places.fields_begin ? places.fields_begin[task_idx] : nullptr;
-        callback(task_idx, field, value_view_t(document.begin(), binary_doc.size()));
+        callback(task_idx, field, *found_binary_it);
+        return_if_error_m(c_error);
     }
 
     unique_places = places;
@@ -1319,6 +1423,7 @@ template <typename callback_at>
 void read_modify_unique_docs( //
     ustore_database_t const c_db,
     ustore_transaction_t const c_txn,
+    ustore_snapshot_t const c_snapshot,
     places_arg_t const& places,
     ustore_options_t const c_options,
     doc_modification_t const c_modification,
@@ -1328,7 +1433,7 @@ void read_modify_unique_docs( //
     callback_at callback) noexcept {
 
     if (c_modification == doc_modification_t::nothing_k)
-        return read_unique_docs(c_db, c_txn, places, c_options, arena, unique_places, c_error, callback);
+        return read_unique_docs(c_db, c_txn, c_snapshot, places, c_options, arena, unique_places, c_error, callback);
 
     auto has_fields = places.fields_begin && (!places.fields_begin.repeats() || *places.fields_begin);
     bool need_values =
@@ -1341,6 +1446,7 @@ void read_modify_unique_docs( //
         read.db = c_db;
         read.error = c_error;
         read.transaction = c_txn;
+        read.snapshot = c_snapshot;
         read.arena = arena;
         read.options = c_options;
         read.tasks_count = places.count;
@@ -1375,6 +1481,7 @@ void read_modify_unique_docs( //
         read.db = c_db;
         read.error = c_error;
         read.transaction = c_txn;
+        read.snapshot = c_snapshot;
         read.arena = arena;
         read.options = c_options;
         read.tasks_count = places.count;
@@ -1407,6 +1514,7 @@ template <typename callback_at>
 void read_modify_docs( //
     ustore_database_t const c_db,
     ustore_transaction_t const c_txn,
+    ustore_snapshot_t const c_snapshot,
     places_arg_t const& places,
     ustore_options_t const c_options,
     doc_modification_t const c_modification,
@@ -1421,6 +1529,7 @@ void read_modify_docs( //
     if (all_ascending(places.keys_begin, places.count))
         return read_modify_unique_docs(c_db,
                                        c_txn,
+                                       c_snapshot,
                                        places,
                                        c_options,
                                        c_modification,
@@ -1443,6 +1552,7 @@ void read_modify_docs( //
     if (unique_col_keys.size() == places.count)
         return read_modify_unique_docs(c_db,
                                        c_txn,
+                                       c_snapshot,
                                        places,
                                        c_options,
                                        c_modification,
@@ -1455,6 +1565,7 @@ void read_modify_docs( //
     // which may be in a very different order from original.
     ustore_byte_t* found_binary_begin = nullptr;
     ustore_length_t* found_binary_offs = nullptr;
+    ustore_length_t* found_binary_lens = nullptr;
     auto unique_col_keys_strided = strided_range(unique_col_keys.begin(), unique_col_keys.end()).immutable();
     unique_places.collections_begin = unique_col_keys_strided.members(&collection_key_t::collection).begin();
     unique_places.keys_begin = unique_col_keys_strided.members(&collection_key_t::key).begin();
@@ -1464,6 +1575,7 @@ void read_modify_docs( //
     read.db = c_db;
     read.error = c_error;
     read.transaction = c_txn;
+    read.snapshot = c_snapshot;
     read.arena = arena;
     read.options = c_options;
     read.tasks_count = unique_places.count;
@@ -1472,6 +1584,7 @@ void read_modify_docs( //
     read.keys = unique_places.keys_begin.get();
     read.keys_stride = unique_places.keys_begin.stride();
     read.offsets = &found_binary_offs;
+    read.lengths = &found_binary_lens;
     read.values = &found_binary_begin;
 
     ustore_read(&read);
@@ -1484,7 +1597,7 @@ void read_modify_docs( //
     // Alternatively we can compensate it with additional memory:
 
     // Parse all the unique documents
-    auto found_binaries = joined_blobs_t(places.count, found_binary_offs, found_binary_begin);
+    embedded_blobs_t found_binaries {unique_places.count, found_binary_offs, found_binary_lens, found_binary_begin};
 
     // Join docs and fields with binary search
     for (std::size_t task_idx = 0; task_idx != places.size(); ++task_idx) {
@@ -1511,31 +1624,28 @@ void read_modify_write( //
     growing_tape.reserve(places.size(), c_error);
     return_if_error_m(c_error);
 
-    yyjson_alc allocator = wrap_allocator(arena);
+    doc_builder_t builder {arena, c_error};
     auto safe_callback = [&](ustore_size_t task_idx, ustore_str_view_t field, value_view_t binary_doc) {
-        json_t parsed = any_parse(binary_doc, internal_format_k, arena, c_error);
+        json_t parsed = doc_parse(binary_doc, arena, c_error);
+        // This error is extremely unlikely, as we have previously accepted the data into the store.
+        return_if_error_m(c_error);
         if (!contents[task_idx]) {
-            any_dump({nullptr, parsed.mut_handle->root}, internal_format_k, arena, growing_tape, c_error);
+            doc_dump(parsed.mut_handle ? parsed.mut_handle->root : nullptr, builder, growing_tape, c_error);
             return;
         }
 
-        // This error is extremely unlikely, as we have previously accepted the data into the store.
-        return_if_error_m(c_error);
-        if (!parsed.mut_handle)
-            parsed.mut_handle = yyjson_doc_mut_copy(parsed.handle, &allocator);
-
         json_t parsed_task = any_parse(contents[task_idx], c_type, arena, c_error);
         return_if_error_m(c_error);
 
         // Perform modifications
         modify(parsed, parsed_task.mut_handle->root, field, c_modification, arena, c_error);
-        any_dump({nullptr, parsed.mut_handle->root}, internal_format_k, arena, growing_tape, c_error);
         return_if_error_m(c_error);
+        doc_dump(parsed.mut_handle->root, builder, growing_tape, c_error);
     };
 
     places_arg_t unique_places;
     auto opts = c_txn ? ustore_options_t(c_options & ~ustore_option_transaction_dont_watch_k) : c_options;
-    read_modify_docs(c_db, c_txn, places, opts, c_modification, arena, unique_places, c_error, safe_callback);
+    read_modify_docs(c_db, c_txn, {}, places, opts, c_modification, arena, unique_places, c_error, safe_callback);
     return_if_error_m(c_error);
 
     // By now, the tape contains concatenated updates docs:
@@ -1594,8 +1704,6 @@ void ustore_docs_write(ustore_docs_write_t* c_ptr) {
         }
         c.keys_stride = sizeof(ustore_key_t);
     }
-    // If user wants the entire doc in the same format, as the one we use internally,
-    // this request can be passed entirely to the underlying Key-Value store.
     strided_iterator_gt<ustore_str_view_t const> fields {c.fields, c.fields_stride};
     auto has_fields = fields && (!fields.repeats() || *fields);
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
@@ -1607,7 +1715,7 @@ void ustore_docs_write(ustore_docs_write_t* c_ptr) {
     places_arg_t places {collections, keys, fields, c.tasks_count};
     contents_arg_t contents {presences, offs, lens, vals, c.tasks_count};
 
-    if (has_fields || c.type != internal_format_k || c.modification != ustore_doc_modify_upsert_k)
+    if (has_fields || c.modification != ustore_doc_modify_upsert_k)
         return read_modify_write(c.db,
                                  c.transaction,
                                  places,
@@ -1618,24 +1726,28 @@ void ustore_docs_write(ustore_docs_write_t* c_ptr) {
                                  arena,
                                  c.error);
 
-    // Validate JSONs Before Write
-    ustore_length_t max_length = 0;
-    for (std::size_t i = 0; i != contents.size(); ++i) {
-        if (max_length < contents[i].size() && contents[i].size() != ustore_length_missing_k)
-            max_length = contents[i].size();
-    }
-
-    auto document = arena.alloc<byte_t>(max_length + sj::SIMDJSON_PADDING, c.error);
+    // Entire documents are replaced without reading the previous versions,
+    // but still have to be parsed to be laid out as tapes.
+    growing_tape_t growing_tape {arena};
+    growing_tape.reserve(places.size(), c.error);
     return_if_error_m(c.error);
 
-    sj::dom::parser parser;
-    for (std::size_t i = 0; i < contents.size(); ++i) {
-        std::memcpy(document.begin(), contents[i].data(), contents[i].size());
-        std::memset(document.begin() + contents[i].size(), 0, sj::SIMDJSON_PADDING);
-        auto result = parser.parse((const char*)document.begin(), contents[i].size(), false);
-        return_error_if_m(result.error() == sj::SUCCESS, c.error, 0, "Invalid Json!");
+    doc_builder_t builder {arena, c.error};
+    for (std::size_t i = 0; i != contents.size(); ++i) {
+        if (!contents[i]) {
+            growing_tape.push_back(value_view_t {}, c.error);
+            return_if_error_m(c.error);
+            continue;
+        }
+
+        json_t parsed = any_parse(contents[i], c.type, arena, c.error);
+        return_if_error_m(c.error);
+        return_error_if_m(parsed.mut_handle, c.error, 0, "Invalid Document!");
+        doc_dump(parsed.mut_handle->root, builder, growing_tape, c.error);
+        return_if_error_m(c.error);
     }
 
+    ustore_byte_t* tape_begin = reinterpret_cast<ustore_byte_t*>(growing_tape.contents().begin().get());
     ustore_write_t write {};
     write.db = c.db;
     write.error = c.error;
@@ -1647,13 +1759,11 @@ void ustore_docs_write(ustore_docs_write_t* c_ptr) {
     write.collections_stride = c.collections_stride;
     write.keys = c.keys ? c.keys : tape.begin();
     write.keys_stride = c.keys_stride;
-    write.presences = c.presences;
-    write.offsets = c.offsets;
-    write.offsets_stride = c.offsets_stride;
-    write.lengths = c.lengths;
-    write.lengths_stride = c.lengths_stride;
-    write.values = c.values;
-    write.values_stride = c.values_stride;
+    write.offsets = growing_tape.offsets().begin().get();
+    write.offsets_stride = growing_tape.offsets().stride();
+    write.lengths = growing_tape.lengths().begin().get();
+    write.lengths_stride = growing_tape.lengths().stride();
+    write.values = &tape_begin;
 
     ustore_write(&write);
 }
@@ -1667,43 +1777,20 @@ void ustore_docs_read(ustore_docs_read_t* c_ptr) {
     linked_memory_lock_t arena = linked_memory(c.arena, c.options, c.error);
     return_if_error_m(c.error);
 
-    // If user wants the entire doc in the same format, as the one we use internally,
-    // this request can be passed entirely to the underlying Key-Value store.
-    strided_iterator_gt<ustore_str_view_t const> fields {c.fields, c.fields_stride};
-    auto has_fields = fields && (!fields.repeats() || *fields);
-    if (!has_fields && c.type == internal_format_k) {
-        ustore_read_t read {};
-        read.db = c.db;
-        read.error = c.error;
-        read.transaction = c.transaction;
-        read.snapshot = c.snapshot;
-        read.arena = arena;
-        read.options = c.options;
-        read.tasks_count = c.tasks_count;
-        read.collections = c.collections;
-        read.collections_stride = c.collections_stride;
-        read.keys = c.keys;
-        read.keys_stride = c.keys_stride;
-        read.presences = c.presences;
-        read.offsets = c.offsets;
-        read.lengths = c.lengths;
-        read.values = c.values;
-
-        return ustore_read(&read);
-    }
-
     return_error_if_m(c.db, c.error, uninitialized_state_k, "DataBase is uninitialized");
 
     strided_iterator_gt<ustore_collection_t const> collections {c.collections, c.collections_stride};
     strided_iterator_gt<ustore_key_t const> keys {c.keys, c.keys_stride};
+    strided_iterator_gt<ustore_str_view_t const> fields {c.fields, c.fields_stride};
     places_arg_t places {collections, keys, fields, c.tasks_count};
 
-    // Now, we need to parse all the entries to later export them into a target format.
-    // Potentially sampling certain sub-fields again along the way.
+    // Documents are stored as tapes, so the requested fields are located without parsing,
+    // and only the exported parts are converted into the target format.
     growing_tape_t growing_tape {arena};
     growing_tape.reserve(places.size(), c.error);
     return_if_error_m(c.error);
-    sj::ondemand::parser parser;
+    string_t buffer {arena};
+    doc_builder_t builder {arena, c.error};
 
     auto safe_callback = [&](ustore_size_t, ustore_str_view_t field, value_view_t binary_doc) {
         if (binary_doc.empty()) {
@@ -1711,45 +1798,15 @@ void ustore_docs_read(ustore_docs_read_t* c_ptr) {
             return;
         }
 
-        std::string_view result;
-        auto padded_doc =
-            sj::padded_string_view(binary_doc.c_str(), binary_doc.size(), binary_doc.size() + sj::SIMDJSON_PADDING);
-
-        string_t output {arena};
-        if (c.type == ustore_doc_field_msgpack_k) {
-            json_to_mpack(padded_doc, output, c.error);
-            result = {output.data(), output.size()};
-        }
-        else if (c.type == ustore_doc_field_bson_k) {
-            bson_error_t error;
-            bson_t* b = bson_new_from_json((uint8_t*)binary_doc.c_str(), -1, &error);
-            result = {(const char*)bson_get_data(b), b->len};
-            growing_tape.push_back(result, c.error);
-            growing_tape.add_terminator(byte_t {0}, c.error);
-            return_if_error_m(c.error);
-            bson_clear(&b);
-            return;
-        }
-        else {
-            auto maybe_doc = parser.iterate(padded_doc);
-            return_error_if_m(maybe_doc.error() == sj::SUCCESS, c.error, 0, "Fail To Parse Document!");
-            printed_number_buffer_t print_buffer;
-            if (maybe_doc.value().is_scalar())
-                result = get_value(maybe_doc.value(), c.type, print_buffer);
-            else {
-                auto parsed = maybe_doc.value().get_value();
-                auto branch = simdjson_lookup(parsed.value(), field);
-                result = get_value(branch, c.type, print_buffer);
-            }
-        }
-        growing_tape.push_back(result, c.error);
-        growing_tape.add_terminator(byte_t {0}, c.error);
+        doc_view_t doc = doc_view(binary_doc, builder, arena, c.error);
         return_if_error_m(c.error);
+        doc_export(doc.lookup(field), c.type, buffer, growing_tape, c.error);
     };
 
     places_arg_t unique_places;
     read_modify_docs(c.db,
                      c.transaction,
+                     c.snapshot,
                      places,
                      c.options,
                      doc_modification_t::nothing_k,
@@ -1757,7 +1814,10 @@ void ustore_docs_read(ustore_docs_read_t* c_ptr) {
                      unique_places,
                      c.error,
                      safe_callback);
+    return_if_error_m(c.error);
 
+    if (c.presences)
+        *c.presences = growing_tape.presences().get();
     if (c.offsets)
         *c.offsets = growing_tape.offsets().begin().get();
     if (c.lengths)
@@ -1770,7 +1830,7 @@ void ustore_docs_read(ustore_docs_read_t* c_ptr) {
 /*****************	 Tabular Exports	  ****************/
 /*********************************************************/
 
-void gist_recursively(yyjson_val* node,
+void gist_recursively(doc_view_t node,
                       field_path_buffer_t& path,
                       uninitialized_array_gt<std::string_view>& sorted_paths,
                       growing_tape_t& exported_paths,
@@ -1780,32 +1840,27 @@ void gist_recursively(yyjson_val* node,
     auto constexpr slash_len = 1;
     auto constexpr terminator_len = 1;
 
-    if (yyjson_is_obj(node)) {
-        yyjson_val *key, *val;
-        yyjson_obj_iter iter;
-        yyjson_obj_iter_init(node, &iter);
-        while ((key = yyjson_obj_iter_next(&iter)) && !*c_error) {
-            val = yyjson_obj_iter_get_val(key);
-            char const* key_name = yyjson_get_str(key);
-            size_t key_len = yyjson_get_len(key);
-            if (path_len + slash_len + key_len + terminator_len >= field_path_len_limit_k) {
+    if (node.is_obj()) {
+        node.for_each_member([&](std::string_view key, doc_view_t val) {
+            if (*c_error)
+                return;
+            if (path_len + slash_len + key.size() + terminator_len >= field_path_len_limit_k) {
                 *c_error = "Path is too long!";
                 return;
             }
 
             path[path_len] = '/';
-            std::memcpy(path + path_len + slash_len, key_name, key_len);
-            path[path_len + slash_len + key_len] = 0;
+            std::memcpy(path + path_len + slash_len, key.data(), key.size());
+            path[path_len + slash_len + key.size()] = 0;
             gist_recursively(val, path, sorted_paths, exported_paths, c_error);
-        }
+        });
         path[path_len] = 0;
     }
-    else if (yyjson_is_arr(node)) {
+    else if (node.is_arr()) {
         std::size_t idx = 0;
-        yyjson_val* val;
-        yyjson_arr_iter iter;
-        yyjson_arr_iter_init(node, &iter);
-        while ((val = yyjson_arr_iter_next(&iter)) && !*c_error) {
+        node.for_each_element([&](doc_view_t val) {
+            if (*c_error)
+                return;
 
             path[path_len] = '/';
             auto result = print_number(path + path_len + slash_len, path + field_path_len_limit_k, idx);
@@ -1816,7 +1871,7 @@ void gist_recursively(yyjson_val* node,
 
             gist_recursively(val, path, sorted_paths, exported_paths, c_error);
             ++idx;
-        }
+        });
         path[path_len] = 0;
     }
     else {
@@ -1878,17 +1933,17 @@ void ustore_docs_gist(ustore_docs_gist_t* c_ptr) {
     field_path_buffer_t field_name = {0};
     uninitialized_array_gt<std::string_view> sorted_paths(arena);
     growing_tape_t exported_paths(arena);
+    doc_builder_t builder {arena, c.error};
     for (ustore_size_t doc_idx = 0; doc_idx != c.docs_count; ++doc_idx, ++found_binary_it) {
         value_view_t binary_doc = *found_binary_it;
         if (!binary_doc)
             continue;
 
-        json_t doc = any_parse(binary_doc, internal_format_k, arena, c.error);
+        doc_view_t root = doc_view(binary_doc, builder, arena, c.error);
         return_if_error_m(c.error);
-        if (!doc)
+        if (!root)
             continue;
 
-        yyjson_val* root = yyjson_doc_get_root(doc.handle);
         gist_recursively(root, field_name, sorted_paths, exported_paths, c.error);
         return_if_error_m(c.error);
     }
@@ -1945,7 +2000,7 @@ struct column_begin_t {
     ustore_length_t* str_lengths;
 
     template <typename scalar_at>
-    inline void set(std::size_t doc_idx, yyjson_val* value) noexcept {
+    inline void set(std::size_t doc_idx, doc_view_t value) noexcept {
 
         ustore_octet_t mask = static_cast<ustore_octet_t>(1 << (doc_idx % CHAR_BIT));
         ustore_octet_t& valid = validities[doc_idx / CHAR_BIT];
@@ -1953,15 +2008,14 @@ struct column_begin_t {
         ustore_octet_t& collide = collisions[doc_idx / CHAR_BIT];
         scalar_at& scalar = reinterpret_cast<scalar_at*>(scalars)[doc_idx];
 
-        json_to_scalar(value, mask, valid, convert, collide, scalar);
+        doc_to_scalar(value, mask, valid, convert, collide, scalar);
     }
 
     inline void set_str(std::size_t doc_idx,
-                        yyjson_val* value,
+                        doc_view_t value,
                         printed_number_buffer_t& print_buffer,
                         string_t& output,
                         bool with_separator,
-                        bool is_last,
                         ustore_error_t* c_error) noexcept {
 
         ustore_octet_t mask = static_cast<ustore_octet_t>(1 << (doc_idx % CHAR_BIT));
@@ -1971,18 +2025,148 @@ struct column_begin_t {
         ustore_length_t& off = str_offsets[doc_idx];
         ustore_length_t& len = str_lengths[doc_idx];
 
-        auto str = json_to_string(value, mask, valid, convert, collide, print_buffer);
+        auto str = doc_to_string(value, mask, valid, convert, collide, print_buffer);
         off = static_cast<ustore_length_t>(output.size());
         len = static_cast<ustore_length_t>(str.size());
         output.insert(output.size(), str.begin(), str.end(), c_error);
         return_if_error_m(c_error);
         if (with_separator)
             output.push_back('\0', c_error);
-        if (is_last)
-            str_offsets[doc_idx + 1] = static_cast<ustore_length_t>(output.size());
     }
 };
 
+/**
+ * @brief Fills the columns for documents in `[begin, end)`, appending the strings to the @p strings tape.
+ * String offsets are relative to the start of that tape. Missing documents have all of their fields missing.
+ */
+void gather_docs( //
+    joined_blobs_t found_binaries,
+    std::size_t begin,
+    std::size_t end,
+    strided_iterator_gt<ustore_str_view_t const> fields,
+    strided_iterator_gt<ustore_doc_field_type_t const> types,
+    ptr_range_gt<column_begin_t> columns,
+    linked_memory_lock_t& arena,
+    string_t& strings,
+    ustore_error_t* c_error) noexcept {
+
+    printed_number_buffer_t print_buffer;
+    doc_builder_t builder {arena, c_error};
+    for (std::size_t doc_idx = begin; doc_idx != end; ++doc_idx) {
+        doc_view_t root = doc_view(found_binaries[doc_idx], builder, arena, c_error);
+        return_if_error_m(c_error);
+
+        for (std::size_t field_idx = 0; field_idx != columns.size(); ++field_idx) {
+
+            // Find this field within document
+            doc_view_t found_value = root.lookup(fields[field_idx]);
+            column_begin_t& column = columns[field_idx];
+
+            // Export the types
+            switch (types[field_idx]) {
+
+            case ustore_doc_field_bool_k: column.set<bool>(doc_idx, found_value); break;
+
+            case ustore_doc_field_i8_k: column.set<std::int8_t>(doc_idx, found_value); break;
+            case ustore_doc_field_i16_k: column.set<std::int16_t>(doc_idx, found_value); break;
+            case ustore_doc_field_i32_k: column.set<std::int32_t>(doc_idx, found_value); break;
+            case ustore_doc_field_i64_k: column.set<std::int64_t>(doc_idx, found_value); break;
+
+            case ustore_doc_field_u8_k: column.set<std::uint8_t>(doc_idx, found_value); break;
+            case ustore_doc_field_u16_k: column.set<std::uint16_t>(doc_idx, found_value); break;
+            case ustore_doc_field_u32_k: column.set<std::uint32_t>(doc_idx, found_value); break;
+            case ustore_doc_field_u64_k: column.set<std::uint64_t>(doc_idx, found_value); break;
+
+            case ustore_doc_field_f32_k: column.set<float>(doc_idx, found_value); break;
+            case ustore_doc_field_f64_k: column.set<double>(doc_idx, found_value); break;
+
+            case ustore_doc_field_str_k:
+                column.set_str(doc_idx, found_value, print_buffer, strings, true, c_error);
+                break;
+            case ustore_doc_field_bin_k:
+                column.set_str(doc_idx, found_value, print_buffer, strings, false, c_error);
+                break;
+
+            default: break;
+            }
+            return_if_error_m(c_error);
+        }
+    }
+}
+
+/**
+ * @brief Shared by all the databases, as modalities keep no state of their own.
+ * Started on first use, so that small gathers never spawn threads.
+ */
+thread_pool_t& gather_threads() noexcept(false) {
+    static thread_pool_t pool {std::max(std::thread::hardware_concurrency(), 1u) - 1u};
+    return pool;
+}
+
+/**
+ * @brief Splits the documents into chunks of whole bitmap bytes, so that no two threads modify the same byte.
+ * Every chunk gets its own arena and strings tape, concatenated into @p strings in the original order.
+ */
+void gather_parallel( //
+    joined_blobs_t found_binaries,
+    strided_iterator_gt<ustore_str_view_t const> fields,
+    strided_iterator_gt<ustore_doc_field_type_t const> types,
+    ptr_range_gt<column_begin_t> columns,
+    string_t& strings,
+    ustore_error_t* c_error) noexcept(false) {
+
+    struct chunk_t {
+        ustore_arena_t arena = nullptr;
+        ustore_error_t error = nullptr;
+        std::string_view strings;
+        std::size_t strings_offset = 0;
+
+        ~chunk_t() noexcept { clear_linked_memory(arena); }
+    };
+
+    thread_pool_t& pool = gather_threads();
+    std::size_t const docs_count = found_binaries.size();
+    std::size_t const chunks_count = std::min(pool.size() + 1, docs_count / parallel_gather_min_k);
+    std::size_t const docs_per_chunk = divide_round_up(docs_count, chunks_count);
+    std::size_t const chunk_size = divide_round_up(docs_per_chunk, bits_in_byte_k) * bits_in_byte_k;
+    auto chunk_range = [&](std::size_t chunk_idx) {
+        std::size_t const begin = std::min(chunk_idx * chunk_size, docs_count);
+        return std::make_pair(begin, std::min(begin + chunk_size, docs_count));
+    };
+
+    std::vector<chunk_t> chunks(chunks_count);
+    pool.parallel_for(chunks_count, [&](std::size_t chunk_idx) noexcept {
+        chunk_t& chunk = chunks[chunk_idx];
+        auto [begin, end] = chunk_range(chunk_idx);
+        linked_memory_lock_t arena = linked_memory(&chunk.arena, ustore_options_default_k, &chunk.error);
+        return_if_error_m(&chunk.error);
+        string_t chunk_strings(arena);
+        gather_docs(found_binaries, begin, end, fields, types, columns, arena, chunk_strings, &chunk.error);
+        chunk.strings = {chunk_strings.data(), chunk_strings.size()};
+    });
+
+    std::size_t strings_length = 0;
+    for (chunk_t& chunk : chunks) {
+        return_error_if_m(!chunk.error, c_error, error_unknown_k, chunk.error);
+        chunk.strings_offset = strings_length;
+        strings_length += chunk.strings.size();
+    }
+    strings.resize(strings_length, c_error);
+    return_if_error_m(c_error);
+
+    // Offsets were relative to the chunks, so they are shifted along with the strings
+    pool.parallel_for(chunks_count, [&](std::size_t chunk_idx) noexcept {
+        chunk_t const& chunk = chunks[chunk_idx];
+        auto [begin, end] = chunk_range(chunk_idx);
+        if (!chunk.strings.empty())
+            std::memcpy(strings.data() + chunk.strings_offset, chunk.strings.data(), chunk.strings.size());
+        for (column_begin_t const& column : columns)
+            if (column.str_offsets && chunk.strings_offset)
+                for (std::size_t doc_idx = begin; doc_idx != end; ++doc_idx)
+                    column.str_offsets[doc_idx] += static_cast<ustore_length_t>(chunk.strings_offset);
+    });
+}
+
 void ustore_docs_gather(ustore_docs_gather_t* c_ptr) {
 
     ustore_docs_gather_t& c = *c_ptr;
@@ -2019,7 +2203,6 @@ void ustore_docs_gather(ustore_docs_gather_t* c_ptr) {
     strided_iterator_gt<ustore_doc_field_type_t const> types {c.types, c.types_stride};
 
     joined_blobs_t found_binaries {c.docs_count, found_binary_offs, found_binary_begin};
-    joined_blobs_iterator_t found_binary_it = found_binaries.begin();
 
     // Estimate the amount of memory needed to store at least scalars and columns addresses
     // TODO: Align offsets of bitmaps to 64-byte boundaries for Arrow
@@ -2125,62 +2308,33 @@ void ustore_docs_gather(ustore_docs_gather_t* c_ptr) {
         }
     }
 
+    // Describe every column once, instead of doing it for every document
+    auto columns = arena.alloc<column_begin_t>(c.fields_count, c.error);
+    return_if_error_m(c.error);
+    for (ustore_size_t field_idx = 0; field_idx != c.fields_count; ++field_idx) {
+        column_begin_t& column = columns[field_idx];
+        column.validities = first_collection_validities + field_idx * slots_per_bitmap;
+        column.conversions = first_collection_conversions + field_idx * slots_per_bitmap;
+        column.collisions = first_collection_collisions + field_idx * slots_per_bitmap;
+        column.scalars = addresses_scalars[field_idx];
+        column.str_offsets = addresses_offs[field_idx];
+        column.str_lengths = addresses_lens[field_idx];
+    }
+
     // Go though all the documents extracting and type-checking the relevant parts
-    printed_number_buffer_t print_buffer;
     string_t string_tape(arena);
-    for (ustore_size_t doc_idx = 0; doc_idx != c.docs_count; ++doc_idx, ++found_binary_it) {
-        value_view_t binary_doc = *found_binary_it;
-        json_t doc = any_parse(binary_doc, internal_format_k, arena, c.error);
-        return_if_error_m(c.error);
-        if (!doc)
-            continue;
-        yyjson_val* root = yyjson_doc_get_root(doc.handle);
-
-        for (ustore_size_t field_idx = 0; field_idx != c.fields_count; ++field_idx) {
-
-            // Find this field within document
-            ustore_doc_field_type_t type = types[field_idx];
-            ustore_str_view_t field = fields[field_idx];
-            yyjson_val* found_value = json_lookup(root, field);
-
-            column_begin_t column {};
-            column.validities = (*c.columns_validities)[field_idx];
-            column.conversions = (*(c.columns_conversions ? c.columns_conversions : c.columns_validities))[field_idx];
-            column.collisions = (*(c.columns_collisions ? c.columns_collisions : c.columns_validities))[field_idx];
-            column.scalars = addresses_scalars[field_idx];
-            column.str_offsets = addresses_offs[field_idx];
-            column.str_lengths = addresses_lens[field_idx];
-
-            bool is_last = doc_idx == c.docs_count - 1;
-            // Export the types
-            switch (type) {
-
-            case ustore_doc_field_bool_k: column.set<bool>(doc_idx, found_value); break;
-
-            case ustore_doc_field_i8_k: column.set<std::int8_t>(doc_idx, found_value); break;
-            case ustore_doc_field_i16_k: column.set<std::int16_t>(doc_idx, found_value); break;
-            case ustore_doc_field_i32_k: column.set<std::int32_t>(doc_idx, found_value); break;
-            case ustore_doc_field_i64_k: column.set<std::int64_t>(doc_idx, found_value); break;
-
-            case ustore_doc_field_u8_k: column.set<std::uint8_t>(doc_idx, found_value); break;
-            case ustore_doc_field_u16_k: column.set<std::uint16_t>(doc_idx, found_value); break;
-            case ustore_doc_field_u32_k: column.set<std::uint32_t>(doc_idx, found_value); break;
-            case ustore_doc_field_u64_k: column.set<std::uint64_t>(doc_idx, found_value); break;
-
-            case ustore_doc_field_f32_k: column.set<float>(doc_idx, found_value); break;
-            case ustore_doc_field_f64_k: column.set<double>(doc_idx, found_value); break;
-
-            case ustore_doc_field_str_k:
-                column.set_str(doc_idx, found_value, print_buffer, string_tape, true, is_last, c.error);
-                break;
-            case ustore_doc_field_bin_k:
-                column.set_str(doc_idx, found_value, print_buffer, string_tape, false, is_last, c.error);
-                break;
+    if (c.docs_count >= parallel_gather_min_k * 2)
+        safe_section("Gathering in parallel", c.error, [&] {
+            gather_parallel(found_binaries, fields, types, columns, string_tape, c.error);
+        });
+    else
+        gather_docs(found_binaries, 0, c.docs_count, fields, types, columns, arena, string_tape, c.error);
+    return_if_error_m(c.error);
 
-            default: break;
-            }
-        }
-    }
+    for (column_begin_t const& column : columns)
+        if (column.str_offsets)
+            column.str_offsets[c.docs_count] = static_cast<ustore_length_t>(string_tape.size());
 
-    *c.joined_strings = reinterpret_cast<ustore_byte_t*>(string_tape.data());
+    if (c.joined_strings)
+        *c.joined_strings = reinterpret_cast<ustore_byte_t*>(string_tape.data());
 }
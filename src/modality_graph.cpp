@@ -504,10 +504,14 @@ void update_neighborhoods( //
     auto unique_count = sort_and_deduplicate(unique_entries.begin(), unique_entries.end());
     unique_entries = {unique_entries.begin(), unique_count};
 
-    // Fetch the existing entries
+    // Fetch the existing entries, unless the engine can merge the new edges into them.
+    // Erasing still needs a read, as it mustn't create the missing vertices.
+    bool const merge = !erase_ak && &ustore_supports_neighborhood_merges_k && ustore_supports_neighborhood_merges_k;
     auto unique_strided = unique_entries.strided();
-    pull_and_link_for_updates(c_db, c_transaction, unique_strided, c_options, arena, c_error);
-    return_if_error_m(c_error);
+    if (!merge) {
+        pull_and_link_for_updates(c_db, c_transaction, unique_strided, c_options, arena, c_error);
+        return_if_error_m(c_error);
+    }
 
     // Define our primary for-loop
     auto for_each_task = [&](auto entry_role_target_edge_callback) {
@@ -538,7 +542,8 @@ void update_neighborhoods( //
             auto new_size = bytes_present + bytes_for_relations + bytes_for_degrees;
             auto new_buffer = arena.alloc<byte_t>(new_size, c_error);
             return_if_error_m(c_error);
-            std::memcpy(new_buffer.begin(), unique_entry.content, bytes_present);
+            if (bytes_present)
+                std::memcpy(new_buffer.begin(), unique_entry.content, bytes_present);
 
             unique_entry.content = (ustore_bytes_ptr_t)new_buffer.begin();
             // No need to grow `length` here, we will update in `insert_into_entry` later
@@ -565,7 +570,7 @@ void update_neighborhoods( //
     write.error = c_error;
     write.transaction = c_transaction;
     write.arena = arena;
-    write.options = c_options;
+    write.options = merge ? ustore_options_t(c_options | ustore_option_write_merge_neighborhoods_k) : c_options;
     write.tasks_count = unique_count;
     write.collections = collections.begin().get();
     write.collections_stride = collections.begin().stride();
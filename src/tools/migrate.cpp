@@ -0,0 +1,146 @@
+/**
+ * @file migrate.cpp
+ * @author Ashot Vardanian
+ *
+ * @brief Copies every collection of one UStore database into another.
+ *
+ * Is engine-agnostic, as it only uses the public interface. Among other things,
+ * it converts RocksDB stores between the "native" and the "bytewise" key encodings,
+ * by opening the same engine with two different configs.
+ * The source is read from a snapshot, so concurrent writers don't break its consistency.
+ */
+
+#include <limits> // `std::numeric_limits`
+#include <string> // `std::string`
+
+#include "migrate.hpp"
+
+namespace unum::ustore {
+
+static constexpr ustore_length_t batch_size_k = 4096;
+
+/**
+ * @brief Streams all the pairs of a collection in batches, scanning the source
+ * snapshot and writing into the target without a transaction. Every batch is flushed,
+ * as engines may skip their logs otherwise, like RocksDB does, and an interrupted
+ * migration would silently leave a truncated target.
+ */
+static status_t migrate_collection( //
+    ustore_database_t source,
+    ustore_snapshot_t snapshot,
+    ustore_collection_t source_collection,
+    ustore_database_t target,
+    ustore_collection_t target_collection,
+    std::size_t& migrated) noexcept {
+
+    arena_t source_arena(source);
+    arena_t target_arena(target);
+    ustore_key_t next_min_key = std::numeric_limits<ustore_key_t>::min();
+
+    while (true) {
+        status_t status;
+        ustore_length_t* found_counts = nullptr;
+        ustore_key_t* found_keys = nullptr;
+        ustore_scan_t scan {};
+        scan.db = source;
+        scan.error = status.member_ptr();
+        scan.snapshot = snapshot;
+        scan.arena = source_arena.member_ptr();
+        scan.tasks_count = 1;
+        scan.collections = &source_collection;
+        scan.start_keys = &next_min_key;
+        scan.count_limits = &batch_size_k;
+        scan.counts = &found_counts;
+        scan.keys = &found_keys;
+        ustore_scan(&scan);
+        if (!status)
+            return status;
+
+        ustore_length_t const count = *found_counts;
+        if (!count)
+            return {};
+
+        ustore_octet_t* found_presences = nullptr;
+        ustore_length_t* found_offsets = nullptr;
+        ustore_byte_t* found_values = nullptr;
+        ustore_read_t read {};
+        read.db = source;
+        read.error = status.member_ptr();
+        read.snapshot = snapshot;
+        read.arena = source_arena.member_ptr();
+        read.options = ustore_option_dont_discard_memory_k;
+        read.tasks_count = count;
+        read.collections = &source_collection;
+        read.keys = found_keys;
+        read.keys_stride = sizeof(ustore_key_t);
+        read.presences = &found_presences;
+        read.offsets = &found_offsets;
+        read.values = &found_values;
+        ustore_read(&read);
+        if (!status)
+            return status;
+
+        ustore_bytes_cptr_t values = found_values;
+        ustore_write_t write {};
+        write.db = target;
+        write.error = status.member_ptr();
+        write.arena = target_arena.member_ptr();
+        write.options = ustore_option_write_flush_k;
+        write.tasks_count = count;
+        write.collections = &target_collection;
+        write.keys = found_keys;
+        write.keys_stride = sizeof(ustore_key_t);
+        write.presences = found_presences;
+        write.offsets = found_offsets;
+        write.offsets_stride = sizeof(ustore_length_t);
+        write.values = &values;
+        ustore_write(&write);
+        if (!status)
+            return status;
+
+        migrated += count;
+        if (count < batch_size_k || found_keys[count - 1] == std::numeric_limits<ustore_key_t>::max())
+            return {};
+        next_min_key = found_keys[count - 1] + 1;
+    }
+}
+
+status_t migrate(database_t& source, database_t& target, migrate_callback_t const& callback) noexcept {
+
+    // The snapshot is dropped with the context
+    auto maybe_context = source.snapshot();
+    if (!maybe_context)
+        return maybe_context.release_status();
+    ustore_snapshot_t snapshot = maybe_context->snap();
+
+    auto maybe_collections = maybe_context->collections();
+    if (!maybe_collections)
+        return maybe_collections.release_status();
+    collections_list_t collections = *maybe_collections;
+
+    std::size_t migrated = 0;
+    status_t status =
+        migrate_collection(source, snapshot, ustore_collection_main_k, target, ustore_collection_main_k, migrated);
+    if (!status)
+        return status;
+    if (callback)
+        callback({}, migrated);
+
+    auto name_it = collections.names;
+    for (auto id_it = collections.ids.begin(); id_it != collections.ids.end(); ++id_it, ++name_it) {
+        std::string name {*name_it};
+        auto maybe_target = target.find_or_create(name.c_str());
+        if (!maybe_target)
+            return maybe_target.release_status();
+
+        migrated = 0;
+        status = migrate_collection(source, snapshot, *id_it, target, *maybe_target, migrated);
+        if (!status)
+            return status;
+        if (callback)
+            callback(name, migrated);
+    }
+    return {};
+}
+
+} // namespace unum::ustore
@@ -0,0 +1,29 @@
+/**
+ * @file migrate.hpp
+ * @author Ashot Vardanian
+ *
+ * @brief Copies every collection of one UStore database into another.
+ */
+
+#pragma once
+#include <functional>  // `std::function`
+#include <string_view> // `std::string_view`
+
+#include "ustore/cpp/db.hpp"
+
+namespace unum::ustore {
+
+/**
+ * @brief Called after every migrated collection with its name, empty for the main one,
+ * and the number of copied entries.
+ */
+using migrate_callback_t = std::function<void(std::string_view, std::size_t)>;
+
+/**
+ * @brief Copies the main and all the named collections of the @p source into the @p target,
+ * creating the missing ones. The source is read from a snapshot, and the target is written
+ * with `ustore_option_write_flush_k`, so the migrated entries are durable, once it succeeds.
+ */
+status_t migrate(database_t& source, database_t& target, migrate_callback_t const& callback = {}) noexcept;
+
+} // namespace unum::ustore
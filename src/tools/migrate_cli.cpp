@@ -0,0 +1,80 @@
+/**
+ * @file migrate_cli.cpp
+ * @author Ashot Vardanian
+ *
+ * @brief Command line interface of the migration tool, see `migrate.hpp`.
+ * Converts RocksDB stores between the "native" and the "bytewise" key encodings,
+ * by opening the same engine with two different configs:
+ *
+ *      ustore_migrate_rocksdb --from old.json --to new.json
+ */
+
+#include <fstream>  // `std::ifstream`
+#include <iostream> // `std::cerr`
+#include <string>   // `std::string`
+
+#include <clipp.h> // Command Line Interface
+
+#include "migrate.hpp"
+
+using namespace unum::ustore;
+
+std::string read_file(std::string const& path) {
+    std::ifstream ifs(path);
+    return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char* argv[]) {
+
+    using namespace clipp;
+
+    std::string source_config_path;
+    std::string target_config_path;
+    bool quiet = false;
+    bool help = false;
+
+    auto cli = ( //
+        (required("--from") & value("path", source_config_path)).doc("Configuration file of the source database"),
+        (required("--to") & value("path", target_config_path)).doc("Configuration file of the target database"),
+        option("-q", "--quiet").set(quiet).doc("Silence outputs"),
+        option("-h", "--help").set(help).doc("Print this help information on this tool and exit"));
+
+    if (!parse(argc, argv, cli)) {
+        std::cerr << make_man_page(cli, argv[0]);
+        exit(1);
+    }
+    if (help) {
+        std::cout << make_man_page(cli, argv[0]);
+        exit(0);
+    }
+
+    std::string source_config = read_file(source_config_path);
+    std::string target_config = read_file(target_config_path);
+
+    database_t source;
+    status_t status = source.open(source_config.c_str());
+    if (!status) {
+        std::cerr << "Failed to open the source: " << status.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    database_t target;
+    status = target.open(target_config.c_str());
+    if (!status) {
+        std::cerr << "Failed to open the target: " << status.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto report = [](std::string_view name, std::size_t migrated) {
+        if (name.empty())
+            std::cout << "Migrated the main collection: " << migrated << " entries" << std::endl;
+        else
+            std::cout << "Migrated collection \"" << name << "\": " << migrated << " entries" << std::endl;
+    };
+    status = migrate(source, target, quiet ? migrate_callback_t {} : migrate_callback_t {report});
+    if (!status) {
+        std::cerr << "Migration failed: " << status.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -32,6 +32,7 @@
 
 #include <ustore/ustore.hpp>
 #include "dataset.h"
+#include "migrate.hpp"
 
 using namespace unum::ustore;
 using docs_t = std::unordered_map<ustore_key_t, std::string>;
@@ -1121,6 +1122,75 @@ TEST(crash_cases, docs_export) {
     test_crash_cases_docs_export(ext_csv_k);
 }
 
+/**
+ * Migrates a RocksDB store with the native key encoding into the bytewise one,
+ * spanning negative keys, which the two encodings order differently, and several batches.
+ * Other engines ignore the encoding, but must migrate the same contents.
+ */
+TEST(migrate, native_to_bytewise) {
+#if defined(USTORE_FLIGHT_CLIENT) || !defined(USTORE_TEST_PATH)
+    return;
+#else
+    if (!ustore_supports_snapshots_k || !ustore_supports_named_collections_k)
+        return;
+
+    auto make_config = [](std::string const& directory, char const* key_encoding) {
+        fs::remove_all(directory);
+        fs::create_directories(directory);
+        return fmt::format(R"({{"version": "1.0", "directory": "{}", "engine": {{"config": {{"key_encoding": "{}"}}}}}})",
+                           directory,
+                           key_encoding);
+    };
+    std::string source_config = make_config(USTORE_TEST_PATH "_migrate_source/", "native");
+    std::string target_config = make_config(USTORE_TEST_PATH "_migrate_target/", "bytewise");
+
+    // Empty values must stay present, unlike the removed ones
+    constexpr ustore_key_t keys_count = 10'000;
+    std::vector<std::string> names {"", "first", "second"};
+    auto expected_value = [](std::string const& name, ustore_key_t key) {
+        return key % 7 ? fmt::format("{}{}", name, key) : std::string();
+    };
+
+    database_t source;
+    EXPECT_TRUE(source.open(source_config.c_str()));
+    for (std::string const& name : names) {
+        auto collection = name.empty() ? source.main() : *source.find_or_create(name.c_str());
+        for (ustore_key_t key = -keys_count / 2; key != keys_count / 2; ++key)
+            EXPECT_TRUE(collection[key].assign(value_view_t(expected_value(name, key))));
+        EXPECT_TRUE(collection[{0, 1, 2}].erase());
+    }
+
+    database_t target;
+    EXPECT_TRUE(target.open(target_config.c_str()));
+    EXPECT_TRUE(migrate(source, target));
+
+    // Everything must be durable, once the migration succeeds
+    target.close();
+    EXPECT_TRUE(target.open(target_config.c_str()));
+    for (std::string const& name : names) {
+        auto source_collection = name.empty() ? source.main() : *source.find_or_create(name.c_str());
+        auto target_collection = name.empty() ? target.main() : *target.find_or_create(name.c_str());
+
+        keys_stream_t source_stream(source, source_collection, 256);
+        keys_stream_t target_stream(target, target_collection, 256);
+        EXPECT_TRUE(source_stream.seek_to_first());
+        EXPECT_TRUE(target_stream.seek_to_first());
+        std::size_t count = 0;
+        for (; !source_stream.is_end() && !target_stream.is_end(); ++source_stream, ++target_stream, ++count) {
+            ustore_key_t key = source_stream.key();
+            ASSERT_EQ(target_stream.key(), key);
+            auto source_value = *source_collection[key].value();
+            auto target_value = *target_collection[key].value();
+            ASSERT_TRUE(target_value);
+            EXPECT_EQ(std::string_view(target_value), std::string_view(source_value));
+        }
+        EXPECT_TRUE(source_stream.is_end());
+        EXPECT_TRUE(target_stream.is_end());
+        EXPECT_EQ(count, static_cast<std::size_t>(keys_count - 3));
+    }
+#endif
+}
+
 int main(int argc, char** argv) {
     make_ndjson_docs();
     for (const auto& entry : fs::directory_iterator(path_k))
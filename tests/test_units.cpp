@@ -7,14 +7,19 @@
  */
 
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include <unordered_set>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <unistd.h>
 #include <thread>
+#include <atomic>
+#include <chrono>
 #include <mutex>
 #include <shared_mutex>
+#include <optional>
 
 #include <gtest/gtest.h>
 #include <nlohmann/json.hpp>
@@ -24,6 +29,8 @@
 
 #include <ustore/arrow.h>
 #include "ustore/ustore.hpp"
+#include "slab_allocator.hpp"
+#include "neighborhoods.hpp"
 
 using namespace unum::ustore;
 using namespace unum;
@@ -85,6 +92,19 @@ static std::string config() {
     return fmt::format(R"({{"version": "1.0", "directory": "{}"}})", dir);
 }
 
+/**
+ * Empty directory next to the tested database, for instances opened alongside it.
+ */
+static std::string sibling_directory(char const* suffix) {
+    namespace stdfs = std::filesystem;
+    stdfs::path root(path());
+    if (!root.has_filename())
+        root = root.parent_path();
+    std::string directory = root.string() + suffix;
+    stdfs::remove_all(directory);
+    return directory;
+}
+
 #if defined(USTORE_FLIGHT_CLIENT)
 static pid_t srv_id = -1;
 static std::string srv_path;
@@ -114,6 +134,26 @@ void clear_environment() {
     }
 }
 
+/**
+ * Sends a free-form request through `ustore_database_control`,
+ * returning nothing, if the engine doesn't support it.
+ */
+std::optional<std::string> control(database_t& db, char const* request) {
+    arena_t arena(db);
+    status_t status;
+    ustore_str_view_t response = nullptr;
+    ustore_database_control_t command {};
+    command.db = db;
+    command.error = status.member_ptr();
+    command.arena = arena.member_ptr();
+    command.request = request;
+    command.response = &response;
+    ustore_database_control(&command);
+    if (!status || !response)
+        return std::nullopt;
+    return std::string(response);
+}
+
 inline std::ostream& operator<<(std::ostream& os, collection_key_t obj) {
     return os << obj.collection << obj.key;
 }
@@ -404,6 +444,51 @@ TEST(db, persistency) {
     }
 }
 
+/**
+ * Commits durable changes, drops a collection and checks that
+ * neither is lost or resurrected after reopening the DBMS.
+ */
+TEST(db, persistency_flush) {
+
+    if (!path() || !ustore_supports_named_collections_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    triplet_t triplet;
+    {
+        blobs_collection_t main_collection = db.main();
+        auto main_collection_ref = main_collection[triplet.keys];
+        round_trip(main_collection_ref, triplet);
+
+        blobs_collection_t named_collection = *db.create("dropped");
+        auto named_collection_ref = named_collection[triplet.keys];
+        round_trip(named_collection_ref, triplet);
+    }
+    db.close();
+    {
+        EXPECT_TRUE(db.open(config().c_str()));
+        EXPECT_TRUE(db.drop("dropped"));
+
+        transaction_t txn = *db.transact();
+        blobs_collection_t txn_collection = txn.main();
+        txn_collection[triplet.keys[0]] = "flushed";
+        EXPECT_TRUE(txn.commit(true));
+    }
+    db.close();
+    {
+        EXPECT_TRUE(db.open(config().c_str()));
+        EXPECT_FALSE(*db.contains("dropped"));
+
+        blobs_collection_t main_collection = db.main();
+        auto value = *main_collection[triplet.keys[0]].value();
+        EXPECT_EQ(std::string_view(value.c_str(), value.size()), std::string_view("flushed"));
+        EXPECT_EQ(main_collection.keys().size(), 3ul);
+    }
+}
+
 /**
  * Creates news collections under unique names.
  * Tests collection lookup by name, dropping/clearing existing collections.
@@ -568,6 +653,315 @@ TEST(db, presences) {
     }
 }
 
+/**
+ * Tests that values exported without copies outlive their overwrites,
+ * until the arena is reused. Engines without such support copy as usual.
+ */
+TEST(db, pinned_reads) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+
+    constexpr std::size_t keys_count = 100;
+    for (std::size_t i = 0; i != keys_count; ++i)
+        if (i % 10)
+            main[i] = std::to_string(i).c_str();
+
+    std::vector<ustore_key_t> keys(keys_count);
+    std::iota(keys.begin(), keys.end(), 0);
+    ustore_length_t* found_lengths = nullptr;
+    ustore_bytes_cptr_t* found_addresses = nullptr;
+    arena_t arena(db);
+    status_t status {};
+    ustore_read_t read {};
+    read.db = db;
+    read.error = status.member_ptr();
+    read.arena = arena.member_ptr();
+    read.options = ustore_option_read_pinned_k;
+    read.tasks_count = keys_count;
+    read.keys = keys.data();
+    read.keys_stride = sizeof(ustore_key_t);
+    read.lengths = &found_lengths;
+    read.addresses = &found_addresses;
+
+    ustore_read(&read);
+    EXPECT_TRUE(status);
+    if (!found_addresses)
+        return;
+
+    auto check = [&] {
+        for (std::size_t i = 0; i != keys_count; ++i) {
+            if (i % 10) {
+                std::string expected = std::to_string(i);
+                ASSERT_EQ(found_lengths[i], expected.size());
+                EXPECT_EQ(std::memcmp(found_addresses[i], expected.data(), expected.size()), 0);
+            }
+            else
+                EXPECT_EQ(found_lengths[i], ustore_length_missing_k);
+        }
+    };
+
+    for (std::size_t i = 0; i != keys_count; ++i)
+        main[i] = "overwritten";
+    check();
+
+    // Pins hold for the writes of other threads, and are released by any thread
+    std::thread([&] {
+        for (std::size_t i = 0; i != keys_count; ++i)
+            main[i] = "overwritten again";
+    }).join();
+    check();
+    std::thread([&] { arena = arena_t(db); }).join();
+    EXPECT_EQ(*main[0].value(), "overwritten again");
+}
+
+/**
+ * Values exported without copies stay valid, if the database is closed before
+ * their arena is released, and the database is fully closed after it.
+ */
+TEST(db, pinned_reads_outlive_database) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr std::size_t keys_count = 100;
+    {
+        auto main = db.main();
+        for (std::size_t i = 0; i != keys_count; ++i)
+            main[i] = std::to_string(i).c_str();
+    }
+
+    std::vector<ustore_key_t> keys(keys_count);
+    std::iota(keys.begin(), keys.end(), 0);
+    ustore_length_t* found_lengths = nullptr;
+    ustore_bytes_cptr_t* found_addresses = nullptr;
+    arena_t arena(db);
+    status_t status {};
+    ustore_read_t read {};
+    read.db = db;
+    read.error = status.member_ptr();
+    read.arena = arena.member_ptr();
+    read.options = ustore_option_read_pinned_k;
+    read.tasks_count = keys_count;
+    read.keys = keys.data();
+    read.keys_stride = sizeof(ustore_key_t);
+    read.lengths = &found_lengths;
+    read.addresses = &found_addresses;
+
+    ustore_read(&read);
+    EXPECT_TRUE(status);
+    if (!found_addresses)
+        return;
+
+    db.close();
+    for (std::size_t i = 0; i != keys_count; ++i) {
+        std::string expected = std::to_string(i);
+        ASSERT_EQ(found_lengths[i], expected.size());
+        EXPECT_EQ(std::memcmp(found_addresses[i], expected.data(), expected.size()), 0);
+    }
+
+    // Releasing the last pin closes the database, so it can be opened again
+    arena = arena_t(nullptr);
+    if (!path())
+        return;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+    EXPECT_EQ(*main[keys_count - 1].value(), std::to_string(keys_count - 1).c_str());
+}
+
+/**
+ * Batches are read in arbitrary order, with duplicates and missing keys,
+ * and the results must follow the order of requests.
+ */
+TEST(db, unordered_batch_reads) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+
+    constexpr std::size_t keys_count = 1000;
+    for (std::size_t i = 0; i != keys_count; i += 2)
+        main[i] = std::to_string(i).c_str();
+
+    // Walk the keys in a permuted order, repeating every tenth one
+    std::vector<ustore_key_t> keys;
+    for (std::size_t i = 0; i != keys_count; ++i) {
+        keys.push_back(static_cast<ustore_key_t>(i * 7919 % keys_count));
+        if (i % 10 == 0)
+            keys.push_back(keys.back());
+    }
+
+    auto check = [&](auto&& values) {
+        ASSERT_EQ(values.size(), keys.size());
+        auto it = values.begin();
+        for (std::size_t i = 0; i != keys.size(); ++i, ++it) {
+            value_view_t value = *it;
+            if (keys[i] % 2)
+                EXPECT_FALSE(value);
+            else
+                EXPECT_EQ(value, value_view_t(std::to_string(keys[i]).c_str()));
+        }
+    };
+    check(main[keys].value().throw_or_release());
+
+    if (!ustore_supports_transactions_k)
+        return;
+    auto txn = db.transact().throw_or_release();
+    check(txn[keys].value().throw_or_release());
+    EXPECT_TRUE(txn.commit());
+}
+
+/**
+ * Bulk loads arrive unsorted and with repeated keys, of which the last state wins.
+ * Engines without specialized support treat them as regular writes.
+ */
+TEST(db, bulk_writes) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+
+    constexpr std::size_t keys_count = 1000;
+    for (std::size_t i = 0; i < keys_count; i += 3)
+        main[i] = "stale";
+
+    // Every key is written twice, and every fifth one is then removed
+    std::vector<ustore_key_t> keys;
+    std::vector<std::string> values;
+    for (std::size_t round = 0; round != 2; ++round) {
+        for (std::size_t i = 0; i != keys_count; ++i) {
+            ustore_key_t key = static_cast<ustore_key_t>(i * 7919 % keys_count);
+            keys.push_back(key);
+            values.push_back(round && key % 5 == 0 ? std::string() : std::to_string(key + round));
+        }
+    }
+
+    std::vector<ustore_bytes_cptr_t> addresses(keys.size());
+    std::vector<ustore_length_t> lengths(keys.size());
+    std::vector<ustore_octet_t> presences((keys.size() + 7) / 8);
+    for (std::size_t i = 0; i != keys.size(); ++i) {
+        addresses[i] = reinterpret_cast<ustore_bytes_cptr_t>(values[i].data());
+        lengths[i] = static_cast<ustore_length_t>(values[i].size());
+        if (!values[i].empty())
+            presences[i / 8] |= 1 << (i % 8);
+    }
+
+    arena_t arena(db);
+    status_t status {};
+    ustore_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.options = ustore_option_write_bulk_k;
+    write.tasks_count = keys.size();
+    write.keys = keys.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.presences = presences.data();
+    write.lengths = lengths.data();
+    write.lengths_stride = sizeof(ustore_length_t);
+    write.values = addresses.data();
+    write.values_stride = sizeof(ustore_bytes_cptr_t);
+    ustore_write(&write);
+    EXPECT_TRUE(status);
+
+    for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(keys_count); ++key) {
+        auto value = main[key].value().throw_or_release();
+        if (key % 5 == 0)
+            EXPECT_FALSE(value);
+        else
+            EXPECT_EQ(value, value_view_t(std::to_string(key + 1).c_str()));
+    }
+}
+
+/**
+ * Checks that the size estimates bound the actual number of entries,
+ * as they are overwritten and removed.
+ */
+TEST(db, size_estimates) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+
+    constexpr std::size_t keys_count = 1000;
+    for (std::size_t i = 0; i != keys_count; ++i)
+        main[i] = "value";
+    for (std::size_t i = 0; i != keys_count; i += 2)
+        main[i] = "longer value";
+    for (std::size_t i = 0; i != keys_count; i += 10)
+        EXPECT_TRUE(main[i].erase());
+
+    std::size_t const present_count = keys_count - keys_count / 10;
+    auto estimates = main.members().size_estimates().throw_or_release();
+    EXPECT_LE(estimates.cardinality.min, present_count);
+    EXPECT_GE(estimates.cardinality.max, present_count);
+
+    estimates = main.members(100, 200).size_estimates().throw_or_release();
+    EXPECT_LE(estimates.cardinality.min, 90ul);
+    EXPECT_GE(estimates.cardinality.max, 90ul);
+
+    // Batches may come unsorted and repeat keys, which are still counted once
+    std::vector<ustore_key_t> batch;
+    for (std::size_t i = 0; i != keys_count; ++i)
+        batch.push_back(static_cast<ustore_key_t>(keys_count * 2 - 1 - i));
+    batch.push_back(static_cast<ustore_key_t>(keys_count));
+    EXPECT_TRUE(main[batch].assign("value"));
+    estimates = main.members().size_estimates().throw_or_release();
+    EXPECT_LE(estimates.cardinality.min, present_count + keys_count);
+    EXPECT_GE(estimates.cardinality.max, present_count + keys_count);
+
+    EXPECT_TRUE(main[batch].erase());
+    estimates = main.members().size_estimates().throw_or_release();
+    EXPECT_LE(estimates.cardinality.min, present_count);
+    EXPECT_GE(estimates.cardinality.max, present_count);
+}
+
+/**
+ * Samples from large collections may be gathered with random seeks, which
+ * land on the same keys in sparse regions. Every sample must still be distinct
+ * and present, with and without weighting the seeks by density.
+ */
+TEST(db, sample) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+
+    // Dense and sparse regions make neighboring seeks collide
+    constexpr std::size_t keys_count = 1000;
+    std::vector<ustore_key_t> keys;
+    for (std::size_t i = 0; i != keys_count; ++i)
+        keys.push_back(static_cast<ustore_key_t>(i < keys_count / 2 ? i : i * 1000));
+    EXPECT_TRUE(main[keys].assign("value"));
+
+    for (ustore_options_t options : {ustore_options_default_k, ustore_option_sample_weighted_k}) {
+        arena_t arena(db);
+        status_t status;
+        ustore_length_t count_limit = 10;
+        ustore_length_t* found_counts = nullptr;
+        ustore_key_t* found_keys = nullptr;
+        ustore_sample_t sample {};
+        sample.db = db;
+        sample.error = status.member_ptr();
+        sample.arena = arena.member_ptr();
+        sample.options = options;
+        sample.tasks_count = 1;
+        sample.count_limits = &count_limit;
+        sample.counts = &found_counts;
+        sample.keys = &found_keys;
+        ustore_sample(&sample);
+        EXPECT_TRUE(status);
+        ASSERT_EQ(found_counts[0], count_limit);
+
+        std::vector<ustore_key_t> sampled(found_keys, found_keys + found_counts[0]);
+        std::sort(sampled.begin(), sampled.end());
+        EXPECT_EQ(std::adjacent_find(sampled.begin(), sampled.end()), sampled.end());
+        for (ustore_key_t key : sampled)
+            EXPECT_TRUE(std::binary_search(keys.begin(), keys.end(), key));
+    }
+}
+
 TEST(db, scan) {
     clear_environment();
     database_t db;
@@ -628,6 +1022,57 @@ TEST(db, batch_scan) {
     EXPECT_TRUE(stream.is_end());
 }
 
+/**
+ * Scans stop at the exclusive end keys, even before reaching their limits,
+ * and can export values in the same pass.
+ */
+TEST(db, bounded_scans_with_values) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+
+    for (ustore_key_t key = 0; key != 100; key += 2)
+        main[key] = std::to_string(key).c_str();
+
+    std::array<ustore_key_t, 3> start_keys {10, 51, 90};
+    std::array<ustore_key_t, 3> end_keys {20, 51, 1000};
+    ustore_length_t limit = 100;
+    ustore_length_t* found_counts = nullptr;
+    ustore_key_t* found_keys = nullptr;
+    ustore_length_t* found_offsets = nullptr;
+    ustore_byte_t* found_values = nullptr;
+    arena_t arena(db);
+    status_t status {};
+    ustore_scan_t scan {};
+    scan.db = db;
+    scan.error = status.member_ptr();
+    scan.arena = arena.member_ptr();
+    scan.tasks_count = start_keys.size();
+    scan.start_keys = start_keys.data();
+    scan.start_keys_stride = sizeof(ustore_key_t);
+    scan.end_keys = end_keys.data();
+    scan.end_keys_stride = sizeof(ustore_key_t);
+    scan.count_limits = &limit;
+    scan.counts = &found_counts;
+    scan.keys = &found_keys;
+    scan.value_offsets = &found_offsets;
+    scan.values = &found_values;
+    ustore_scan(&scan);
+    EXPECT_TRUE(status);
+
+    std::vector<ustore_key_t> expected_keys {10, 12, 14, 16, 18, 90, 92, 94, 96, 98};
+    ASSERT_EQ(found_counts[0], 5u);
+    ASSERT_EQ(found_counts[1], 0u);
+    ASSERT_EQ(found_counts[2], 5u);
+    for (std::size_t i = 0; i != expected_keys.size(); ++i) {
+        EXPECT_EQ(found_keys[i], expected_keys[i]);
+        std::string expected_value = std::to_string(expected_keys[i]);
+        value_view_t value {found_values + found_offsets[i], found_offsets[i + 1] - found_offsets[i]};
+        EXPECT_EQ(value, value_view_t(expected_value.c_str()));
+    }
+}
+
 /**
  * Checks the "Read Commited" consistency guarantees of transactions.
  * Readers can't see the contents of pending (not committed) transactions.
@@ -885,6 +1330,50 @@ TEST(db, snapshot_with_threads) {
     EXPECT_TRUE(db.clear());
 }
 
+/**
+ * Drops a collection under an open snapshot, while another thread keeps inserting keys
+ * below the existing ones and overwriting them. The snapshot must still see exactly
+ * the entries, that existed when it was taken.
+ */
+TEST(db, snapshot_drop_with_writers) {
+    if (!ustore_supports_snapshots_k || !ustore_supports_named_collections_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    constexpr ustore_key_t keys_count = 10'000;
+    auto collection = *db.find_or_create("dropped");
+    ustore_collection_t const id = collection;
+    for (ustore_key_t key = keys_count; key < keys_count * 2; key += 2)
+        EXPECT_TRUE(collection[key].assign(std::to_string(key).c_str()));
+
+    auto snap = *db.snapshot();
+    std::atomic<bool> dropped = false;
+    std::thread writer([&] {
+        blobs_collection_t rival {db, id};
+        for (ustore_key_t key = keys_count - 1; !dropped.load(); key = key ? key - 1 : keys_count - 1) {
+            // Writes into the dropped collection may fail, which is fine
+            (void)rival[key].assign("rival");
+            (void)rival[key + keys_count + 1].assign("rival");
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(db.drop("dropped"));
+    dropped = true;
+    writer.join();
+
+    blobs_collection_t in_snapshot {db, id, nullptr, snap.snap()};
+    for (ustore_key_t key = 0; key != keys_count * 2; ++key) {
+        auto value = *in_snapshot[key].value();
+        if (key >= keys_count && key % 2 == 0)
+            EXPECT_EQ(value, std::to_string(key).c_str()) << key;
+        else
+            EXPECT_FALSE(value) << key;
+    }
+}
+
 TEST(db, transaction_erase_missing) {
     if (!ustore_supports_transactions_k)
         return;
@@ -946,6 +1435,11 @@ TEST(db, transaction_sequenced_commit) {
     auto current_sequence_number = *maybe_sequence_number;
     EXPECT_GT(current_sequence_number, 0);
     EXPECT_TRUE(txn.reset());
+
+    // Persisted commits are numbered like the log records, reported by the "flush" control
+    if (path())
+        if (auto durable = control(db, "flush"))
+            EXPECT_GE(std::stoull(*durable), current_sequence_number);
 #if 0
     auto previous_sequence_number = current_sequence_number;
     EXPECT_TRUE(txn_ref.value());
@@ -964,6 +1458,400 @@ TEST(db, transaction_sequenced_commit) {
 #endif
 }
 
+/**
+ * Persistent engines keep growing the sequence numbers across restarts.
+ */
+TEST(db, transaction_sequenced_commit_reopen) {
+    if (!ustore_supports_transactions_k || !path())
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    triplet_t triplet;
+    auto commit = [&] {
+        transaction_t txn = *db.transact();
+        EXPECT_TRUE(txn[triplet.keys].assign(triplet.contents()));
+        auto maybe_sequence_number = txn.sequenced_commit();
+        EXPECT_TRUE(maybe_sequence_number);
+        return *maybe_sequence_number;
+    };
+
+    auto previous_sequence_number = commit();
+    db.close();
+    EXPECT_TRUE(db.open(config().c_str()));
+    EXPECT_GT(commit(), previous_sequence_number);
+}
+
+/**
+ * UCSet spreads the entries across independently locked partitions, and other engines ignore
+ * the option. Batches, transactions, scans and samples must behave the same, when they cross
+ * the partition boundaries: changes become visible all at once and scans stay sorted.
+ */
+TEST(db, partitions) {
+    if (!path())
+        return;
+
+    clear_environment();
+    database_t db;
+    auto partitioned_config = fmt::format(R"({{"version": "1.0", "directory": "{}", )"
+                                          R"("engine": {{"config": {{"partitions": 8}}}}}})",
+                                          path());
+    EXPECT_TRUE(db.open(partitioned_config.c_str()));
+    auto main = db.main();
+
+    // Batches come in descending order, spanning all the partitions
+    constexpr std::size_t keys_count = 1000;
+    std::vector<ustore_key_t> keys(keys_count), odd_keys;
+    std::iota(keys.rbegin(), keys.rend(), 0);
+    for (ustore_key_t key = 1; key < static_cast<ustore_key_t>(keys_count); key += 2)
+        odd_keys.push_back(key);
+    EXPECT_TRUE(main[keys].assign("value"));
+    EXPECT_TRUE(main[odd_keys].erase());
+
+    keys_stream_t stream(db, main, 64);
+    EXPECT_TRUE(stream.seek_to_first());
+    ustore_key_t expected_key = 0;
+    for (; !stream.is_end(); ++stream, expected_key += 2)
+        EXPECT_EQ(stream.key(), expected_key);
+    EXPECT_EQ(expected_key, static_cast<ustore_key_t>(keys_count));
+
+    auto estimates = main.members().size_estimates().throw_or_release();
+    EXPECT_LE(estimates.cardinality.min, keys_count / 2);
+    EXPECT_GE(estimates.cardinality.max, keys_count / 2);
+
+    arena_t arena(db);
+    auto sampled = main.keys().sample(10, arena.member_ptr()).throw_or_release();
+    std::vector<ustore_key_t> sampled_keys(sampled.begin(), sampled.end());
+    std::sort(sampled_keys.begin(), sampled_keys.end());
+    EXPECT_EQ(sampled_keys.size(), 10ul);
+    EXPECT_EQ(std::adjacent_find(sampled_keys.begin(), sampled_keys.end()), sampled_keys.end());
+    for (ustore_key_t key : sampled_keys)
+        EXPECT_EQ(key % 2, 0);
+
+    if (!ustore_supports_transactions_k)
+        return;
+
+    // A conflict in any of the touched partitions aborts the whole transaction
+    std::vector<ustore_key_t> watched_keys(16);
+    std::iota(watched_keys.begin(), watched_keys.end(), 0);
+    std::vector<ustore_key_t> changed_keys {1, 3, 5, 7, 9, 11, 13, 15};
+    auto txn = db.transact().throw_or_release();
+    EXPECT_TRUE(txn[watched_keys].value());
+    EXPECT_TRUE(txn[changed_keys].assign("committed"));
+
+    auto rival = db.transact().throw_or_release();
+    EXPECT_TRUE(rival.main().at(14).assign("rival"));
+    auto rival_sequence_number = rival.sequenced_commit().throw_or_release();
+    EXPECT_FALSE(txn.commit());
+    for (ustore_key_t key : changed_keys)
+        EXPECT_FALSE(*main[key].value());
+
+    EXPECT_TRUE(txn.reset());
+    EXPECT_TRUE(txn[changed_keys].assign("committed"));
+    auto sequence_number = txn.sequenced_commit().throw_or_release();
+    EXPECT_GT(sequence_number, rival_sequence_number);
+    for (ustore_key_t key : changed_keys)
+        EXPECT_EQ(*main[key].value(), "committed");
+}
+
+/**
+ * RocksDB builds its tables with the configured filters and block cache, and other engines
+ * ignore the `BlockBasedTableOptions`. Every combination must return the same present and
+ * missing keys, after a reopen moves them from the memtable into the filtered tables.
+ */
+TEST(db, table_options) {
+    if (!path())
+        return;
+
+    constexpr std::size_t keys_count = 1000;
+    for (char const* filter_policy : {"bloom", "ribbon", "none"}) {
+        for (char const* block_cache : {"lru", "hyper_clock"}) {
+            clear_environment();
+            auto table_config = fmt::format(R"({{"version": "1.0", "directory": "{}", "engine": {{"config": )"
+                                            R"({{"BlockBasedTableOptions": {{"filter_policy": "{}", )"
+                                            R"("block_cache": "{}", "block_cache_size": "1MB"}}}}}}}})",
+                                            path(),
+                                            filter_policy,
+                                            block_cache);
+
+            database_t db;
+            EXPECT_TRUE(db.open(table_config.c_str())) << filter_policy << " " << block_cache;
+            {
+                auto main = db.main();
+                for (std::size_t i = 0; i != keys_count; ++i)
+                    main[i * 2] = std::to_string(i).c_str();
+            }
+            db.close();
+
+            EXPECT_TRUE(db.open(table_config.c_str()));
+            auto main = db.main();
+            for (std::size_t i = 0; i != keys_count; ++i) {
+                EXPECT_EQ(*main[i * 2].value(), std::to_string(i).c_str());
+                EXPECT_FALSE(*main[i * 2 + 1].value());
+            }
+        }
+    }
+
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+    clear_environment();
+    database_t db;
+    auto unknown_filter = fmt::format(R"({{"version": "1.0", "directory": "{}", "engine": {{"config": )"
+                                      R"({{"BlockBasedTableOptions": {{"filter_policy": "cuckoo"}}}}}}}})",
+                                      path());
+    EXPECT_FALSE(db.open(unknown_filter.c_str()));
+    auto unknown_cache = fmt::format(R"({{"version": "1.0", "directory": "{}", "engine": {{"config": )"
+                                     R"({{"BlockBasedTableOptions": {{"block_cache": "fifo"}}}}}}}})",
+                                     path());
+    EXPECT_FALSE(db.open(unknown_cache.c_str()));
+#endif
+}
+
+/**
+ * With blob files enabled, RocksDB moves the values above `min_blob_size` out of the tables,
+ * and other engines ignore the option. Values on both sides of the threshold must read back
+ * intact, and the disk usage estimates must cover the blob files.
+ */
+TEST(db, blob_files) {
+    if (!path())
+        return;
+
+    constexpr std::size_t keys_count = 256;
+    constexpr std::size_t min_blob_size = 64;
+    auto blobs_config = fmt::format(R"({{"version": "1.0", "directory": "{}", "engine": {{"config": )"
+                                    R"({{"CFOptions": {{"enable_blob_files": true, "min_blob_size": {}}}}}}}}})",
+                                    path(),
+                                    min_blob_size);
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(blobs_config.c_str()));
+
+    // Every other value is large enough to become a blob
+    auto make_value = [&](ustore_key_t key) {
+        std::size_t length = key % 2 ? min_blob_size * 16 : min_blob_size / 2;
+        return std::string(length, static_cast<char>('a' + key % 26));
+    };
+    [[maybe_unused]] std::size_t blob_bytes = 0;
+    {
+        auto main = db.main();
+        for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(keys_count); ++key) {
+            std::string value = make_value(key);
+            EXPECT_TRUE(main[key].assign(value_view_t(value)));
+            blob_bytes += value.size() > min_blob_size ? value.size() : 0;
+        }
+    }
+
+    // Reopening flushes the memtable, separating the blobs
+    db.close();
+    EXPECT_TRUE(db.open(blobs_config.c_str()));
+    auto main = db.main();
+    for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(keys_count); ++key)
+        EXPECT_EQ(std::string_view(*main[key].value()), make_value(key)) << key;
+
+#if defined(USTORE_ENGINE_IS_ROCKSDB)
+    std::size_t blob_files_count = 0;
+    for (auto const& entry : std::filesystem::directory_iterator(path()))
+        blob_files_count += entry.path().extension() == ".blob";
+    EXPECT_GT(blob_files_count, 0ul);
+
+    auto estimates = main.members().size_estimates().throw_or_release();
+    EXPECT_GE(estimates.bytes_on_disk.max, blob_bytes);
+#endif
+}
+
+/**
+ * UCSet moves the coldest values into a spill file, once they outgrow the `memory_limit`,
+ * and other engines ignore the option. Spilled values must read back intact after
+ * overwrites, removals and a reopen, while the memory usage settles under the limit.
+ */
+TEST(db, memory_limit) {
+    if (!path())
+        return;
+
+    constexpr std::size_t memory_limit = 1024 * 1024;
+    constexpr std::size_t keys_count = 8 * 1024;
+    constexpr std::size_t value_length = 1024;
+
+    clear_environment();
+    database_t db;
+    auto limited_config = fmt::format(R"({{"version": "1.0", "directory": "{}", )"
+                                      R"("engine": {{"config": {{"memory_limit": {}}}}}}})",
+                                      path(),
+                                      memory_limit);
+    EXPECT_TRUE(db.open(limited_config.c_str()));
+
+    // Values differ in every byte, so misplaced or truncated reads are noticed
+    std::vector<std::string> expected(keys_count);
+    auto make_value = [&](ustore_key_t key, std::size_t version) {
+        std::string value(value_length, '\0');
+        for (std::size_t i = 0; i != value_length; ++i)
+            value[i] = static_cast<char>((static_cast<std::size_t>(key) * 31 + i * 7 + version) % 251);
+        return value;
+    };
+
+    // Only UCSet reports the usage, and the evictor works in the background
+    auto settles_under_limit = [&] {
+        for (std::size_t attempt = 0; attempt != 100; ++attempt) {
+            auto response = control(db, "usage");
+            if (!response)
+                return true;
+            auto usage = json_t::parse(*response);
+            if (!usage.contains("memory_bytes") || usage["memory_bytes"].get<std::size_t>() <= memory_limit)
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return false;
+    };
+
+    auto check_contents = [&] {
+        auto main = db.main();
+        for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(keys_count); ++key) {
+            auto value = *main[key].value();
+            if (expected[key].empty())
+                EXPECT_FALSE(value) << key;
+            else
+                EXPECT_EQ(std::string_view(value), expected[key]) << key;
+        }
+    };
+
+    // Individual writes grow the usage well past the limit
+    auto main = db.main();
+    for (ustore_key_t key = 0; key != static_cast<ustore_key_t>(keys_count); ++key) {
+        expected[key] = make_value(key, 0);
+        EXPECT_TRUE(main[key].assign(value_view_t(expected[key])));
+    }
+    EXPECT_TRUE(settles_under_limit());
+    check_contents();
+
+    // Overwrites and removals replace and free the spilled values
+    for (ustore_key_t key = 0; key < static_cast<ustore_key_t>(keys_count); key += 3) {
+        expected[key] = make_value(key, 1);
+        EXPECT_TRUE(main[key].assign(value_view_t(expected[key])));
+    }
+    for (ustore_key_t key = 0; key < static_cast<ustore_key_t>(keys_count); key += 5) {
+        expected[key].clear();
+        EXPECT_TRUE(main[key].erase());
+    }
+    EXPECT_TRUE(settles_under_limit());
+    check_contents();
+
+    // Persisted values are loaded into the spill file, once they don't fit into RAM
+    db.close();
+    EXPECT_TRUE(db.open(limited_config.c_str()));
+    EXPECT_TRUE(settles_under_limit());
+    check_contents();
+}
+
+/**
+ * Every documented control either isn't supported by the engine,
+ * or responds with valid JSON: an object or a sequence number.
+ */
+TEST(db, controls) {
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+    for (ustore_key_t key = 0; key != 100; ++key)
+        main[key] = "value";
+
+    for (char const* request : {"usage", "statistics", "properties", "perf enable", "perf", "perf disable"}) {
+        auto response = control(db, request);
+        if (!response)
+            continue;
+        SCOPED_TRACE(request);
+        EXPECT_TRUE(json_t::parse(*response).is_object());
+    }
+
+    for (char const* request : {"flush", "durable"}) {
+        auto response = control(db, request);
+        if (!response)
+            continue;
+        SCOPED_TRACE(request);
+        EXPECT_TRUE(json_t::parse(*response).is_number_unsigned());
+    }
+
+    // Only secondary instances catch up
+    EXPECT_FALSE(control(db, "catch up"));
+}
+
+/**
+ * Snapshots with a directory materialize a checkpoint, that opens as
+ * a separate database with the state at the time of the snapshot.
+ */
+TEST(db, snapshot_checkpoint) {
+    if (!path())
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+    main[1] = "before";
+
+    std::string checkpoint = sibling_directory("_checkpoint");
+    auto snap = db.snapshot(checkpoint.c_str());
+    if (!snap)
+        return;
+    main[1] = "after";
+    main[2] = "after";
+
+    database_t restored;
+    EXPECT_TRUE(restored.open(fmt::format(R"({{"version": "1.0", "directory": "{}"}})", checkpoint).c_str()));
+    auto restored_main = restored.main();
+    EXPECT_EQ(*restored_main[1].value(), "before");
+    EXPECT_FALSE(*restored_main[2].value());
+    EXPECT_EQ(*main[1].value(), "after");
+}
+
+/**
+ * Secondary instances follow the writer of the same directory,
+ * seeing its latest changes after catching up.
+ */
+TEST(db, secondary_catch_up) {
+    if (!path())
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+    auto main = db.main();
+    main[1] = "first";
+
+    std::string secondary_path = sibling_directory("_secondary");
+    std::filesystem::create_directories(secondary_path);
+    auto secondary_config = fmt::format(R"({{"version": "1.0", "directory": "{}", "engine": {{"config": {{)"
+                                        R"("secondary_directory": "{}", "catch_up_interval_ms": 0}}}}}})",
+                                        path(),
+                                        secondary_path);
+
+    // Engines without secondary instances either refuse the second instance, or can't catch up
+    database_t secondary;
+    if (!secondary.open(secondary_config.c_str()))
+        return;
+    auto caught_up = control(secondary, "catch up");
+    if (!caught_up)
+        return;
+    EXPECT_TRUE(json_t::parse(*caught_up).contains("sequence_number"));
+    auto secondary_main = secondary.main();
+    EXPECT_EQ(*secondary_main[1].value(), "first");
+
+    main[2] = "second";
+    EXPECT_FALSE(*secondary_main[2].value());
+    EXPECT_TRUE(control(secondary, "catch up"));
+    EXPECT_EQ(*secondary_main[2].value(), "second");
+    EXPECT_FALSE(secondary_main[3].assign("third"));
+
+    // The last catch up succeeded, so there is no error to report
+    auto properties = control(secondary, "properties");
+    EXPECT_TRUE(properties);
+    if (properties) {
+        json_t response = json_t::parse(*properties);
+        EXPECT_TRUE(response.contains("catch_up_error") && response.at("catch_up_error").is_null());
+    }
+}
+
 #pragma region Paths Modality
 
 /**
@@ -1295,6 +2183,29 @@ TEST(db, docs_flat) {
     M_EXPECT_EQ_JSON(*collection[ckf(5, "age")].value(), "24");
 }
 
+/**
+ * Documents are stored as binary tapes, but plain JSONs written as BLOBs
+ * by older versions must still be readable and modifiable at field-level.
+ */
+TEST(db, docs_legacy_json) {
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    auto jsons = make_three_nested_docs();
+    blobs_collection_t blobs = db.main();
+    blobs[1] = jsons[0].c_str();
+
+    docs_collection_t collection = db.main<docs_collection_t>();
+    M_EXPECT_EQ_JSON(*collection[1].value(), jsons[0]);
+    M_EXPECT_EQ_JSON(*collection[ckf(1, "/person/name")].value(), "\"Alice\"");
+
+    EXPECT_TRUE(collection[ckf(1, "/person/age")].update("25"));
+    M_EXPECT_EQ_JSON(*collection[ckf(1, "/person/age")].value(), "25");
+    EXPECT_NE(std::string_view(*blobs[1].value()), std::string_view(jsons[0]));
+}
+
 /**
  * Tries adding 3 simple nested JSONs, using JSON-Pointers
  * to retrieve specific fields across multiple keys.
@@ -1633,6 +2544,36 @@ TEST(db, docs_table) {
         EXPECT_STREQ(col1[1].value.c_str(), "27");
         EXPECT_STREQ(col1[2].value.c_str(), "24");
     }
+
+    // Large batches, split across threads, with some documents missing
+    {
+        std::vector<ustore_key_t> keys(5003);
+        std::iota(keys.begin(), keys.end(), 1000);
+        for (ustore_key_t key : keys) {
+            if (!(key % 10))
+                continue;
+            auto json = "{\"age\":" + std::to_string(key) + ",\"person\":\"" + std::to_string(key) + "\"}";
+            collection[key] = json.c_str();
+        }
+
+        auto header = table_header() //
+                          .with<std::int64_t>("age")
+                          .with<std::string_view>("person");
+
+        auto maybe_table = collection[keys].gather(header);
+        auto table = *maybe_table;
+        auto col0 = table.column<0>();
+        auto col1 = table.column<1>();
+
+        for (std::size_t i = 0; i != keys.size(); ++i) {
+            EXPECT_EQ(col0[i].valid, keys[i] % 10 != 0);
+            EXPECT_EQ(col1[i].valid, keys[i] % 10 != 0);
+            if (!col0[i].valid)
+                continue;
+            EXPECT_EQ(col0[i].value, keys[i]);
+            EXPECT_EQ(std::string(col1[i].value), std::to_string(keys[i]));
+        }
+    }
 }
 
 #pragma region Graph Modality
@@ -2173,6 +3114,84 @@ TEST(db, graph_neighbors) {
     EXPECT_EQ(neighbors[1], 3);
 }
 
+/**
+ * Serializes a neighborhood the way the graph modality stores it.
+ */
+std::string neighborhood(std::vector<neighborship_t> const& outgoing, std::vector<neighborship_t> const& incoming) {
+    ustore_vertex_degree_t degrees[2] {static_cast<ustore_vertex_degree_t>(outgoing.size()),
+                                       static_cast<ustore_vertex_degree_t>(incoming.size())};
+    std::string bytes(reinterpret_cast<char const*>(degrees), sizeof(degrees));
+    bytes.append(reinterpret_cast<char const*>(outgoing.data()), outgoing.size() * sizeof(neighborship_t));
+    bytes.append(reinterpret_cast<char const*>(incoming.data()), incoming.size() * sizeof(neighborship_t));
+    return bytes;
+}
+
+/**
+ * Adds edges through the engine-side neighborhood merges, where supported,
+ * including repeated edges and bulk writes, that fold several merges of a key.
+ */
+TEST(db, graph_merges) {
+    if (!&ustore_supports_neighborhood_merges_k || !ustore_supports_neighborhood_merges_k)
+        return;
+
+    clear_environment();
+    database_t db;
+    EXPECT_TRUE(db.open(config().c_str()));
+
+    graph_collection_t graph = db.main<graph_collection_t>();
+    EXPECT_TRUE(graph.upsert_edge(edge_t {1, 2, 9}));
+    EXPECT_TRUE(graph.upsert_edge(edge_t {1, 3, 8}));
+    EXPECT_TRUE(graph.upsert_edge(edge_t {1, 2, 9}));
+    EXPECT_TRUE(graph.upsert_edge(edge_t {3, 1, 7}));
+    EXPECT_EQ(*graph.degree(1), 3u);
+    EXPECT_EQ(*graph.degree(2), 1u);
+    EXPECT_EQ(*graph.degree(3), 2u);
+
+    // Vertex 1 gets two merges in one batch, while vertex 5 is removed and recreated
+    EXPECT_TRUE(graph.upsert_edge(edge_t {5, 2, 3}));
+    std::vector<ustore_key_t> keys {1, 4, 1, 5, 5};
+    std::vector<std::string> values {
+        neighborhood({{4, 6}}, {}),
+        neighborhood({}, {{1, 6}}),
+        neighborhood({{2, 9}}, {{4, 5}}),
+        std::string(),
+        neighborhood({{4, 4}}, {}),
+    };
+    std::vector<ustore_bytes_cptr_t> addresses(keys.size());
+    std::vector<ustore_length_t> lengths(keys.size());
+    ustore_octet_t presences = 0b10111;
+    for (std::size_t i = 0; i != keys.size(); ++i) {
+        addresses[i] = reinterpret_cast<ustore_bytes_cptr_t>(values[i].data());
+        lengths[i] = static_cast<ustore_length_t>(values[i].size());
+    }
+
+    arena_t arena(db);
+    status_t status {};
+    ustore_write_t write {};
+    write.db = db;
+    write.error = status.member_ptr();
+    write.arena = arena.member_ptr();
+    write.options = ustore_options_t(ustore_option_write_bulk_k | ustore_option_write_merge_neighborhoods_k);
+    write.tasks_count = keys.size();
+    write.keys = keys.data();
+    write.keys_stride = sizeof(ustore_key_t);
+    write.presences = &presences;
+    write.lengths = lengths.data();
+    write.lengths_stride = sizeof(ustore_length_t);
+    write.values = addresses.data();
+    write.values_stride = sizeof(ustore_bytes_cptr_t);
+    ustore_write(&write);
+    EXPECT_TRUE(status);
+
+    EXPECT_EQ(*graph.degree(1), 5u);
+    EXPECT_EQ(*graph.degree(1, ustore_vertex_source_k), 3u);
+    EXPECT_EQ(*graph.degree(4), 1u);
+    EXPECT_EQ(*graph.degree(5), 1u);
+    auto neighbors = graph.neighbors(5).throw_or_release();
+    EXPECT_EQ(neighbors.size(), 1);
+    EXPECT_EQ(neighbors[0], 4);
+}
+
 #pragma region Vectors Modality
 
 /**
@@ -2234,6 +3253,119 @@ TEST(db, vectors) {
     EXPECT_EQ(found_keys[1], ustore_key_t('b'));
 }
 
+#pragma region Helpers
+
+/**
+ * Merges serialized neighborhoods directly, the way engines fold them,
+ * with missing values, repeated edges and both halves of the neighborhoods.
+ */
+TEST(neighborhoods, merge) {
+    std::string const a = neighborhood({{2, 9}, {3, 7}}, {{5, 1}});
+    std::string merged;
+    merge_neighborhoods(value_view_t {}, std::string_view(a), merged);
+    EXPECT_EQ(merged, a);
+    merged.clear();
+    merge_neighborhoods(std::string_view(a), value_view_t {}, merged);
+    EXPECT_EQ(merged, a);
+    merged.clear();
+    merge_neighborhoods(value_view_t {}, value_view_t {}, merged);
+    EXPECT_EQ(merged, neighborhood({}, {}));
+
+    // Repeated neighborships are kept once, but the same neighbor over another edge is a new one
+    std::string const b = neighborhood({{3, 7}, {3, 8}}, {{2, 9}, {5, 1}});
+    merged.clear();
+    merge_neighborhoods(std::string_view(a), std::string_view(b), merged);
+    EXPECT_EQ(merged, neighborhood({{2, 9}, {3, 7}, {3, 8}}, {{2, 9}, {5, 1}}));
+    merged.clear();
+    merge_neighborhoods(std::string_view(a), std::string_view(a), merged);
+    EXPECT_EQ(merged, a);
+
+    // The union is appended to the existing contents, which don't affect it
+    std::string prefixed = "prefix";
+    merge_neighborhoods(std::string_view(b), std::string_view(a), prefixed);
+    EXPECT_EQ(prefixed, "prefix" + neighborhood({{2, 9}, {3, 7}, {3, 8}}, {{2, 9}, {5, 1}}));
+}
+
+#pragma region Allocators
+
+/**
+ * Blobs of the slab allocator are freed by threads, that didn't allocate them,
+ * after the allocating threads have already exited and released their caches.
+ */
+TEST(slab_allocator, cross_thread) {
+    constexpr std::size_t threads_count_k = 4;
+    constexpr std::size_t blobs_per_thread_k = 10'000;
+    constexpr std::size_t max_size_k = slab_allocator_t::max_class_size_k + 1024;
+    using blobs_t = std::vector<std::pair<byte_t*, std::size_t>>;
+
+    for (std::size_t size = 1; size <= max_size_k; ++size)
+        EXPECT_GE(slab_allocator_t::capacity(size), size);
+
+    std::vector<blobs_t> allocated(threads_count_k);
+    std::vector<std::thread> threads;
+    for (std::size_t thread_idx = 0; thread_idx != threads_count_k; ++thread_idx)
+        threads.emplace_back([&, thread_idx] {
+            for (std::size_t i = 0; i != blobs_per_thread_k; ++i) {
+                std::size_t size = 1 + (i * 7919 + thread_idx) % max_size_k;
+                byte_t* blob = slab_allocator_t {}.allocate(size);
+                ASSERT_NE(blob, nullptr);
+                std::memset(blob, static_cast<int>(thread_idx), size);
+                allocated[thread_idx].emplace_back(blob, size);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_GT(slab_allocator_t::reserved_bytes(), 0u);
+
+    threads.clear();
+    for (std::size_t thread_idx = 0; thread_idx != threads_count_k; ++thread_idx)
+        threads.emplace_back([&, thread_idx] {
+            std::size_t owner_idx = (thread_idx + 1) % threads_count_k;
+            for (auto [blob, size] : allocated[owner_idx]) {
+                auto is_intact = [=](byte_t b) { return b == static_cast<byte_t>(owner_idx); };
+                EXPECT_TRUE(std::all_of(blob, blob + size, is_intact));
+                slab_allocator_t {}.deallocate(blob, size);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    // The freed blocks must be reused, instead of carving new slabs
+    std::size_t reserved = slab_allocator_t::reserved_bytes();
+    for (auto& blobs : allocated) {
+        for (auto& [blob, size] : blobs)
+            blob = slab_allocator_t {}.allocate(size);
+        for (auto [blob, size] : blobs)
+            slab_allocator_t {}.deallocate(blob, size);
+    }
+    std::size_t carved_limit = threads_count_k * slab_allocator_t::classes_count_k * slab_allocator_t::slab_size_k;
+    EXPECT_LE(slab_allocator_t::reserved_bytes(), reserved + carved_limit);
+}
+
+/**
+ * Thread-local objects, constructed before the allocator cache of their thread,
+ * are destroyed after it, and may still free their blobs.
+ */
+TEST(slab_allocator, thread_exit) {
+    struct holder_t {
+        std::vector<std::pair<byte_t*, std::size_t>> blobs;
+        ~holder_t() {
+            for (auto [blob, size] : blobs)
+                slab_allocator_t {}.deallocate(blob, size);
+        }
+    };
+
+    std::thread([] {
+        thread_local holder_t holder;
+        for (std::size_t size = 1; size <= slab_allocator_t::max_class_size_k; size += 7)
+            holder.blobs.emplace_back(slab_allocator_t {}.allocate(size), size);
+    }).join();
+
+    byte_t* blob = slab_allocator_t {}.allocate(64);
+    EXPECT_NE(blob, nullptr);
+    slab_allocator_t {}.deallocate(blob, 64);
+}
+
 int main(int argc, char** argv) {
 
 #if defined(USTORE_FLIGHT_CLIENT)